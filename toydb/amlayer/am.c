@@ -1,6 +1,7 @@
 # include <stdio.h>
 # include "am.h"
 # include "pf.h"
+# include "../pflayer/pftrace.h"
 
 
 /* splits a leaf node */
@@ -22,6 +23,7 @@ char *key; /* returns the key to be filled in the parent */
 	AM_LEAFHEADER *header,*tempheader;
 	char tempPage[PF_PAGE_SIZE]; /* temporary page for manipulation on the 
 								         page */
+	char tempPage2[PF_PAGE_SIZE]; /* the other half, until it has a page */
 	char *tempPageBuf,*tempPageBuf1;/* buffers for new pages to be
 								    allocated */
 	int errVal; 
@@ -34,16 +36,13 @@ char *key; /* returns the key to be filled in the parent */
 	/* copy header from buffer */
 	bcopy(pageBuf,header,AM_sl);
 
-	/* compact half the keys into temporary page */
+	/* compact half the keys into temporary page, the other half into
+	another, and insert the key into its half: a key whose recId list
+	fills a leaf by itself cannot take another recId, and the insert is
+	refused before anything is allocated or changed */
 	AM_Compact(1,(header->numKeys)/2,pageBuf,tempPage,header);
-
-	/* Allocate a new page for the other half of the leaf*/
-	errVal = PF_AllocPage(fileDesc,&tempPageNum,&tempPageBuf);
-	AM_Check;
-
-	/* compact the other half keys */
 	AM_Compact((header->numKeys)/2 + 1,header->numKeys
-			      ,pageBuf,tempPageBuf,header);
+			      ,pageBuf,tempPage2,header);
 
 	/*check where key has to be inserted */
 	if (index <= ((header->numKeys)/2))
@@ -56,9 +55,22 @@ char *key; /* returns the key to be filled in the parent */
 	{
 		/* value to be inserted in second half */
 		index = index - ((header->numKeys)/2);
-		errVal = AM_InsertintoLeaf(tempPageBuf,attrLength,value,
+		errVal = AM_InsertintoLeaf(tempPage2,attrLength,value,
 					   recId,index,status);
 	}
+	if (errVal != TRUE)
+	{
+		/* recId list too long for a leaf */
+		PF_UnfixPage(fileDesc,*pageNum,FALSE);
+		AM_Errno = AME_INVALIDVALUE;
+		return(AME_INVALIDVALUE);
+	}
+
+	/* Allocate a new page for the other half of the leaf*/
+	errVal = PF_AllocPage(fileDesc,&tempPageNum,&tempPageBuf);
+	AM_Check;
+	PF_TRACE(am_leaf_split,fileDesc,tempPageNum);
+	bcopy(tempPage2,tempPageBuf,PF_PAGE_SIZE);
 
 	/* change the next leafpage of first half of leaf to second half */
 	bcopy(tempPage,tempheader,AM_sl);
@@ -163,6 +175,7 @@ int attrLength;
 		AM_Check;
 
 		/* split the internal node */
+		PF_TRACE(am_int_split,fileDesc,pageNumber);
 		AM_SplitIntNode(pageBuf,tempPage,pageBuf1,header,
 					 value,pageNum,offset);
 
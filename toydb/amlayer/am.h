@@ -19,9 +19,41 @@ typedef struct am_intheader
 		short attrLength;
 	}	AM_INTHEADER ; /* Header for an internal node */
 
+# define AM_MAXLEVELS 20 /* levels counted by AM_Analyze */
+# define AM_FILLBUCKETS 10 /* fill in tenths: 0-10%, ..., 90-100% */
+# define AM_CHAINBUCKETS 8 /* recIds of a key: 1, 2, 3-4, 5-8, ..., over 64 */
+
+typedef struct am_analysis
+	{
+		int numPages; /* pages in use in the file */
+		int height; /* levels, the leaves included; 0 if unknown */
+		int pagesPerLevel[AM_MAXLEVELS]; /* the root's level first */
+		int unreached; /* pages no path from the root leads to */
+		int numLeaves;
+		int numInternal;
+		int emptyLeaves; /* leaves without keys */
+		long numKeys; /* distinct keys, on the leaves */
+		long numRecIds;
+		double leafFill; /* mean bytes of a leaf in use / PF_PAGE_SIZE */
+		double intFill; /* mean numKeys / maxKeys of internal nodes */
+		int leafFillHist[AM_FILLBUCKETS];
+		int intFillHist[AM_FILLBUCKETS];
+		long chainHist[AM_CHAINBUCKETS]; /* keys by length of recId list */
+		int maxChain; /* longest recId list */
+		long freeListEntries; /* deleted recIds on the leaves' free lists */
+		long freeListBytes;
+		/* the leaves in key order, by nextLeafPage from the leftmost */
+		int leafSteps; /* links followed */
+		int seqSteps; /* links to the next leaf in the file */
+		int backSteps; /* links to an earlier leaf in the file */
+		int unlinkedLeaves; /* leaves not on the list */
+		double orderCorr; /* rank correlation of key order and file order */
+	}	AM_ANALYSIS; /* Shape of an index (AM_Analyze) */
+
 extern int AM_RootPageNum; /* The page number of the root */
 extern int AM_LeftPageNum; /* The page Number of the leftmost leaf */
 extern int AM_Errno; /* last error in AM layer */
+extern int AM_ShadowSync; /* TRUE if inserts into shadow indexes are fsync()ed */
 /* Use standard headers for allocation prototypes */
 #include <stdlib.h>
 #include <string.h>
@@ -0,0 +1,315 @@
+# include <stdio.h>
+# include "am.h"
+# include "pf.h"
+
+/* what the sweep keeps of each page */
+struct am_pageinfo
+	{
+		char pageType; /* 'l', 'i', or 0 for a free or unknown page */
+		int nextLeafPage; /* of a leaf */
+		int firstChild; /* of an internal node: its children are */
+		int numChildren; /* children[firstChild..+numChildren-1] */
+		int rank; /* of a leaf: leaves before it in the file */
+	};
+
+
+/* Bucket of a fraction in 0..1 */
+static AM_FillBucket(fill)
+double fill;
+
+{
+	int b;
+
+	b = (int)(fill * AM_FILLBUCKETS);
+	if (b < 0) return(0);
+	if (b >= AM_FILLBUCKETS) return(AM_FILLBUCKETS - 1);
+	return(b);
+}
+
+
+/* Adds the leaf in pageBuf to stats */
+static void AM_AnalyzeLeaf(pageBuf,stats)
+char *pageBuf;
+AM_ANALYSIS *stats;
+
+{
+	AM_LEAFHEADER head,*header;
+	int recSize,recIds,len,maxLen,b,i;
+	short nextRec;
+	double fill;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	recSize = header->attrLength + AM_ss;
+	maxLen = PF_PAGE_SIZE / (AM_si + AM_ss);
+	recIds = 0;
+	for (i = 1; i <= header->numKeys; i++)
+	{
+		/* the key's recId list, which a bad page could make endless */
+		bcopy(pageBuf + AM_sl + (i-1)*recSize + header->attrLength,
+		      (char *)&nextRec,AM_ss);
+		for (len = 0; nextRec > 0 && nextRec <= PF_PAGE_SIZE - AM_si - AM_ss
+		     && len < maxLen; len++)
+			bcopy(pageBuf + nextRec + AM_si,(char *)&nextRec,AM_ss);
+		recIds += len;
+		if (len == 0)
+			continue;
+		for (b = 0; b < AM_CHAINBUCKETS - 1 && len > (1 << b); b++)
+			;
+		stats->chainHist[b]++;
+		if (len > stats->maxChain)
+			stats->maxChain = len;
+	}
+
+	fill = (double)(AM_sl + header->numKeys*recSize + recIds*(AM_si + AM_ss))
+		/ PF_PAGE_SIZE;
+	stats->leafFill += fill;
+	stats->leafFillHist[AM_FillBucket(fill)]++;
+	stats->numLeaves++;
+	if (header->numKeys == 0)
+		stats->emptyLeaves++;
+	stats->numKeys += header->numKeys;
+	stats->numRecIds += recIds;
+	stats->freeListEntries += header->numinfreeList;
+	stats->freeListBytes += header->numinfreeList * (AM_si + AM_ss);
+}
+
+
+/* Reports the shape of the index fileDesc in stats: its height and pages on
+each level, how full its leaves and internal nodes are, the lengths of the
+keys' recId lists, the deleted recIds left on the leaves' free lists, and
+how closely the order of the leaves in the file follows the order of their
+keys. The file is read once, page after page; the levels and the order of
+the leaves are then found from what was kept of each page, without reading
+it again. Returns AME_OK or an AM error. */
+AM_Analyze(fileDesc,stats)
+int fileDesc; /* file Descriptor */
+AM_ANALYSIS *stats;
+
+{
+	struct am_pageinfo *info;
+	int *children; /* child pointers of all internal nodes */
+	int nChildren,maxChildren;
+	int *level,*nextLevel; /* pages of a level, and of the one below */
+	int nLevel,nNext,internal;
+	char *seen; /* page reached from the root, or put on the leaf list */
+	int numPages,pageNum,root,leaf,p,q,i,k,errVal;
+	char *pageBuf,*grown;
+	AM_LEAFHEADER lhead,*lheader;
+	AM_INTHEADER ihead,*iheader;
+	double sumd2;
+
+	if (fileDesc < 0)
+	{
+		AM_Errno = AME_FD;
+		return(AME_FD);
+	}
+	bzero((char *)stats,sizeof(AM_ANALYSIS));
+	lheader = &lhead;
+	iheader = &ihead;
+	if ((numPages = PF_GetNumPages(fileDesc)) < 0)
+	{
+		AM_Errno = AME_PF;
+		return(AME_PF);
+	}
+	info = (struct am_pageinfo *)calloc(numPages + 1,sizeof(struct am_pageinfo));
+	level = (int *)malloc((numPages + 1)*sizeof(int));
+	nextLevel = (int *)malloc((numPages + 1)*sizeof(int));
+	seen = calloc(numPages + 1,1);
+	maxChildren = 1024;
+	nChildren = 0;
+	children = (int *)malloc(maxChildren*sizeof(int));
+	if (info == NULL || level == NULL || nextLevel == NULL || seen == NULL ||
+	    children == NULL)
+	{
+		errVal = AME_INTERROR;
+		goto done;
+	}
+
+	/* the sweep: every page in the order of the file */
+	root = AM_NULL_PAGE;
+	pageNum = -1;
+	while ((errVal = PF_GetNextPage(fileDesc,&pageNum,&pageBuf)) == PFE_OK)
+	{
+		if (root == AM_NULL_PAGE)
+			root = pageNum;
+		stats->numPages++;
+		info[pageNum].pageType = *pageBuf;
+		if (*pageBuf == 'l')
+		{
+			bcopy(pageBuf,lheader,AM_sl);
+			info[pageNum].nextLeafPage = lheader->nextLeafPage;
+			info[pageNum].rank = stats->numLeaves;
+			AM_AnalyzeLeaf(pageBuf,stats);
+		}
+		else if (*pageBuf == 'i')
+		{
+			bcopy(pageBuf,iheader,AM_sint);
+			stats->numInternal++;
+			if (iheader->maxKeys > 0)
+			{
+				stats->intFill += (double)iheader->numKeys / iheader->maxKeys;
+				stats->intFillHist[AM_FillBucket((double)iheader->numKeys
+						   / iheader->maxKeys)]++;
+			}
+			/* the children, unless the node is too bad to have them */
+			k = iheader->numKeys + 1;
+			if (k < 1 || iheader->attrLength < 1 || AM_sint + (k - 1)*
+			    (AM_si + iheader->attrLength) > PF_PAGE_SIZE - AM_si)
+				k = 0;
+			if (nChildren + k > maxChildren)
+			{
+				while (nChildren + k > maxChildren)
+					maxChildren *= 2;
+				grown = realloc((char *)children,maxChildren*sizeof(int));
+				if (grown == NULL)
+				{
+					PF_UnfixPage(fileDesc,pageNum,FALSE);
+					errVal = AME_INTERROR;
+					goto done;
+				}
+				children = (int *)grown;
+			}
+			info[pageNum].firstChild = nChildren;
+			info[pageNum].numChildren = k;
+			for (i = 0; i < k; i++)
+				bcopy(pageBuf + AM_sint + i*(AM_si + iheader->attrLength),
+				      (char *)&children[nChildren++],AM_si);
+		}
+		else
+			info[pageNum].pageType = 0;
+		errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+		if (errVal != PFE_OK)
+			break;
+	}
+	if (errVal != PFE_EOF)
+	{
+		errVal = AME_PF;
+		goto done;
+	}
+	errVal = AME_OK;
+	if (stats->numLeaves > 0)
+		stats->leafFill /= stats->numLeaves;
+	if (stats->numInternal > 0)
+		stats->intFill /= stats->numInternal;
+	if (root == AM_NULL_PAGE)
+		goto done;
+
+	/* the levels, from the root down to the first level without
+	internal nodes */
+	level[0] = root;
+	nLevel = 1;
+	seen[root] = TRUE;
+	while (nLevel > 0 && stats->height < AM_MAXLEVELS)
+	{
+		stats->pagesPerLevel[stats->height++] = nLevel;
+		nNext = 0;
+		internal = FALSE;
+		for (i = 0; i < nLevel; i++)
+		{
+			p = level[i];
+			if (info[p].pageType != 'i')
+				continue;
+			internal = TRUE;
+			for (k = 0; k < info[p].numChildren; k++)
+			{
+				q = children[info[p].firstChild + k];
+				if (q < 0 || q >= numPages || seen[q])
+					continue;
+				seen[q] = TRUE;
+				nextLevel[nNext++] = q;
+			}
+		}
+		if (!internal)
+			break;
+		bcopy((char *)nextLevel,(char *)level,nNext*sizeof(int));
+		nLevel = nNext;
+	}
+	stats->unreached = stats->numPages;
+	for (p = 0; p < numPages; p++)
+		if (seen[p] && info[p].pageType != 0)
+			stats->unreached--;
+
+	/* the leftmost leaf: first children down from the root */
+	for (leaf = root, k = 0; info[leaf].pageType == 'i' && k < AM_MAXLEVELS; k++)
+	{
+		if (info[leaf].numChildren == 0)
+			break;
+		q = children[info[leaf].firstChild];
+		if (q < 0 || q >= numPages)
+			break;
+		leaf = q;
+	}
+
+	/* the leaf list in key order: position of each leaf on it (in level),
+	and then the leaves' rank in the file among those on the list */
+	bzero(seen,numPages);
+	for (p = leaf, k = 0; p >= 0 && p < numPages && info[p].pageType == 'l'
+	     && !seen[p]; p = info[p].nextLeafPage, k++)
+	{
+		seen[p] = TRUE;
+		level[p] = k;
+		q = info[p].nextLeafPage;
+		if (q < 0 || q >= numPages || info[q].pageType != 'l')
+			continue;
+		stats->leafSteps++;
+		if (info[q].rank == info[p].rank + 1)
+			stats->seqSteps++;
+		else if (info[q].rank < info[p].rank)
+			stats->backSteps++;
+	}
+	stats->unlinkedLeaves = stats->numLeaves - k;
+	sumd2 = 0;
+	for (p = 0, i = 0; p < numPages; p++)
+		if (seen[p])
+		{
+			sumd2 += (double)(i - level[p]) * (i - level[p]);
+			i++;
+		}
+	stats->orderCorr = (k < 2) ? 1.0 : 1.0 - 6.0*sumd2 / ((double)k*((double)k*k - 1));
+
+done:
+	free((char *)info);
+	free((char *)level);
+	free((char *)nextLevel);
+	free(seen);
+	free((char *)children);
+	if (errVal != AME_OK)
+		AM_Errno = errVal;
+	return(errVal);
+}
+
+
+/* Prints what AM_Analyze found */
+AM_PrintAnalysis(stats)
+AM_ANALYSIS *stats;
+
+{
+	int i;
+
+	printf("pages %d: %d internal, %d leaves (%d empty), %d unreached\n",
+	       stats->numPages,stats->numInternal,stats->numLeaves,
+	       stats->emptyLeaves,stats->unreached);
+	printf("height %d, pages per level:",stats->height);
+	for (i = 0; i < stats->height; i++)
+		printf(" %d",stats->pagesPerLevel[i]);
+	printf("\nkeys %ld, recIds %ld, longest recId list %d\n",
+	       stats->numKeys,stats->numRecIds,stats->maxChain);
+	printf("recId lists of 1, 2, 3-4, 5-8, 9-16, 17-32, 33-64, more:");
+	for (i = 0; i < AM_CHAINBUCKETS; i++)
+		printf(" %ld",stats->chainHist[i]);
+	printf("\nleaf fill %.1f%%, internal fill %.1f%%\n",
+	       100*stats->leafFill,100*stats->intFill);
+	printf("leaves by fill 0-10%%, ..., 90-100%%:");
+	for (i = 0; i < AM_FILLBUCKETS; i++)
+		printf(" %d",stats->leafFillHist[i]);
+	printf("\ninternal nodes by fill:");
+	for (i = 0; i < AM_FILLBUCKETS; i++)
+		printf(" %d",stats->intFillHist[i]);
+	printf("\nfree lists: %ld deleted recIds, %ld bytes\n",
+	       stats->freeListEntries,stats->freeListBytes);
+	printf("leaf list: %d links, %d to the next leaf in the file, %d backwards,"
+	       " %d leaves not on it, order correlation %.3f\n",
+	       stats->leafSteps,stats->seqSteps,stats->backSteps,
+	       stats->unlinkedLeaves,stats->orderCorr);
+}
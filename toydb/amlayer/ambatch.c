@@ -0,0 +1,190 @@
+# include <stdio.h>
+# include "am.h"
+# include "pf.h"
+
+# define AM_MAXDEPTH 20 /* max height of a B+ tree handled by a batch probe */
+
+/* one node on the path from the root to the current leaf */
+struct am_pathnode
+	{
+		int pageNum; /* page number of the node */
+		int hasFence; /* 0 if the node's key range is unbounded above */
+		char fence[AM_MAXATTRLENGTH]; /* keys in the node are < fence */
+	};
+
+/* Looks up nKeys keys, stored one after another attrLength bytes apart in
+ascending order, in a single pass over the index. The root-to-leaf path of
+the previous key is kept together with the upper bound of every node on it,
+so a key only climbs to the lowest node whose range still contains it and
+descends from there; keys on the same leaf cost no descent at all.
+The recIds of key i are appended to recIds and their number is put in
+counts[i] (0 if the key is absent). Stops before the first key whose recIds
+do not fit in maxRecIds and returns the number of keys done, or an AM error.
+A key smaller than its predecessor restarts from the root. */
+AM_BatchSearch(fileDesc,attrType,attrLength,keys,nKeys,recIds,maxRecIds,counts)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'c' , 'i' or 'f' */
+int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
+char *keys; /* nKeys values in ascending order */
+int nKeys;
+int *recIds; /* recIds found, key after key */
+int maxRecIds; /* room in recIds */
+int *counts; /* # of recIds of each key */
+
+{
+	struct am_pathnode path[AM_MAXDEPTH]; /* path[depth-1] is the leaf */
+	int depth; /* # of nodes on the path */
+	int level; /* node the current key descends from */
+	int nRecIds; /* # of recIds written so far */
+	int leafFixed; /* leaf page is fixed in the buffer */
+	char *pageBuf;
+	char *value; /* current key */
+	int pageNum,index,status,recSize,errVal,i,n;
+	short recIdPtr;
+	AM_LEAFHEADER lhead,*lheader;
+	AM_INTHEADER ihead,*iheader;
+
+	if (fileDesc < 0)
+	{
+		AM_Errno = AME_FD;
+		return(AME_FD);
+	}
+	lheader = &lhead;
+	iheader = &ihead;
+	depth = 0;
+	nRecIds = 0;
+	leafFixed = FALSE;
+	recSize = attrLength + AM_ss;
+
+	for (i = 0; i < nKeys; i++)
+	{
+		value = keys + i*attrLength;
+
+		/* climb to the lowest node whose range holds value */
+		if (i > 0 && AM_Compare(value - attrLength,attrType,attrLength,
+			value) < 0)
+			level = 0;
+		else
+			for (level = depth - 1; level > 0; level--)
+				if (!path[level].hasFence || AM_Compare(path[level].fence,
+					attrType,attrLength,value) < 0)
+					break;
+
+		if (level < depth - 1 || depth == 0)
+		{
+			/* leave the current leaf and descend from path[level] */
+			if (leafFixed)
+			{
+				errVal = PF_UnfixPage(fileDesc,path[depth-1].pageNum,FALSE);
+				AM_Check;
+				leafFixed = FALSE;
+			}
+			if (depth == 0)
+			{
+				errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
+				AM_Check;
+				path[0].pageNum = pageNum;
+				path[0].hasFence = FALSE;
+				level = 0;
+			}
+			else
+			{
+				pageNum = path[level].pageNum;
+				errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
+				AM_Check;
+			}
+			while (*pageBuf != 'l')
+			{
+				if (level + 1 >= AM_MAXDEPTH)
+				{
+					PF_UnfixPage(fileDesc,pageNum,FALSE);
+					AM_Errno = AME_INTERROR;
+					return(AME_INTERROR);
+				}
+				bcopy(pageBuf,iheader,AM_sint);
+				if (iheader->attrLength != attrLength)
+				{
+					PF_UnfixPage(fileDesc,pageNum,FALSE);
+					return(AME_INVALIDATTRLENGTH);
+				}
+				path[level+1].pageNum = AM_BinSearch(pageBuf,attrType,
+					attrLength,value,&index,iheader);
+
+				/* the child's range ends at the key to the right of
+				its pointer, or where this node's range ends */
+				if (index < iheader->numKeys)
+				{
+					path[level+1].hasFence = TRUE;
+					bcopy(pageBuf + AM_sint + AM_si +
+					      index*(AM_si + attrLength),
+					      path[level+1].fence,attrLength);
+				}
+				else
+				{
+					path[level+1].hasFence = path[level].hasFence;
+					bcopy(path[level].fence,path[level+1].fence,
+					      attrLength);
+				}
+				errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+				AM_Check;
+				level++;
+				pageNum = path[level].pageNum;
+				errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
+				AM_Check;
+			}
+			depth = level + 1;
+			leafFixed = TRUE;
+		}
+
+		/* value is on the leaf path[depth-1], if anywhere */
+		bcopy(pageBuf,lheader,AM_sl);
+		if (lheader->attrLength != attrLength)
+		{
+			PF_UnfixPage(fileDesc,path[depth-1].pageNum,FALSE);
+			return(AME_INVALIDATTRLENGTH);
+		}
+		status = AM_SearchLeaf(pageBuf,attrType,attrLength,value,&index,
+			lheader);
+
+		/* count the key's recIds first so that a key is never split */
+		n = 0;
+		if (status == AM_FOUND)
+		{
+			bcopy(pageBuf + AM_sl + (index - 1)*recSize + attrLength,
+			      &recIdPtr,AM_ss);
+			while (recIdPtr != 0)
+			{
+				n++;
+				bcopy(pageBuf + recIdPtr + AM_si,&recIdPtr,AM_ss);
+			}
+		}
+		if (nRecIds + n > maxRecIds)
+		{
+			if (i == 0)
+			{
+				PF_UnfixPage(fileDesc,path[depth-1].pageNum,FALSE);
+				AM_Errno = AME_INVALIDVALUE;
+				return(AME_INVALIDVALUE);
+			}
+			break;
+		}
+		if (n > 0)
+		{
+			bcopy(pageBuf + AM_sl + (index - 1)*recSize + attrLength,
+			      &recIdPtr,AM_ss);
+			while (recIdPtr != 0)
+			{
+				bcopy(pageBuf + recIdPtr,&recIds[nRecIds++],AM_si);
+				bcopy(pageBuf + recIdPtr + AM_si,&recIdPtr,AM_ss);
+			}
+		}
+		counts[i] = n;
+	}
+
+	if (leafFixed)
+	{
+		errVal = PF_UnfixPage(fileDesc,path[depth-1].pageNum,FALSE);
+		AM_Check;
+	}
+	return(i);
+}
@@ -0,0 +1,257 @@
+# include <stdio.h>
+# include "am.h"
+# include "pf.h"
+
+/* Page number of leaf i of a bulk-built tree with nLeaves leaves. When the
+root is not a leaf, GetLeftPageNum() takes page 2 to be the leftmost leaf
+(that is where the first root split leaves it), so the first two leaves go
+to pages 2 and 1 and the rest follow in key order. */
+AM_BulkLeafPage(i,nLeaves)
+int i;
+int nLeaves;
+
+{
+	if (nLeaves == 1) return(0);
+	if (i == 0) return(2);
+	if (i == 1) return(1);
+	return(i + 1);
+}
+
+
+/* Allocates the next page of the file, copies page into it and unfixes it */
+AM_BulkWritePage(fileDesc,pageNum,page)
+int fileDesc;
+int pageNum; /* page number the page is expected to get */
+char *page;
+
+{
+	char *pageBuf;
+	int newPage;
+	int errVal;
+
+	if (pageNum == 0)
+	{
+		/* the root stays on the page AM_CreateIndex gave it */
+		errVal = PF_GetThisPage(fileDesc,0,&pageBuf);
+		AM_Check;
+	}
+	else
+	{
+		errVal = PF_AllocPage(fileDesc,&newPage,&pageBuf);
+		AM_Check;
+		if (newPage != pageNum)
+		{
+			PF_UnfixPage(fileDesc,newPage,FALSE);
+			AM_Errno = AME_INTERROR;
+			return(AME_INTERROR);
+		}
+	}
+	bcopy(page,pageBuf,PF_PAGE_SIZE);
+	errVal = PF_UnfixPage(fileDesc,pageNum,TRUE);
+	AM_Check;
+	return(AME_OK);
+}
+
+
+/* Builds a B+ tree bottom up in the empty index fileDesc (as left by
+AM_CreateIndex) from nEntries (key,recId) pairs. The keys are stored one
+after another attrLength bytes apart in ascending order; equal keys must be
+adjacent and their recIds are listed in the order given. Leaves are packed
+full and written in key order, then each level of internal nodes above
+them, and the root last onto page 0. Every key's recId list must fit on one
+leaf. Returns AME_OK or an AM error. */
+AM_BulkLoad(fileDesc,attrType,attrLength,keys,recIds,nEntries)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'c' , 'i' or 'f' */
+int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
+char *keys; /* nEntries values in ascending order */
+int *recIds; /* recId of each value */
+int nEntries;
+
+{
+	char page[PF_PAGE_SIZE]; /* the page being built */
+	char *pageBuf;
+	int *leafStart; /* first entry of each leaf, and nEntries at the end */
+	int nLeaves;
+	int *childPage; /* nodes of the level below the one being built */
+	char *childKey; /* smallest key under each of them */
+	int nChildren;
+	int nNodes; /* nodes on the level being built */
+	int nextPage; /* next page to allocate for an internal node */
+	int used; /* bytes of the current leaf in use */
+	int need; /* bytes a key with its recId list takes on a leaf */
+	int recSize,maxKeys,errVal;
+	int i,j,k,first,last,node;
+	short recIdPtr,next,null = AM_NULL;
+	AM_LEAFHEADER lhead,*lheader;
+	AM_INTHEADER ihead,*iheader;
+
+	if (fileDesc < 0)
+	{
+		AM_Errno = AME_FD;
+		return(AME_FD);
+	}
+	lheader = &lhead;
+	iheader = &ihead;
+	recSize = attrLength + AM_ss;
+
+	/* the index has to be the single empty leaf of a new index */
+	errVal = PF_GetThisPage(fileDesc,0,&pageBuf);
+	AM_Check;
+	bcopy(pageBuf,lheader,AM_sl);
+	errVal = PF_UnfixPage(fileDesc,0,FALSE);
+	AM_Check;
+	if (lheader->pageType != 'l' || lheader->numKeys != 0 ||
+	    lheader->nextLeafPage != AM_NULL_PAGE)
+	{
+		AM_Errno = AME_INVALIDVALUE;
+		return(AME_INVALIDVALUE);
+	}
+	if (lheader->attrLength != attrLength)
+		return(AME_INVALIDATTRLENGTH);
+	maxKeys = lheader->maxKeys;
+	if (nEntries == 0)
+		return(AME_OK);
+
+	/* split the entries into leaves, never splitting a key */
+	leafStart = (int *)malloc((nEntries + 1)*sizeof(int));
+	if (leafStart == NULL)
+	{
+		AM_Errno = AME_INTERROR;
+		return(AME_INTERROR);
+	}
+	nLeaves = 0;
+	used = PF_PAGE_SIZE;
+	for (i = 0; i < nEntries; i = j)
+	{
+		for (j = i + 1; j < nEntries; j++)
+			if (AM_Compare(keys + i*attrLength,attrType,attrLength,
+			    keys + j*attrLength) != 0)
+				break;
+		if (j < nEntries && AM_Compare(keys + i*attrLength,attrType,
+		    attrLength,keys + j*attrLength) < 0)
+		{
+			/* keys out of order */
+			free(leafStart);
+			AM_Errno = AME_INVALIDVALUE;
+			return(AME_INVALIDVALUE);
+		}
+		need = recSize + (j - i)*(AM_si + AM_ss);
+		if (AM_sl + need > PF_PAGE_SIZE)
+		{
+			/* recId list too long for a leaf */
+			free(leafStart);
+			AM_Errno = AME_INVALIDVALUE;
+			return(AME_INVALIDVALUE);
+		}
+		if (used + need > PF_PAGE_SIZE)
+		{
+			leafStart[nLeaves++] = i;
+			used = AM_sl;
+		}
+		used += need;
+	}
+	leafStart[nLeaves] = nEntries;
+
+	childPage = (int *)malloc(nLeaves*sizeof(int));
+	childKey = malloc(nLeaves*attrLength);
+	if (childPage == NULL || childKey == NULL)
+	{
+		free(leafStart);
+		free(childPage);
+		free(childKey);
+		AM_Errno = AME_INTERROR;
+		return(AME_INTERROR);
+	}
+
+	/* write the leaves, allocating their pages in page number order */
+	for (k = 1; k <= nLeaves; k++)
+	{
+		node = (nLeaves == 1) ? 0 : (k == 1) ? 1 : (k == 2) ? 0 : k - 1;
+
+		lheader->pageType = 'l';
+		lheader->nextLeafPage = (node + 1 < nLeaves) ?
+			AM_BulkLeafPage(node + 1,nLeaves) : AM_NULL_PAGE;
+		lheader->freeListPtr = AM_NULL;
+		lheader->numinfreeList = 0;
+		lheader->attrLength = attrLength;
+		lheader->numKeys = 0;
+		lheader->maxKeys = maxKeys;
+		recIdPtr = PF_PAGE_SIZE;
+		for (i = leafStart[node]; i < leafStart[node+1]; i = j)
+		{
+			bcopy(keys + i*attrLength,page + AM_sl +
+			      lheader->numKeys*recSize,attrLength);
+			for (j = i; j < leafStart[node+1]; j++)
+			{
+				if (j > i && AM_Compare(keys + i*attrLength,
+				    attrType,attrLength,keys + j*attrLength) != 0)
+					break;
+				recIdPtr = recIdPtr - AM_si - AM_ss;
+				/* link the previous node of the list, or the key */
+				if (j == i)
+					bcopy((char *)&recIdPtr,page + AM_sl +
+					      lheader->numKeys*recSize + attrLength,AM_ss);
+				else
+					bcopy((char *)&recIdPtr,page + next + AM_si,AM_ss);
+				bcopy((char *)&recIds[j],page + recIdPtr,AM_si);
+				bcopy((char *)&null,page + recIdPtr + AM_si,AM_ss);
+				next = recIdPtr;
+			}
+			lheader->numKeys++;
+		}
+		lheader->recIdPtr = recIdPtr;
+		lheader->keyPtr = AM_sl + lheader->numKeys*recSize;
+		bcopy(lheader,page,AM_sl);
+
+		errVal = AM_BulkWritePage(fileDesc,AM_BulkLeafPage(node,nLeaves),
+					  page);
+		if (errVal != AME_OK)
+			break;
+		childPage[node] = AM_BulkLeafPage(node,nLeaves);
+		bcopy(keys + leafStart[node]*attrLength,childKey + node*attrLength,
+		      attrLength);
+	}
+	free(leafStart);
+
+	/* each level spreads its children evenly over as few nodes as hold
+	them, until one node - the root - is left */
+	nChildren = nLeaves;
+	nextPage = nLeaves + 1;
+	while (errVal == AME_OK && nChildren > 1)
+	{
+		nNodes = (nChildren + maxKeys) / (maxKeys + 1);
+		for (node = 0, first = 0; node < nNodes; node++, first = last)
+		{
+			last = first + nChildren / nNodes +
+				(node < nChildren % nNodes ? 1 : 0);
+			iheader->pageType = 'i';
+			iheader->numKeys = last - first - 1;
+			iheader->maxKeys = maxKeys;
+			iheader->attrLength = attrLength;
+			bcopy(iheader,page,AM_sint);
+			bcopy((char *)&childPage[first],page + AM_sint,AM_si);
+			for (i = first + 1; i < last; i++)
+			{
+				bcopy(childKey + i*attrLength,page + AM_sint + AM_si
+				      + (i - first - 1)*(attrLength + AM_si),attrLength);
+				bcopy((char *)&childPage[i],page + AM_sint + AM_si
+				      + (i - first - 1)*(attrLength + AM_si) +
+				      attrLength,AM_si);
+			}
+			k = (nNodes == 1) ? 0 : nextPage++;
+			errVal = AM_BulkWritePage(fileDesc,k,page);
+			if (errVal != AME_OK)
+				break;
+
+			/* the node becomes a child on the level above */
+			childPage[node] = k;
+			bcopy(childKey + first*attrLength,childKey + node*attrLength,
+			      attrLength);
+		}
+		nChildren = nNodes;
+	}
+	free(childPage);
+	free(childKey);
+	return(errVal);
+}
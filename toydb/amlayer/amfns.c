@@ -4,12 +4,13 @@
 
 
 
-/* Creates a secondary idex file called fileName.indexNo */
-AM_CreateIndex(fileName,indexNo,attrType,attrLength)
+/* Creates the index file fileName.indexNo, a shadow file if shadow is TRUE */
+static AM_MakeIndex(fileName,indexNo,attrType,attrLength,shadow)
 char *fileName;/* Name of indexed file */
 int indexNo;/*number of this index for file */
 char attrType;/* 'c' for char ,'i' for int ,'f' for float */
 int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+int shadow; /* TRUE for PF_CreateShadowFile() */
 
 
 {
@@ -46,7 +47,10 @@ int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 	
 	/* Get the filename with extension and create a paged file by that name*/
 	sprintf(indexfName,"%s.%d",fileName,indexNo);
-	errVal = PF_CreateFile(indexfName);
+	if (shadow)
+		errVal = PF_CreateShadowFile(indexfName);
+	else
+		errVal = PF_CreateFile(indexfName);
 	AM_Check;
 
 	/* open the new file */
@@ -92,6 +96,32 @@ int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 }
 
 
+/* Creates a secondary idex file called fileName.indexNo */
+AM_CreateIndex(fileName,indexNo,attrType,attrLength)
+char *fileName;/* Name of indexed file */
+int indexNo;/*number of this index for file */
+char attrType;/* 'c' for char ,'i' for int ,'f' for float */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+
+{
+	return(AM_MakeIndex(fileName,indexNo,attrType,attrLength,FALSE));
+}
+
+
+/* Creates the index fileName.indexNo as a shadow file, in which each 
+insert, with the splits it makes, reaches the file all at once: a crash 
+leaves the tree as it was before some insert, never half split */
+AM_CreateShadowIndex(fileName,indexNo,attrType,attrLength)
+char *fileName;/* Name of indexed file */
+int indexNo;/*number of this index for file */
+char attrType;/* 'c' for char ,'i' for int ,'f' for float */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+
+{
+	return(AM_MakeIndex(fileName,indexNo,attrType,attrLength,TRUE));
+}
+
+
 /* Destroys the index fileName.indexNo */
 AM_DestroyIndex(fileName,indexNo)
 char *fileName;/* name of indexed file */
@@ -283,6 +313,32 @@ int recId; /* recId to be inserted */
 		 return(AME_FD);
                 }
 	
+	/* in a shadow index the insert is one update of the file, unless
+	the caller has begun one; the inner call finds the update begun
+	and inserts as usual. A failed insert is dropped, so that a half
+	done split is never published. */
+	if (PF_ShadowState(fileDesc) == PF_SHADOW_IDLE)
+	{
+		if (PF_ShadowBegin(fileDesc) != PFE_OK)
+		{
+			AM_Errno = AME_PF;
+			return(AME_PF);
+		}
+		errVal = AM_InsertEntry(fileDesc,attrType,attrLength,value,
+					recId);
+		if (errVal != AME_OK)
+		{
+			AM_EmptyStack();
+			PF_ShadowAbort(fileDesc);
+			return(errVal);
+		}
+		if (PF_ShadowCommit(fileDesc,AM_ShadowSync) != PFE_OK)
+		{
+			AM_Errno = AME_PF;
+			return(AME_PF);
+		}
+		return(errVal);
+	}
 	
 	/* Search the leaf for the key */
 	status = AM_Search(fileDesc,attrType,attrLength,value,&pageNum,
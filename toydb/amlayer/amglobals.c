@@ -3,4 +3,5 @@
 int AM_RootPageNum = 0;
 int AM_LeftPageNum = 0;
 int AM_Errno;
+int AM_ShadowSync = 1;
 
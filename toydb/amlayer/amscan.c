@@ -2,6 +2,7 @@
 # include <stdio.h>
 # include "am.h"
 # include "pf.h"
+# include "../pflayer/pftrace.h"
 
 /* The structure of the scan Table */
 struct {
@@ -73,6 +74,7 @@ if (scanDesc > MAXSCANS - 1)
 /* there is room */
 AM_scanTable[scanDesc].status = FIRST;
 AM_scanTable[scanDesc].attrType = attrType;
+PF_TRACE_OPEN(am_scan,scanDesc,fileDesc);
 
 /* initialise AM_LeftPageNum */
 AM_LeftPageNum = GetLeftPageNum(fileDesc);
@@ -479,6 +481,7 @@ if ((scanDesc < 0) || (scanDesc > MAXSCANS - 1))
    AM_Errno = AME_INVALID_SCANDESC;
    return(AME_INVALID_SCANDESC);
   }
+PF_TRACE_CLOSE(am_scan,scanDesc,AM_scanTable[scanDesc].fileDesc);
 AM_scanTable[scanDesc].status = FREE;
 return(AME_OK);
 }
@@ -29,10 +29,16 @@
 #define PFE_PAGEINBUF	-17	/* new page to be allocated already in buffer */
 #define PFE_HASHNOTFOUND -18	/* hash table entry not found */
 #define PFE_HASHPAGEEXIST -19	/* page already exist in hash table */
+#define PFE_SHADOW	-25	/* not a shadow file, or wrong update state */
+
+/* PF_ShadowState() */
+#define PF_SHADOW_NONE		0	/* not a shadow file */
+#define PF_SHADOW_IDLE		1	/* a shadow file, not in an update */
+#define PF_SHADOW_UPDATING	2	/* in an update */
 
 
 /* page size */
-#define PF_PAGE_SIZE	1020
+#define PF_PAGE_SIZE	4096
 
 /* externs from the PF layer */
 extern int PFerrno;		/* error number of last error */
@@ -2,6 +2,7 @@
 import subprocess
 import sys
 import shutil
+import time
 from pathlib import Path
 
 BIN = Path(__file__).resolve().parent / 'test_task3'
@@ -44,6 +45,26 @@ def run_one(n, data_path):
 
     return results
 
+def run_sweep(sizes, data_path):
+    """all sizes in one test_task3 process; returns the rows of every size"""
+    cmd = [str(BIN), ','.join(str(n) for n in sizes), str(data_path)]
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if proc.returncode != 0:
+        print(f"ERROR: command failed (rc={proc.returncode})\n{proc.stderr}")
+        return None
+
+    lines = [l.strip() for l in proc.stdout.splitlines() if l.strip()]
+    start = next((i + 1 for i, l in enumerate(lines) if l.startswith('Method,')), len(lines))
+    results = []
+    for r in lines[start:]:
+        parts = [p.strip() for p in r.split(',')]
+        # Method, n, then the 7 columns of a single run
+        if len(parts) != 9:
+            print('WARNING: unexpected row format:', r)
+            continue
+        results.append((parts[0], *map(int, parts[1:])))
+    return results
+
 def print_table(all_results):
     hdr = ['Method', 'n', 'time-ms', 'phys_reads', 'phys_writes', 'logical_reads', 'logical_writes', 'page_hits', 'page_misses']
     # compute column widths
@@ -68,9 +89,13 @@ def main():
         print(f"ERROR: test binary not found at {BIN}")
         sys.exit(1)
 
+    # --per-process runs test_task3 once per size, as before the in-process sweep
+    args = [a for a in sys.argv[1:] if a != '--per-process']
+    per_process = len(args) != len(sys.argv) - 1
+
     # data file path: argument 1 or default to data/student.txt relative to repo
-    if len(sys.argv) >= 2:
-        data_path = Path(sys.argv[1])
+    if len(args) >= 1:
+        data_path = Path(args[0])
     else:
         data_path = Path(__file__).resolve().parents[2] / 'data' / 'student.txt'
 
@@ -79,13 +104,21 @@ def main():
         sys.exit(1)
 
     aggregated = []
-    for n in SIZES:
-        print(f"Running n={n} ...")
-        res = run_one(n, data_path)
-        if res is None:
-            print(f"Run for n={n} failed; aborting remaining runs.")
-            break
-        aggregated.extend(res)
+    t0 = time.monotonic()
+    if per_process:
+        for n in SIZES:
+            print(f"Running n={n} ...")
+            res = run_one(n, data_path)
+            if res is None:
+                print(f"Run for n={n} failed; aborting remaining runs.")
+                break
+            aggregated.extend(res)
+    else:
+        print(f"Running n={','.join(str(n) for n in SIZES)} in one process ...")
+        aggregated = run_sweep(SIZES, data_path) or []
+    elapsed = time.monotonic() - t0
+    print(f"Sweep wall time: {elapsed:.3f} s for {len(SIZES)} sizes "
+          f"({'one process per size' if per_process else 'in-process'})")
 
     if aggregated:
         print('\nAggregated results:')
@@ -8,6 +8,10 @@
  * For each method we measure build time and PF page-level statistics.
  * We also measure point-query performance (time & pages accessed) on a sample
  * of keys.
+ *
+ * Usage: test_task3 [n] [datafile]
+ *        test_task3 n1,n2,... [datafile]   all sizes in one process; the
+ *                                          rows then carry an n column
  */
 
 #include "am.h"
@@ -115,81 +119,117 @@ static long measure_point_queries(int fd, int *keys, int n, int m, PFstats *befo
     return elapsed_ms(t0,t1);
 }
 
-int main(int argc, char **argv){
-    const char *datafile = "../data/student.txt"; /* default relative */
-    int nrecs = 2000; /* default records to process */
-    if(argc > 1) nrecs = atoi(argv[1]);
-    if(argc > 2) datafile = argv[2];
-
-    printf("Task 3: AM index-build experiments using '%s' (n=%d)\n", datafile, nrecs);
-    PF_Init();
-
-    int *keys = NULL;
-    int count = read_rollnos(datafile, nrecs, &keys);
-    if(count <= 0){ fprintf(stderr,"failed to read rollnos\n"); return 1; }
-    printf("Read %d roll-no keys\n", count);
+static int cmp_int(const void *a, const void *b){ return (*(int*)a) - (*(int*)b); }
+
+/* print one result row; n is left out when negative */
+static void print_row(const char *method, int n, long ms, PFstats *before, PFstats *after){
+    if(n >= 0) printf("%s,%d,%ld,%d,%d,%d,%d,%d,%d\n", method, n, ms,
+        after->phys_reads - before->phys_reads,
+        after->phys_writes - before->phys_writes,
+        after->logical_reads - before->logical_reads,
+        after->logical_writes - before->logical_writes,
+        after->page_hits - before->page_hits,
+        after->page_misses - before->page_misses);
+    else printf("%s,%ld,%d,%d,%d,%d,%d,%d\n", method, ms,
+        after->phys_reads - before->phys_reads,
+        after->phys_writes - before->phys_writes,
+        after->logical_reads - before->logical_reads,
+        after->logical_writes - before->logical_writes,
+        after->page_hits - before->page_hits,
+        after->page_misses - before->page_misses);
+}
 
+/* the three builds over keys[0..count-1]; rows carry n if n >= 0.
+   Returns 0, or 1 if an index could not be created. */
+static int run_builds(int *keys, int count, int n){
     /* prepare three orders: original (input), sorted, random-shuffled */
     int *keys_orig = malloc(sizeof(int)*count);
     int *keys_sorted = malloc(sizeof(int)*count);
     int *keys_rand = malloc(sizeof(int)*count);
     for(int i=0;i<count;i++){ keys_orig[i] = keys[i]; keys_sorted[i] = keys[i]; keys_rand[i] = keys[i]; }
     /* sort keys_sorted */
-    int cmp_int(const void *a, const void *b){ return (*(int*)a) - (*(int*)b); }
     qsort(keys_sorted, count, sizeof(int), cmp_int);
 
-    /* random shuffle into keys_rand */
+    /* random shuffle into keys_rand; rand()'s default seed, so that a
+       size gives the same order in a sweep as on its own */
+    srand(1);
     for(int i=count-1;i>0;i--){ int j = rand() % (i+1); int t = keys_rand[i]; keys_rand[i] = keys_rand[j]; keys_rand[j] = t; }
 
     /* experiment variants: unsorted (input order), sorted (bulk-sorted), random-insert */
     const char *basename = "student_am";
+    const char *methods[3] = { "unsorted", "sorted", "random" };
+    int *orders[3] = { keys_orig, keys_sorted, keys_rand };
     PFstats before, after;
-
-    printf("\nMethod, build-time-ms, phys_reads, phys_writes, logical_reads, logical_writes, page_hits, page_misses\n");
-
-    /* 1) Unsorted build (input order) */
-    int fd1 = create_and_open_index(basename);
-    if(fd1 < 0) return 1;
-    long t_unsorted = build_index_insert(fd1, keys_orig, count, &before, &after);
-    PF_CloseFile(fd1);
-    printf("unsorted,%ld,%d,%d,%d,%d,%d,%d\n", t_unsorted,
-        after.phys_reads - before.phys_reads,
-        after.phys_writes - before.phys_writes,
-        after.logical_reads - before.logical_reads,
-        after.logical_writes - before.logical_writes,
-        after.page_hits - before.page_hits,
-        after.page_misses - before.page_misses);
-
-    /* 2) Sorted bulk-load (sort keys first then insert) */
-    int fd2 = create_and_open_index(basename);
-    if(fd2 < 0) return 1;
-    long t_sorted = build_index_insert(fd2, keys_sorted, count, &before, &after);
-    PF_CloseFile(fd2);
-    printf("sorted,%ld,%d,%d,%d,%d,%d,%d\n", t_sorted,
-        after.phys_reads - before.phys_reads,
-        after.phys_writes - before.phys_writes,
-        after.logical_reads - before.logical_reads,
-        after.logical_writes - before.logical_writes,
-        after.page_hits - before.page_hits,
-        after.page_misses - before.page_misses);
-
-    /* 3) Random incremental build */
-    int fd3 = create_and_open_index(basename);
-    if(fd3 < 0) return 1;
-    long t_random = build_index_insert(fd3, keys_rand, count, &before, &after);
-    PF_CloseFile(fd3);
-    printf("random,%ld,%d,%d,%d,%d,%d,%d\n", t_random,
-        after.phys_reads - before.phys_reads,
-        after.phys_writes - before.phys_writes,
-        after.logical_reads - before.logical_reads,
-        after.logical_writes - before.logical_writes,
-        after.page_hits - before.page_hits,
-        after.page_misses - before.page_misses);
+    int rc = 0;
+
+    for(int m=0;m<3;m++){
+        int fd = create_and_open_index(basename);
+        if(fd < 0){ rc = 1; break; }
+        long t = build_index_insert(fd, orders[m], count, &before, &after);
+        PF_CloseFile(fd);
+        print_row(methods[m], n, t, &before, &after);
+    }
 
     /* cleanup (query workload measurement is done in a separate step to avoid
        interaction with index file destruction in this old AM implementation) */
     AM_DestroyIndex((char*)basename, INDEXNO);
     /* free buffers */
-    free(keys); free(keys_orig); free(keys_sorted); free(keys_rand);
+    free(keys_orig); free(keys_sorted); free(keys_rand);
+    return rc;
+}
+
+/* run every size of the comma-separated list in this process, the PF
+   layer reinitialized before each; the keys are read once, and a size
+   builds over the first n of them */
+static int sweep(const char *sizes, const char *datafile){
+    int sizev[64], nsizes = 0, maxn = 0;
+    struct timespec t0, t1;
+
+    for(const char *p = sizes; *p && nsizes < 64; ){
+        sizev[nsizes] = atoi(p);
+        if(sizev[nsizes] > maxn) maxn = sizev[nsizes];
+        nsizes++;
+        p = strchr(p, ',');
+        if(p == NULL) break;
+        p++;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    int *keys = NULL;
+    int count = read_rollnos(datafile, maxn, &keys);
+    if(count <= 0){ fprintf(stderr,"failed to read rollnos\n"); return 1; }
+
+    printf("Task 3: AM index-build sweep using '%s' (n=%s)\n", datafile, sizes);
+    printf("\nMethod, n, build-time-ms, phys_reads, phys_writes, logical_reads, logical_writes, page_hits, page_misses\n");
+    for(int i=0;i<nsizes;i++){
+        int n = sizev[i] < count ? sizev[i] : count;
+        PF_Init();
+        if(run_builds(keys, n, n)){ free(keys); return 1; }
+    }
+    free(keys);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+    fprintf(stderr, "sweep: %d sizes in %ld ms\n", nsizes, elapsed_ms(t0,t1));
     return 0;
 }
+
+int main(int argc, char **argv){
+    const char *datafile = "../data/student.txt"; /* default relative */
+    int nrecs = 2000; /* default records to process */
+    if(argc > 1) nrecs = atoi(argv[1]);
+    if(argc > 2) datafile = argv[2];
+
+    /* several sizes (e.g. 2000,5000,10000): an in-process sweep */
+    if(argc > 1 && strchr(argv[1], ',') != NULL) return sweep(argv[1], datafile);
+
+    printf("Task 3: AM index-build experiments using '%s' (n=%d)\n", datafile, nrecs);
+    PF_Init();
+
+    int *keys = NULL;
+    int count = read_rollnos(datafile, nrecs, &keys);
+    if(count <= 0){ fprintf(stderr,"failed to read rollnos\n"); return 1; }
+    printf("Read %d roll-no keys\n", count);
+
+    printf("\nMethod, build-time-ms, phys_reads, phys_writes, logical_reads, logical_writes, page_hits, page_misses\n");
+    int rc = run_builds(keys, count, -1);
+    free(keys);
+    return rc;
+}
@@ -0,0 +1,177 @@
+/* testanalyze.c
+ * AM_Analyze (amanalyze.c) on indexes of known shape, and its cost next to
+ * a full index scan.
+ *
+ * Indexes of n int keys are built
+ *   bulk       by AM_BulkLoad, in key order
+ *   ascending  by AM_InsertEntry, in key order
+ *   random     by AM_InsertEntry, in random order
+ *   dups       as random, but n/DUPS keys with DUPS recIds each
+ *   deletes    as random, then every 4th entry deleted
+ * and analyzed. Checked: the keys, recIds, longest recId list and free list
+ * entries are those put in; every page is on a level under the root and
+ * every leaf on the leaf list; the levels hold as many leaves and internal
+ * nodes as the file; a bulk-loaded index has full leaves in file order.
+ * Each index is printed as
+ *   index, pages, height, pages-per-level, leaf-fill-%, internal-fill-%,
+ *   keys, recids, max-chain, freelist-bytes, seq-links, back-links,
+ *   order-corr, analyze-ms, scan-ms
+ * where scan-ms is a full AM_OpenIndexScan(ALL) of the same index, and
+ * then the full report (AM_PrintAnalysis) of the random one.
+ *
+ * Usage: testanalyze [n]       or       testanalyze -f indexfile
+ * The second form prints the report of an existing index.
+ */
+
+#include "am.h"
+#include "../pflayer/pf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* AM layer functions used */
+extern int AM_CreateIndex(char *fileName,int indexNo,char attrType,int attrLength);
+extern int AM_DestroyIndex(char *fileName,int indexNo);
+extern int AM_InsertEntry(int fileDesc,char attrType,int attrLength,char *value,int recId);
+extern int AM_DeleteEntry(int fileDesc,char attrType,int attrLength,char *value,int recId);
+extern int AM_BulkLoad(int fileDesc,char attrType,int attrLength,char *keys,int *recIds,int nEntries);
+extern int AM_OpenIndexScan(int fileDesc,char attrType,int attrLength,int op,char *value);
+extern int AM_FindNextEntry(int scanDesc);
+extern int AM_CloseIndexScan(int scanDesc);
+extern int AM_Analyze(int fileDesc,AM_ANALYSIS *stats);
+extern int AM_PrintAnalysis(AM_ANALYSIS *stats);
+extern int AM_PrintError(char *s);
+extern void AM_EmptyStack(void);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+
+#define BASENAME "/tmp/am_analyze"
+#define INDEXNO 0
+#define IDXNAME "/tmp/am_analyze.0"
+#define DUPS 8
+
+enum { BULK, ASCENDING, RANDOM, DUPKEYS, DELETES, NKINDS };
+static const char *kinds[NKINDS] = { "bulk", "ascending", "random", "dups", "deletes" };
+
+static void check(int error, const char *what) {
+    if (error < 0) {
+        AM_PrintError((char *)what);
+        exit(1);
+    }
+}
+
+static void shuffle(int *a, int n) {
+    int i, j, t;
+    for (i = n - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        t = a[i]; a[i] = a[j]; a[j] = t;
+    }
+}
+
+/* builds the index; returns the # of entries deleted */
+static int build(int kind, int n) {
+    int *keys = malloc(n * sizeof(int)), *ids = malloc(n * sizeof(int));
+    int fd, i, deleted = 0;
+
+    srand(11);
+    for (i = 0; i < n; i++) {
+        keys[i] = kind == DUPKEYS ? i / DUPS : i;
+        ids[i] = i;
+    }
+    if (kind != BULK && kind != ASCENDING) {
+        /* shuffle the entries, each key keeping its recIds */
+        shuffle(ids, n);
+        for (i = 0; i < n; i++) keys[i] = kind == DUPKEYS ? ids[i] / DUPS : ids[i];
+    }
+    AM_DestroyIndex(BASENAME, INDEXNO);
+    check(AM_CreateIndex(BASENAME, INDEXNO, 'i', sizeof(int)), "create");
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    if (kind == BULK)
+        check(AM_BulkLoad(fd, 'i', sizeof(int), (char *)keys, ids, n), "bulk load");
+    else
+        for (i = 0; i < n; i++)
+            check(AM_InsertEntry(fd, 'i', sizeof(int), (char *)&keys[i], ids[i]), "insert");
+    if (kind == DELETES)
+        for (i = 0; i < n; i += 4, deleted++)
+            check(AM_DeleteEntry(fd, 'i', sizeof(int), (char *)&keys[i], ids[i]), "delete");
+    check(PF_CloseFile(fd), "close");
+    free(keys);
+    free(ids);
+    return deleted;
+}
+
+/* checks of stats of an index of kind; returns the # of errors */
+static int verify(int kind, int n, int deleted, AM_ANALYSIS *s) {
+    long keys = kind == DUPKEYS ? (n + DUPS - 1) / DUPS : n - deleted;
+    int bad = 0, i, levels = 0;
+
+    for (i = 0; i < s->height; i++) levels += s->pagesPerLevel[i];
+    bad += s->numKeys != keys;
+    bad += s->numRecIds != n - deleted;
+    bad += s->maxChain != (kind == DUPKEYS ? DUPS : 1);
+    bad += s->freeListEntries != deleted;
+    bad += s->unreached != 0 || s->unlinkedLeaves != 0;
+    bad += levels != s->numPages || s->numPages != s->numLeaves + s->numInternal;
+    bad += s->pagesPerLevel[0] != 1 || s->pagesPerLevel[s->height - 1] != s->numLeaves;
+    bad += s->leafSteps != s->numLeaves - 1;
+    if (kind == DUPKEYS) bad += s->chainHist[3] != keys;
+    if (kind == BULK) bad += s->leafFill < 0.9 || s->orderCorr < 0.99;
+    return bad;
+}
+
+/* a full index scan; returns the entries */
+static long scan_all(int fd) {
+    long count = 0;
+    int sd;
+    check(sd = AM_OpenIndexScan(fd, 'i', sizeof(int), ALL, NULL), "scan");
+    while (AM_FindNextEntry(sd) >= 0) count++;
+    AM_CloseIndexScan(sd);
+    return count;
+}
+
+int main(int argc, char **argv) {
+    int n, kind, fd, deleted, bad = 0, i;
+    AM_ANALYSIS s, random;
+    struct timespec t0, t1, t2;
+    double ams, sms;
+
+    PF_Init();
+    if (argc > 2 && strcmp(argv[1], "-f") == 0) {
+        check(fd = PF_OpenFile(argv[2]), argv[2]);
+        check(AM_Analyze(fd, &s), "analyze");
+        AM_PrintAnalysis(&s);
+        return PF_CloseFile(fd) != PFE_OK;
+    }
+    n = argc > 1 ? atoi(argv[1]) : 100000;
+
+    printf("index,pages,height,pages-per-level,leaf-fill-%%,internal-fill-%%,keys,recids,"
+           "max-chain,freelist-bytes,seq-links,back-links,order-corr,analyze-ms,scan-ms\n");
+    for (kind = 0; kind < NKINDS; kind++) {
+        deleted = build(kind, n);
+        check(fd = PF_OpenFile(IDXNAME), "open");
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        check(AM_Analyze(fd, &s), "analyze");
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (scan_all(fd) != n - deleted) bad++;
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        check(PF_CloseFile(fd), "close");
+        ams = PF_MsBetween(t0, t1);
+        sms = PF_MsBetween(t1, t2);
+
+        printf("%s,%d,%d,", kinds[kind], s.numPages, s.height);
+        for (i = 0; i < s.height; i++) printf("%s%d", i ? "/" : "", s.pagesPerLevel[i]);
+        printf(",%.1f,%.1f,%ld,%ld,%d,%ld,%d,%d,%.3f,%.2f,%.2f\n",
+            100 * s.leafFill, 100 * s.intFill, s.numKeys, s.numRecIds, s.maxChain,
+            s.freeListBytes, s.seqSteps, s.backSteps, s.orderCorr, ams, sms);
+        i = verify(kind, n, deleted, &s);
+        if (i) printf("%s: %d checks failed\n", kinds[kind], i);
+        bad += i;
+        if (kind == RANDOM) random = s;
+    }
+    printf("\nrandom:\n");
+    AM_PrintAnalysis(&random);
+    AM_DestroyIndex(BASENAME, INDEXNO);
+    printf("\n%d errors\n", bad);
+    return bad != 0;
+}
@@ -0,0 +1,137 @@
+/* testckpt.c
+ * Restart time after a crash during an AM_InsertEntry workload, with and
+ * without fuzzy checkpoints (PF_LogCheckpoint in pflayer/pflog.c).
+ *
+ * A child process inserts n int keys in ascending order into a new index,
+ * BATCH keys per logged transaction, then begins one more transaction,
+ * inserts part of a batch and exits without closing anything. The parent
+ * times PF_LogOpen(), which recovers the index, and checks that it holds
+ * exactly the committed keys. Each run is printed as
+ *   mode, inserts, insert-ms, checkpoints, log-MB, restart-ms,
+ *   log-records-read, updates-redone, keys-found
+ *
+ * Usage: testckpt [n] [checkpoint-interval-bytes] [trickle-pages]
+ */
+
+#include "am.h"
+#include "../pflayer/pf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* AM layer functions used */
+extern int AM_CreateIndex(char *fileName,int indexNo,char attrType,int attrLength);
+extern int AM_DestroyIndex(char *fileName,int indexNo);
+extern int AM_InsertEntry(int fileDesc,char attrType,int attrLength,char *value,int recId);
+extern int AM_OpenIndexScan(int fileDesc,char attrType,int attrLength,int op,char *value);
+extern int AM_FindNextEntry(int scanDesc);
+extern int AM_CloseIndexScan(int scanDesc);
+extern int AM_PrintError(char *s);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+
+#define BASENAME "/tmp/am_ckpt"
+#define INDEXNO 0
+#define IDXNAME "/tmp/am_ckpt.0"
+#define LOG "/tmp/am_ckpt_log"
+#define BATCH 1000
+
+static void check(int error, const char *what) {
+    if (error < 0) {
+        PF_PrintError((char *)what);
+        exit(1);
+    }
+}
+
+/* in the child: insert n keys and crash inside the next transaction */
+static void workload(int n, long interval, int trickle) {
+    struct timespec t0, t1;
+    PFlogstats st;
+    int fd, key, txn;
+
+    PF_Init();
+    check(PF_LogOpen(LOG), "log open");
+    check(PF_LogSetCheckpoint(interval, trickle), "checkpoints");
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (key = 0; key < n; key++) {
+        if (key % BATCH == 0) check(txn = PF_LogBegin(), "begin");
+        if (AM_InsertEntry(fd, 'i', sizeof(int), (char *)&key, key) != AME_OK) {
+            AM_PrintError("insert");
+            exit(1);
+        }
+        if (key % BATCH == BATCH - 1 || key == n - 1) check(PF_LogCommit(txn), "commit");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    check(txn = PF_LogBegin(), "begin");
+    for (; key < n + BATCH / 2; key++)
+        AM_InsertEntry(fd, 'i', sizeof(int), (char *)&key, key);
+    PF_LogGetStats(&st);
+    printf("%.0f,%d,", PF_MsBetween(t0, t1), st.checkpoints);
+    fflush(stdout);
+    _exit(0);
+}
+
+static int count_keys(void) {
+    int fd, sd, n = 0, zero = 0;
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    if ((sd = AM_OpenIndexScan(fd, 'i', sizeof(int), GREATER_THAN_EQUAL, (char *)&zero)) < 0) {
+        AM_PrintError("scan");
+        exit(1);
+    }
+    while (AM_FindNextEntry(sd) >= 0) n++;
+    AM_CloseIndexScan(sd);
+    check(PF_CloseFile(fd), "close");
+    return n;
+}
+
+static int run(const char *mode, int n, long interval, int trickle) {
+    struct timespec t0, t1;
+    struct stat sb;
+    PFlogstats st;
+    int status, found;
+    pid_t pid;
+
+    PF_Init();
+    AM_DestroyIndex(BASENAME, INDEXNO);
+    unlink(LOG);
+    if (AM_CreateIndex(BASENAME, INDEXNO, 'i', sizeof(int)) != AME_OK) {
+        AM_PrintError("create");
+        exit(1);
+    }
+    printf("%s,%d,", mode, n);
+    fflush(stdout);
+    if ((pid = fork()) == 0) workload(n, interval, trickle);
+    waitpid(pid, &status, 0);
+
+    stat(LOG, &sb);
+    PF_Init();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    check(PF_LogOpen(LOG), "recovery");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    PF_LogGetStats(&st);
+    check(PF_LogClose(), "log close");
+    found = count_keys();
+    printf("%.1f,%.1f,%d,%d,%d%s\n", sb.st_size / 1048576.0, PF_MsBetween(t0, t1),
+        st.recovered, st.redone, found, found == n ? "" : " MISMATCH");
+    return found == n;
+}
+
+int main(int argc, char **argv) {
+    int n = 1000000, trickle = 4, ok = 1;
+    long interval = 4L << 20;
+
+    if (argc > 1) n = atoi(argv[1]);
+    if (argc > 2) interval = atol(argv[2]);
+    if (argc > 3) trickle = atoi(argv[3]);
+    printf("mode, inserts, insert-ms, checkpoints, log-MB, restart-ms, log-records-read, updates-redone, keys-found\n");
+    ok &= run("no checkpoints", n, 0, 0);
+    ok &= run("checkpoints", n, interval, trickle);
+    AM_DestroyIndex(BASENAME, INDEXNO);
+    unlink(LOG);
+    return !ok;
+}
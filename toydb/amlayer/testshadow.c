@@ -0,0 +1,285 @@
+/* testshadow.c
+ * B+ tree splits in a shadow index (AM_CreateShadowIndex, shadow files in
+ * pflayer/pf.c) against an ordinary index updated in place.
+ *
+ * Throughput: n int keys, in ascending and in random order, are inserted
+ * into a new index in place, in a shadow index whose inserts are not
+ * fsync()ed (safe from a crash of the process) and in one whose inserts
+ * are (safe from a crash of the system). Each run is printed as
+ *   order, mode, inserts/sec, splits, us/split, us/other-insert,
+ *   MB-written, file-MB
+ * where a split is an insert that adds pages to the file.
+ *
+ * Crash: a child process inserts k random keys and closes the index, then
+ * inserts keys, writing every dirty page after each insert, until one
+ * splits a leaf. It then writes some of the pages the split changed and
+ * exits without closing: each subset of them is a crash at some point of
+ * the split. The parent opens the index and checks that it is a B+ tree
+ * holding every key inserted before the split, and in a shadow index not
+ * the key of the split: a full scan returns them in order, and each of
+ * them is found from the root. A shadow index must pass every time.
+ *
+ * Abort: after ABORTKEYS keys the buffer pool is cut to 1 or 2 pages, so
+ * that the next split, which adds a root, fails half done. The insert
+ * must be dropped (PF_ShadowAbort): the index holds exactly the keys
+ * before it, including those of inserts whose page was not yet written,
+ * and takes the key again once the pool is back.
+ *
+ * Usage: testshadow [n]
+ */
+
+#include "am.h"
+#include "../pflayer/pf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* AM layer functions used */
+extern int AM_CreateIndex(char *fileName,int indexNo,char attrType,int attrLength);
+extern int AM_CreateShadowIndex(char *fileName,int indexNo,char attrType,int attrLength);
+extern int AM_DestroyIndex(char *fileName,int indexNo);
+extern int AM_InsertEntry(int fileDesc,char attrType,int attrLength,char *value,int recId);
+extern int AM_OpenIndexScan(int fileDesc,char attrType,int attrLength,int op,char *value);
+extern int AM_FindNextEntry(int scanDesc);
+extern int AM_CloseIndexScan(int scanDesc);
+extern int AM_PrintError(char *s);
+extern void AM_EmptyStack(void);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+
+#define BASENAME "/tmp/am_shadow"
+#define INDEXNO 0
+#define IDXNAME "/tmp/am_shadow.0"
+
+#define NCRASHKEYS 20000
+#define ABORTKEYS 300	/* the next split adds a level */
+
+#define INPLACE 0	/* modes */
+#define SHADOW 1
+#define SHADOWSYNC 2
+static const char *modes[] = { "in-place", "shadow", "shadow+fsync" };
+
+static void check(int error, const char *what) {
+    if (error < 0) {
+        PF_PrintError((char *)what);
+        exit(1);
+    }
+}
+
+/* keys 0..n-1, shuffled if random */
+static int *make_keys(int n, int random) {
+    int *keys = malloc(n * sizeof(int)), i, j, t;
+    for (i = 0; i < n; i++) keys[i] = i;
+    if (random)
+        for (i = n - 1; i > 0; i--) {
+            j = rand() % (i + 1);
+            t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+        }
+    return keys;
+}
+
+static void create(int mode) {
+    AM_DestroyIndex(BASENAME, INDEXNO);
+    if ((mode == INPLACE ? AM_CreateIndex(BASENAME, INDEXNO, 'i', sizeof(int))
+            : AM_CreateShadowIndex(BASENAME, INDEXNO, 'i', sizeof(int))) != AME_OK) {
+        AM_PrintError("create");
+        exit(1);
+    }
+    AM_ShadowSync = mode == SHADOWSYNC;
+}
+
+static void insert(int fd, int key) {
+    if (AM_InsertEntry(fd, 'i', sizeof(int), (char *)&key, key) != AME_OK) {
+        AM_PrintError("insert");
+        exit(1);
+    }
+}
+
+static void throughput(const char *order, int *keys, int n, int mode) {
+    struct timespec t0, t1, a, b;
+    struct stat sb;
+    long r0, w0, r1, w1;
+    int fd, i, pages, splits = 0;
+    double ms, splitms = 0;
+
+    PF_Init();
+    create(mode);
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    PF_GetIOBytes(&r0, &w0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < n; i++) {
+        pages = PF_GetNumPages(fd);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        insert(fd, keys[i]);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        if (PF_GetNumPages(fd) != pages) {
+            splits++;
+            splitms += PF_MsBetween(a, b);
+        }
+    }
+    check(PF_CloseFile(fd), "close");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    PF_GetIOBytes(&r1, &w1);
+    stat(IDXNAME, &sb);
+    ms = PF_MsBetween(t0, t1);
+    printf("%s,%s,%.0f,%d,%.1f,%.2f,%.1f,%.1f\n", order, modes[mode], n / ms * 1e3,
+        splits, splitms * 1e3 / splits, (ms - splitms) * 1e3 / (n - splits),
+        (w1 - w0) / 1048576.0, sb.st_size / 1048576.0);
+}
+
+/* in the child: insert k keys, then crash in the next split, having
+   written the pages in "mask" of those it changed */
+static void crash_child(int *keys, int k, int mode, int mask, int out) {
+    int fd, i, p, pages, res[2], dirty[32];
+
+    PF_Init();
+    AM_ShadowSync = FALSE;
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    for (i = 0; i < k; i++) insert(fd, keys[i]);
+    check(PF_CloseFile(fd), "close");
+
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    pages = PF_GetNumPages(fd);
+    for (i = k; ; i++) {
+        /* begun here, the update of the split is never committed */
+        if (mode != INPLACE) check(PF_ShadowBegin(fd), "begin");
+        insert(fd, keys[i]);
+        if (PF_GetNumPages(fd) != pages) break;
+        if (mode != INPLACE) check(PF_ShadowCommit(fd, FALSE), "commit");
+        for (p = 0; p < pages; p++) check(PFflushPage(fd, p), "flush");
+    }
+
+    res[0] = i;
+    res[1] = 0;
+    for (p = 0; p < PF_GetNumPages(fd) && res[1] < 32; p++)
+        if (PFbufIsDirty(fd, p)) dirty[res[1]++] = p;
+    for (p = 0; p < res[1]; p++)
+        if (mask & (1 << p)) check(PFflushPage(fd, dirty[p]), "flush");
+    write(out, res, sizeof(res));
+    _exit(0);
+}
+
+/* 1 if the index is a tree of keys[0..k-1], and maybe keys[k..m-1] */
+static int consistent(int *keys, int nkeys, int k, int m) {
+    char *state = calloc(nkeys, 1);	/* 1: may be there, 2: must, 3: found */
+    int fd, sd, id, last = -1, i, ok = 1;
+
+    for (i = 0; i < m; i++) state[keys[i]] = i < k ? 2 : 1;
+    if ((fd = PF_OpenFile(IDXNAME)) < 0) ok = 0;
+    else if ((sd = AM_OpenIndexScan(fd, 'i', sizeof(int), ALL, NULL)) < 0) ok = 0;
+    else {
+        while ((id = AM_FindNextEntry(sd)) >= 0) {
+            if (id <= last || id >= nkeys || state[id] == 0) ok = 0;
+            else state[id] = 3;
+            last = id;
+        }
+        if (id != AME_EOF) ok = 0;
+        AM_CloseIndexScan(sd);
+    }
+    for (i = 0; ok && i < nkeys; i++) {
+        if (state[i] == 2) ok = 0;
+        if (state[i] != 3) continue;
+        /* the scan leaves its search path on the stack */
+        sd = AM_OpenIndexScan(fd, 'i', sizeof(int), EQUAL, (char *)&i);
+        AM_EmptyStack();
+        if (sd < 0 || AM_FindNextEntry(sd) != i) ok = 0;
+        if (sd >= 0) AM_CloseIndexScan(sd);
+    }
+    if (fd >= 0) PF_CloseFile(fd);
+    free(state);
+    return ok;
+}
+
+/* crash at k with pages "mask" written; sets *split and *ndirty */
+static int crash_at(int *keys, int nkeys, int k, int mode, int mask,
+        int *split, int *ndirty) {
+    int status, ok, res[2], p[2];
+    pid_t pid;
+
+    PF_Init();
+    create(mode);
+    if (pipe(p) != 0) exit(1);
+    if ((pid = fork()) == 0) crash_child(keys, k, mode, mask, p[1]);
+    waitpid(pid, &status, 0);
+    ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        read(p[0], res, sizeof(res)) == sizeof(res);
+    close(p[0]);
+    close(p[1]);
+    if (!ok) return 0;
+    *split = res[0];
+    *ndirty = res[1];
+    PF_Init();
+    /* updated in place, the key of the split may be there */
+    return consistent(keys, nkeys, res[0], mode == INPLACE ? res[0] + 1 : res[0]);
+}
+
+/* every crash in the split after k inserts; returns the # broken */
+static int crash(int *keys, int nkeys, int k, int mode) {
+    int split, ndirty, mask, broken = 0;
+
+    broken += !crash_at(keys, nkeys, k, mode, 0, &split, &ndirty);
+    for (mask = 1; mask < (1 << ndirty); mask++)
+        broken += !crash_at(keys, nkeys, k, mode, mask, &split, &ndirty);
+    printf("crash %s k=%d: split at insert %d changed %d pages, %d of %d crashes broken\n",
+        modes[mode], k, split + 1, ndirty, broken, 1 << ndirty);
+    return broken;
+}
+
+/* inserts keys after k with a pool of npool pages until one fails; then
+   with the whole pool the index must be keys[0..i-1], and take key i */
+static int abort_test(int *keys, int nkeys, int k, int npool) {
+    int fd, i, error, ok;
+
+    PF_Init();
+    create(SHADOW);
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    for (i = 0; i < k; i++) insert(fd, keys[i]);
+    check(PF_SetBufferParams(npool, PF_REPL_LRU), "buffers");
+    for (; i < nkeys; i++)
+        if ((error = AM_InsertEntry(fd, 'i', sizeof(int), (char *)&keys[i], keys[i])) != AME_OK)
+            break;
+    check(PF_SetBufferParams(PF_MAX_BUFS, PF_REPL_LRU), "buffers");
+    ok = i < nkeys && PF_ShadowState(fd) == PF_SHADOW_IDLE;
+    ok &= PF_CloseFile(fd) == PFE_OK;
+    ok &= consistent(keys, nkeys, i, i);
+    check(fd = PF_OpenFile(IDXNAME), "open");
+    insert(fd, keys[i]);
+    check(PF_CloseFile(fd), "close");
+    ok &= consistent(keys, nkeys, i + 1, i + 1);
+    printf("abort k=%d pool=%d: insert %d failed (%d), index as before it %s\n",
+        k, npool, i + 1, error, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    static int crashes[] = { 300, 1000, 3000, 10000 };
+    int n = 100000, i, mode, ok = 1, *keys;
+
+    if (argc > 1) n = atoi(argv[1]);
+    printf("order, mode, inserts/sec, splits, us/split, us/other-insert, MB-written, file-MB\n");
+    for (i = 0; i < 2; i++) {
+        srand(1);
+        keys = make_keys(n, i);
+        for (mode = INPLACE; mode <= SHADOWSYNC; mode++)
+            throughput(i ? "random" : "ascending", keys, n, mode);
+        free(keys);
+    }
+
+    printf("\n");
+    srand(2);
+    keys = make_keys(NCRASHKEYS, 1);
+    for (i = 0; i < (int)(sizeof(crashes) / sizeof(crashes[0])); i++) {
+        crash(keys, NCRASHKEYS, crashes[i], INPLACE);
+        ok &= crash(keys, NCRASHKEYS, crashes[i], SHADOW) == 0;
+    }
+    ok &= abort_test(keys, NCRASHKEYS, ABORTKEYS, 1);
+    ok &= abort_test(keys, NCRASHKEYS, ABORTKEYS, 2);
+    free(keys);
+
+    AM_DestroyIndex(BASENAME, INDEXNO);
+    return !ok;
+}
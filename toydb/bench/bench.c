@@ -0,0 +1,493 @@
+/* bench.c
+ * One benchmark driver for the PF, SP and AM layers, with YCSB-style
+ * workloads.
+ *
+ * A run loads `records` fixed-size records into a new file of the target,
+ * reopens it, and times `ops` operations drawn from a workload's mix. Keys
+ * are chosen from one of the distributions below, over the records loaded
+ * plus those inserted so far.
+ *
+ * Targets; a record is RECLEN bytes, key k being the k-th one loaded:
+ *   pf  - records packed into PF pages by key; an operation fixes the
+ *         record's page (PF_GetThisPage) and unfixes it, dirty for writes
+ *   sp  - an SP heap loaded in key order; reads are SP_GetRec by rid,
+ *         updates SP_OverwriteRec, inserts SP_AppendRec
+ *   am  - an AM index of int keys; a read is an EQUAL scan, an update
+ *         replaces the key's recId (AM_DeleteEntry + AM_InsertEntry)
+ * Workloads (read/update/insert/scan/read-modify-write %):
+ *   read-only 100/0/0/0/0, read-update 50/50/0/0/0 (YCSB A),
+ *   scan-heavy 0/0/5/95/0 (YCSB E), insert-heavy 10/0/90/0/0,
+ *   read-modify-write 50/0/0/0/50 (YCSB F)
+ * A scan reads 1..SCANMAX consecutive keys; an AM scan is a
+ * GREATER_THAN_EQUAL scan stopped after that many entries.
+ * Distributions:
+ *   uniform - every key alike
+ *   zipfian - Zipf(THETA) popularity, the hot keys scattered over the
+ *             keyspace by a hash (YCSB's scrambled zipfian)
+ *   latest  - Zipf(THETA) over recency: the newest keys are the hottest
+ *
+ * Each run prints one CSV row:
+ *   target, workload, distribution, records, ops, pool, policy, storage, ops/sec,
+ *   avg-us, p50-us, p95-us, p99-us, p999-us, max-us, logical_reads,
+ *   logical_writes, phys_reads, phys_writes, page_hits, page_misses
+ * the last six being the PFstats deltas of the timed operations. Then come
+ * hardware counts per operation over the same phase (perfctr.h): cycles,
+ * instructions, l1d_misses, llc_misses, branch_misses, dtlb_misses; a
+ * counter that could not be opened is left empty, so without
+ * perf_event_open (or with BENCH_NOPERF set) only the wall times remain.
+ *
+ * Usage: bench [target|all] [workload|all] [distribution|all] [records]
+ *              [ops] [pool] [lru|mru] [out_csv|-] [disk|mem]
+ * out_csv, if given, gets the rows appended as well. With mem the file is
+ * a PF memory file (PF_CreateMemFile): the same page reads and writes,
+ * counted the same, but no disk I/O, leaving the CPU cost of the layers.
+ * With BENCH_TRACE=dumpfile the PF/SP/AM events are traced (pftrace.h),
+ * the last BENCH_TRACE_EVENTS (default 65536) kept and written to dumpfile
+ * at exit; pflayer/pftrace2json turns it into a Chrome trace. With
+ * BENCH_REPORT and/or BENCH_REPORT_PROM set, the stats reporter
+ * (PF_ReportStart) samples to them every BENCH_REPORT_MS (default 100) ms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "pf.h"
+#include "pftypes.h"
+#include "splayer.h"
+#include "am.h"
+#include "perfctr.h"
+
+/* PF and AM layer functions used; char arguments of the K&R definitions
+   are promoted to int */
+extern int PF_CreateFile(char *fname);
+extern int PF_DestroyFile(char *fname);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+extern int AM_CreateIndex(char *fileName, int indexNo, int attrType, int attrLength);
+extern int AM_DestroyIndex(char *fileName, int indexNo);
+extern int AM_InsertEntry(int fileDesc, int attrType, int attrLength, char *value, int recId);
+extern int AM_DeleteEntry(int fileDesc, int attrType, int attrLength, char *value, int recId);
+extern int AM_OpenIndexScan(int fileDesc, int attrType, int attrLength, int op, char *value);
+extern int AM_FindNextEntry(int scanDesc);
+extern int AM_CloseIndexScan(int scanDesc);
+extern void AM_EmptyStack(void);
+
+#define FILENAME "bench_file"
+#define INDEXNO 0
+
+/* FILENAME under /tmp/, or a PF memory file; the index is name.INDEXNO */
+static char filename[64], idxname[72];
+
+#define RECLEN 100      /* bytes per record */
+#define PF_RECS (PF_PAGE_SIZE / RECLEN) /* records per PF page */
+#define SCANMAX 100     /* longest scan, in records */
+#define THETA 0.99      /* Zipf skew, as in YCSB */
+
+enum { T_PF, T_SP, T_AM, NTARGETS };
+enum { D_UNIFORM, D_ZIPFIAN, D_LATEST, NDISTS };
+enum { OP_READ, OP_UPDATE, OP_INSERT, OP_SCAN, OP_RMW, NOPS };
+
+static const char *targets[NTARGETS] = { "pf", "sp", "am" };
+static const char *dists[NDISTS] = { "uniform", "zipfian", "latest" };
+
+static const struct {
+    const char *name;
+    int mix[NOPS];      /* % of each operation */
+} workloads[] = {
+    { "read-only",         { 100, 0, 0, 0, 0 } },
+    { "read-update",       { 50, 50, 0, 0, 0 } },
+    { "scan-heavy",        { 0, 0, 5, 95, 0 } },
+    { "insert-heavy",      { 10, 0, 90, 0, 0 } },
+    { "read-modify-write", { 50, 0, 0, 0, 50 } },
+};
+#define NWORKLOADS ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+/******************** random numbers ********************/
+
+static unsigned long long rng = 88172645463325252ULL;
+
+static unsigned long long next_rand(void) {
+    /* xorshift64* */
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 2685821657736338717ULL;
+}
+
+static double rand01(void) {
+    return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Zipf(THETA) ranks over 0..items-1 (Gray et al., "Quickly generating
+   billion-record synthetic databases"), as in YCSB's ZipfianGenerator.
+   zetan is extended as items grows with inserts. */
+typedef struct {
+    long items;
+    double zetan, zeta2, alpha, eta;
+} zipf_t;
+
+static void zipf_grow(zipf_t *z, long items) {
+    long i;
+    for (i = z->items + 1; i <= items; i++) z->zetan += 1.0 / pow((double)i, THETA);
+    z->items = items;
+    z->eta = (1 - pow(2.0 / items, 1 - THETA)) / (1 - z->zeta2 / z->zetan);
+}
+
+static void zipf_init(zipf_t *z, long items) {
+    z->items = 0;
+    z->zetan = 0;
+    z->zeta2 = 1 + 1 / pow(2.0, THETA);
+    z->alpha = 1 / (1 - THETA);
+    zipf_grow(z, items);
+}
+
+static long zipf_next(zipf_t *z) {
+    double u = rand01(), uz = u * z->zetan;
+    long r;
+
+    if (uz < 1) return 0;
+    if (uz < z->zeta2) return 1;
+    r = (long)(z->items * pow(z->eta * u - z->eta + 1, z->alpha));
+    return r < z->items ? r : z->items - 1;
+}
+
+static unsigned long long fnv64(unsigned long long v) {
+    unsigned long long h = 14695981039346656037ULL;
+    int i;
+    for (i = 0; i < 8; i++) {
+        h = (h ^ (v & 0xff)) * 1099511628211ULL;
+        v >>= 8;
+    }
+    return h;
+}
+
+/* a key among 0..nkeys-1 */
+static long next_key(int dist, zipf_t *z, long nkeys) {
+    switch (dist) {
+    case D_ZIPFIAN:
+        return (long)(fnv64(zipf_next(z)) % nkeys);
+    case D_LATEST:
+        if (z->items < nkeys) zipf_grow(z, nkeys);
+        return nkeys - 1 - zipf_next(z);
+    default:
+        return (long)(next_rand() % nkeys);
+    }
+}
+
+/******************** targets ********************/
+
+typedef struct {
+    int target;
+    int fd;
+    long nkeys;         /* keys 0..nkeys-1 exist */
+    SPRID *rids;        /* sp: rid of each key */
+    int *recids;        /* am: recId of each key */
+    int lastpage;       /* pf: page of the last record */
+    int hint;
+} store_t;
+
+static char rec[RECLEN];
+
+static void fail(const char *what) {
+    PF_PrintError((char *)what);
+    exit(1);
+}
+
+static void make_rec(long key, int version) {
+    memset(rec, 'a' + version % 26, RECLEN);
+    memcpy(rec, &key, sizeof(key));
+}
+
+static void store_create(store_t *s) {
+    PF_DestroyFile(filename);
+    AM_DestroyIndex(filename, INDEXNO);
+    switch (s->target) {
+    case T_PF: if (PF_CreateFile(filename) != PFE_OK) fail("create"); break;
+    case T_SP: if (SP_CreateFile(filename) != PFE_OK) fail("create"); break;
+    case T_AM:
+        if (AM_CreateIndex(filename, INDEXNO, 'i', sizeof(int)) != AME_OK) fail("create");
+        break;
+    }
+}
+
+static void store_open(store_t *s) {
+    if ((s->fd = PF_OpenFile(s->target == T_AM ? idxname : filename)) < 0) fail("open");
+}
+
+static void store_close(store_t *s) {
+    if (PF_CloseFile(s->fd) != PFE_OK) fail("close");
+}
+
+static void store_destroy(store_t *s) {
+    if (s->target == T_AM) AM_DestroyIndex(filename, INDEXNO);
+    else PF_DestroyFile(filename);
+}
+
+static void do_insert(store_t *s) {
+    long key = s->nkeys;
+    int k = (int)key;
+    char *buf;
+
+    make_rec(key, 0);
+    switch (s->target) {
+    case T_PF:
+        if (key % PF_RECS == 0) {
+            if (PF_AllocPage(s->fd, &s->lastpage, &buf) != PFE_OK) fail("alloc");
+        } else if (PF_GetThisPage(s->fd, s->lastpage, &buf) != PFE_OK) fail("get");
+        memcpy(buf + (key % PF_RECS) * RECLEN, rec, RECLEN);
+        PF_UnfixPage(s->fd, s->lastpage, TRUE);
+        break;
+    case T_SP:
+        if (SP_AppendRec(s->fd, rec, RECLEN, &s->rids[key]) != 0) fail("insert");
+        break;
+    case T_AM:
+        s->recids[key] = 2 * k;
+        if (AM_InsertEntry(s->fd, 'i', sizeof(int), (char *)&k, s->recids[key]) != AME_OK)
+            fail("insert");
+        break;
+    }
+    s->nkeys++;
+}
+
+static void do_read(store_t *s, long key) {
+    static char out[RECLEN];
+    int k = (int)key, sd, len;
+    char *buf;
+
+    switch (s->target) {
+    case T_PF:
+        if (PF_GetThisPage(s->fd, key / PF_RECS, &buf) != PFE_OK) fail("get");
+        memcpy(out, buf + (key % PF_RECS) * RECLEN, RECLEN);
+        PF_UnfixPage(s->fd, key / PF_RECS, FALSE);
+        break;
+    case T_SP:
+        if (SP_GetRec(s->fd, s->rids[key], out, RECLEN, &len) != 0) fail("read");
+        break;
+    case T_AM:
+        sd = AM_OpenIndexScan(s->fd, 'i', sizeof(int), EQUAL, (char *)&k);
+        /* the scan leaves its search path on the AM stack */
+        AM_EmptyStack();
+        if (sd < 0 || AM_FindNextEntry(sd) != s->recids[key]) fail("read");
+        AM_CloseIndexScan(sd);
+        break;
+    }
+}
+
+static void do_update(store_t *s, long key) {
+    int k = (int)key;
+    char *buf;
+
+    make_rec(key, 1);
+    switch (s->target) {
+    case T_PF:
+        if (PF_GetThisPage(s->fd, key / PF_RECS, &buf) != PFE_OK) fail("get");
+        memcpy(buf + (key % PF_RECS) * RECLEN, rec, RECLEN);
+        PF_UnfixPage(s->fd, key / PF_RECS, TRUE);
+        break;
+    case T_SP:
+        if (SP_OverwriteRec(s->fd, s->rids[key], 0, rec, RECLEN) != 0) fail("update");
+        break;
+    case T_AM:
+        if (AM_DeleteEntry(s->fd, 'i', sizeof(int), (char *)&k, s->recids[key]) != AME_OK)
+            fail("delete");
+        AM_EmptyStack();
+        s->recids[key] ^= 1;
+        if (AM_InsertEntry(s->fd, 'i', sizeof(int), (char *)&k, s->recids[key]) != AME_OK)
+            fail("insert");
+        break;
+    }
+}
+
+static void do_scan(store_t *s, long key, int len) {
+    int k = (int)key, sd, i;
+
+    if (s->target != T_AM) {
+        for (i = 0; i < len && key + i < s->nkeys; i++) do_read(s, key + i);
+        return;
+    }
+    sd = AM_OpenIndexScan(s->fd, 'i', sizeof(int), GREATER_THAN_EQUAL, (char *)&k);
+    AM_EmptyStack();
+    if (sd < 0) fail("scan");
+    for (i = 0; i < len && AM_FindNextEntry(sd) >= 0; i++)
+        ;
+    AM_CloseIndexScan(sd);
+}
+
+/******************** runs ********************/
+
+static double ns_between(struct timespec a, struct timespec b) {
+    return (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double pct(const double *lat, long n, double p) {
+    long i = (long)(p * n);
+    return lat[i < n ? i : n - 1] / 1e3;
+}
+
+static void run(int target, int w, int dist, long records, long ops, int pool,
+                int policy, int mem, perfctr_t *pc, FILE *csv) {
+    struct timespec t0, t1, a, b;
+    PFstats s0, s1;
+    store_t s;
+    zipf_t z;
+    double *lat, total = 0, ms;
+    long i, key;
+    int op, r, c, n;
+    char line[640];
+
+    memset(&s, 0, sizeof(s));
+    s.target = target;
+    s.rids = malloc((records + ops) * sizeof(SPRID));
+    s.recids = malloc((records + ops) * sizeof(int));
+    lat = malloc(ops * sizeof(double));
+    if (!s.rids || !s.recids || !lat) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+    rng = 88172645463325252ULL;
+    PF_Init();
+    if (PF_SetBufferParams(pool, policy) != PFE_OK) fail("buffer params");
+    store_create(&s);
+    store_open(&s);
+    for (i = 0; i < records; i++) do_insert(&s);
+    /* start from a flushed file */
+    store_close(&s);
+    store_open(&s);
+    zipf_init(&z, records);
+
+    PF_GetStats(&s0);
+    PC_Start(pc);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < ops; i++) {
+        r = (int)(next_rand() % 100);
+        for (op = 0, c = workloads[w].mix[0]; r >= c; c += workloads[w].mix[++op])
+            ;
+        key = op == OP_INSERT ? 0 : next_key(dist, &z, s.nkeys);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        switch (op) {
+        case OP_READ: do_read(&s, key); break;
+        case OP_UPDATE: do_update(&s, key); break;
+        case OP_INSERT: do_insert(&s); break;
+        case OP_SCAN: do_scan(&s, key, 1 + (int)(next_rand() % SCANMAX)); break;
+        case OP_RMW: do_read(&s, key); do_update(&s, key); break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        lat[i] = ns_between(a, b);
+        total += lat[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    PC_Stop(pc);
+    PF_GetStats(&s1);
+    store_close(&s);
+    store_destroy(&s);
+
+    ms = ns_between(t0, t1) / 1e6;
+    qsort(lat, ops, sizeof(double), cmp_double);
+    n = snprintf(line, sizeof(line),
+        "%s,%s,%s,%ld,%ld,%d,%s,%s,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%d,%d,%d,%d,%d,%d",
+        targets[target], workloads[w].name, dists[dist], records, ops, pool,
+        policy == PF_REPL_MRU ? "mru" : "lru", mem ? "mem" : "disk",
+        ops / ms * 1e3, total / ops / 1e3,
+        pct(lat, ops, 0.5), pct(lat, ops, 0.95), pct(lat, ops, 0.99),
+        pct(lat, ops, 0.999), lat[ops - 1] / 1e3,
+        s1.logical_reads - s0.logical_reads, s1.logical_writes - s0.logical_writes,
+        s1.phys_reads - s0.phys_reads, s1.phys_writes - s0.phys_writes,
+        s1.page_hits - s0.page_hits, s1.page_misses - s0.page_misses);
+    for (c = 0; c < PC_NCOUNTERS; c++)
+        n += pc->fd[c] < 0
+            ? snprintf(line + n, sizeof(line) - n, ",")
+            : snprintf(line + n, sizeof(line) - n, ",%.2f", pc->value[c] / ops);
+    snprintf(line + n, sizeof(line) - n, "\n");
+    fputs(line, stdout);
+    fflush(stdout);
+    if (csv) fputs(line, csv);
+    free(s.rids);
+    free(s.recids);
+    free(lat);
+}
+
+/* index of name in names[0..n-1], n for "all", -1 if unknown */
+static int lookup(const char *name, const char *const *names, int n) {
+    int i;
+    if (strcmp(name, "all") == 0) return n;
+    for (i = 0; i < n; i++)
+        if (strcmp(name, names[i]) == 0) return i;
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    const char *wnames[NWORKLOADS];
+    int target = NTARGETS, w = NWORKLOADS, dist = NDISTS;
+    int pool = PF_MAX_BUFS, policy = PF_REPL_LRU, mem = 0, t, wi, d;
+    long records = 100000, ops = 100000;
+    FILE *csv = NULL;
+    perfctr_t pc;
+
+    for (wi = 0; wi < NWORKLOADS; wi++) wnames[wi] = workloads[wi].name;
+    if (argc > 1) target = lookup(argv[1], targets, NTARGETS);
+    if (argc > 2) w = lookup(argv[2], wnames, NWORKLOADS);
+    if (argc > 3) dist = lookup(argv[3], dists, NDISTS);
+    if (argc > 4) records = atol(argv[4]);
+    if (argc > 5) ops = atol(argv[5]);
+    if (argc > 6) pool = atoi(argv[6]);
+    if (argc > 7 && strcmp(argv[7], "mru") == 0) policy = PF_REPL_MRU;
+    if (argc > 9) mem = strcmp(argv[9], "mem") == 0;
+    if (target < 0 || w < 0 || dist < 0 || records < 1 || ops < 1 ||
+        pool < 1 || pool > PF_MAX_BUFS || (argc > 9 && !mem && strcmp(argv[9], "disk") != 0)) {
+        fprintf(stderr, "usage: bench [pf|sp|am|all] [workload|all] "
+            "[uniform|zipfian|latest|all] [records] [ops] [pool 1-%d] [lru|mru] "
+            "[out_csv|-] [disk|mem]\n", PF_MAX_BUFS);
+        return 1;
+    }
+    if (argc > 8 && strcmp(argv[8], "-") != 0 && (csv = fopen(argv[8], "a")) == NULL) {
+        perror(argv[8]);
+        return 1;
+    }
+    snprintf(filename, sizeof(filename), "%s" FILENAME, mem ? PF_MEM_PREFIX : "/tmp/");
+    snprintf(idxname, sizeof(idxname), "%s.%d", filename, INDEXNO);
+
+    if (getenv("BENCH_TRACE"))
+        PF_TraceStart(getenv("BENCH_TRACE_EVENTS") ? atoi(getenv("BENCH_TRACE_EVENTS")) : 0);
+    if ((getenv("BENCH_REPORT") || getenv("BENCH_REPORT_PROM")) &&
+        PF_ReportStart(getenv("BENCH_REPORT"), getenv("BENCH_REPORT_PROM"),
+            getenv("BENCH_REPORT_MS") ? atoi(getenv("BENCH_REPORT_MS")) : 100) != PFE_OK) {
+        PF_PrintError((char *)"bench: stats reporter");
+        return 1;
+    }
+    if (PC_Open(&pc) == 0)
+        fprintf(stderr, "bench: no hardware counters, reporting wall time only\n");
+    printf("target,workload,distribution,records,ops,pool,policy,storage,ops/sec,avg-us,"
+        "p50-us,p95-us,p99-us,p999-us,max-us,logical_reads,logical_writes,"
+        "phys_reads,phys_writes,page_hits,page_misses");
+    for (t = 0; t < PC_NCOUNTERS; t++) printf(",%s/op", PC_names[t]);
+    printf("\n");
+    for (t = 0; t < NTARGETS; t++) {
+        if (target != NTARGETS && t != target) continue;
+        for (wi = 0; wi < NWORKLOADS; wi++) {
+            if (w != NWORKLOADS && wi != w) continue;
+            for (d = 0; d < NDISTS; d++) {
+                if (dist != NDISTS && d != dist) continue;
+                run(t, wi, d, records, ops, pool, policy, mem, &pc, csv);
+            }
+        }
+    }
+    PC_Close(&pc);
+    if (csv) fclose(csv);
+    if (getenv("BENCH_REPORT") || getenv("BENCH_REPORT_PROM")) PF_ReportStop();
+    if (getenv("BENCH_TRACE") && PF_TraceDump(getenv("BENCH_TRACE")) != PFE_OK) {
+        fprintf(stderr, "bench: cannot write %s\n", getenv("BENCH_TRACE"));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,471 @@
+/* micro.c
+ * Microbenchmarks of the kernels under the PF, SP and AM layers, each on
+ * its own data in memory, without files or I/O, so that a change to one
+ * kernel can be measured in isolation.
+ *
+ * Kernels; size is what the cost should grow with:
+ *   hash-find      PFhashFind of present pages     size: entries in table
+ *   hash-insert    PFhashInsert of new pages       size: entries before
+ *   hash-delete    PFhashDelete of those pages     size: entries after
+ *   buf-hit        PFbufGet + PFbufUnfix of a      size: pages in pool
+ *                  resident page
+ *   buf-miss       the same, every get a miss      size: pool; 2 * pool
+ *                  evicting the LRU page            pages are cycled
+ *   am-binsearch   AM_BinSearch in an internal     size: keys in node
+ *                  node of int keys
+ *   am-searchleaf  AM_SearchLeaf in a leaf         size: keys in leaf
+ *   am-insertleaf  AM_InsertToLeafNotFound at      size: keys shifted
+ *                  index 1, shifting every key
+ *   am-compact     AM_Compact of a whole leaf      size: keys in leaf
+ *   sp-slot        SP_PageRec of every slot of     size: slots in page
+ *                  an SP page
+ * Lookups go through the keys in a fixed random order. The buffer
+ * kernels use a file descriptor with no file behind it and read and write
+ * functions that do nothing, so a miss costs the replacement and the hash
+ * table but no copy. am-insertleaf resets the leaf's header before each
+ * insert, so every insert shifts the same keys.
+ *
+ * Each kernel and size is run for WARMUP_MS, then timed REPS times, a
+ * repetition being as many rounds as take REP_MS. A round does NPROBES
+ * ops or more between two clock readings, except in hash-insert and
+ * hash-delete, which time the size's inserts or deletes of a round and
+ * subtract the cost of reading the clock. Output,
+ * one CSV row per kernel and size:
+ *   kernel, size, reps, ops/rep, ns/op-min, ns/op-median
+ * the op being the call above (with its PFbufUnfix for buf-*).
+ *
+ * Usage: micro [kernel|all] [reps] [out_csv|-]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pf.h"
+#include "pftypes.h"
+#include "splayer.h"
+#include "am.h"
+
+/* AM layer functions used; char arguments of the K&R definitions are
+   promoted to int */
+extern int AM_BinSearch(char *pageBuf, int attrType, int attrLength, char *value,
+                        int *indexPtr, AM_INTHEADER *header);
+extern int AM_SearchLeaf(char *pageBuf, int attrType, int attrLength, char *value,
+                         int *indexPtr, AM_LEAFHEADER *header);
+extern int AM_InsertintoLeaf(char *pageBuf, int attrLength, char *value, int recId,
+                             int index, int status);
+extern int AM_InsertToLeafNotFound(char *pageBuf, char *value, int recId, int index,
+                                   AM_LEAFHEADER *header);
+extern int AM_Compact(int low, int high, char *pageBuf, char *tempPage,
+                      AM_LEAFHEADER *header);
+extern int PF_CreateFile(char *fname);
+extern int PF_DestroyFile(char *fname);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+
+#define WARMUP_MS 20
+#define REP_MS 10
+#define REPS 7
+#define MAXSIZES 4
+#define NPROBES 1024    /* lookups per round of the search kernels */
+#define BUF_FD 0        /* file descriptor of the buffer kernels */
+#define SP_FILE "/tmp/micro_sp"
+
+static volatile long sink;      /* keeps results alive */
+
+static void fail(const char *what) {
+    fprintf(stderr, "micro: %s failed\n", what);
+    exit(1);
+}
+
+static double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* ns between two now_ns() calls with nothing in between, the least of many */
+static double clock_cost;
+
+static void calibrate_clock(void) {
+    double t0, t1;
+    int i;
+    clock_cost = 1e9;
+    for (i = 0; i < 10000; i++) {
+        t0 = now_ns();
+        t1 = now_ns();
+        if (t1 - t0 < clock_cost) clock_cost = t1 - t0;
+    }
+}
+
+/* times to go over n items in a round, for NPROBES ops or more, so that
+   the clock is read once per NPROBES ops at most */
+static int rounds(long n) {
+    return (int)((NPROBES + n - 1) / n);
+}
+
+/* a random permutation of 0..n-1, the same each run */
+static unsigned long long rng = 88172645463325252ULL;
+
+static unsigned long long next_rand(void) {
+    /* xorshift64* */
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 2685821657736338717ULL;
+}
+
+static int *perm;
+
+static void make_perm(long n) {
+    long i, j;
+    int t;
+    free(perm);
+    if (!(perm = malloc((n + 1) * sizeof(int)))) fail("malloc");
+    for (i = 0; i < n; i++) perm[i] = (int)i;
+    for (i = n - 1; i > 0; i--) {
+        j = (long)(next_rand() % (unsigned long long)(i + 1));
+        t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+    }
+}
+
+/******************** PF hash table ********************/
+
+#define HASH_FD 1
+
+static void hash_setup(long n) {
+    long i;
+    PFhashInit();
+    for (i = 0; i < n; i++)
+        if (PFhashInsert(HASH_FD, (int)i, (PFbpage *)(i + 1)) != PFE_OK) fail("PFhashInsert");
+    make_perm(n);
+}
+
+static void hash_teardown(long n) {
+    long i;
+    for (i = 0; i < n; i++) PFhashDelete(HASH_FD, (int)i);
+}
+
+static double hash_find(long n, long *ops) {
+    double t0 = now_ns();
+    long i, s = 0;
+    int k;
+    for (k = 0; k < rounds(n); k++)
+        for (i = 0; i < n; i++) s += (long)PFhashFind(HASH_FD, perm[i]);
+    sink += s;
+    *ops = rounds(n) * n;
+    return now_ns() - t0;
+}
+
+/* n more pages, timing the inserts or the deletes */
+static double hash_insdel(long n, long *ops, int time_insert) {
+    double t0, t1, t2;
+    long i;
+    t0 = now_ns();
+    for (i = 0; i < n; i++) PFhashInsert(HASH_FD, (int)(n + perm[i]), (PFbpage *)1);
+    t1 = now_ns();
+    for (i = 0; i < n; i++) PFhashDelete(HASH_FD, (int)(n + perm[i]));
+    t2 = now_ns();
+    *ops = n;
+    return (time_insert ? t1 - t0 : t2 - t1) - clock_cost;
+}
+
+static double hash_insert(long n, long *ops) { return hash_insdel(n, ops, 1); }
+static double hash_delete(long n, long *ops) { return hash_insdel(n, ops, 0); }
+
+/******************** PF buffer manager ********************/
+
+static int nop_read(int fd, int pagenum, PFfpage *fpage) {
+    (void)fd; (void)pagenum; (void)fpage;
+    return PFE_OK;
+}
+
+static int nop_write(int fd, int pagenum, PFfpage *fpage) {
+    (void)fd; (void)pagenum; (void)fpage;
+    return PFE_OK;
+}
+
+static long buf_pages;  /* pages cycled through */
+
+static double buf_round(long n, long *ops) {
+    PFfpage *fpage;
+    double t0 = now_ns();
+    long i;
+    int k;
+    for (k = 0; k < rounds(buf_pages); k++)
+        for (i = 0; i < buf_pages; i++) {
+            if (PFbufGet(BUF_FD, perm[i], &fpage, nop_read, nop_write) != PFE_OK)
+                fail("PFbufGet");
+            sink += fpage->pagebuf[0];
+            PFbufUnfix(BUF_FD, perm[i], FALSE);
+        }
+    (void)n;
+    *ops = rounds(buf_pages) * buf_pages;
+    return now_ns() - t0;
+}
+
+static void buf_setup(long pool, long pages) {
+    long ops;
+    PF_Init();
+    if (PF_SetBufferParams((int)pool, PF_REPL_LRU) != PFE_OK) fail("PF_SetBufferParams");
+    buf_pages = pages;
+    make_perm(pages);
+    if (pages > pool) {
+        /* in order, so that LRU always evicts the page needed next */
+        long i;
+        for (i = 0; i < pages; i++) perm[i] = (int)i;
+    }
+    buf_round(pool, &ops);
+}
+
+static void buf_hit_setup(long n) { buf_setup(n, n); }
+static void buf_miss_setup(long n) { buf_setup(n, 2 * n); }
+
+static void buf_teardown(long n) {
+    (void)n;
+    PFbufReleaseFile(BUF_FD, nop_write);
+}
+
+/******************** AM nodes ********************/
+
+static char node[PF_PAGE_SIZE], leaf[PF_PAGE_SIZE], work[PF_PAGE_SIZE];
+static int probes[NPROBES];
+
+/* the keys are 10, 20, ...; probes hit a key or fall between two */
+static void make_probes(long n) {
+    int i;
+    for (i = 0; i < NPROBES; i++) probes[i] = (int)(next_rand() % (unsigned long long)(10 * n + 10));
+}
+
+/* an internal node of n keys; its pointers are 0..n */
+static void node_setup(long n) {
+    AM_INTHEADER h;
+    int i, key;
+    memset(node, 0, sizeof(node));
+    h.pageType = 'i';
+    h.numKeys = (short)n;
+    h.maxKeys = (short)n;
+    h.attrLength = AM_si;
+    memcpy(node, &h, AM_sint);
+    for (i = 0; i <= n; i++) {
+        memcpy(node + AM_sint + i * (AM_si + AM_si), &i, AM_si);
+        key = 10 * (i + 1);
+        if (i < n) memcpy(node + AM_sint + AM_si + i * (AM_si + AM_si), &key, AM_si);
+    }
+    make_probes(n);
+}
+
+/* a leaf as AM_CreateIndex makes it, then the keys 10..10n appended;
+   returns the keys it holds, fewer than n if n do not fit */
+static long leaf_fill(char *page, long n) {
+    AM_LEAFHEADER h;
+    long i;
+    int key;
+    memset(page, 0, PF_PAGE_SIZE);
+    h.pageType = 'l';
+    h.nextLeafPage = AM_NULL_PAGE;
+    h.recIdPtr = PF_PAGE_SIZE;
+    h.keyPtr = AM_sl;
+    h.freeListPtr = AM_NULL;
+    h.numinfreeList = 0;
+    h.attrLength = AM_si;
+    h.numKeys = 0;
+    h.maxKeys = (PF_PAGE_SIZE - AM_sint - AM_si) / (AM_si + AM_si) & ~1;
+    memcpy(page, &h, AM_sl);
+    for (i = 0; i < n; i++) {
+        key = (int)(10 * (i + 1));
+        if (!AM_InsertintoLeaf(page, AM_si, (char *)&key, (int)i, (int)(i + 1), AM_NOT_FOUND))
+            return i;
+    }
+    return n;
+}
+
+static void leaf_setup(long n) {
+    if (leaf_fill(leaf, n) != n) fail("leaf too small for size");
+    memcpy(work, leaf, PF_PAGE_SIZE);
+    make_probes(n);
+}
+
+static double am_binsearch(long n, long *ops) {
+    AM_INTHEADER h;
+    double t0;
+    long s = 0;
+    int i, index;
+    memcpy(&h, node, AM_sint);
+    t0 = now_ns();
+    for (i = 0; i < NPROBES; i++)
+        s += AM_BinSearch(node, 'i', AM_si, (char *)&probes[i], &index, &h) + index;
+    sink += s;
+    (void)n;
+    *ops = NPROBES;
+    return now_ns() - t0;
+}
+
+static double am_searchleaf(long n, long *ops) {
+    AM_LEAFHEADER h;
+    double t0;
+    long s = 0;
+    int i, index;
+    memcpy(&h, leaf, AM_sl);
+    t0 = now_ns();
+    for (i = 0; i < NPROBES; i++)
+        s += AM_SearchLeaf(leaf, 'i', AM_si, (char *)&probes[i], &index, &h) + index;
+    sink += s;
+    (void)n;
+    *ops = NPROBES;
+    return now_ns() - t0;
+}
+
+static double am_insertleaf(long n, long *ops) {
+    AM_LEAFHEADER h;
+    double t0 = now_ns();
+    int i, key = 5;
+    for (i = 0; i < NPROBES; i++) {
+        memcpy(&h, leaf, AM_sl);
+        AM_InsertToLeafNotFound(work, (char *)&key, i, 1, &h);
+    }
+    sink += work[AM_sl];
+    (void)n;
+    *ops = NPROBES;
+    return now_ns() - t0;
+}
+
+static double am_compact(long n, long *ops) {
+    AM_LEAFHEADER h;
+    double t0;
+    int i;
+    memcpy(&h, leaf, AM_sl);
+    t0 = now_ns();
+    for (i = 0; i < 16; i++) AM_Compact(1, (int)n, leaf, work, &h);
+    sink += work[AM_sl];
+    *ops = 16;
+    return now_ns() - t0;
+}
+
+/******************** SP pages ********************/
+
+static char sppage[PF_PAGE_SIZE];
+
+/* a page of n records, as SP_AppendRec leaves it */
+static void sp_setup(long n) {
+    char rec[PF_PAGE_SIZE], *pagebuf;
+    int fd, reclen, i;
+    /* the page holds n slots of 8 bytes and n records, after its two ints */
+    reclen = (int)((PF_PAGE_SIZE - 2 * sizeof(int)) / n - 2 * sizeof(int));
+    memset(rec, 'r', sizeof(rec));
+    PF_Init();
+    PF_DestroyFile(SP_FILE);
+    if (SP_CreateFile(SP_FILE) != PFE_OK || (fd = SP_OpenFile(SP_FILE)) < 0) fail("SP_OpenFile");
+    for (i = 0; i < n; i++)
+        if (SP_AppendRec(fd, rec, reclen, NULL) != 0) fail("SP_AppendRec");
+    if (PF_GetThisPage(fd, 0, &pagebuf) != PFE_OK) fail("PF_GetThisPage");
+    memcpy(sppage, pagebuf, PF_PAGE_SIZE);
+    PF_UnfixPage(fd, 0, FALSE);
+    SP_CloseFile(fd);
+    PF_DestroyFile(SP_FILE);
+    if (!SP_PageRec(sppage, (int)n - 1, &reclen)) fail("page too small for size");
+}
+
+static double sp_slot(long n, long *ops) {
+    double t0 = now_ns();
+    long s = 0;
+    int i, k, reclen;
+    char *rec;
+    for (k = 0; k < rounds(n); k++)
+        for (i = 0; i < n; i++)
+            if ((rec = SP_PageRec(sppage, i, &reclen))) s += rec[0] + reclen;
+    sink += s;
+    *ops = rounds(n) * n;
+    return now_ns() - t0;
+}
+
+/******************** driver ********************/
+
+static const struct kernel {
+    const char *name;
+    void (*setup)(long size);
+    double (*round)(long size, long *ops); /* ns measured, *ops done */
+    void (*teardown)(long size);
+    long sizes[MAXSIZES];                   /* 0-terminated */
+} kernels[] = {
+    { "hash-find",     hash_setup,     hash_find,     hash_teardown, { 16, 256, 4096 } },
+    { "hash-insert",   hash_setup,     hash_insert,   hash_teardown, { 16, 256, 4096 } },
+    { "hash-delete",   hash_setup,     hash_delete,   hash_teardown, { 16, 256, 4096 } },
+    { "buf-hit",       buf_hit_setup,  buf_round,     buf_teardown,  { 1, 5, 20 } },
+    { "buf-miss",      buf_miss_setup, buf_round,     buf_teardown,  { 1, 5, 20 } },
+    { "am-binsearch",  node_setup,     am_binsearch,  NULL,          { 8, 64, 510 } },
+    { "am-searchleaf", leaf_setup,     am_searchleaf, NULL,          { 8, 64, 330 } },
+    { "am-insertleaf", leaf_setup,     am_insertleaf, NULL,          { 8, 64, 320 } },
+    { "am-compact",    leaf_setup,     am_compact,    NULL,          { 8, 64, 330 } },
+    { "sp-slot",       sp_setup,       sp_slot,       NULL,          { 8, 64, 256 } },
+};
+#define NKERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* one rep: rounds until REP_MS of measured time; returns ns/op */
+static double rep(const struct kernel *k, long size, long *ops) {
+    double ns = 0;
+    long n;
+    *ops = 0;
+    while (ns < REP_MS * 1e6) {
+        ns += k->round(size, &n);
+        *ops += n;
+    }
+    return ns / *ops;
+}
+
+static void run(const struct kernel *k, long size, int reps, FILE *out) {
+    double nsop[64], t0;
+    long ops, n;
+    int r;
+    char row[160];
+
+    k->setup(size);
+    for (t0 = now_ns(); now_ns() - t0 < WARMUP_MS * 1e6; )
+        k->round(size, &n);
+    for (r = 0; r < reps; r++) nsop[r] = rep(k, size, &ops);
+    if (k->teardown) k->teardown(size);
+    qsort(nsop, reps, sizeof(double), cmp_double);
+    snprintf(row, sizeof(row), "%s,%ld,%d,%ld,%.2f,%.2f\n",
+        k->name, size, reps, ops, nsop[0], nsop[reps / 2]);
+    fputs(row, stdout);
+    fflush(stdout);
+    if (out) fputs(row, out);
+}
+
+int main(int argc, char **argv) {
+    const char *which = argc > 1 ? argv[1] : "all";
+    int reps = argc > 2 ? atoi(argv[2]) : REPS;
+    FILE *out = NULL;
+    int i, j, found = 0;
+
+    if (reps < 1 || reps > 64) {
+        fprintf(stderr, "micro: reps must be 1..64\n");
+        return 2;
+    }
+    if (argc > 3 && strcmp(argv[3], "-") != 0 && !(out = fopen(argv[3], "a"))) {
+        perror(argv[3]);
+        return 1;
+    }
+    PF_Init();
+    calibrate_clock();
+    printf("kernel,size,reps,ops/rep,ns/op-min,ns/op-median\n");
+    for (i = 0; i < NKERNELS; i++) {
+        if (strcmp(which, "all") != 0 && strcmp(which, kernels[i].name) != 0) continue;
+        found = 1;
+        for (j = 0; j < MAXSIZES && kernels[i].sizes[j]; j++)
+            run(&kernels[i], kernels[i].sizes[j], reps, out);
+    }
+    if (!found) {
+        fprintf(stderr, "usage: micro [kernel|all] [reps] [out_csv|-]\nkernels:");
+        for (i = 0; i < NKERNELS; i++) fprintf(stderr, " %s", kernels[i].name);
+        fprintf(stderr, "\n");
+        return 2;
+    }
+    if (out) fclose(out);
+    return 0;
+}
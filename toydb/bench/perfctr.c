@@ -0,0 +1,117 @@
+/* perfctr.c
+ * Hardware performance counters for the benchmark drivers; see perfctr.h.
+ *
+ * Each counter is opened on its own rather than as one group, so that a
+ * CPU lacking, say, a dTLB event still reports the others. With more
+ * counters than the PMU has registers the kernel multiplexes them; the
+ * counts are then scaled by time enabled / time running.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *const PC_names[PC_NCOUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+    "dtlb_misses"
+};
+
+#ifdef __linux__
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} events[PC_NCOUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+};
+
+int PC_Open(perfctr_t *pc) {
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    for (i = 0; i < PC_NCOUNTERS; i++) {
+        pc->fd[i] = -1;
+        pc->value[i] = 0;
+    }
+    if (getenv("BENCH_NOPERF")) return 0;
+    for (i = 0; i < PC_NCOUNTERS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        /* user space only: allowed at the default perf_event_paranoid */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        pc->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (pc->fd[i] >= 0) n++;
+    }
+    return n;
+}
+
+void PC_Start(perfctr_t *pc) {
+    int i;
+    for (i = 0; i < PC_NCOUNTERS; i++) {
+        if (pc->fd[i] < 0) continue;
+        ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void PC_Stop(perfctr_t *pc) {
+    unsigned long long v[3];    /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PC_NCOUNTERS; i++)
+        if (pc->fd[i] >= 0) ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PC_NCOUNTERS; i++) {
+        pc->value[i] = 0;
+        if (pc->fd[i] < 0) continue;
+        if (read(pc->fd[i], v, sizeof(v)) != sizeof(v)) continue;
+        if (v[2] == 0) continue;            /* never scheduled */
+        pc->value[i] = v[2] < v[1] ? (double)v[0] * v[1] / v[2] : (double)v[0];
+    }
+}
+
+void PC_Close(perfctr_t *pc) {
+    int i;
+    for (i = 0; i < PC_NCOUNTERS; i++) {
+        if (pc->fd[i] >= 0) close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+}
+
+#else
+
+int PC_Open(perfctr_t *pc) {
+    int i;
+    for (i = 0; i < PC_NCOUNTERS; i++) {
+        pc->fd[i] = -1;
+        pc->value[i] = 0;
+    }
+    return 0;
+}
+
+void PC_Start(perfctr_t *pc) { (void)pc; }
+void PC_Stop(perfctr_t *pc) { (void)pc; }
+void PC_Close(perfctr_t *pc) { (void)pc; }
+
+#endif
@@ -0,0 +1,34 @@
+/* perfctr.h
+ * Hardware performance counters around a measured phase, through Linux
+ * perf_event_open. Counters the kernel, the CPU or the permissions do not
+ * allow are left out; with none at all only wall time is reported.
+ */
+
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#define PC_CYCLES       0
+#define PC_INSTRUCTIONS 1
+#define PC_L1D_MISSES   2
+#define PC_LLC_MISSES   3
+#define PC_BRANCH_MISSES 4
+#define PC_DTLB_MISSES  5
+#define PC_NCOUNTERS    6
+
+/* CSV column names, in PC_* order */
+extern const char *const PC_names[PC_NCOUNTERS];
+
+typedef struct {
+    int fd[PC_NCOUNTERS];               /* -1 if not available */
+    double value[PC_NCOUNTERS];         /* last phase, scaled for multiplexing */
+} perfctr_t;
+
+/* open the counters of the calling thread, user space only; returns how
+   many opened (0 on other systems, or with BENCH_NOPERF set) */
+int PC_Open(perfctr_t *pc);
+void PC_Start(perfctr_t *pc);
+/* stop, and read the counts since PC_Start into pc->value */
+void PC_Stop(perfctr_t *pc);
+void PC_Close(perfctr_t *pc);
+
+#endif
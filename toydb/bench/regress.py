@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+regress.py
+
+Performance regression gate. Runs a fixed suite of `bench`, `test_task3` and
+`testpf_policy` cases, repeats it, and compares the medians against a
+checked-in baseline (baseline.csv). Exits 1 if any metric regressed beyond
+its threshold, 2 if a case failed or has no baseline.
+
+Usage: python3 regress.py                      # run and compare, 5 repeats
+       python3 regress.py --repeat 9 --throughput 0.15 --p99 0.3 --io 0
+       python3 regress.py --update             # rewrite baseline.csv from this machine
+
+Metrics per case:
+  ops/sec        bench throughput; a drop beyond --throughput regresses
+  p99-us         bench p99 latency; a rise beyond --p99 (and --p99-floor us)
+  build-time-ms  test_task3 build time; a rise beyond --build-time (and --build-floor ms)
+  phys_io        phys_reads + phys_writes; a rise beyond --io (and --io-floor pages)
+Physical I/O is deterministic for a given build, since the drivers use fixed
+seeds, so its threshold is the tightest. The timings depend on the machine:
+regenerate the baseline with --update when moving to another one.
+"""
+import subprocess
+import argparse
+import csv
+import os
+import statistics
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TOYDB = os.path.dirname(HERE)
+DATA = os.path.join(TOYDB, '..', 'data', 'student.txt')
+
+# bench cases: target, workload, distribution, records, ops, pool, policy
+BENCH = [
+    ('pf', 'read-update', 'zipfian', 50000, 50000, 20, 'lru'),
+    ('pf', 'scan-heavy', 'uniform', 50000, 20000, 20, 'lru'),
+    ('sp', 'read-update', 'zipfian', 50000, 50000, 20, 'lru'),
+    ('sp', 'read-modify-write', 'latest', 50000, 50000, 20, 'lru'),
+    ('am', 'read-only', 'zipfian', 50000, 50000, 20, 'lru'),
+    ('am', 'insert-heavy', 'uniform', 50000, 50000, 20, 'lru'),
+    ('am', 'scan-heavy', 'zipfian', 50000, 20000, 20, 'mru'),
+]
+# test_task3 sizes; each gives the unsorted, sorted and random builds
+TASK3 = [17000]
+# testpf_policy cases: pool, policy, ops, pages, write_frac, pattern
+POLICY = [
+    (10, 'LRU', 20000, 200, 0.3, 'loop'),
+    (10, 'MRU', 20000, 200, 0.3, 'loop'),
+    (10, 'LRU', 20000, 200, 0.3, 'zipf'),
+    (10, 'MRU', 20000, 200, 0.3, 'scan:0.9'),
+]
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--repeat', type=int, default=5, help='runs of the suite; medians are compared')
+parser.add_argument('--baseline', type=str, default=os.path.join(HERE, 'baseline.csv'), help='baseline CSV')
+parser.add_argument('--update', action='store_true', help='write the medians to the baseline instead of comparing')
+parser.add_argument('--throughput', type=float, default=0.25, help='allowed ops/sec drop (fraction)')
+parser.add_argument('--p99', type=float, default=0.5, help='allowed p99 latency rise (fraction)')
+parser.add_argument('--p99-floor', type=float, default=2.0, help='p99 rises below this many us are ignored')
+parser.add_argument('--build-time', type=float, default=0.5, help='allowed test_task3 build time rise (fraction)')
+parser.add_argument('--build-floor', type=float, default=5.0, help='build time rises below this many ms are ignored')
+parser.add_argument('--io', type=float, default=0.05, help='allowed physical I/O rise (fraction)')
+parser.add_argument('--io-floor', type=float, default=2.0, help='I/O rises below this many pages are ignored')
+parser.add_argument('--no-build', action='store_true', help='do not run make first')
+args = parser.parse_args()
+
+# metric -> (higher is better, relative threshold, absolute floor)
+RULES = {
+    'ops/sec': (True, args.throughput, 0.0),
+    'p99-us': (False, args.p99, args.p99_floor),
+    'build-time-ms': (False, args.build_time, args.build_floor),
+    'phys_io': (False, args.io, args.io_floor),
+}
+
+
+def run(cmd, cwd):
+    proc = subprocess.run(cmd, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if proc.returncode != 0:
+        raise RuntimeError('%s failed (rc=%d)\n%s' % (' '.join(cmd), proc.returncode, proc.stderr))
+    return proc.stdout
+
+
+def build():
+    run(['make', '-s', 'pflayer.o', 'testpf_policy'], os.path.join(TOYDB, 'pflayer'))
+    run(['make', '-s', 'amlayer.a', 'test_task3'], os.path.join(TOYDB, 'amlayer'))
+    run(['make', '-s'], HERE)
+
+
+def run_suite():
+    """one pass of the suite: {(case, metric): value}"""
+    res = {}
+    for c in BENCH:
+        out = run([os.path.join(HERE, 'bench')] + [str(x) for x in c], HERE)
+        rows = list(csv.DictReader(out.splitlines()))
+        if len(rows) != 1:
+            raise RuntimeError('bench %s: expected one row' % ' '.join(map(str, c)))
+        r = rows[0]
+        case = 'bench:' + '/'.join(str(x) for x in c)
+        res[(case, 'ops/sec')] = float(r['ops/sec'])
+        res[(case, 'p99-us')] = float(r['p99-us'])
+        res[(case, 'phys_io')] = float(r['phys_reads']) + float(r['phys_writes'])
+    for n in TASK3:
+        out = run([os.path.join(TOYDB, 'amlayer', 'test_task3'), str(n), DATA],
+                  os.path.join(TOYDB, 'amlayer'))
+        lines = [l.strip() for l in out.splitlines() if l.strip()]
+        start = next(i for i, l in enumerate(lines) if l.startswith('Method,')) + 1
+        for l in lines[start:start + 3]:
+            p = [x.strip() for x in l.split(',')]
+            case = 'task3:%s/%d' % (p[0], n)
+            res[(case, 'build-time-ms')] = float(p[1])
+            res[(case, 'phys_io')] = float(p[2]) + float(p[3])
+    for c in POLICY:
+        pool, policy, ops, pages, wf, pattern = c
+        out = run([os.path.join(TOYDB, 'pflayer', 'testpf_policy'), str(pool), policy, str(ops),
+                   str(pages), str(wf), '-', pattern], os.path.join(TOYDB, 'pflayer'))
+        kv = dict(f.split('=', 1) for f in out.strip().splitlines()[-1].split(','))
+        case = 'policy:' + '/'.join(str(x) for x in c)
+        res[(case, 'phys_io')] = float(kv['phys_reads']) + float(kv['phys_writes'])
+    return res
+
+
+def check(metric, base, cur):
+    """'ok', 'better' or 'REGRESSED', and the relative change"""
+    higher, thr, floor = RULES[metric]
+    change = (cur - base) / base if base else (0.0 if cur == base else float('inf'))
+    worse = base - cur if higher else cur - base
+    if worse > floor and (worse / base if base else float('inf')) > thr:
+        return 'REGRESSED', change
+    if -worse > floor and (-worse / base if base else 0) > thr:
+        return 'better', change
+    return 'ok', change
+
+
+def main():
+    if not args.no_build:
+        build()
+    runs = []
+    for i in range(args.repeat):
+        print('run %d/%d...' % (i + 1, args.repeat), file=sys.stderr)
+        runs.append(run_suite())
+    med = {k: statistics.median(r[k] for r in runs) for k in runs[0]}
+
+    if args.update:
+        with open(args.baseline, 'w', newline='') as f:
+            w = csv.writer(f)
+            w.writerow(['case', 'metric', 'value'])
+            for (case, metric), v in med.items():
+                w.writerow([case, metric, '%.2f' % v])
+        print('wrote %d metrics to %s' % (len(med), args.baseline))
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print('no baseline at %s; create one with --update' % args.baseline)
+        return 2
+    with open(args.baseline, newline='') as f:
+        base = {(r['case'], r['metric']): float(r['value']) for r in csv.DictReader(f)}
+
+    rows = [('case', 'metric', 'baseline', 'current', 'change', 'status')]
+    bad = missing = 0
+    for key, cur in med.items():
+        if key not in base:
+            rows.append((key[0], key[1], '-', '%.2f' % cur, '-', 'NO BASELINE'))
+            missing += 1
+            continue
+        status, change = check(key[1], base[key], cur)
+        bad += status == 'REGRESSED'
+        rows.append((key[0], key[1], '%.2f' % base[key], '%.2f' % cur, '%+.1f%%' % (100 * change), status))
+    widths = [max(len(r[c]) for r in rows) for c in range(len(rows[0]))]
+    for r in rows:
+        print(' | '.join(r[c].ljust(widths[c]) for c in range(len(r))))
+    print('\n%d metrics, %d regressed, %d without baseline (median of %d runs)'
+          % (len(med), bad, missing, args.repeat))
+    if bad:
+        return 1
+    return 2 if missing else 0
+
+
+if __name__ == '__main__':
+    try:
+        sys.exit(main())
+    except RuntimeError as e:
+        print('ERROR:', e)
+        sys.exit(2)
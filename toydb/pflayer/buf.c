@@ -4,6 +4,7 @@ PFbufPrint() */
 #include <stdio.h>
 #include "pf.h"
 #include "pftypes.h"
+#include "pftrace.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -17,6 +18,24 @@ static int PF_config_policy = PF_REPL_LRU; /* default policy */
 
 /* stats */
 static PFstats PF_stats; 
+static struct {
+	int	open;		/* TRUE while the fd is open */
+	char	name[PF_STATS_NAMELEN];	/* its file name, maybe cut short */
+	PFstats	st;		/* PF_stats of its pages since it was opened */
+} PFfstats[PF_FTAB_SIZE];
+#define PFcount(fd,counter) (PF_stats.counter++, PFfstats[fd].st.counter++)
+
+/* pool occupancy, kept as pages change state so that PF_GetPoolStats()
+need not walk the pool */
+static int PFnumfree = 0;	/* # of buffer pages in the free list */
+static int PFnumfixed = 0;	/* # of used buffer pages fixed */
+static int PFnumdirty = 0;	/* # of used buffer pages dirty */
+#define PFsetFixed(bpage,v) { \
+	if (!(bpage)->fixed != !(v)) PFnumfixed += (v) ? 1 : -1; \
+	(bpage)->fixed = (v); }
+#define PFsetDirty(bpage,v) { \
+	if (!(bpage)->dirty != !(v)) PFnumdirty += (v) ? 1 : -1; \
+	(bpage)->dirty = (v); }
 
 // extern char *malloc(); // Removed to avoid implicit declaration
 
@@ -25,12 +44,22 @@ PFbpage *bpage;
 /****************************************************************************
 SPECIFICATIONS:
 	Insert the buffer page pointed by "bpage" into the free list.
+	If the pool holds more pages than PF_SetBufferParams() now
+	allows, the page is freed instead, so that a pool shrunk while
+	its pages were in use comes down to the new size.
 
 AUTHOR: clc
 *****************************************************************************/
 {
+	if (PFnumbpage > PF_config_maxbufs){
+		free((char *)bpage->before);
+		free((char *)bpage);
+		PFnumbpage--;
+		return;
+	}
 	bpage->nextpage = PFfreebpage;
 	PFfreebpage = bpage;
+	PFnumfree++;
 }
 
 
@@ -139,18 +168,21 @@ int error;		/* error value returned*/
 		/* Free list not empty, use the one from the free list. */
 		*bpage = PFfreebpage;
 		PFfreebpage = (*bpage)->nextpage;
+		PFnumfree--;
 	}
 	 else if (PFnumbpage < PF_config_maxbufs){
 		/* We have not reached max buffer limit, so
 		malloc() a new one */
 		if ((*bpage=(PFbpage *)malloc(sizeof(PFbpage)))==NULL){
 			/* no mem */
-			*bpage = NULL;
 			PFerrno = PFE_NOMEM;
 			return(PFerrno);
 		}
+		/* allocated by PFbufBefore() if the page is logged */
+		(*bpage)->before = NULL;
 		/* increment # of pages allocated */
 		PFnumbpage++;
+		(*bpage)->fixed = (*bpage)->dirty = FALSE;
 	}
 	else {
 		/* we have reached max buffer limit */
@@ -176,13 +208,21 @@ int error;		/* error value returned*/
 			PFerrno = PFE_NOBUF;
 			return(PFerrno);
 		}
+		PF_TRACE(buf_evict,tbpage->fd,tbpage->page);
 
-		/* write out the dirty page, if any */
+		/* write out the dirty page, if any, after the log
+		records of its changes */
 		if (tbpage->dirty) {
-			if ((error = (*writefcn)(tbpage->fd, tbpage->page, &tbpage->fpage)) != PFE_OK)
+			if ((error=PFlogFlush(tbpage->fpage.lsn)) != PFE_OK)
+				return(error);
+			PF_TRACE_BEGIN(page_write,tbpage->fd,tbpage->page);
+			error = (*writefcn)(tbpage->fd, tbpage->page, &tbpage->fpage);
+			PF_TRACE_END(page_write,tbpage->fd,tbpage->page);
+			if (error != PFE_OK)
 				return(error);
-			tbpage->dirty = FALSE;
-			PF_stats.phys_writes++;
+			PFsetDirty(tbpage,FALSE);
+			tbpage->reclsn = 0;
+			PFcount(tbpage->fd,phys_writes);
 		}
 
 		/* unlink from hash table */
@@ -202,6 +242,47 @@ int error;		/* error value returned*/
 }
 
 
+static PFbufBefore(bpage,fd)
+PFbpage *bpage;		/* buffer page about to be fixed */
+int fd;		/* file descriptor of the page */
+/****************************************************************************
+SPECIFICATIONS:
+	If a transaction is logging changes to file "fd", make sure that
+	"bpage" has a page for its before image (PFbufCapture()). Only
+	buffer pages of logged files get one.
+
+RETURN VALUE:
+	PFE_OK if no error.
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+	if (PFlogCapturing(fd) && bpage->before == NULL &&
+			(bpage->before=(PFfpage *)malloc(sizeof(PFfpage))) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+static void PFbufCapture(bpage)
+PFbpage *bpage;		/* buffer page being fixed */
+/****************************************************************************
+SPECIFICATIONS:
+	If a transaction is logging changes to the file of "bpage", copy
+	the page to bpage->before, so that PFbufUnfix() can log what was
+	changed while it was fixed.
+
+RETURN VALUE: none
+*****************************************************************************/
+{
+	bpage->captured = FALSE;
+	if (PFlogCapturing(bpage->fd)){
+		memcpy((char *)bpage->before,(char *)&bpage->fpage,sizeof(PFfpage));
+		bpage->captured = TRUE;
+	}
+}
+
+
 /************************* Interface to the Outside World ****************/
 
 PFbufGet(fd,pagenum,fpage,readfcn,writefcn)
@@ -240,7 +321,13 @@ GLOBAL VARIABLES MODIFIED:
 PFbpage *bpage;	/* pointer to buffer */
 int error;
 
-	PF_stats.logical_reads++;
+	if ((error=PFlogCheckFile(fd)) != PFE_OK){
+		/* its changes could not be logged */
+		*fpage = NULL;
+		return(error);
+	}
+
+	PFcount(fd,logical_reads);
 	int is_miss = 0;
 	if ((bpage=PFhashFind(fd,pagenum)) == NULL){
 		is_miss = 1;
@@ -254,8 +341,11 @@ int error;
 		}
 		
 		/* read the page */
-		PF_stats.phys_reads++;
-		if ((error=(*readfcn)(fd,pagenum,&bpage->fpage))!= PFE_OK){
+		PFcount(fd,phys_reads);
+		PF_TRACE_BEGIN(page_read,fd,pagenum);
+		error = (*readfcn)(fd,pagenum,&bpage->fpage);
+		PF_TRACE_END(page_read,fd,pagenum);
+		if (error != PFE_OK){
 			/* error reading the page. put buffer back into 
 			the free list, and return gracefully */
 			PFbufUnlink(bpage);
@@ -276,9 +366,10 @@ int error;
 		/* set the fields for this page*/
 		bpage->fd = fd;
 		bpage->page = pagenum;
-		bpage->dirty = FALSE;
-		bpage->dirty = FALSE;
-		PF_stats.page_misses++;
+		PFsetDirty(bpage,FALSE);
+		bpage->reclsn = 0;
+		PFcount(fd,page_misses);
+		PF_TRACE(buf_miss,fd,pagenum);
 	}
 	else if (bpage->fixed){
 		/* page already in memory, and is fixed, so we can't
@@ -289,10 +380,15 @@ int error;
 	}
 
 	/* Fix the page in the buffer then return*/
-	bpage->fixed = TRUE;
+	if ((error=PFbufBefore(bpage,fd)) != PFE_OK)
+		return(error);
+	PFsetFixed(bpage,TRUE);
+	PFbufCapture(bpage);
 	/* Count a hit only when the page was already resident (i.e. not a miss) */
-	if (!is_miss)
-		PF_stats.page_hits++;
+	if (!is_miss){
+		PFcount(fd,page_hits);
+		PF_TRACE(buf_hit,fd,pagenum);
+	}
 	*fpage = &bpage->fpage;
 	return(PFE_OK);
 }
@@ -316,6 +412,8 @@ RETURN VALUE:
 *****************************************************************************/
 {
 PFbpage *bpage;
+long first;	/* LSN of the first record logged */
+int error;
 
 	if ((bpage= PFhashFind(fd,pagenum))==NULL){
 		/* page not in buffer */
@@ -329,14 +427,24 @@ PFbpage *bpage;
 		return(PFerrno);
 	}
 
+	if (bpage->captured){
+		/* log the changes made while the page was fixed */
+		if ((dirty || bpage->dirty) && (error=PFlogPage(fd,pagenum,
+				bpage->before,&bpage->fpage,&first)) != PFE_OK)
+			return(error);
+		if ((dirty || bpage->dirty) && bpage->reclsn == 0)
+			bpage->reclsn = first;
+		bpage->captured = FALSE;
+	}
+
 	if (dirty) {
 		/* mark this page dirty */
-		bpage->dirty = TRUE;
-		PF_stats.logical_writes++;
+		PFsetDirty(bpage,TRUE);
+		PFcount(fd,logical_writes);
 	}
 	
 	/* unfix the page */
-	bpage->fixed = FALSE;
+	PFsetFixed(bpage,FALSE);
 	
 	/* unlink this page */
 	PFbufUnlink(bpage);
@@ -370,6 +478,10 @@ int error;
 
 	*fpage = NULL;	/* initial value of fpage */
 
+	if ((error=PFlogCheckFile(fd)) != PFE_OK)
+		/* its changes could not be logged */
+		return(error);
+
 	if ((bpage=PFhashFind(fd,pagenum))!= NULL){
 		/* page already in buffer*/
 		PFerrno = PFE_PAGEINBUF;
@@ -381,7 +493,8 @@ int error;
 		return(error);
 	
 	/* put ourselves into the hash table */
-	if ((error=PFhashInsert(fd,pagenum,bpage))!= PFE_OK){
+	if ((error=PFbufBefore(bpage,fd)) != PFE_OK ||
+			(error=PFhashInsert(fd,pagenum,bpage))!= PFE_OK){
 		/* can't insert into the hash table */
 		/* unlink bpage, and put it into the free list */
 		PFbufUnlink(bpage);
@@ -392,8 +505,14 @@ int error;
 	/* init the fields of bpage and return */
 	bpage->fd = fd;
 	bpage->page = pagenum;
-	bpage->fixed = TRUE;
-	bpage->dirty = FALSE;
+	PFsetFixed(bpage,TRUE);
+	PFsetDirty(bpage,FALSE);
+	bpage->reclsn = 0;
+	bpage->fpage.lsn = 0;
+	if (PFlogCapturing(fd))
+		/* a new page is logged as changed from an empty one */
+		memset((char *)&bpage->fpage,0,sizeof(PFfpage));
+	PFbufCapture(bpage);
 
 	*fpage = &bpage->fpage;
 	return(PFE_OK);
@@ -433,12 +552,19 @@ int error;		/* error code */
 				return(PFerrno);
 			}
 
-			/* write out dirty page */
-			if (bpage->dirty&&((error=(*writefcn)(fd,bpage->page,
-					&bpage->fpage))!= PFE_OK))
-				/* error writing file */
+			/* write out dirty page, after its log records */
+			if (bpage->dirty&&(error=PFlogFlush(bpage->fpage.lsn))!= PFE_OK)
 				return(error);
-			bpage->dirty = FALSE;
+			if (bpage->dirty){
+				PF_TRACE_BEGIN(page_write,fd,bpage->page);
+				error = (*writefcn)(fd,bpage->page,&bpage->fpage);
+				PF_TRACE_END(page_write,fd,bpage->page);
+				if (error != PFE_OK)
+					/* error writing file */
+					return(error);
+			}
+			PFsetDirty(bpage,FALSE);
+			bpage->reclsn = 0;
 
 			/* get rid of it from the hash table */
 			if ((error=PFhashDelete(fd,bpage->page))!= PFE_OK){
@@ -491,10 +617,10 @@ PFbpage *bpage;	/* pointer to the bpage we are looking for */
 	}
 
 	/* mark this page dirty */
-	bpage->dirty = TRUE;
+	PFsetDirty(bpage,TRUE);
 
 	/* account for logical write */
-	PF_stats.logical_writes++;
+	PFcount(fd,logical_writes);
 
 	/* make this page head of the list of buffers*/
 	PFbufUnlink(bpage);
@@ -503,6 +629,109 @@ PFbpage *bpage;	/* pointer to the bpage we are looking for */
 	return(PFE_OK);
 }
 
+PFbufDirty(dirty,max)
+PFdirty *dirty;	/* set to the dirty pages */
+int max;	/* size of dirty */
+/****************************************************************************
+SPECIFICATIONS:
+	Find the dirty pages in the buffer that have logged changes, with
+	the LSN of the first change since each was written.
+
+RETURN VALUE: the # of pages put in dirty.
+*****************************************************************************/
+{
+PFbpage *bpage;
+int n = 0;
+
+	for (bpage=PFfirstbpage; bpage != NULL && n < max; bpage=bpage->nextpage)
+		if (bpage->dirty && bpage->reclsn != 0){
+			dirty[n].file = bpage->fd;
+			dirty[n].page = bpage->page;
+			dirty[n].reclsn = bpage->reclsn;
+			n++;
+		}
+	return(n);
+}
+
+PFbufWritePage(fd,pagenum,writefcn)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+int (*writefcn)();	/* function to write a page of file */
+/****************************************************************************
+SPECIFICATIONS:
+	Write page "pagenum" of file "fd", after its log records, if it is
+	in the buffer, dirty and not fixed. It stays in the buffer, clean.
+
+RETURN VALUE:
+	PFE_OK if no error.
+	PF error code if error.
+*****************************************************************************/
+{
+PFbpage *bpage;
+int error;
+
+	if ((bpage=PFhashFind(fd,pagenum)) == NULL || !bpage->dirty ||
+			bpage->fixed)
+		return(PFE_OK);
+	if ((error=PFlogFlush(bpage->fpage.lsn)) != PFE_OK)
+		return(error);
+	PF_TRACE_BEGIN(page_write,fd,pagenum);
+	error = (*writefcn)(fd,pagenum,&bpage->fpage);
+	PF_TRACE_END(page_write,fd,pagenum);
+	if (error != PFE_OK)
+		return(error);
+	PFsetDirty(bpage,FALSE);
+	bpage->reclsn = 0;
+	PFcount(fd,phys_writes);
+	return(PFE_OK);
+}
+
+PFbufIsDirty(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell whether page "pagenum" of file "fd" is in the buffer and
+	dirty.
+
+RETURN VALUE:
+	TRUE or FALSE.
+*****************************************************************************/
+{
+PFbpage *bpage;
+
+	return((bpage=PFhashFind(fd,pagenum)) != NULL && bpage->dirty);
+}
+
+PFbufDiscard(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Drop page "pagenum" of file "fd" from the buffer without writing
+	it, even if it is fixed or dirty: its changes are lost.
+
+RETURN VALUE:
+	PFE_OK if no error, also if the page is not in the buffer.
+	PF error code if error.
+*****************************************************************************/
+{
+PFbpage *bpage;
+int error;
+
+	if ((bpage=PFhashFind(fd,pagenum)) == NULL)
+		return(PFE_OK);
+	if ((error=PFhashDelete(fd,pagenum)) != PFE_OK)
+		return(error);
+	PFsetFixed(bpage,FALSE);
+	PFsetDirty(bpage,FALSE);
+	bpage->reclsn = 0;
+	bpage->captured = FALSE;
+	PFbufUnlink(bpage);
+	PFbufInsertFree(bpage);
+	return(PFE_OK);
+}
+
 void PFbufPrint()
 /****************************************************************************
 SPECIFICATIONS:
@@ -535,6 +764,16 @@ int PF_SetBufferParams(int buf_count, int repl_policy)
 		return PFE_NOBUF;
 	PF_config_maxbufs = buf_count;
 	PF_config_policy = repl_policy;
+	/* free the free pages beyond the new size; pages in use go as
+	they are released (PFbufInsertFree()) */
+	while (PFnumbpage > PF_config_maxbufs && PFfreebpage != NULL){
+		PFbpage *bpage = PFfreebpage;
+		PFfreebpage = bpage->nextpage;
+		free((char *)bpage->before);
+		free((char *)bpage);
+		PFnumbpage--;
+		PFnumfree--;
+	}
 	/* reset stats */
 	PF_stats.logical_reads = 0;
 	PF_stats.logical_writes = 0;
@@ -542,6 +781,8 @@ int PF_SetBufferParams(int buf_count, int repl_policy)
 	PF_stats.phys_writes = 0;
 	PF_stats.page_hits = 0;
 	PF_stats.page_misses = 0;
+	for (int fd = 0; fd < PF_FTAB_SIZE; fd++)
+		memset(&PFfstats[fd].st, 0, sizeof(PFstats));
 	return PFE_OK;
 }
 
@@ -551,3 +792,66 @@ int PF_GetStats(struct PFstats *out)
 	*out = PF_stats;
 	return PFE_OK;
 }
+
+/* Per-file stats and pool occupancy */
+int PF_GetFileStats(int fd, struct PFstats *out)
+{
+	if (out == NULL) return PFE_NOMEM;
+	if (fd < 0 || fd >= PF_FTAB_SIZE || !PFfstats[fd].open) return PFE_FD;
+	*out = PFfstats[fd].st;
+	return PFE_OK;
+}
+
+int PF_GetPoolStats(struct PFpoolstats *out)
+{
+	if (out == NULL) return PFE_NOMEM;
+	out->size = PF_config_maxbufs;
+	out->policy = PF_config_policy;
+	out->used = PFnumbpage - PFnumfree;
+	out->dirty = PFnumdirty;
+	out->fixed = PFnumfixed;
+	return PFE_OK;
+}
+
+void PFbufFileOpened(fd,fname)
+int fd;
+char *fname;
+/****************************************************************************
+SPECIFICATIONS:
+	Start the stats of file "fname", just opened as "fd".
+*****************************************************************************/
+{
+	memset((char *)&PFfstats[fd].st,0,sizeof(PFstats));
+	strncpy(PFfstats[fd].name,fname,PF_STATS_NAMELEN - 1);
+	PFfstats[fd].name[PF_STATS_NAMELEN - 1] = '\0';
+	PFfstats[fd].open = TRUE;
+}
+
+void PFbufFileClosed(fd)
+int fd;
+{
+	PFfstats[fd].open = FALSE;
+}
+
+PFbufFileStats(fd,st,name)
+int fd;
+PFstats *st;	/* set to the stats of fd */
+char *name;	/* set to its name; PF_STATS_NAMELEN bytes */
+/****************************************************************************
+SPECIFICATIONS:
+	Copy the stats and the name of file "fd", for the reporter
+	(pfreport.c). The copy is not atomic: taken while "fd" is used,
+	its counters may be a few operations apart, or while "fd" is
+	closed and opened again, the name of either file.
+
+RETURN VALUE:
+	TRUE if "fd" is open, FALSE if not.
+*****************************************************************************/
+{
+	if (!PFfstats[fd].open)
+		return(FALSE);
+	*st = PFfstats[fd].st;
+	memcpy(name,PFfstats[fd].name,PF_STATS_NAMELEN);
+	name[PF_STATS_NAMELEN - 1] = '\0';
+	return(PFfstats[fd].open);
+}
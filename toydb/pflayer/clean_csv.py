@@ -10,8 +10,9 @@ rows = []
 with open(path,'r',newline='') as f:
     reader = csv.reader(f)
     for r in reader:
-        # keep only rows with expected 11 columns
-        if len(r) == 11:
+        # keep only rows with the expected 11 columns, or 13 with the
+        # pattern and files columns of testpf_policy's access patterns
+        if len(r) in (11, 13):
             rows.append(r)
         else:
             # ignore malformed rows
@@ -1,5 +1,9 @@
 /* pf.c: Paged File Interface Routines+ support routines */
+/* struct timespec under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <time.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/file.h>
@@ -25,6 +29,7 @@ sense that it's <0 or >= # of pages in the file */
 				PFftab[fd].hdr.numpages)
 
 extern char *malloc();
+extern char *realloc();
 
 /****************** Internal Support Functions *****************************/
 static char *savestr(str)
@@ -89,6 +94,738 @@ int i;
 	return(-1);
 }
 
+static long PFbytesread = 0;	/* bytes read by PFreadfcn() */
+static long PFbyteswritten = 0;	/* bytes written by PFwritefcn() */
+
+static char PFcbuf[PF_LZ_BOUND(sizeof(PFfpage))]; /* a compressed page */
+
+#define PFextentAlign(len) (((len) + PF_EXTENT_ALIGN - 1) / PF_EXTENT_ALIGN \
+				* PF_EXTENT_ALIGN)
+
+static PFcgrowmap(fd,n)
+int fd;		/* file descriptor of a compressed file */
+int n;		/* # of entries needed */
+/****************************************************************************
+SPECIFICATIONS:
+	Make the page map of file "fd" hold at least "n" entries. New
+	entries are zero: pages never written.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+PFextent *map;
+int cap;
+
+	if (n <= PFftab[fd].mapcap)
+		return(PFE_OK);
+	cap = PFftab[fd].mapcap * 2;
+	if (cap < n)
+		cap = n < 64 ? 64 : n;
+	if ((map=(PFextent *)malloc(cap*sizeof(PFextent))) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	memset(map,0,cap*sizeof(PFextent));
+	if (PFftab[fd].map != NULL){
+		memcpy(map,PFftab[fd].map,PFftab[fd].mapcap*sizeof(PFextent));
+		free((char *)PFftab[fd].map);
+	}
+	PFftab[fd].map = map;
+	PFftab[fd].mapcap = cap;
+	return(PFE_OK);
+}
+
+static PFcreadfcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a compressed file */
+int pagenum;	/* page number */
+PFfpage *buf;
+/****************************************************************************
+SPECIFICATIONS:
+	PFreadfcn() for a compressed file: read the extent of page
+	"pagenum" and decompress it into "buf".
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFextent *e;
+int error;
+
+	if (pagenum >= PFftab[fd].mapcap || PFftab[fd].map[pagenum].off == 0){
+		/* never written */
+		PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	e = &PFftab[fd].map[pagenum];
+
+	if (lseek(PFftab[fd].unixfd,e->off,L_SET) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((error=read(PFftab[fd].unixfd,PFcbuf,e->len)) != e->len){
+		if (error <0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	PFbytesread += e->len;
+
+	if (e->len == sizeof(PFfpage))
+		/* stored as is */
+		memcpy((char *)buf,PFcbuf,sizeof(PFfpage));
+	else if (PFlzDecompress(PFcbuf,e->len,(char *)buf,sizeof(PFfpage))
+			!= sizeof(PFfpage)){
+		PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+static PFcwritefcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a compressed file */
+int pagenum;	/* page number */
+PFfpage *buf;
+/****************************************************************************
+SPECIFICATIONS:
+	PFwritefcn() for a compressed file: compress "buf" and write it
+	to the extent of page "pagenum", or to a new extent at the end of
+	the file if it no longer fits. A page that does not get smaller
+	is stored as is.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFextent *e;
+char *data;
+int len, error;
+
+	if ((error=PFcgrowmap(fd,pagenum+1)) != PFE_OK)
+		return(error);
+	e = &PFftab[fd].map[pagenum];
+
+	if ((len=PFlzCompress((char *)buf,sizeof(PFfpage),PFcbuf,
+				sizeof(PFfpage)-1)) < 0){
+		len = sizeof(PFfpage);
+		data = (char *)buf;
+	}
+	else	data = PFcbuf;
+
+	if (e->off == 0 || len > e->cap){
+		/* new extent */
+		e->off = PFftab[fd].end;
+		e->cap = PFextentAlign(len);
+		PFftab[fd].end += e->cap;
+	}
+	e->len = len;
+	PFftab[fd].hdrchanged = TRUE;
+
+	if (lseek(PFftab[fd].unixfd,e->off,L_SET) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((error=write(PFftab[fd].unixfd,data,len)) != len){
+		if (error <0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEWRITE;
+		return(PFerrno);
+	}
+	PFbyteswritten += len;
+	return(PFE_OK);
+}
+
+static PFcwritehdr(fd)
+int fd;		/* file descriptor of a compressed file */
+/****************************************************************************
+SPECIFICATIONS:
+	Write the page map of file "fd" after its last extent, then its
+	headers.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFhdr_str hdr;
+PFchdr_str chdr;
+int error, len;
+
+	if ((error=PFcgrowmap(fd,PFftab[fd].hdr.numpages)) != PFE_OK)
+		return(error);
+	len = PFftab[fd].hdr.numpages * sizeof(PFextent);
+	if (lseek(PFftab[fd].unixfd,PFftab[fd].end,L_SET) == -1 ||
+			write(PFftab[fd].unixfd,(char *)PFftab[fd].map,len) != len){
+		PFerrno = PFE_HDRWRITE;
+		return(PFerrno);
+	}
+
+	hdr.magic = PF_FILE_MAGIC;
+	hdr.firstfree = PF_COMPRESSED_FILE;
+	hdr.numpages = 0;
+	chdr.firstfree = PFftab[fd].hdr.firstfree;
+	chdr.numpages = PFftab[fd].hdr.numpages;
+	chdr.mapoff = PFftab[fd].end;
+	chdr.end = PFftab[fd].end;
+	if (lseek(PFftab[fd].unixfd,(unsigned)0,L_SET) == -1 ||
+			write(PFftab[fd].unixfd,(char *)&hdr,PF_HDR_SIZE) != PF_HDR_SIZE ||
+			write(PFftab[fd].unixfd,(char *)&chdr,sizeof(chdr)) != sizeof(chdr)){
+		PFerrno = PFE_HDRWRITE;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+static PFcopen(fd)
+int fd;		/* file descriptor; its PFhdr_str has been read */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the header and page map of the compressed file "fd".
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFchdr_str chdr;
+int error, len;
+
+	if (read(PFftab[fd].unixfd,(char *)&chdr,sizeof(chdr)) != sizeof(chdr)){
+		PFerrno = PFE_HDRREAD;
+		return(PFerrno);
+	}
+	PFftab[fd].hdr.firstfree = chdr.firstfree;
+	PFftab[fd].hdr.numpages = chdr.numpages;
+	if ((error=PFcgrowmap(fd,chdr.numpages)) != PFE_OK)
+		return(error);
+	len = chdr.numpages * sizeof(PFextent);
+	/* new extents go after the map, which the header names until the
+	next close writes a new one */
+	PFftab[fd].end = chdr.end;
+	if (PFftab[fd].end < chdr.mapoff + len)
+		PFftab[fd].end = chdr.mapoff + len;
+	if (len > 0 && (lseek(PFftab[fd].unixfd,chdr.mapoff,L_SET) == -1 ||
+			read(PFftab[fd].unixfd,(char *)PFftab[fd].map,len) != len)){
+		PFerrno = PFE_HDRREAD;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+#define PFslotOffset(slot) ((long)PF_SHADOW_DATA + (long)(slot) * sizeof(PFfpage))
+
+static PFsgrow(a,cap,n,fill)
+int **a;	/* array of a shadow file to grow */
+int *cap;	/* # of entries in *a */
+int n;		/* # of entries needed */
+int fill;	/* value of new entries */
+/****************************************************************************
+SPECIFICATIONS:
+	Make the array "*a" hold at least "n" entries. New entries are
+	"fill".
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+int *na;
+int i, ncap;
+
+	if (n <= *cap)
+		return(PFE_OK);
+	ncap = *cap * 2;
+	if (ncap < n)
+		ncap = n < 64 ? 64 : n;
+	if ((na=(int *)malloc(ncap*sizeof(int))) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	if (*a != NULL){
+		memcpy(na,*a,*cap*sizeof(int));
+		free((char *)*a);
+	}
+	for (i = *cap; i < ncap; i++)
+		na[i] = fill;
+	*a = na;
+	*cap = ncap;
+	return(PFE_OK);
+}
+
+static PFscheck(shdr)
+PFshdr_str *shdr;	/* shadow file header */
+/* the check of "shdr"; not 0 for a header of zeros */
+{
+unsigned h = 0x53484457;
+
+	h = h * 31 + shdr->version;
+	h = h * 31 + shdr->firstfree;
+	h = h * 31 + shdr->numpages;
+	h = h * 31 + shdr->nslots;
+	h = h * 31 + shdr->tableslot;
+	return((int)h);
+}
+
+static PFsalloc(sh)
+PFshadow *sh;	/* shadow file state */
+/****************************************************************************
+SPECIFICATIONS:
+	Take a free slot, or one more at the end of the file, and mark
+	it PF_SLOT_NEW.
+
+RETURN VALUE:
+	The slot, which is >= 0, or
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+int i, slot;
+
+	if (sh->nfree > 0)
+		for (i=0; i < sh->nslots; i++){
+			slot = (sh->nextslot + i) % sh->nslots;
+			if (sh->slots[slot] == PF_SLOT_FREE){
+				sh->slots[slot] = PF_SLOT_NEW;
+				sh->nfree--;
+				sh->nextslot = slot + 1;
+				return(slot);
+			}
+		}
+	if (PFsgrow(&sh->slots,&sh->slotcap,sh->nslots+1,PF_SLOT_FREE) != PFE_OK)
+		return(PFerrno);
+	slot = sh->nslots++;
+	sh->slots[slot] = PF_SLOT_NEW;
+	return(slot);
+}
+
+static PFstouched(sh,pagenum)
+PFshadow *sh;	/* shadow file state */
+int pagenum;	/* page number */
+/* TRUE if page "pagenum" was fixed in the update of the file, if any */
+{
+int i;
+
+	if (sh->updating)
+		for (i=0; i < sh->ntouched; i++)
+			if (sh->touched[i] == pagenum)
+				return(TRUE);
+	return(FALSE);
+}
+
+static PFsreadfcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a shadow file */
+int pagenum;	/* page number */
+PFfpage *buf;	/* page read */
+/****************************************************************************
+SPECIFICATIONS:
+	PFreadfcn() for a shadow file: read the slot of page "pagenum".
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_INCOMPLETEREAD if the page was never written.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFshadow *sh = PFftab[fd].shadow;
+int slot, error;
+
+	if (pagenum >= sh->tablecap || (slot=sh->table[pagenum]) < 0){
+		PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	if (lseek(PFftab[fd].unixfd,PFslotOffset(slot),L_SET) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((error=read(PFftab[fd].unixfd,(char *)buf,sizeof(PFfpage)))
+			!= sizeof(PFfpage)){
+		if (error < 0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	PFbytesread += sizeof(PFfpage);
+	return(PFE_OK);
+}
+
+static PFswritefcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a shadow file */
+int pagenum;	/* page number */
+PFfpage *buf;	/* page to write */
+/****************************************************************************
+SPECIFICATIONS:
+	PFwritefcn() for a shadow file. A page fixed in the update and
+	still in the slot of the last commit is written to a new slot,
+	and the table changed to it, the move kept for PF_ShadowAbort();
+	other pages are written in place.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFshadow *sh = PFftab[fd].shadow;
+int slot, newslot, error;
+
+	if ((error=PFsgrow(&sh->table,&sh->tablecap,pagenum+1,-1)) != PFE_OK)
+		return(error);
+	slot = sh->table[pagenum];
+	if (slot < 0 || (sh->slots[slot] != PF_SLOT_NEW &&
+			PFstouched(sh,pagenum))){
+		if (PFstouched(sh,pagenum) && (error=PFsgrow(&sh->undo,
+				&sh->undocap,3*(sh->nundo+1),-1)) != PFE_OK)
+			return(error);
+		if ((newslot=PFsalloc(sh)) < 0)
+			return(newslot);
+		if (PFstouched(sh,pagenum)){
+			sh->undo[3*sh->nundo] = pagenum;
+			sh->undo[3*sh->nundo+1] = slot;
+			sh->undo[3*sh->nundo+2] = newslot;
+			sh->nundo++;
+		}
+		if (slot >= 0){
+			/* kept until the commit */
+			sh->slots[slot] = PF_SLOT_OLD;
+			sh->moved++;
+		}
+		sh->table[pagenum] = slot = newslot;
+		sh->changed = TRUE;
+	}
+
+	if (lseek(PFftab[fd].unixfd,PFslotOffset(slot),L_SET) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((error=write(PFftab[fd].unixfd,(char *)buf,sizeof(PFfpage)))
+			!= sizeof(PFfpage)){
+		if (error < 0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEWRITE;
+		return(PFerrno);
+	}
+	PFbyteswritten += sizeof(PFfpage);
+	return(PFE_OK);
+}
+
+static PFswritehdr(fd,sync)
+int fd;		/* file descriptor of a shadow file */
+int sync;	/* TRUE to fsync() before and after the header */
+/****************************************************************************
+SPECIFICATIONS:
+	Commit the shadow file "fd": write its page table to free slots,
+	then its header over the older of the two. Slots the table no
+	longer holds are then free. With "sync" the commit is durable,
+	and the table is on disk before the header.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFshadow *sh = PFftab[fd].shadow;
+PFshdr_str shdr;
+int buf[sizeof(PFfpage) / sizeof(int)];	/* a slot of the table */
+int *tslots = NULL;	/* the new table's slots */
+int cap = 0, n, i, k, p, error = PFE_OK;
+
+	n = (PFftab[fd].hdr.numpages + PF_SHADOW_PERSLOT - 1) /
+		PF_SHADOW_PERSLOT;
+	if (n > 0 && (error=PFsgrow(&tslots,&cap,n,-1)) != PFE_OK)
+		return(error);
+	for (i=0; i < n && error == PFE_OK; i++)
+		if ((tslots[i]=PFsalloc(sh)) < 0)
+			error = tslots[i];
+
+	for (i=0; i < n && error == PFE_OK; i++){
+		memset((char *)buf,0,sizeof(buf));
+		buf[0] = i + 1 < n ? tslots[i+1] : -1;
+		for (k=0; k < PF_SHADOW_PERSLOT; k++){
+			p = i * PF_SHADOW_PERSLOT + k;
+			buf[k+1] = p < PFftab[fd].hdr.numpages &&
+				p < sh->tablecap ? sh->table[p] : -1;
+		}
+		if (lseek(PFftab[fd].unixfd,PFslotOffset(tslots[i]),L_SET) == -1
+				|| write(PFftab[fd].unixfd,(char *)buf,sizeof(buf))
+				!= sizeof(buf))
+			error = PFerrno = PFE_HDRWRITE;
+		else	PFbyteswritten += sizeof(buf);
+	}
+	if (error == PFE_OK && sync && fsync(PFftab[fd].unixfd) == -1)
+		error = PFerrno = PFE_UNIX;
+
+	if (error == PFE_OK){
+		shdr.version = sh->version + 1;
+		shdr.firstfree = PFftab[fd].hdr.firstfree;
+		shdr.numpages = PFftab[fd].hdr.numpages;
+		shdr.nslots = sh->nslots;
+		shdr.tableslot = n > 0 ? tslots[0] : -1;
+		shdr.check = PFscheck(&shdr);
+		if (lseek(PFftab[fd].unixfd,PF_HDR_SIZE + (shdr.version % 2) *
+				sizeof(shdr),L_SET) == -1 ||
+				write(PFftab[fd].unixfd,(char *)&shdr,sizeof(shdr))
+				!= sizeof(shdr))
+			error = PFerrno = PFE_HDRWRITE;
+		else if (sync && fsync(PFftab[fd].unixfd) == -1)
+			error = PFerrno = PFE_UNIX;
+	}
+
+	if (error != PFE_OK){
+		/* the last commit stands */
+		for (k=0; k < n; k++)
+			if (tslots[k] >= 0){
+				sh->slots[tslots[k]] = PF_SLOT_FREE;
+				sh->nfree++;
+			}
+		if (tslots != NULL)
+			free((char *)tslots);
+		return(error);
+	}
+	PFbyteswritten += sizeof(shdr);
+
+	/* the commit is done: free what it replaced */
+	sh->version++;
+	for (i=0; i < sh->ntslots; i++)
+		sh->slots[sh->tslots[i]] = PF_SLOT_OLD;
+	if (sh->tslots != NULL)
+		free((char *)sh->tslots);
+	sh->tslots = tslots;
+	sh->ntslots = n;
+	for (i=0; i < sh->nslots; i++)
+		if (sh->slots[i] == PF_SLOT_NEW)
+			sh->slots[i] = PF_SLOT_USED;
+		else if (sh->slots[i] == PF_SLOT_OLD){
+			sh->slots[i] = PF_SLOT_FREE;
+			sh->nfree++;
+		}
+	sh->changed = FALSE;
+	return(PFE_OK);
+}
+
+static void PFsfree(sh)
+PFshadow *sh;	/* shadow file state */
+{
+	if (sh->table != NULL)
+		free((char *)sh->table);
+	if (sh->slots != NULL)
+		free((char *)sh->slots);
+	if (sh->tslots != NULL)
+		free((char *)sh->tslots);
+	if (sh->touched != NULL)
+		free((char *)sh->touched);
+	if (sh->undo != NULL)
+		free((char *)sh->undo);
+	if (sh->saved != NULL)
+		free((char *)sh->saved);
+	free((char *)sh);
+}
+
+static PFsopen(fd)
+int fd;		/* file descriptor; its PFhdr_str has been read */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the current header and the page table of the shadow file
+	"fd", and find the free slots: those not in the table.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFshdr_str shdr[2], *cur;
+PFshadow *sh;
+int buf[sizeof(PFfpage) / sizeof(int)];
+int tcap = 0, slot, i, k, p, s;
+
+	if (read(PFftab[fd].unixfd,(char *)shdr,sizeof(shdr)) != sizeof(shdr)){
+		PFerrno = PFE_HDRREAD;
+		return(PFerrno);
+	}
+	cur = NULL;
+	for (i=0; i < 2; i++)
+		if (shdr[i].check == PFscheck(&shdr[i]) &&
+				(cur == NULL || shdr[i].version > cur->version))
+			cur = &shdr[i];
+	if (cur == NULL){
+		PFerrno = PFE_HDRREAD;
+		return(PFerrno);
+	}
+
+	if ((sh=(PFshadow *)malloc(sizeof(PFshadow))) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	memset((char *)sh,0,sizeof(PFshadow));
+	PFftab[fd].shadow = sh;
+	sh->version = cur->version;
+	PFftab[fd].hdr.firstfree = cur->firstfree;
+	PFftab[fd].hdr.numpages = cur->numpages;
+	if (PFsgrow(&sh->slots,&sh->slotcap,cur->nslots,PF_SLOT_FREE) != PFE_OK ||
+			PFsgrow(&sh->table,&sh->tablecap,cur->numpages,-1) != PFE_OK)
+		return(PFerrno);
+	sh->nslots = sh->nfree = cur->nslots;
+
+	for (slot=cur->tableslot, i=0; slot >= 0; slot=buf[0], i++){
+		if (slot >= sh->nslots || sh->slots[slot] != PF_SLOT_FREE ||
+				lseek(PFftab[fd].unixfd,PFslotOffset(slot),L_SET) == -1 ||
+				read(PFftab[fd].unixfd,(char *)buf,sizeof(buf))
+				!= sizeof(buf)){
+			PFerrno = PFE_HDRREAD;
+			return(PFerrno);
+		}
+		if (PFsgrow(&sh->tslots,&tcap,i+1,-1) != PFE_OK)
+			return(PFerrno);
+		sh->tslots[sh->ntslots++] = slot;
+		sh->slots[slot] = PF_SLOT_USED;
+		sh->nfree--;
+		for (k=0; k < PF_SHADOW_PERSLOT; k++){
+			p = i * PF_SHADOW_PERSLOT + k;
+			if (p >= cur->numpages || (s=buf[k+1]) < 0)
+				continue;
+			if (s >= sh->nslots || sh->slots[s] != PF_SLOT_FREE){
+				PFerrno = PFE_HDRREAD;
+				return(PFerrno);
+			}
+			sh->table[p] = s;
+			sh->slots[s] = PF_SLOT_USED;
+			sh->nfree--;
+		}
+	}
+	return(PFE_OK);
+}
+
+static PFstouch(fd,pagenum,fpage)
+int fd;		/* file descriptor */
+int pagenum;	/* page fixed */
+PFfpage *fpage;	/* the page, not yet changed */
+/****************************************************************************
+SPECIFICATIONS:
+	Note that page "pagenum" was fixed in the update of file "fd",
+	if it is a shadow file in an update, so that the commit writes
+	it if it is dirty. If it is dirty already, with changes from
+	outside the update, a copy is kept for PF_ShadowAbort().
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+PFshadow *sh = PFftab[fd].shadow;
+PFssaved *ns;
+int ncap;
+
+	if (sh == NULL || !sh->updating || PFstouched(sh,pagenum))
+		return(PFE_OK);
+	if (PFsgrow(&sh->touched,&sh->touchedcap,sh->ntouched+1,-1) != PFE_OK)
+		return(PFerrno);
+	if (PFbufIsDirty(fd,pagenum)){
+		if (sh->nsaved == sh->savedcap){
+			ncap = sh->savedcap == 0 ? 4 : 2 * sh->savedcap;
+			if ((ns=(PFssaved *)realloc((char *)sh->saved,
+					ncap*sizeof(PFssaved))) == NULL){
+				PFerrno = PFE_NOMEM;
+				return(PFerrno);
+			}
+			sh->saved = ns;
+			sh->savedcap = ncap;
+		}
+		sh->saved[sh->nsaved].page = pagenum;
+		memcpy((char *)&sh->saved[sh->nsaved].fpage,(char *)fpage,
+			sizeof(PFfpage));
+		sh->nsaved++;
+	}
+	sh->touched[sh->ntouched++] = pagenum;
+	return(PFE_OK);
+}
+
+static PFmemfile *PFmemfiles = NULL;	/* all memory files */
+
+static PFmemfile *PFmfind(fname)
+char *fname;	/* file name */
+/****************************************************************************
+SPECIFICATIONS:
+	Find the memory file called "fname".
+
+RETURN VALUE:
+	The memory file, or NULL if there is none of that name.
+*****************************************************************************/
+{
+PFmemfile *m;
+
+	for (m = PFmemfiles; m != NULL; m = m->next)
+		if (strcmp(m->name,fname) == 0)
+			return(m);
+	return(NULL);
+}
+
+static PFmreadfcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a memory file */
+int pagenum;	/* page number */
+PFfpage *buf;	/* where to copy the page */
+/****************************************************************************
+SPECIFICATIONS:
+	Copy page "pagenum" of memory file "fd" into "buf". As past the
+	end of a unix file, a page beyond the last one written cannot be
+	read.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_INCOMPLETEREAD if the page was never written.
+*****************************************************************************/
+{
+PFmemfile *m = PFftab[fd].mem;
+
+	if (pagenum < 0 || pagenum >= m->npages){
+		PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	memcpy((char *)buf,(char *)&m->pages[pagenum],sizeof(PFfpage));
+	PFbytesread += sizeof(PFfpage);
+	return(PFE_OK);
+}
+
+static PFmwritefcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a memory file */
+int pagenum;	/* page number */
+PFfpage *buf;	/* the page */
+/****************************************************************************
+SPECIFICATIONS:
+	Copy "buf" to page "pagenum" of memory file "fd", growing its
+	page array (doubling) if needed. Pages skipped over are zero, as
+	the holes of a unix file.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+PFmemfile *m = PFftab[fd].mem;
+PFfpage *pages;
+int cap;
+
+	if (pagenum >= m->cap){
+		cap = m->cap < 16 ? 16 : m->cap * 2;
+		if (cap <= pagenum)
+			cap = pagenum + 1;
+		if ((pages=(PFfpage *)realloc((char *)m->pages,
+				cap * sizeof(PFfpage))) == NULL){
+			PFerrno = PFE_NOMEM;
+			return(PFerrno);
+		}
+		m->pages = pages;
+		m->cap = cap;
+	}
+	if (pagenum >= m->npages){
+		memset((char *)&m->pages[m->npages],0,
+			(pagenum + 1 - m->npages) * sizeof(PFfpage));
+		m->npages = pagenum + 1;
+	}
+	memcpy((char *)&m->pages[pagenum],(char *)buf,sizeof(PFfpage));
+	PFbyteswritten += sizeof(PFfpage);
+	return(PFE_OK);
+}
+
 PFreadfcn(fd,pagenum,buf)
 int fd;	/* file descriptor */
 int pagenum; /* page number */
@@ -107,6 +844,13 @@ RETURN VALUE:
 {
 int error;
 
+	if (PFftab[fd].mem != NULL)
+		return(PFmreadfcn(fd,pagenum,buf));
+	if (PFftab[fd].compressed)
+		return(PFcreadfcn(fd,pagenum,buf));
+	if (PFftab[fd].shadow != NULL)
+		return(PFsreadfcn(fd,pagenum,buf));
+
 	/* seek to the appropriate place */
 	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
 				L_SET)) == -1){
@@ -122,6 +866,7 @@ int error;
 		else	PFerrno = PFE_INCOMPLETEREAD;
 		return(PFerrno);
 	}
+	PFbytesread += sizeof(PFfpage);
 
 	return(PFE_OK);
 }
@@ -145,6 +890,13 @@ RETURN VALUE:
 {
 int error;
 
+	if (PFftab[fd].mem != NULL)
+		return(PFmwritefcn(fd,pagenum,buf));
+	if (PFftab[fd].compressed)
+		return(PFcwritefcn(fd,pagenum,buf));
+	if (PFftab[fd].shadow != NULL)
+		return(PFswritefcn(fd,pagenum,buf));
+
 	/* seek to the right place */
 	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
 				L_SET)) == -1){
@@ -160,6 +912,7 @@ int error;
 		else	PFerrno = PFE_INCOMPLETEWRITE;
 		return(PFerrno);
 	}
+	PFbyteswritten += sizeof(PFfpage);
 
 	return(PFE_OK);
 
@@ -193,6 +946,7 @@ int i;
 
 	/* reset any buffer stats and config to defaults */
 	PF_SetBufferParams(PF_MAX_BUFS, PF_REPL_LRU);
+	PFbytesread = PFbyteswritten = 0;
 }
 
 PF_CreateFile(fname)
@@ -200,7 +954,8 @@ char *fname;	/* name of file to create */
 /****************************************************************************
 SPECIFICATIONS:
 	Create a paged file called "fname". The file should not have
-	already existed before.
+	already existed before. A name starting with PF_MEM_PREFIX makes
+	a memory file (PF_CreateMemFile()).
 
 AUTHOR: clc
 
@@ -213,6 +968,9 @@ int fd;	/* unix file descripotr */
 PFhdr_str hdr;	/* file header */
 int error;
 
+	if (strncmp(fname,PF_MEM_PREFIX,strlen(PF_MEM_PREFIX)) == 0)
+		return(PF_CreateMemFile(fname));
+
 	/* create file for exclusive use */
 	if ((fd=open(fname,O_CREAT|O_EXCL|O_WRONLY,0664))<0){
 		/* unix error on open */
@@ -221,6 +979,7 @@ int error;
 	}
 
 	/* write out the file header */
+	hdr.magic = PF_FILE_MAGIC;
 	hdr.firstfree = PF_PAGE_LIST_END;	/* no free pag yet */
 	hdr.numpages = 0;
 	if ((error=write(fd,(char *)&hdr,sizeof(hdr))) != sizeof(hdr)){
@@ -237,11 +996,146 @@ int error;
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
-
+
+	return(PFE_OK);
+}
+
+PF_CreateCompressedFile(fname)
+char *fname;	/* name of file to create */
+/****************************************************************************
+SPECIFICATIONS:
+	Create a paged file called "fname" whose pages are stored
+	compressed. It is used like any other paged file. The file should
+	not have already existed before.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int fd;	/* unix file descripotr */
+PFhdr_str hdr;	/* file header */
+PFchdr_str chdr;	/* compressed file header */
+
+	if ((fd=open(fname,O_CREAT|O_EXCL|O_WRONLY,0664))<0){
+		PFerrno = PFE_UNIX;
+		return(PFE_UNIX);
+	}
+
+	hdr.magic = PF_FILE_MAGIC;
+	hdr.firstfree = PF_COMPRESSED_FILE;
+	hdr.numpages = 0;
+	chdr.firstfree = PF_PAGE_LIST_END;
+	chdr.numpages = 0;
+	chdr.end = chdr.mapoff = PF_HDR_SIZE + sizeof(PFchdr_str);
+	if (write(fd,(char *)&hdr,sizeof(hdr)) != sizeof(hdr) ||
+			write(fd,(char *)&chdr,sizeof(chdr)) != sizeof(chdr)){
+		PFerrno = PFE_HDRWRITE;
+		close(fd);
+		unlink(fname);
+		return(PFerrno);
+	}
+
+	if (close(fd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	return(PFE_OK);
+}
+
+
+PF_CreateShadowFile(fname)
+char *fname;	/* name of file to create */
+/****************************************************************************
+SPECIFICATIONS:
+	Create a paged file called "fname" whose pages are kept through
+	a page table, so that the changes between PF_ShadowBegin() and
+	PF_ShadowCommit() reach the file all at once or not at all. It is
+	used like any other paged file. The file should not have already
+	existed before.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int fd;	/* unix file descripotr */
+PFhdr_str hdr;	/* file header */
+PFshdr_str shdr[2];	/* shadow file headers */
+
+	if ((fd=open(fname,O_CREAT|O_EXCL|O_WRONLY,0664))<0){
+		PFerrno = PFE_UNIX;
+		return(PFE_UNIX);
+	}
+
+	/* version 1 holds no pages; the other header is not valid */
+	hdr.magic = PF_FILE_MAGIC;
+	hdr.firstfree = PF_SHADOW_FILE;
+	hdr.numpages = 0;
+	memset((char *)shdr,0,sizeof(shdr));
+	shdr[1].version = 1;
+	shdr[1].firstfree = PF_PAGE_LIST_END;
+	shdr[1].tableslot = -1;
+	shdr[1].check = PFscheck(&shdr[1]);
+	if (write(fd,(char *)&hdr,sizeof(hdr)) != sizeof(hdr) ||
+			write(fd,(char *)shdr,sizeof(shdr)) != sizeof(shdr)){
+		PFerrno = PFE_HDRWRITE;
+		close(fd);
+		unlink(fname);
+		return(PFerrno);
+	}
+
+	if (close(fd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	return(PFE_OK);
+}
+
+PF_CreateMemFile(fname)
+char *fname;	/* name of file to create */
+/****************************************************************************
+SPECIFICATIONS:
+	Create a paged file called "fname" whose header and pages are
+	kept in memory (see pftypes.h), for scratch files and for
+	measuring the layers above without disk I/O. It is opened,
+	closed and destroyed by name like any other paged file, and
+	while it exists it hides a unix file of the same name. It should
+	not have already existed before.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_UNIX if a memory file of that name exists.
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+PFmemfile *m;
+
+	if (PFmfind(fname) != NULL){
+		/* as O_EXCL of a unix file */
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((m=(PFmemfile *)malloc(sizeof(PFmemfile))) == NULL ||
+			(m->name=savestr(fname)) == NULL){
+		if (m != NULL)
+			free((char *)m);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	m->hdr.magic = PF_FILE_MAGIC;
+	m->hdr.firstfree = PF_PAGE_LIST_END;
+	m->hdr.numpages = 0;
+	m->pages = NULL;
+	m->npages = m->cap = 0;
+	m->nopen = 0;
+	m->next = PFmemfiles;
+	PFmemfiles = m;
 	return(PFE_OK);
 }
 
-
 PF_DestroyFile(fname)
 char *fname;		/* file name to destroy */
 /****************************************************************************
@@ -258,6 +1152,7 @@ RETURN VALUE:
 *****************************************************************************/
 {
 int error;
+PFmemfile **mp, *m;
 
 	if (PFtabFindFname(fname)!= -1){
 		/* file is open */
@@ -265,6 +1160,17 @@ int error;
 		return(PFerrno);
 	}
 
+	for (mp = &PFmemfiles; (m = *mp) != NULL; mp = &m->next)
+		if (strcmp(m->name,fname) == 0){
+			/* a memory file: free its pages */
+			*mp = m->next;
+			if (m->pages != NULL)
+				free((char *)m->pages);
+			free(m->name);
+			free((char *)m);
+			return(PFE_OK);
+		}
+
 	if ((error =unlink(fname))!= 0){
 		/* unix error */
 		PFerrno = PFE_UNIX;
@@ -308,15 +1214,20 @@ int fd; /* file descriptor */
 		return(PFerrno);
 	}
 
+	if ((PFftab[fd].mem = PFmfind(fname)) != NULL){
+		/* a memory file: its header is kept with it */
+		PFftab[fd].unixfd = -1;
+		PFftab[fd].hdr = PFftab[fd].mem->hdr;
+	}
 	/* open the file */
-	if ((PFftab[fd].unixfd = open(fname,O_RDWR))< 0){
+	else if ((PFftab[fd].unixfd = open(fname,O_RDWR))< 0){
 		/* can't open the file */
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
 
 	/* Read the file header */
-	if ((count=read(PFftab[fd].unixfd,(char *)&PFftab[fd].hdr,PF_HDR_SIZE))
+	else if ((count=read(PFftab[fd].unixfd,(char *)&PFftab[fd].hdr,PF_HDR_SIZE))
 				!= PF_HDR_SIZE){
 		if (count < 0)
 			/* unix error */
@@ -326,17 +1237,55 @@ int fd; /* file descriptor */
 		close(PFftab[fd].unixfd);
 		return(PFerrno);
 	}
+	else if (PFftab[fd].hdr.magic != PF_FILE_MAGIC){
+		/* not a paged file, or pages without an LSN */
+		PFerrno = PFE_MAGIC;
+		close(PFftab[fd].unixfd);
+		return(PFerrno);
+	}
 	/* set file header to be not changed */
 	PFftab[fd].hdrchanged = FALSE;
 
+	PFftab[fd].compressed = FALSE;
+	PFftab[fd].map = NULL;
+	PFftab[fd].mapcap = 0;
+	PFftab[fd].shadow = NULL;
+	if (PFftab[fd].hdr.firstfree == PF_COMPRESSED_FILE){
+		PFftab[fd].compressed = TRUE;
+		if (PFcopen(fd) != PFE_OK){
+			if (PFftab[fd].map != NULL)
+				free((char *)PFftab[fd].map);
+			close(PFftab[fd].unixfd);
+			return(PFerrno);
+		}
+	}
+	else if (PFftab[fd].hdr.firstfree == PF_SHADOW_FILE &&
+			PFsopen(fd) != PFE_OK){
+		if (PFftab[fd].shadow != NULL)
+			PFsfree(PFftab[fd].shadow);
+		close(PFftab[fd].unixfd);
+		return(PFerrno);
+	}
+
 	/* save the file name */
 	if ((PFftab[fd].fname = savestr(fname)) == NULL){
 		/* no memory */
+		if (PFftab[fd].map != NULL)
+			free((char *)PFftab[fd].map);
+		if (PFftab[fd].shadow != NULL)
+			PFsfree(PFftab[fd].shadow);
 		close(PFftab[fd].unixfd);
 		PFerrno = PFE_NOMEM;
 		return(PFerrno);
 	}
 
+	if (PFftab[fd].mem != NULL)
+		PFftab[fd].mem->nopen++;
+
+	PFbufFileOpened(fd,PFftab[fd].fname);
+	PFlogFileOpened(fd,PFftab[fd].fname,
+		PFftab[fd].compressed || PFftab[fd].shadow != NULL ||
+		PFftab[fd].mem != NULL);
 	return(fd);
 }
 
@@ -369,37 +1318,54 @@ int error;
 	if ( (error=PFbufReleaseFile(fd,PFwritefcn)) != PFE_OK)
 		return(error);
 
-	if (PFftab[fd].hdrchanged){
-		/* write the header back to the file */
-		/* First seek to the appropriate place */
-		if ((error=lseek(PFftab[fd].unixfd,(unsigned)0,L_SET)) == -1){
-			/* seek error */
-			PFerrno = PFE_UNIX;
-			return(PFerrno);
-		}
-
-		/* write header*/
-		if((error=write(PFftab[fd].unixfd, (char *)&PFftab[fd].hdr,
-				PF_HDR_SIZE))!=PF_HDR_SIZE){
-			if (error <0)
-				PFerrno = PFE_UNIX;
-			else	PFerrno = PFE_HDRWRITE;
-			return(PFerrno);
-		}
+	if (PFftab[fd].mem != NULL){
+		/* keep the header with the pages */
+		PFftab[fd].mem->hdr = PFftab[fd].hdr;
+		PFftab[fd].mem->nopen--;
 		PFftab[fd].hdrchanged = FALSE;
 	}
+	else if (PFftab[fd].shadow != NULL){
+		/* an update not committed ends here */
+		PFftab[fd].shadow->updating = FALSE;
+		if ((PFftab[fd].hdrchanged || PFftab[fd].shadow->changed) &&
+				(error=PFswritehdr(fd,FALSE)) != PFE_OK)
+			return(error);
+		PFftab[fd].hdrchanged = FALSE;
+	}
+	else if (PFftab[fd].hdrchanged && PFftab[fd].compressed){
+		/* write the page map and headers back to the file */
+		if ((error=PFcwritehdr(fd)) != PFE_OK)
+			return(error);
+		PFftab[fd].hdrchanged = FALSE;
+	}
+	else if ((error=PFflushHdr(fd)) != PFE_OK)
+		/* write the header back to the file */
+		return(error);
 
-
+	/* a file changed by logged transactions is made durable, so that
+	the log no longer needs its records */
+	if (PFlogFileClosed(fd) && fsync(PFftab[fd].unixfd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
 		
 	/* close the file */
-	if ((error=close(PFftab[fd].unixfd))== -1){
+	if (PFftab[fd].mem == NULL && (error=close(PFftab[fd].unixfd))== -1){
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
 
 	/* free the file name space */
+	PFbufFileClosed(fd);
 	free((char *)PFftab[fd].fname);
 	PFftab[fd].fname = NULL;
+	if (PFftab[fd].map != NULL)
+		free((char *)PFftab[fd].map);
+	PFftab[fd].map = NULL;
+	if (PFftab[fd].shadow != NULL)
+		PFsfree(PFftab[fd].shadow);
+	PFftab[fd].shadow = NULL;
+	PFftab[fd].mem = NULL;
 
 	return(PFE_OK);
 }
@@ -479,7 +1445,7 @@ PFfpage *fpage;	/* pointer to file page */
 			/* found a used page */
 			*pagenum = temppage;
 			*pagebuf = (char *)fpage->pagebuf;
-			return(PFE_OK);
+			return(PFstouch(fd,temppage,fpage));
 		}
 
 		/* page is free, unfix it */
@@ -535,7 +1501,7 @@ PFfpage *fpage;
 	if (fpage->nextfree == PF_PAGE_USED){
 		/* page is used*/
 		*pagebuf = (char *)fpage->pagebuf;
-		return(PFE_OK);
+		return(PFstouch(fd,pagenum,fpage));
 	}
 	else {
 		/* invalid page */
@@ -582,6 +1548,10 @@ int error;
 					PFwritefcn))!= PFE_OK)
 			/* can't get the page */
 			return(error);
+		if ((error=PFstouch(fd,*pagenum,fpage)) != PFE_OK){
+			PFbufUnfix(fd,*pagenum,FALSE);
+			return(error);
+		}
 		PFftab[fd].hdr.firstfree = fpage->nextfree;
 		PFftab[fd].hdrchanged = TRUE;
 	}
@@ -591,6 +1561,10 @@ int error;
 		if ((error=PFbufAlloc(fd,*pagenum,&fpage,PFwritefcn))!= PFE_OK)
 			/* can't allocate a page */
 			return(error);
+		if ((error=PFstouch(fd,*pagenum,fpage)) != PFE_OK){
+			PFbufDiscard(fd,*pagenum);
+			return(error);
+		}
 	
 		/* increment # of pages for this file */
 		PFftab[fd].hdr.numpages++;
@@ -663,6 +1637,10 @@ int error;
 	}
 
 	/* put this page into the free list */
+	if ((error=PFstouch(fd,pagenum,fpage)) != PFE_OK){
+		PFbufUnfix(fd,pagenum,FALSE);
+		return(error);
+	}
 	fpage->nextfree = PFftab[fd].hdr.firstfree;
 	PFftab[fd].hdr.firstfree = pagenum;
 	PFftab[fd].hdrchanged = TRUE;
@@ -703,6 +1681,377 @@ RETURN VALUE:
 	return(PFbufUnfix(fd,pagenum,dirty));
 }
 
+PF_GetNumPages(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Return the number of pages (used or free) in the file "fd", as
+	recorded in its header. Pages numbered 0 .. numpages-1 exist.
+
+RETURN VALUE:
+	The number of pages, which is >= 0, if no error.
+	PFE_FD	if the file descriptor is invalid.
+
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+
+	return(PFftab[fd].hdr.numpages);
+}
+
+double PF_MsBetween(a,b)
+struct timespec a;	/* start */
+struct timespec b;	/* end */
+/****************************************************************************
+SPECIFICATIONS:
+	Elapsed time between two clock_gettime() readings of the same
+	clock, for the drivers that time their runs.
+
+RETURN VALUE:
+	the milliseconds from a to b.
+*****************************************************************************/
+{
+	return((b.tv_sec - a.tv_sec) * 1e3 + (b.tv_nsec - a.tv_nsec) / 1e6);
+}
+
+PFflushPage(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Write page "pagenum" of file "fd" if it is dirty in the buffer and
+	not fixed. It stays in the buffer.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFbufWritePage(fd,pagenum,PFwritefcn));
+}
+
+PFflushHdr(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Write the header of file "fd" back to the file if it has changed,
+	so that pages allocated since are part of the file even if it is
+	not closed. Compressed, shadow and memory files are left alone:
+	their headers are written at close.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	if (!PFftab[fd].hdrchanged || PFftab[fd].mem != NULL ||
+			PFftab[fd].shadow != NULL || PFftab[fd].compressed)
+		return(PFE_OK);
+
+	/* First seek to the appropriate place */
+	if ((error=lseek(PFftab[fd].unixfd,(unsigned)0,L_SET)) == -1){
+		/* seek error */
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	/* write header*/
+	if((error=write(PFftab[fd].unixfd, (char *)&PFftab[fd].hdr,
+			PF_HDR_SIZE))!=PF_HDR_SIZE){
+		if (error <0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_HDRWRITE;
+		return(PFerrno);
+	}
+	PFftab[fd].hdrchanged = FALSE;
+	return(PFE_OK);
+}
+
+PFgetHdr(fd,hdr)
+int fd;		/* file descriptor */
+PFhdr_str *hdr;	/* set to the header of the file */
+/****************************************************************************
+SPECIFICATIONS:
+	Copy the header of file "fd", with its free list and page count,
+	to "hdr", for PFputHdr().
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	*hdr = PFftab[fd].hdr;
+	return(PFE_OK);
+}
+
+PFputHdr(fd,hdr)
+int fd;		/* file descriptor */
+PFhdr_str *hdr;	/* a header from PFgetHdr() */
+/****************************************************************************
+SPECIFICATIONS:
+	Put back header "hdr" of file "fd", as the log manager does when
+	a transaction aborts. Pages past its end, allocated since, are
+	dropped from the buffer without being written.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int pagenum, error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	for (pagenum=hdr->numpages; pagenum < PFftab[fd].hdr.numpages; pagenum++)
+		if ((error=PFbufDiscard(fd,pagenum)) != PFE_OK)
+			return(error);
+	PFftab[fd].hdr = *hdr;
+	PFftab[fd].hdrchanged = TRUE;
+	return(PFE_OK);
+}
+
+PF_ShadowBegin(fd)
+int fd;		/* file descriptor of a shadow file */
+/****************************************************************************
+SPECIFICATIONS:
+	Start an update of the shadow file "fd". Until PF_ShadowCommit(),
+	pages of the file written from the buffer go to free slots; the
+	pages of the last commit stay as they are.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_SHADOW if "fd" is not a shadow file, or is in an update.
+	other PF error code if error.
+*****************************************************************************/
+{
+PFshadow *sh;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	if ((sh=PFftab[fd].shadow) == NULL || sh->updating){
+		PFerrno = PFE_SHADOW;
+		return(PFerrno);
+	}
+	sh->updating = TRUE;
+	sh->ntouched = 0;
+	sh->moved = 0;
+	sh->nundo = 0;
+	sh->nsaved = 0;
+	sh->begin = PFftab[fd].hdr;
+	return(PFE_OK);
+}
+
+PF_ShadowCommit(fd,sync)
+int fd;		/* file descriptor of a shadow file */
+int sync;	/* TRUE if the commit is to survive a crash of the system */
+/****************************************************************************
+SPECIFICATIONS:
+	End the update of the shadow file "fd" started by PF_ShadowBegin().
+	The pages changed by it should all be unfixed. They are written
+	to free slots, then a new page table and the header that points
+	to it: a crash before the header is written leaves the file as
+	of the last commit. With "sync" the file is fsync()ed before and
+	after the header, which also makes the commit durable; without,
+	the file is only safe from a crash of the process.
+	An update that changed one page and not the file header is not
+	written: the page is written in place when it leaves the buffer,
+	which is as atomic as any other page write.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_SHADOW if "fd" is not a shadow file in an update.
+	other PF error code if error.
+*****************************************************************************/
+{
+PFshadow *sh;
+int i, ndirty, error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	if ((sh=PFftab[fd].shadow) == NULL || !sh->updating){
+		PFerrno = PFE_SHADOW;
+		return(PFerrno);
+	}
+
+	for (i=0, ndirty=0; i < sh->ntouched; i++)
+		if (PFbufIsDirty(fd,sh->touched[i]))
+			ndirty++;
+	if (ndirty <= 1 && sh->moved == 0 &&
+			sh->begin.firstfree == PFftab[fd].hdr.firstfree &&
+			sh->begin.numpages == PFftab[fd].hdr.numpages){
+		sh->updating = FALSE;
+		return(PFE_OK);
+	}
+
+	for (i=0; i < sh->ntouched; i++)
+		if ((error=PFbufWritePage(fd,sh->touched[i],PFwritefcn)) != PFE_OK)
+			return(error);
+	sh->updating = FALSE;
+	if ((error=PFswritehdr(fd,sync)) != PFE_OK)
+		return(error);
+	PFftab[fd].hdrchanged = FALSE;
+	return(PFE_OK);
+}
+
+PF_ShadowAbort(fd)
+int fd;		/* file descriptor of a shadow file */
+/****************************************************************************
+SPECIFICATIONS:
+	End the update of the shadow file "fd" started by PF_ShadowBegin()
+	without publishing it: the pages fixed in it are dropped from the
+	buffer, or put back as they were if they held changes from
+	outside the update, the pages it wrote to new slots go back to
+	the slots of the last commit and the file header is put back.
+	Pages of the update still fixed are dropped too.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_SHADOW if "fd" is not a shadow file in an update.
+	other PF error code if error.
+*****************************************************************************/
+{
+PFshadow *sh;
+PFfpage *fpage;
+int i, page, error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	if ((sh=PFftab[fd].shadow) == NULL || !sh->updating){
+		PFerrno = PFE_SHADOW;
+		return(PFerrno);
+	}
+
+	for (i=0; i < sh->ntouched; i++)
+		if ((error=PFbufDiscard(fd,sh->touched[i])) != PFE_OK)
+			return(error);
+	for (i=sh->nundo - 1; i >= 0; i--){
+		page = sh->undo[3*i];
+		sh->slots[sh->undo[3*i+2]] = PF_SLOT_FREE;
+		sh->nfree++;
+		sh->table[page] = sh->undo[3*i+1];
+		if (sh->table[page] >= 0)
+			sh->slots[sh->table[page]] = PF_SLOT_USED;
+	}
+	sh->nundo = sh->moved = sh->ntouched = 0;
+	sh->updating = FALSE;
+	PFftab[fd].hdr = sh->begin;
+
+	/* changes from before the update, not yet written */
+	for (i=0; i < sh->nsaved; i++){
+		if ((error=PFbufAlloc(fd,sh->saved[i].page,&fpage,PFwritefcn))
+				!= PFE_OK)
+			return(error);
+		memcpy((char *)fpage,(char *)&sh->saved[i].fpage,sizeof(PFfpage));
+		if ((error=PFbufUnfix(fd,sh->saved[i].page,TRUE)) != PFE_OK)
+			return(error);
+	}
+	sh->nsaved = 0;
+	return(PFE_OK);
+}
+
+PF_ShadowState(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell whether "fd" is a shadow file, and whether an update of it
+	is under way. It does not set PFerrno.
+
+RETURN VALUE:
+	PF_SHADOW_NONE	if it is not a shadow file, or "fd" is invalid.
+	PF_SHADOW_IDLE	if it is a shadow file not in an update.
+	PF_SHADOW_UPDATING if it is a shadow file in an update.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd) || PFftab[fd].shadow == NULL)
+		return(PF_SHADOW_NONE);
+	return(PFftab[fd].shadow->updating ? PF_SHADOW_UPDATING : PF_SHADOW_IDLE);
+}
+
+PFfixPage(fd,pagenum,fpage,extend)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+PFfpage **fpage;	/* set to the fixed page */
+int extend;	/* TRUE if pages past the end are added */
+/****************************************************************************
+SPECIFICATIONS:
+	Fix page "pagenum" of file "fd" in the buffer for the log manager,
+	which unfixes it with PFbufUnfix(). With "extend", a page past
+	the end of the file, whose header may be older than its pages
+	after a crash, is added to the file: it is read if it was
+	written, and is an empty used page if not.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	if (extend && pagenum >= PFftab[fd].hdr.numpages){
+		PFftab[fd].hdr.numpages = pagenum+1;
+		PFftab[fd].hdrchanged = TRUE;
+	}
+	if (pagenum < 0 || pagenum >= PFftab[fd].hdr.numpages){
+		PFerrno = PFE_INVALIDPAGE;
+		return(PFerrno);
+	}
+
+	if ((error=PFbufGet(fd,pagenum,fpage,PFreadfcn,PFwritefcn))
+			== PFE_INCOMPLETEREAD && extend){
+		/* never written */
+		if ((error=PFbufAlloc(fd,pagenum,fpage,PFwritefcn)) != PFE_OK)
+			return(error);
+		memset((char *)*fpage,0,sizeof(PFfpage));
+		(*fpage)->nextfree = PF_PAGE_USED;
+	}
+	return(error);
+}
+
+void PF_GetIOBytes(nread,nwritten)
+long *nread;	/* bytes read from paged files */
+long *nwritten;	/* bytes written to paged files */
+/****************************************************************************
+SPECIFICATIONS:
+	Return the # of bytes of pages read from and written to files since
+	PF_Init(). A page of an ordinary file is sizeof(PFfpage) bytes; a
+	page of a compressed file is the size of its compressed data.
+
+RETURN VALUE: none
+*****************************************************************************/
+{
+	*nread = PFbytesread;
+	*nwritten = PFbyteswritten;
+}
+
 /* error messages */
 static char *PFerrormsg[]={
 "No error",
@@ -724,7 +2073,14 @@ static char *PFerrormsg[]={
 "page already unfixed",
 "new page to be allocated already in buffer",
 "hash table entry not found",
-"page already in hash table"
+"page already in hash table",
+"not the active transaction",
+"bad record in the log",
+"too many files in the log",
+"not a paged file, or one of an older format",
+"log record too large",
+"not a shadow file, or not in the right update state",
+"stats reporter already running, or not running"
 };
 
 void PF_PrintError(s)
@@ -30,6 +30,19 @@
 #define PFE_HASHNOTFOUND -18	/* hash table entry not found */
 #define PFE_HASHPAGEEXIST -19	/* page already exist in hash table */
 
+/* Write-ahead log */
+#define PFE_TXN		-20	/* not the active transaction */
+#define PFE_LOGREAD	-21	/* bad record in the log */
+#define PFE_LOGFULL	-22	/* PF_LOG_MAXFILES files already in the log */
+#define PFE_MAGIC	-23	/* not a paged file, or one of an older format */
+#define PFE_LOGREC	-24	/* log record too large */
+
+/* Shadow files */
+#define PFE_SHADOW	-25	/* not a shadow file, or wrong update state */
+
+/* Stats reporter */
+#define PFE_REPORT	-26	/* reporter already running, or not running */
+
 
 /* page size */
 #define PF_PAGE_SIZE	4096
@@ -44,3 +57,40 @@ extern void PF_PrintError();
 /* Configuration API for buffer manager */
 extern int PF_SetBufferParams(int buf_count, int repl_policy); /* buf_count<=PF_MAX_BUFS, repl_policy: PF_REPL_LRU or PF_REPL_MRU */
 extern int PF_GetStats(struct PFstats *out); /* copy current stats into out */
+extern int PF_GetFileStats(int fd, struct PFstats *out); /* the same, for the pages of fd since it was opened */
+extern int PF_GetPoolStats(struct PFpoolstats *out); /* pages used, dirty and fixed */
+extern int PF_GetNumPages(int fd); /* # of pages in the file, or PF error code */
+struct timespec;
+extern double PF_MsBetween(struct timespec a, struct timespec b); /* ms from a to b, as read by clock_gettime() */
+extern int PF_CreateCompressedFile(char *fname); /* pages stored LZ-compressed */
+extern void PF_GetIOBytes(long *nread, long *nwritten); /* bytes of pages read/written */
+extern int PF_CreateShadowFile(char *fname); /* updates reach the file atomically */
+extern int PF_ShadowBegin(int fd); /* start an atomic update */
+extern int PF_ShadowCommit(int fd, int sync); /* publish it; sync: fsync() too */
+extern int PF_ShadowAbort(int fd); /* drop it; the last commit stands */
+extern int PF_ShadowState(int fd); /* one of: */
+#define PF_SHADOW_NONE		0	/* not a shadow file */
+#define PF_SHADOW_IDLE		1	/* a shadow file, not in an update */
+#define PF_SHADOW_UPDATING	2	/* in an update */
+extern int PF_CreateMemFile(char *fname); /* pages kept in memory, not on disk */
+
+/* Write-ahead log (pflog.c) */
+extern int PF_LogOpen(char *fname); /* recover from, then log to, fname */
+extern int PF_LogClose(void);
+extern int PF_LogBegin(void); /* start a transaction; returns its id > 0 */
+extern int PF_LogCommit(int txn);
+extern int PF_LogAbort(int txn);
+extern int PF_LogForce(void); /* make all commits durable */
+extern int PF_LogSetGroupSize(int n); /* commits per fsync() of the log */
+extern int PF_LogCheckpoint(void); /* fuzzy checkpoint: recovery starts here */
+extern int PF_LogSetCheckpoint(long interval, int trickle); /* every interval bytes of log; pages written per commit */
+extern int PF_LogGetStats(struct PFlogstats *out);
+
+/* Event tracing (pftrace.c) */
+extern int PF_TraceStart(int nevents); /* record events, up to nevents per thread */
+extern void PF_TraceStop(void);
+extern int PF_TraceDump(char *fname); /* stop, and write the events to fname */
+
+/* Stats reporter (pfreport.c) */
+extern int PF_ReportStart(char *csvdest, char *promdest, int interval_ms); /* a path, or "unix:" and a socket path; either may be NULL */
+extern int PF_ReportStop(void); /* take a last sample and stop */
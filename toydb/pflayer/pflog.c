@@ -0,0 +1,1056 @@
+/* pflog.c: write-ahead log for paged files. The interface routines are:
+PF_LogOpen(), PF_LogClose(), PF_LogBegin(), PF_LogCommit(), PF_LogAbort(),
+PF_LogForce(), PF_LogSetGroupSize() and PF_LogGetStats().
+
+While a transaction is active, every page fixed in the buffer is copied
+(buf.c), and when it is unfixed the bytes changed are logged with their
+before and after images. The page is stamped with the LSN of the record,
+and the buffer manager forces the log up to that LSN before it writes the
+page (PFlogFlush()). Commits are forced in groups of PF_LogSetGroupSize():
+one fsync() for the group. A commit not yet forced is lost by a crash,
+as is one whose group has not been forced.
+
+PF_LogOpen() recovers from the log: the changes of all transactions are
+redone on pages older than them, those of the transaction active at the
+crash are undone, the files are written back and the log is emptied.
+
+A fuzzy checkpoint (PF_LogCheckpoint()) logs the dirty pages in the buffer
+with the LSN of their first change not yet written, and the transaction
+active, without writing any page, followed by a record naming each file in
+the log. Recovery starts redo at the oldest of
+those LSNs instead of the start of the log. After a checkpoint, each
+commit writes a few of its dirty pages, in page order, so the next
+checkpoint starts redo later. PF_LogSetCheckpoint() takes checkpoints
+every so many bytes of log.
+
+One transaction is active at a time. Changes to compressed and shadow
+files, and the free page list and page count in file headers, are not
+logged: an abort puts back the headers kept when the transaction first
+fixed a page of each file, and the page count of a file is raised at
+recovery to cover the pages logged. A log
+names at most PF_LOG_MAXFILES files until it is emptied, a file opened
+again keeping its id; fixing a page of one more in a transaction fails
+with PFE_LOGFULL. */
+
+/* fsync() and ftruncate() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "pf.h"
+#include "pftypes.h"
+
+static int PFlogfd = -1;	/* unix fd of the log, or -1 if none */
+static long PFlogbase;		/* LSN of the first record in the file */
+static long PFlognext;		/* LSN of the next record */
+static long PFlogwritten;	/* records before this LSN are in the file */
+static long PFlogdurable;	/* ... and these have been fsync()ed */
+static char PFlogbuf[PF_LOG_BUFSIZE];	/* records from PFlogwritten on */
+
+static int PFlogtxn = 0;	/* active transaction, or 0 */
+static int PFlognexttxn = 1;	/* id of the next transaction */
+static long PFloglast;		/* LSN of the last record of PFlogtxn */
+static int PFloggroup = 1;	/* commits per force */
+static int PFlogpending = 0;	/* commits since the last force */
+static PFlogstats PFlog_stats;
+
+/* the log's view of open files, indexed by PF file descriptor */
+static struct {
+	char *fname;	/* name, or NULL if not open */
+	short compressed;
+	short fileid;	/* id in the log, or -1 if not yet logged */
+	int hdrtxn;	/* transaction that first fixed a page of it, or 0 */
+	PFhdr_str hdr;	/* the file header before hdrtxn */
+} PFlogfiles[PF_FTAB_SIZE];
+static short PFlognextfile = 0;	/* next file id */
+static char *PFlognames[PF_LOG_MAXFILES];	/* file names, by file id */
+
+static long PFlogckptlsn;	/* LSN past the last checkpoint and its names */
+static long PFlogckptint = 0;	/* log bytes between checkpoints, or 0 */
+static int PFlogtrickle = 0;	/* pages written per commit */
+static PFdirty PFlogdirty[PF_MAX_BUFS];	/* pages of the last checkpoint */
+static int PFlogndirty = 0;	/* # of them */
+static int PFlognextdirty = 0;	/* next one to write */
+
+/* a record and its data */
+static union {
+	PFlogrec rec;
+	char buf[sizeof(PFlogrec) + 2 * PF_PAGE_SIZE];
+} PFlogrecbuf;
+
+/* file offset of the record with LSN lsn */
+#define PFlogOffset(lsn) ((lsn) - PFlogbase + (long)PF_LOG_HDR_SIZE)
+
+static PFlogWrite()
+/****************************************************************************
+SPECIFICATIONS:
+	Write the records in memory to the log file, without waiting
+	for them to reach the disk.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+int len;
+
+	len = PFlognext - PFlogwritten;
+	if (len == 0)
+		return(PFE_OK);
+	if (lseek(PFlogfd,PFlogOffset(PFlogwritten),SEEK_SET) == -1 ||
+			write(PFlogfd,PFlogbuf,len) != len){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	PFlogwritten = PFlognext;
+	return(PFE_OK);
+}
+
+static PFlogAppend(rec,data1,len1,data2,len2,lsn)
+PFlogrec *rec;		/* record; size and prevlsn are filled in */
+char *data1;		/* data following the record */
+int len1;
+char *data2;		/* more data */
+int len2;
+long *lsn;		/* set to the LSN of the record */
+/****************************************************************************
+SPECIFICATIONS:
+	Append a record to the log. It is kept in memory until the
+	memory is full or the log is forced.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_LOGREC if the record is larger than PFlogRead() can read.
+	PF error code if not OK.
+*****************************************************************************/
+{
+char *p;
+int error;
+
+	if (len1 < 0 || len2 < 0 ||
+			(long)len1 + len2 > (long)(sizeof(PFlogrecbuf) - sizeof(PFlogrec))){
+		PFerrno = PFE_LOGREC;
+		return(PFerrno);
+	}
+	rec->size = sizeof(PFlogrec) + len1 + len2;
+	if (PFlognext - PFlogwritten + rec->size > PF_LOG_BUFSIZE &&
+			(error=PFlogWrite()) != PFE_OK)
+		return(error);
+
+	rec->prevlsn = rec->txn != 0 ? PFloglast : 0;
+	*lsn = PFlognext;
+	p = PFlogbuf + (PFlognext - PFlogwritten);
+	memcpy(p,(char *)rec,sizeof(PFlogrec));
+	memcpy(p + sizeof(PFlogrec),data1,len1);
+	memcpy(p + sizeof(PFlogrec) + len1,data2,len2);
+	PFlognext += rec->size;
+	if (rec->txn != 0)
+		PFloglast = *lsn;
+
+	PFlog_stats.records++;
+	PFlog_stats.bytes += rec->size;
+	return(PFE_OK);
+}
+
+static PFlogRead(lsn,end)
+long lsn;		/* LSN of the record */
+long end;		/* LSN past the last record */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the record with LSN "lsn" into PFlogrecbuf, from memory if
+	it has not been written yet.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_LOGREAD if there is no whole record at lsn.
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFlogrec *rec = &PFlogrecbuf.rec;
+
+	if (lsn >= PFlogwritten){
+		if (lsn + (long)sizeof(PFlogrec) > PFlognext)
+			goto bad;
+		memcpy(PFlogrecbuf.buf,PFlogbuf + (lsn - PFlogwritten),
+			sizeof(PFlogrec));
+	}
+	else if (lsn + (long)sizeof(PFlogrec) > end ||
+			lseek(PFlogfd,PFlogOffset(lsn),SEEK_SET) == -1 ||
+			read(PFlogfd,PFlogrecbuf.buf,sizeof(PFlogrec))
+				!= sizeof(PFlogrec))
+		goto bad;
+
+	if (rec->size < (int)sizeof(PFlogrec) ||
+			rec->size > (int)sizeof(PFlogrecbuf) ||
+			rec->type < PF_LOG_BEGIN || rec->type > PF_LOG_CKPT ||
+			lsn + rec->size > (lsn >= PFlogwritten ? PFlognext : end))
+		goto bad;
+
+	if (lsn >= PFlogwritten)
+		memcpy(PFlogrecbuf.buf + sizeof(PFlogrec),
+			PFlogbuf + (lsn - PFlogwritten) + sizeof(PFlogrec),
+			rec->size - sizeof(PFlogrec));
+	else if (read(PFlogfd,PFlogrecbuf.buf + sizeof(PFlogrec),
+			rec->size - sizeof(PFlogrec))
+				!= rec->size - (int)sizeof(PFlogrec))
+		goto bad;
+	return(PFE_OK);
+
+bad:
+	PFerrno = PFE_LOGREAD;
+	return(PFerrno);
+}
+
+static PFlogSetName(fileid,name,len)
+int fileid;	/* file id in the log */
+char *name;	/* its name, not null terminated */
+int len;	/* length of name */
+/****************************************************************************
+SPECIFICATIONS:
+	Remember the name of file "fileid" of the log, unless it is
+	known already.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_LOGFULL if fileid is not below PF_LOG_MAXFILES.
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+	if (fileid < 0 || fileid >= PF_LOG_MAXFILES){
+		PFerrno = PFE_LOGFULL;
+		return(PFerrno);
+	}
+	if (PFlognames[fileid] != NULL)
+		return(PFE_OK);
+	if ((PFlognames[fileid]=malloc(len + 1)) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	memcpy(PFlognames[fileid],name,len);
+	PFlognames[fileid][len] = '\0';
+	if (fileid >= PFlognextfile)
+		PFlognextfile = fileid + 1;
+	return(PFE_OK);
+}
+
+static void PFlogFreeNames()
+{
+int i;
+
+	for (i=0; i < PF_LOG_MAXFILES; i++){
+		if (PFlognames[i] != NULL)
+			free(PFlognames[i]);
+		PFlognames[i] = NULL;
+	}
+	PFlognextfile = 0;
+}
+
+static PFlogFindName(fname)
+char *fname;	/* file name */
+/****************************************************************************
+SPECIFICATIONS:
+	Find the id in the log of file "fname", which was named while
+	an earlier open of it was changed.
+
+RETURN VALUE:
+	The file id, or -1 if the log does not name the file.
+*****************************************************************************/
+{
+int i;
+
+	for (i=0; i < PFlognextfile; i++)
+		if (PFlognames[i] != NULL && strcmp(PFlognames[i],fname) == 0)
+			return(i);
+	return(-1);
+}
+
+static PFlogWriteHdr(ckpt)
+long ckpt;	/* LSN of the last checkpoint, or 0 */
+/****************************************************************************
+SPECIFICATIONS:
+	Write the log header and sync it.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFloghdr_str hdr;
+
+	hdr.magic = PF_LOG_MAGIC;
+	hdr.base = PFlogbase;
+	hdr.ckpt = ckpt;
+	if (lseek(PFlogfd,0,SEEK_SET) == -1 ||
+			write(PFlogfd,(char *)&hdr,PF_LOG_HDR_SIZE) != PF_LOG_HDR_SIZE ||
+			fsync(PFlogfd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+static long PFlogapplylsn;	/* LSN of the record in PFlogrecbuf */
+
+static PFlogApply(fd,image,extend)
+int fd;		/* file of the update record in PFlogrecbuf */
+int image;	/* 0: the before image, 1: the after image */
+int extend;	/* TRUE if the page may be past the end of the file */
+/****************************************************************************
+SPECIFICATIONS:
+	Put an image of the update record in PFlogrecbuf on its page. The
+	after image (redo) is put only on a page older than the record,
+	which is then stamped with PFlogapplylsn.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFlogrec *rec = &PFlogrecbuf.rec;
+PFfpage *fpage;
+int error, changed;
+
+	if ((error=PFfixPage(fd,rec->page,&fpage,extend)) != PFE_OK)
+		return(error);
+	changed = image == 0 || fpage->lsn < PFlogapplylsn;
+	if (changed){
+		memcpy(fpage->pagebuf + rec->off,
+			PFlogrecbuf.buf + sizeof(PFlogrec) + image * rec->len,
+			rec->len);
+		fpage->nextfree = rec->nextfree[image];
+		if (image == 1){
+			fpage->lsn = PFlogapplylsn;
+			PFlog_stats.redone++;
+		}
+	}
+	return(PFbufUnfix(fd,rec->page,changed));
+}
+
+static PFlogRecover(end,ckpt)
+long end;	/* LSN past the end of the log file */
+long ckpt;	/* LSN of the last checkpoint, or 0 */
+/****************************************************************************
+SPECIFICATIONS:
+	Recover the files in the log: redo all updates from the oldest
+	change of the dirty pages at the last checkpoint, then undo those
+	of the transaction that was active at the crash. Files that no
+	longer exist are skipped. A partly written record ends the log.
+	The files are written back and closed.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+int fds[PF_LOG_MAXFILES];	/* PF fd, -1 not opened, -2 can't open */
+PFlogrec *rec = &PFlogrecbuf.rec;
+PFlogckpt *ck;
+PFdirty *dirty;
+long lsn, start, redo, loserlast = 0;
+int loser = 0, i, error = PFE_OK;
+
+	PFlognext = PFlogwritten = PFlogdurable = end;
+	for (i=0; i < PF_LOG_MAXFILES; i++)
+		fds[i] = -1;
+
+	/* the checkpoint: dirty pages, the transaction active; the file
+	names follow it */
+	start = redo = PFlogbase;
+	if (ckpt != 0 && PFlogRead(ckpt,end) == PFE_OK &&
+			rec->type == PF_LOG_CKPT){
+		ck = (PFlogckpt *)(PFlogrecbuf.buf + sizeof(PFlogrec));
+		dirty = (PFdirty *)(ck + 1);
+		loser = ck->txn;
+		loserlast = ck->txnlast;
+		start = redo = ckpt;
+		for (i=0; i < ck->ndirty; i++)
+			if (dirty[i].reclsn < redo)
+				redo = dirty[i].reclsn;
+	}
+
+	/* analysis: file names, the end of the log, the loser */
+	for (lsn = start; lsn < end && PFlogRead(lsn,end) == PFE_OK;
+			lsn += rec->size){
+		if (rec->type == PF_LOG_FILE &&
+				(error=PFlogSetName(rec->fileid,
+				PFlogrecbuf.buf+sizeof(PFlogrec),rec->len)) != PFE_OK)
+			return(error);
+		else if (rec->type == PF_LOG_BEGIN)
+			loser = rec->txn;
+		else if (rec->type == PF_LOG_COMMIT || rec->type == PF_LOG_ABORT)
+			loser = 0;
+		if (rec->txn != 0 && rec->txn == loser)
+			loserlast = lsn;
+	}
+	end = lsn;
+	PFlognext = PFlogwritten = PFlogdurable = end;
+
+	/* redo */
+	for (lsn = redo; lsn < end && error == PFE_OK; lsn += rec->size){
+		if ((error=PFlogRead(lsn,end)) != PFE_OK)
+			break;
+		PFlog_stats.recovered++;
+		if (rec->type != PF_LOG_UPDATE || rec->fileid < 0 ||
+				rec->fileid >= PF_LOG_MAXFILES ||
+				PFlognames[rec->fileid] == NULL)
+			continue;
+		if (fds[rec->fileid] == -1){
+			if ((fds[rec->fileid]=PF_OpenFile(PFlognames[rec->fileid])) < 0)
+				fds[rec->fileid] = -2;
+			else	/* synced when closed */
+				PFlogfiles[fds[rec->fileid]].fileid = rec->fileid;
+		}
+		if (fds[rec->fileid] < 0)
+			continue;
+		PFlogapplylsn = lsn;
+		error = PFlogApply(fds[rec->fileid],1,TRUE);
+	}
+
+	/* undo the loser, newest update first */
+	for (lsn = loser != 0 ? loserlast : 0; lsn != 0 && error == PFE_OK;
+			lsn = rec->prevlsn){
+		if ((error=PFlogRead(lsn,end)) != PFE_OK)
+			break;
+		if (rec->type != PF_LOG_UPDATE || rec->fileid < 0 ||
+				rec->fileid >= PF_LOG_MAXFILES ||
+				PFlognames[rec->fileid] == NULL)
+			continue;
+		if (fds[rec->fileid] == -1){
+			/* changed only before the redo point */
+			if ((fds[rec->fileid]=PF_OpenFile(PFlognames[rec->fileid])) < 0)
+				fds[rec->fileid] = -2;
+			else	PFlogfiles[fds[rec->fileid]].fileid = rec->fileid;
+		}
+		if (fds[rec->fileid] >= 0){
+			PFlogapplylsn = lsn;
+			error = PFlogApply(fds[rec->fileid],0,TRUE);
+		}
+	}
+
+	for (i=0; i < PF_LOG_MAXFILES; i++)
+		if (fds[i] >= 0 && PF_CloseFile(fds[i]) != PFE_OK &&
+				error == PFE_OK)
+			error = PFerrno;
+	return(error);
+}
+
+static PFlogTruncate()
+/****************************************************************************
+SPECIFICATIONS:
+	Empty the log. Later records get LSNs after those of the records
+	removed.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+int error;
+
+	PFlogbase = PFlogwritten = PFlogdurable = PFlogckptlsn = PFlognext;
+	PFlogndirty = PFlognextdirty = 0;
+	if (ftruncate(PFlogfd,PF_LOG_HDR_SIZE) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((error=PFlogWriteHdr(0L)) != PFE_OK)
+		return(error);
+	PFlogFreeNames();
+	return(PFE_OK);
+}
+
+static PFlogUpdate(fd,pagenum,before,after,off,len,lsn)
+int fd;		/* PF file descriptor */
+int pagenum;	/* page number */
+PFfpage *before;	/* the page when it was fixed */
+PFfpage *after;	/* the page now */
+int off;	/* first byte of pagebuf changed */
+int len;	/* # of bytes */
+long *lsn;	/* set to the LSN of the record */
+/****************************************************************************
+SPECIFICATIONS:
+	Log an update of "len" bytes at "off" of page "pagenum" of file
+	"fd", naming the file in the log first if it is not yet.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFlogrec rec;
+int error;
+
+	if (PFlogfiles[fd].fileid < 0)
+		/* named when it was open before */
+		PFlogfiles[fd].fileid = PFlogFindName(PFlogfiles[fd].fname);
+	if (PFlogfiles[fd].fileid < 0){
+		/* first change to the file: name it in the log */
+		if ((error=PFlogCheckFile(fd)) != PFE_OK)
+			return(error);
+		memset((char *)&rec,0,sizeof(rec));
+		rec.type = PF_LOG_FILE;
+		rec.fileid = PFlognextfile;
+		rec.len = strlen(PFlogfiles[fd].fname);
+		if ((error=PFlogSetName(rec.fileid,PFlogfiles[fd].fname,
+				rec.len)) != PFE_OK ||
+			(error=PFlogAppend(&rec,PFlogfiles[fd].fname,rec.len,
+				NULL,0,lsn)) != PFE_OK)
+			return(error);
+		PFlogfiles[fd].fileid = rec.fileid;
+	}
+
+	rec.type = PF_LOG_UPDATE;
+	rec.fileid = PFlogfiles[fd].fileid;
+	rec.txn = PFlogtxn;
+	rec.page = pagenum;
+	rec.off = off;
+	rec.len = len;
+	rec.nextfree[0] = before->nextfree;
+	rec.nextfree[1] = after->nextfree;
+	return(PFlogAppend(&rec,before->pagebuf + off,len,
+			after->pagebuf + off,len,lsn));
+}
+
+static int PFlogDirtyCmp(a,b)
+const void *a, *b;
+{
+const PFdirty *x = a, *y = b;
+
+	if (x->file != y->file)
+		return(x->file - y->file);
+	return(x->page - y->page);
+}
+
+static PFlogTrickle()
+/****************************************************************************
+SPECIFICATIONS:
+	Write the next PFlogtrickle pages that were dirty at the last
+	checkpoint, in file and page order. Pages written since are
+	skipped by PFflushPage().
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+int i, error;
+
+	for (i=0; i < PFlogtrickle && PFlognextdirty < PFlogndirty; i++){
+		if ((error=PFflushPage(PFlogdirty[PFlognextdirty].file,
+				PFlogdirty[PFlognextdirty].page)) != PFE_OK)
+			return(error);
+		PFlognextdirty++;
+		PFlog_stats.trickled++;
+	}
+	return(PFE_OK);
+}
+
+/****************** Interface to the PF layer and buffer manager ***********/
+
+PFlogCapturing(fd)
+int fd;		/* PF file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell whether changes to pages of file "fd" are to be logged.
+
+RETURN VALUE:
+	TRUE or FALSE
+*****************************************************************************/
+{
+	return(PFlogtxn != 0 && !PFlogfiles[fd].compressed);
+}
+
+PFlogCheckFile(fd)
+int fd;		/* PF file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell whether a page of file "fd" may be fixed: if its changes are
+	to be logged, the file has an id in the log, the log names it
+	from an earlier open, or an id is left. The first time in a
+	transaction, the file header is kept for PF_LogAbort().
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_LOGFULL if the log already names PF_LOG_MAXFILES files.
+*****************************************************************************/
+{
+	if (PFlogCapturing(fd) && PFlogfiles[fd].fileid < 0 &&
+			PFlognextfile >= PF_LOG_MAXFILES &&
+			PFlogFindName(PFlogfiles[fd].fname) < 0){
+		PFerrno = PFE_LOGFULL;
+		return(PFerrno);
+	}
+	if (PFlogCapturing(fd) && PFlogfiles[fd].hdrtxn != PFlogtxn){
+		PFgetHdr(fd,&PFlogfiles[fd].hdr);
+		PFlogfiles[fd].hdrtxn = PFlogtxn;
+	}
+	return(PFE_OK);
+}
+
+PFlogPage(fd,pagenum,before,after,first)
+int fd;		/* PF file descriptor */
+int pagenum;	/* page number */
+PFfpage *before;	/* the page when it was fixed */
+PFfpage *after;	/* the page now; its LSN is set */
+long *first;	/* set to the LSN of the first record, or 0 if none */
+/****************************************************************************
+SPECIFICATIONS:
+	Log the change from "before" to "after" of page "pagenum" of file
+	"fd": a record for each run of bytes that differ. Runs less than a
+	record header apart are one run. Nothing is logged if the page is
+	unchanged.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+long lsn;
+int i, j, start, end, error;
+
+	*first = 0;
+	if (PFlogtxn == 0)
+		return(PFE_OK);
+
+	for (i = 0; i < PF_PAGE_SIZE; i = end){
+		/* the next run */
+		for (; i < PF_PAGE_SIZE && before->pagebuf[i] == after->pagebuf[i];
+			i++);
+		if (i == PF_PAGE_SIZE)
+			break;
+		start = i;
+		for (end = j = i + 1; j < PF_PAGE_SIZE &&
+				j - end < (int)sizeof(PFlogrec); j++)
+			if (before->pagebuf[j] != after->pagebuf[j])
+				end = j + 1;
+		if ((error=PFlogUpdate(fd,pagenum,before,after,start,end - start,
+				&lsn)) != PFE_OK)
+			return(error);
+		if (*first == 0)
+			*first = lsn;
+	}
+	if (*first == 0 && before->nextfree != after->nextfree){
+		if ((error=PFlogUpdate(fd,pagenum,before,after,0,0,&lsn)) != PFE_OK)
+			return(error);
+		*first = lsn;
+	}
+	if (*first != 0)
+		after->lsn = lsn;
+	return(PFE_OK);
+}
+
+PFlogFlush(lsn)
+long lsn;	/* LSN of a record */
+/****************************************************************************
+SPECIFICATIONS:
+	Make the log durable up to the record with LSN "lsn", so that a
+	page stamped with it can be written.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+int error;
+
+	if (PFlogfd < 0 || lsn < PFlogdurable)
+		return(PFE_OK);
+	if ((error=PFlogWrite()) != PFE_OK)
+		return(error);
+	if (fsync(PFlogfd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	PFlogdurable = PFlognext;
+	PFlogpending = 0;
+	PFlog_stats.forces++;
+	return(PFE_OK);
+}
+
+void PFlogFileOpened(fd,fname,compressed)
+int fd;		/* PF file descriptor */
+char *fname;	/* its name; kept until PFlogFileClosed() */
+int compressed;	/* TRUE if a compressed or shadow file: not logged */
+{
+	PFlogfiles[fd].fname = fname;
+	PFlogfiles[fd].compressed = compressed;
+	PFlogfiles[fd].fileid = -1;
+	PFlogfiles[fd].hdrtxn = 0;
+}
+
+PFlogFileClosed(fd)
+int fd;		/* PF file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Forget file "fd", whose pages have been written back.
+
+RETURN VALUE:
+	TRUE	if its changes were logged: it must be synced before the
+		log is emptied.
+	FALSE	if not.
+*****************************************************************************/
+{
+int logged = PFlogfiles[fd].fileid >= 0;
+
+	PFlogfiles[fd].fname = NULL;
+	PFlogfiles[fd].fileid = -1;
+	return(logged);
+}
+
+/************************* Interface to the Outside World ****************/
+
+PF_LogOpen(fname)
+char *fname;	/* name of the log file */
+/****************************************************************************
+SPECIFICATIONS:
+	Open the log "fname", creating it if it does not exist, and
+	recover the files in it. Transactions begun later are logged to
+	it. No file in the log should be open.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+PFloghdr_str hdr;
+struct stat st;
+int error;
+
+	if (PFlogfd >= 0){
+		PFerrno = PFE_FILEOPEN;
+		return(PFerrno);
+	}
+	if ((PFlogfd=open(fname,O_RDWR|O_CREAT,0664)) < 0 ||
+			fstat(PFlogfd,&st) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	memset((char *)&PFlog_stats,0,sizeof(PFlog_stats));
+	PFlogtxn = 0;
+	PFlogpending = 0;
+
+	if (st.st_size < (long)PF_LOG_HDR_SIZE){
+		/* a new log */
+		PFlognext = 1;
+		error = PFlogTruncate();
+	}
+	else if (read(PFlogfd,(char *)&hdr,PF_LOG_HDR_SIZE) != PF_LOG_HDR_SIZE
+			|| hdr.magic != PF_LOG_MAGIC){
+		PFerrno = error = PFE_HDRREAD;
+	}
+	else {
+		PFlogbase = hdr.base;
+		if ((error=PFlogRecover(PFlogbase + st.st_size -
+				(long)PF_LOG_HDR_SIZE,hdr.ckpt)) == PFE_OK)
+			error = PFlogTruncate();
+	}
+
+	if (error != PFE_OK){
+		PFlogFreeNames();
+		close(PFlogfd);
+		PFlogfd = -1;
+	}
+	return(error);
+}
+
+PF_LogClose()
+/****************************************************************************
+SPECIFICATIONS:
+	Force the log and close it. A transaction still active is lost.
+	The log is emptied if no file changed by a logged transaction is
+	still open; otherwise the next PF_LogOpen() recovers them.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int error, i;
+
+	if (PFlogfd < 0)
+		return(PFE_OK);
+	PFlogtxn = 0;
+	error = PFlogFlush(PFlognext);
+	for (i=0; i < PF_FTAB_SIZE && (PFlogfiles[i].fname == NULL ||
+			PFlogfiles[i].fileid < 0); i++);
+	if (error == PFE_OK && i == PF_FTAB_SIZE)
+		error = PFlogTruncate();
+	for (i=0; i < PF_FTAB_SIZE; i++)
+		PFlogfiles[i].fileid = -1;
+	PFlogFreeNames();
+	PFlogndirty = PFlognextdirty = 0;
+	if (close(PFlogfd) == -1 && error == PFE_OK){
+		PFerrno = PFE_UNIX;
+		error = PFerrno;
+	}
+	PFlogfd = -1;
+	return(error);
+}
+
+PF_LogBegin()
+/****************************************************************************
+SPECIFICATIONS:
+	Begin a transaction. Until it commits or aborts, changes to pages
+	are logged. Pages must not be fixed across its begin or end.
+
+RETURN VALUE:
+	The transaction id, > 0, if OK
+	PFE_TXN if no log is open or a transaction is active.
+	PF error code if error.
+*****************************************************************************/
+{
+PFlogrec rec;
+long lsn;
+int error;
+
+	if (PFlogfd < 0 || PFlogtxn != 0){
+		PFerrno = PFE_TXN;
+		return(PFerrno);
+	}
+	memset((char *)&rec,0,sizeof(rec));
+	rec.type = PF_LOG_BEGIN;
+	rec.txn = PFlogtxn = PFlognexttxn++;
+	PFloglast = 0;
+	if ((error=PFlogAppend(&rec,NULL,0,NULL,0,&lsn)) != PFE_OK){
+		PFlogtxn = 0;
+		return(error);
+	}
+	return(rec.txn);
+}
+
+PF_LogCommit(txn)
+int txn;	/* the active transaction */
+/****************************************************************************
+SPECIFICATIONS:
+	Commit transaction "txn". The log is forced when the commits since
+	it was last forced make a group.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+PFlogrec rec;
+long lsn;
+int error;
+
+	if (PFlogfd < 0 || txn == 0 || txn != PFlogtxn){
+		PFerrno = PFE_TXN;
+		return(PFerrno);
+	}
+	memset((char *)&rec,0,sizeof(rec));
+	rec.type = PF_LOG_COMMIT;
+	rec.txn = txn;
+	if ((error=PFlogAppend(&rec,NULL,0,NULL,0,&lsn)) != PFE_OK)
+		return(error);
+	PFlogtxn = 0;
+	PFlog_stats.commits++;
+	if (++PFlogpending >= PFloggroup && (error=PFlogFlush(lsn)) != PFE_OK)
+		return(error);
+	if ((error=PFlogTrickle()) != PFE_OK)
+		return(error);
+	if (PFlogckptint > 0 && PFlognext - PFlogckptlsn >= PFlogckptint)
+		return(PF_LogCheckpoint());
+	return(PFE_OK);
+}
+
+PF_LogAbort(txn)
+int txn;	/* the active transaction */
+/****************************************************************************
+SPECIFICATIONS:
+	Abort transaction "txn": put back the before images of its
+	updates, newest first. The pages put back are logged as updates
+	of txn, so recovery redoes them like any other. The files changed
+	must still be open. PFlogrecbuf is not overwritten by the logging
+	of the pages put back. Then the header of each file is put back
+	as it was before txn, with its free list and page count; pages
+	allocated past its end are dropped from the buffer.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+PFlogrec *rec = &PFlogrecbuf.rec;
+PFlogrec abort;
+long lsn, prev;
+int error, fd;
+
+	if (PFlogfd < 0 || txn == 0 || txn != PFlogtxn){
+		PFerrno = PFE_TXN;
+		return(PFerrno);
+	}
+	for (lsn = PFloglast; lsn != 0; lsn = prev){
+		if ((error=PFlogRead(lsn,PFlognext)) != PFE_OK)
+			return(error);
+		prev = rec->prevlsn;
+		if (rec->type != PF_LOG_UPDATE)
+			continue;
+		for (fd=0; fd < PF_FTAB_SIZE &&
+			(PFlogfiles[fd].fname == NULL ||
+			PFlogfiles[fd].fileid != rec->fileid); fd++);
+		if (fd == PF_FTAB_SIZE){
+			PFerrno = PFE_FD;
+			return(PFerrno);
+		}
+		if ((error=PFlogApply(fd,0,FALSE)) != PFE_OK)
+			return(error);
+	}
+	for (fd=0; fd < PF_FTAB_SIZE; fd++)
+		if (PFlogfiles[fd].fname != NULL && PFlogfiles[fd].hdrtxn == txn &&
+				(error=PFputHdr(fd,&PFlogfiles[fd].hdr)) != PFE_OK)
+			return(error);
+
+	memset((char *)&abort,0,sizeof(abort));
+	abort.type = PF_LOG_ABORT;
+	abort.txn = txn;
+	if ((error=PFlogAppend(&abort,NULL,0,NULL,0,&lsn)) != PFE_OK)
+		return(error);
+	PFlogtxn = 0;
+	PFlog_stats.aborts++;
+	return(PFE_OK);
+}
+
+PF_LogForce()
+/****************************************************************************
+SPECIFICATIONS:
+	Force the log, making all commits durable.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+	return(PFlogFlush(PFlognext));
+}
+
+PF_LogSetGroupSize(n)
+int n;		/* commits per force, >= 1 */
+/****************************************************************************
+SPECIFICATIONS:
+	Force the log once every "n" commits. Up to n-1 commits may be
+	lost by a crash.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_TXN if n < 1.
+*****************************************************************************/
+{
+	if (n < 1){
+		PFerrno = PFE_TXN;
+		return(PFerrno);
+	}
+	PFloggroup = n;
+	return(PFE_OK);
+}
+
+PF_LogCheckpoint()
+/****************************************************************************
+SPECIFICATIONS:
+	Take a fuzzy checkpoint: log the dirty pages of files in the log
+	with the LSN of their first change not yet written and the
+	transaction active, then name the files in the log again, one
+	record each, so that no record grows with the number of files.
+	Force them and point the log header to the checkpoint. No page is
+	written; the pages logged are written by later commits (see
+	PF_LogSetCheckpoint()).
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+PFdirty dirty[PF_MAX_BUFS];
+char data[sizeof(PFlogckpt) + PF_MAX_BUFS * sizeof(PFdirty)];
+PFlogckpt ck;
+PFlogrec rec;
+char *p;
+long ckpt, lsn;
+int n, i, error;
+
+	if (PFlogfd < 0){
+		PFerrno = PFE_TXN;
+		return(PFerrno);
+	}
+
+	/* the dirty pages of logged files, in page order to be written */
+	n = PFbufDirty(dirty,PF_MAX_BUFS);
+	for (i=0, PFlogndirty=0; i < n; i++)
+		if (PFlogfiles[dirty[i].file].fname != NULL &&
+				PFlogfiles[dirty[i].file].fileid >= 0)
+			PFlogdirty[PFlogndirty++] = dirty[i];
+	qsort(PFlogdirty,PFlogndirty,sizeof(PFdirty),PFlogDirtyCmp);
+	PFlognextdirty = 0;
+
+	ck.txn = PFlogtxn;
+	ck.txnlast = PFlogtxn != 0 ? PFloglast : 0;
+	ck.ndirty = PFlogndirty;
+	ck.nfiles = 0;
+	for (i=0; i < PFlognextfile; i++)
+		if (PFlognames[i] != NULL)
+			ck.nfiles++;
+	memcpy(data,(char *)&ck,sizeof(ck));
+	p = data + sizeof(ck);
+	for (i=0; i < PFlogndirty; i++, p += sizeof(PFdirty)){
+		memcpy(p,(char *)&PFlogdirty[i],sizeof(PFdirty));
+		((PFdirty *)p)->file = PFlogfiles[PFlogdirty[i].file].fileid;
+	}
+
+	memset((char *)&rec,0,sizeof(rec));
+	rec.type = PF_LOG_CKPT;
+	if ((error=PFlogAppend(&rec,data,(int)(p - data),NULL,0,&ckpt)) != PFE_OK)
+		return(error);
+	lsn = ckpt;
+	for (i=0; i < PFlognextfile; i++)
+		if (PFlognames[i] != NULL){
+			memset((char *)&rec,0,sizeof(rec));
+			rec.type = PF_LOG_FILE;
+			rec.fileid = i;
+			rec.len = strlen(PFlognames[i]);
+			if ((error=PFlogAppend(&rec,PFlognames[i],rec.len,
+					NULL,0,&lsn)) != PFE_OK)
+				return(error);
+		}
+	if ((error=PFlogFlush(lsn)) != PFE_OK ||
+			(error=PFlogWriteHdr(ckpt)) != PFE_OK)
+		return(error);
+	PFlogckptlsn = PFlognext;
+	PFlog_stats.checkpoints++;
+	return(PFE_OK);
+}
+
+PF_LogSetCheckpoint(interval,trickle)
+long interval;	/* bytes of log between checkpoints, or 0 for none */
+int trickle;	/* pages of the last checkpoint written per commit */
+/****************************************************************************
+SPECIFICATIONS:
+	Take a checkpoint at the first commit after each "interval" bytes
+	of log, and write "trickle" of its dirty pages at each commit.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_TXN if an argument is < 0.
+*****************************************************************************/
+{
+	if (interval < 0 || trickle < 0){
+		PFerrno = PFE_TXN;
+		return(PFerrno);
+	}
+	PFlogckptint = interval;
+	PFlogtrickle = trickle;
+	return(PFE_OK);
+}
+
+PF_LogGetStats(out)
+PFlogstats *out;	/* set to the counters since PF_LogOpen() */
+{
+	if (out == NULL)
+		return(PFE_NOMEM);
+	*out = PFlog_stats;
+	return(PFE_OK);
+}
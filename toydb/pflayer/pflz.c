@@ -0,0 +1,187 @@
+/* pflz.c: LZ compression of file pages for compressed PF files.
+
+A compressed block is a sequence of
+	[token] [literal length ext] [literals] [offset] [match length ext]
+in the manner of LZ4. The high 4 bits of the token are the # of literals
+and the low 4 bits the match length - PF_LZ_MINMATCH; a value of 15 is
+continued in the following bytes, each added until one is < 255. The
+offset is 2 bytes, little endian, back from the current output position.
+The last sequence has literals only. */
+#include <stdio.h>
+#include <string.h>
+#include "pf.h"
+#include "pftypes.h"
+
+#define PF_LZ_MINMATCH	4
+#define PF_LZ_HASHBITS	12
+#define PF_LZ_MAXOFF	65535
+
+static unsigned PFlzRead32(p)
+unsigned char *p;
+{
+unsigned v;
+
+	memcpy(&v,p,sizeof(v));
+	return(v);
+}
+
+static int PFlzHash(v)
+unsigned v;
+{
+	return((int)((v * 2654435761u) >> (32 - PF_LZ_HASHBITS)));
+}
+
+static unsigned char *PFlzPutLen(op,len)
+unsigned char *op;	/* where to put the extra length bytes */
+int len;		/* length left after the token's 15 */
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return(op);
+}
+
+int PFlzCompress(src,n,dst,cap)
+char *src;	/* data to compress */
+int n;		/* # of bytes in src */
+char *dst;	/* compressed data */
+int cap;	/* size of dst */
+/****************************************************************************
+SPECIFICATIONS:
+	Compress the "n" bytes at "src" into "dst". Matches are found
+	through a table of the last position of each hashed 4 bytes, so
+	compression is one pass with no search.
+	dst should hold PF_LZ_BOUND(n) bytes.
+
+RETURN VALUE:
+	The # of bytes of compressed data, or
+	-1	if more than "cap" bytes were needed.
+*****************************************************************************/
+{
+unsigned char *ip = (unsigned char *)src;	/* next input byte */
+unsigned char *anchor = ip;	/* first literal not yet output */
+unsigned char *iend = ip + n;
+unsigned char *op = (unsigned char *)dst;	/* next output byte */
+unsigned char *oend = op + cap;
+unsigned char *ref, *token;
+int htab[1 << PF_LZ_HASHBITS];
+int i, h, litlen, matchlen;
+
+	for (i=0; i < (1 << PF_LZ_HASHBITS); i++)
+		htab[i] = -1;
+
+	while (ip + PF_LZ_MINMATCH <= iend){
+		h = PFlzHash(PFlzRead32(ip));
+		ref = htab[h] < 0 ? NULL : (unsigned char *)src + htab[h];
+		htab[h] = ip - (unsigned char *)src;
+		if (ref == NULL || ip - ref > PF_LZ_MAXOFF ||
+				PFlzRead32(ref) != PFlzRead32(ip)){
+			ip++;
+			continue;
+		}
+
+		/* extend the match */
+		for (matchlen = PF_LZ_MINMATCH; ip + matchlen < iend &&
+				ref[matchlen] == ip[matchlen]; matchlen++);
+
+		/* the literals before it and the match */
+		litlen = ip - anchor;
+		if (op + 1 + litlen / 255 + 1 + litlen + 2 + matchlen / 255 + 1 > oend)
+			return(-1);
+		token = op++;
+		*token = (litlen < 15 ? litlen : 15) << 4;
+		if (litlen >= 15)
+			op = PFlzPutLen(op,litlen - 15);
+		memcpy(op,anchor,litlen);
+		op += litlen;
+		*op++ = (ip - ref) & 0xff;
+		*op++ = (ip - ref) >> 8;
+		matchlen -= PF_LZ_MINMATCH;
+		*token |= matchlen < 15 ? matchlen : 15;
+		if (matchlen >= 15)
+			op = PFlzPutLen(op,matchlen - 15);
+
+		ip += matchlen + PF_LZ_MINMATCH;
+		anchor = ip;
+	}
+
+	/* the last literals */
+	litlen = iend - anchor;
+	if (op + 1 + litlen / 255 + 1 + litlen > oend)
+		return(-1);
+	token = op++;
+	*token = (litlen < 15 ? litlen : 15) << 4;
+	if (litlen >= 15)
+		op = PFlzPutLen(op,litlen - 15);
+	memcpy(op,anchor,litlen);
+	op += litlen;
+	return(op - (unsigned char *)dst);
+}
+
+int PFlzDecompress(src,n,dst,cap)
+char *src;	/* compressed data */
+int n;		/* # of bytes in src */
+char *dst;	/* decompressed data */
+int cap;	/* size of dst */
+/****************************************************************************
+SPECIFICATIONS:
+	Decompress the "n" bytes at "src", made by PFlzCompress(),
+	into "dst".
+
+RETURN VALUE:
+	The # of bytes of decompressed data, or
+	-1	if src is not valid compressed data or does not fit in
+		"cap" bytes.
+*****************************************************************************/
+{
+unsigned char *ip = (unsigned char *)src;
+unsigned char *iend = ip + n;
+unsigned char *op = (unsigned char *)dst;
+unsigned char *oend = op + cap;
+unsigned char *ref;
+int token, len, off;
+
+	while (ip < iend){
+		token = *ip++;
+
+		/* literals */
+		len = token >> 4;
+		if (len == 15)
+			do {
+				if (ip >= iend) return(-1);
+				len += *ip;
+			} while (*ip++ == 255);
+		if (ip + len > iend || op + len > oend)
+			return(-1);
+		memcpy(op,ip,len);
+		ip += len;
+		op += len;
+		if (ip >= iend)
+			/* last sequence */
+			break;
+
+		/* match */
+		if (ip + 2 > iend)
+			return(-1);
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+		len = (token & 15);
+		if (len == 15)
+			do {
+				if (ip >= iend) return(-1);
+				len += *ip;
+			} while (*ip++ == 255);
+		len += PF_LZ_MINMATCH;
+		ref = op - off;
+		if (off == 0 || ref < (unsigned char *)dst || op + len > oend)
+			return(-1);
+		if (off >= len){
+			memcpy(op,ref,len);
+			op += len;
+		}
+		else	/* overlapping: a run */
+			while (len-- > 0)
+				*op++ = *ref++;
+	}
+	return(op - (unsigned char *)dst);
+}
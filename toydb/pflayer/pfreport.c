@@ -0,0 +1,527 @@
+/* pfreport.c: periodic export of the buffer manager stats. The interface
+routines are PF_ReportStart() and PF_ReportStop().
+
+A thread samples PF_GetStats(), the stats of each open file
+(PF_GetFileStats()) and the pool occupancy (PF_GetPoolStats()) when
+started, every interval, and when stopped, and writes them out in up to
+two formats:
+
+	CSV	a time series: per sample, a row for all files ("*") and
+		one per open file
+	Prometheus	the text exposition format of the latest sample
+
+Each goes to a file, or, given as "unix:" and a path, to a Unix socket
+the reporter listens on. A CSV file is appended to, with a header if it
+is new. A Prometheus file is replaced at each sample, for the
+node_exporter textfile collector. A client of the CSV socket gets the
+header and the rows from then on; one of the Prometheus socket gets the
+latest sample, and the connection is closed. Clients are written to
+without blocking: one that lets its socket fill up, by reading too
+slowly or not at all, is dropped rather than allowed to stall the
+thread, and so PF_ReportStop().
+
+The thread reads the counters without a lock while the PF layer runs, so
+the numbers of one sample may be a few operations apart. The last sample,
+taken in PF_ReportStop(), is exact. */
+
+/* sockets, poll() and clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "pf.h"
+#include "pftypes.h"
+
+#define PF_REPORT_UNIX		"unix:"	/* socket destinations */
+#define PF_REPORT_CLIENTS	8	/* CSV socket clients at a time */
+#define PF_REPORT_BUFSIZE	65536	/* text of one sample */
+#define PF_REPORT_NCOUNTERS	6	/* counters of PFstats */
+
+typedef struct PFrsink {
+	char	*path;		/* file or socket path, or NULL if unused */
+	int	sock;		/* listening socket, or -1 for a file */
+	int	fd;		/* CSV file, or -1 */
+	int	clients[PF_REPORT_CLIENTS];	/* CSV socket clients, or -1 */
+} PFrsink;
+
+typedef struct PFrbuf {
+	char	text[PF_REPORT_BUFSIZE];
+	int	len;
+} PFrbuf;
+
+static int PFrrunning = FALSE;
+static pthread_t PFrthread;
+static int PFrwake[2];		/* pipe: PF_ReportStop() wakes the thread */
+static int PFrinterval;		/* ms */
+static struct timespec PFrstart;
+static PFrsink PFrcsv, PFrprom;
+static PFrbuf PFrrows;		/* CSV rows of the latest sample */
+static PFrbuf PFrexpo;		/* Prometheus text of the latest sample */
+
+static char PFrheader[] = "elapsed_ms,time_ms,file,policy,pool,"
+	"logical_reads,logical_writes,phys_reads,phys_writes,page_hits,"
+	"page_misses,pool_used,pool_clean,pool_dirty,pool_fixed\n";
+
+/* counters of PFstats, in CSV order */
+static struct {
+	char	*name;
+	char	*help;
+} PFrcounters[] = {
+	{ "logical_reads", "Page requests" },
+	{ "logical_writes", "Pages unfixed dirty" },
+	{ "phys_reads", "Pages read from files" },
+	{ "phys_writes", "Pages written to files" },
+	{ "page_hits", "Page requests found in the buffer pool" },
+	{ "page_misses", "Page requests not found in the buffer pool" },
+};
+/* the i-th counter of a PFstats: its members are the six ints above */
+#define PFrcounter(st,i) (&(st)->logical_reads)[i]
+
+static void PFrprintf(PFrbuf *b, const char *fmt, ...)
+/****************************************************************************
+SPECIFICATIONS:
+	Append to "b" as printf() would; text past its end is dropped.
+*****************************************************************************/
+{
+va_list ap;
+int n;
+
+	if (b->len >= PF_REPORT_BUFSIZE - 1)
+		return;
+	va_start(ap,fmt);
+	n = vsnprintf(b->text + b->len,PF_REPORT_BUFSIZE - b->len,fmt,ap);
+	va_end(ap);
+	if (n > 0)
+		b->len += n;
+	if (b->len > PF_REPORT_BUFSIZE - 1)
+		b->len = PF_REPORT_BUFSIZE - 1;
+}
+
+static void PFrquote(PFrbuf *b, char *s, int prom)
+/****************************************************************************
+SPECIFICATIONS:
+	Append "s" to "b" in quotes: escaped as a CSV field, or, if "prom",
+	as a Prometheus label value.
+*****************************************************************************/
+{
+	PFrprintf(b,"\"");
+	for (; *s != '\0'; s++){
+		if (*s == '"')
+			PFrprintf(b,prom ? "\\\"" : "\"\"");
+		else if (prom && *s == '\\')
+			PFrprintf(b,"\\\\");
+		else if (prom && *s == '\n')
+			PFrprintf(b,"\\n");
+		else	PFrprintf(b,"%c",*s);
+	}
+	PFrprintf(b,"\"");
+}
+
+static int PFrsend(int fd, char *text, int len)
+/****************************************************************************
+SPECIFICATIONS:
+	Write "len" bytes of "text" to file or socket "fd". A client that
+	has gone away raises no SIGPIPE.
+
+RETURN VALUE:
+	0 if all were written, -1 if not: for a client, which is
+	non-blocking, also if its socket is full (EAGAIN).
+*****************************************************************************/
+{
+int n;
+struct stat sb;
+int sock;
+
+	sock = fstat(fd,&sb) == 0 && S_ISSOCK(sb.st_mode);
+	while (len > 0){
+		n = sock ? send(fd,text,len,MSG_NOSIGNAL) : write(fd,text,len);
+		if (n <= 0)
+			return(-1);
+		text += n;
+		len -= n;
+	}
+	return(0);
+}
+
+static void PFrRows(elapsed,walltime,st,pool)
+long elapsed;		/* ms since PF_ReportStart() */
+double walltime;	/* ms since the epoch */
+PFstats *st;
+PFpoolstats *pool;
+/****************************************************************************
+SPECIFICATIONS:
+	Set PFrrows to the CSV rows of a sample: the totals and pool
+	occupancy, then the stats of each open file.
+*****************************************************************************/
+{
+PFstats fst;
+char name[PF_STATS_NAMELEN];
+char *policy;
+int fd, i;
+
+	policy = pool->policy == PF_REPL_MRU ? "MRU" : "LRU";
+	PFrrows.len = 0;
+	PFrprintf(&PFrrows,"%ld,%.0f,\"*\",%s,%d",elapsed,walltime,policy,
+		pool->size);
+	for (i=0; i < PF_REPORT_NCOUNTERS; i++)
+		PFrprintf(&PFrrows,",%d",PFrcounter(st,i));
+	PFrprintf(&PFrrows,",%d,%d,%d,%d\n",pool->used,
+		pool->used - pool->dirty,pool->dirty,pool->fixed);
+	for (fd=0; fd < PF_FTAB_SIZE; fd++){
+		if (!PFbufFileStats(fd,&fst,name))
+			continue;
+		PFrprintf(&PFrrows,"%ld,%.0f,",elapsed,walltime);
+		PFrquote(&PFrrows,name,FALSE);
+		PFrprintf(&PFrrows,",%s,%d",policy,pool->size);
+		for (i=0; i < PF_REPORT_NCOUNTERS; i++)
+			PFrprintf(&PFrrows,",%d",PFrcounter(&fst,i));
+		PFrprintf(&PFrrows,",,,,\n");
+	}
+}
+
+static void PFrExpo(st,pool)
+PFstats *st;
+PFpoolstats *pool;
+/****************************************************************************
+SPECIFICATIONS:
+	Set PFrexpo to a sample in the Prometheus text format.
+*****************************************************************************/
+{
+PFstats fst;
+char name[PF_STATS_NAMELEN];
+int fd, i;
+
+	PFrexpo.len = 0;
+	for (i=0; i < PF_REPORT_NCOUNTERS; i++){
+		PFrprintf(&PFrexpo,"# HELP toydb_pf_%s_total %s.\n"
+			"# TYPE toydb_pf_%s_total counter\n"
+			"toydb_pf_%s_total %d\n",PFrcounters[i].name,
+			PFrcounters[i].help,PFrcounters[i].name,
+			PFrcounters[i].name,PFrcounter(st,i));
+	}
+	for (i=0; i < PF_REPORT_NCOUNTERS; i++){
+		PFrprintf(&PFrexpo,"# HELP toydb_pf_file_%s_total %s, "
+			"by file since it was opened.\n"
+			"# TYPE toydb_pf_file_%s_total counter\n",
+			PFrcounters[i].name,PFrcounters[i].help,
+			PFrcounters[i].name);
+		for (fd=0; fd < PF_FTAB_SIZE; fd++){
+			if (!PFbufFileStats(fd,&fst,name))
+				continue;
+			PFrprintf(&PFrexpo,"toydb_pf_file_%s_total{file=",
+				PFrcounters[i].name);
+			PFrquote(&PFrexpo,name,TRUE);
+			PFrprintf(&PFrexpo,"} %d\n",PFrcounter(&fst,i));
+		}
+	}
+	PFrprintf(&PFrexpo,"# HELP toydb_pf_pool_size_pages Buffer pages allowed.\n"
+		"# TYPE toydb_pf_pool_size_pages gauge\n"
+		"toydb_pf_pool_size_pages{policy=\"%s\"} %d\n"
+		"# HELP toydb_pf_pool_pages Buffer pages holding file pages.\n"
+		"# TYPE toydb_pf_pool_pages gauge\n"
+		"toydb_pf_pool_pages{state=\"clean\"} %d\n"
+		"toydb_pf_pool_pages{state=\"dirty\"} %d\n"
+		"# HELP toydb_pf_pool_fixed_pages Buffer pages fixed (pinned).\n"
+		"# TYPE toydb_pf_pool_fixed_pages gauge\n"
+		"toydb_pf_pool_fixed_pages %d\n",
+		pool->policy == PF_REPL_MRU ? "MRU" : "LRU",pool->size,
+		pool->used - pool->dirty,pool->dirty,pool->fixed);
+}
+
+static void PFrSample()
+/****************************************************************************
+SPECIFICATIONS:
+	Take a sample, and write it to the CSV file and clients and the
+	Prometheus file. The formats not asked for are not made.
+*****************************************************************************/
+{
+struct timespec now, wall;
+PFstats st;
+PFpoolstats pool;
+char tmp[1024];
+int k, tfd;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	clock_gettime(CLOCK_REALTIME,&wall);
+	PF_GetStats(&st);
+	PF_GetPoolStats(&pool);
+	if (PFrcsv.path != NULL)
+		PFrRows((now.tv_sec - PFrstart.tv_sec) * 1000L +
+			(now.tv_nsec - PFrstart.tv_nsec) / 1000000L,
+			wall.tv_sec * 1e3 + wall.tv_nsec / 1e6,&st,&pool);
+	if (PFrprom.path != NULL)
+		PFrExpo(&st,&pool);
+
+	if (PFrcsv.fd >= 0)
+		PFrsend(PFrcsv.fd,PFrrows.text,PFrrows.len);
+	for (k=0; k < PF_REPORT_CLIENTS; k++)
+		if (PFrcsv.clients[k] >= 0 &&
+				PFrsend(PFrcsv.clients[k],PFrrows.text,PFrrows.len) < 0){
+			close(PFrcsv.clients[k]);
+			PFrcsv.clients[k] = -1;
+		}
+	if (PFrprom.path != NULL && PFrprom.sock < 0){
+		/* replaced whole, so a reader never sees half a sample */
+		snprintf(tmp,sizeof(tmp),"%s.tmp",PFrprom.path);
+		if ((tfd=open(tmp,O_WRONLY|O_CREAT|O_TRUNC,0644)) >= 0){
+			k = PFrsend(tfd,PFrexpo.text,PFrexpo.len);
+			if (close(tfd) == 0 && k == 0)
+				rename(tmp,PFrprom.path);
+			else	unlink(tmp);
+		}
+	}
+}
+
+static void PFrAccept(PFrsink *sink)
+/****************************************************************************
+SPECIFICATIONS:
+	Accept a client of the socket of "sink": give a CSV client the
+	header and keep it, give a Prometheus client the latest sample
+	and close it. The client is made non-blocking, see PFrsend().
+*****************************************************************************/
+{
+int c, k;
+
+	if ((c=accept(sink->sock,NULL,NULL)) < 0)
+		return;
+	if (fcntl(c,F_SETFL,fcntl(c,F_GETFL) | O_NONBLOCK) < 0){
+		close(c);
+		return;
+	}
+	if (sink == &PFrprom){
+		PFrsend(c,PFrexpo.text,PFrexpo.len);
+		close(c);
+		return;
+	}
+	for (k=0; k < PF_REPORT_CLIENTS && sink->clients[k] >= 0; k++)
+		;
+	if (k == PF_REPORT_CLIENTS || PFrsend(c,PFrheader,strlen(PFrheader)) < 0){
+		close(c);
+		return;
+	}
+	sink->clients[k] = c;
+}
+
+static void *PFrMain(void *arg)
+/****************************************************************************
+SPECIFICATIONS:
+	The reporter thread: sample every PFrinterval ms and serve the
+	sockets until woken by PF_ReportStop(), then take the last sample.
+*****************************************************************************/
+{
+struct pollfd pfd[3];
+struct timespec now;
+long next, t;
+int n;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	next = now.tv_sec * 1000L + now.tv_nsec / 1000000L + PFrinterval;
+	for (;;){
+		n = 0;
+		pfd[n].fd = PFrwake[0];
+		pfd[n++].events = POLLIN;
+		if (PFrcsv.sock >= 0){
+			pfd[n].fd = PFrcsv.sock;
+			pfd[n++].events = POLLIN;
+		}
+		if (PFrprom.sock >= 0){
+			pfd[n].fd = PFrprom.sock;
+			pfd[n++].events = POLLIN;
+		}
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		t = now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+		if (poll(pfd,n,t < next ? (int)(next - t) : 0) > 0){
+			if (pfd[0].revents)
+				break;
+			while (--n > 0)
+				if (pfd[n].revents & POLLIN)
+					PFrAccept(pfd[n].fd == PFrcsv.sock ?
+						&PFrcsv : &PFrprom);
+		}
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		t = now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+		if (t >= next){
+			PFrSample();
+			/* a late sample moves the next one, rather than
+			being followed by a burst */
+			next = next + PFrinterval > t ? next + PFrinterval :
+				t + PFrinterval;
+		}
+	}
+	PFrSample();
+	return(arg);
+}
+
+static PFrOpen(sink,dest,csv)
+PFrsink *sink;
+char *dest;	/* path, "unix:" and a path, or NULL */
+int csv;	/* TRUE for the CSV sink */
+/****************************************************************************
+SPECIFICATIONS:
+	Open the destination "dest" of "sink": listen on the socket, or
+	open a CSV file for appending and give it a header if it is
+	empty.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_UNIX if "dest" cannot be opened.
+*****************************************************************************/
+{
+struct sockaddr_un addr;
+struct stat sb;
+int k;
+
+	sink->path = NULL;
+	sink->sock = sink->fd = -1;
+	for (k=0; k < PF_REPORT_CLIENTS; k++)
+		sink->clients[k] = -1;
+	if (dest == NULL)
+		return(PFE_OK);
+	if (strncmp(dest,PF_REPORT_UNIX,strlen(PF_REPORT_UNIX)) == 0){
+		sink->path = dest + strlen(PF_REPORT_UNIX);
+		memset((char *)&addr,0,sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (strlen(sink->path) >= sizeof(addr.sun_path)){
+			PFerrno = PFE_UNIX;
+			return(PFerrno);
+		}
+		strcpy(addr.sun_path,sink->path);
+		unlink(sink->path);
+		if ((sink->sock=socket(AF_UNIX,SOCK_STREAM,0)) < 0 ||
+				bind(sink->sock,(struct sockaddr *)&addr,
+					sizeof(addr)) < 0 ||
+				listen(sink->sock,PF_REPORT_CLIENTS) < 0){
+			if (sink->sock >= 0)
+				close(sink->sock);
+			sink->sock = -1;
+			PFerrno = PFE_UNIX;
+			return(PFerrno);
+		}
+		return(PFE_OK);
+	}
+	sink->path = dest;
+	if (!csv)
+		return(PFE_OK);
+	if ((sink->fd=open(dest,O_WRONLY|O_CREAT|O_APPEND,0644)) < 0 ||
+			fstat(sink->fd,&sb) < 0 ||
+			(sb.st_size == 0 &&
+			PFrsend(sink->fd,PFrheader,strlen(PFrheader)) < 0)){
+		if (sink->fd >= 0)
+			close(sink->fd);
+		sink->fd = -1;
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+static void PFrClose(sink)
+PFrsink *sink;
+{
+int k;
+
+	if (sink->fd >= 0)
+		close(sink->fd);
+	for (k=0; k < PF_REPORT_CLIENTS; k++)
+		if (sink->clients[k] >= 0)
+			close(sink->clients[k]);
+	if (sink->sock >= 0){
+		close(sink->sock);
+		unlink(sink->path);
+	}
+	sink->path = NULL;
+	sink->sock = sink->fd = -1;
+}
+
+PF_ReportStart(csvdest,promdest,interval_ms)
+char *csvdest;	/* CSV destination, or NULL */
+char *promdest;	/* Prometheus destination, or NULL */
+int interval_ms;	/* ms between samples */
+/****************************************************************************
+SPECIFICATIONS:
+	Start the reporter: sample now, and then every "interval_ms" ms,
+	to the destinations given. A destination is a file path, or
+	"unix:" followed by the path of a socket to listen on. The
+	strings must stay valid until PF_ReportStop().
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_REPORT if the reporter is running, or no destination or
+		a bad interval is given
+	PFE_UNIX if a destination cannot be opened or the thread started.
+*****************************************************************************/
+{
+int error;
+
+	if (PFrrunning || interval_ms <= 0 ||
+			(csvdest == NULL && promdest == NULL)){
+		PFerrno = PFE_REPORT;
+		return(PFerrno);
+	}
+	if ((error=PFrOpen(&PFrcsv,csvdest,TRUE)) != PFE_OK)
+		return(error);
+	if ((error=PFrOpen(&PFrprom,promdest,FALSE)) != PFE_OK){
+		PFrClose(&PFrcsv);
+		return(error);
+	}
+	if (pipe(PFrwake) < 0){
+		PFrClose(&PFrcsv);
+		PFrClose(&PFrprom);
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	PFrinterval = interval_ms;
+	clock_gettime(CLOCK_MONOTONIC,&PFrstart);
+	PFrSample();
+	if (pthread_create(&PFrthread,NULL,PFrMain,NULL) != 0){
+		close(PFrwake[0]);
+		close(PFrwake[1]);
+		PFrClose(&PFrcsv);
+		PFrClose(&PFrprom);
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	PFrrunning = TRUE;
+	return(PFE_OK);
+}
+
+PF_ReportStop()
+/****************************************************************************
+SPECIFICATIONS:
+	Stop the reporter, after a last sample. Called from the thread
+	using the PF layer, so that the last sample is exact.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_REPORT if the reporter is not running.
+*****************************************************************************/
+{
+	if (!PFrrunning){
+		PFerrno = PFE_REPORT;
+		return(PFerrno);
+	}
+	if (write(PFrwake[1],"x",1) != 1){
+		/* cannot happen with an empty pipe; the thread would
+		not stop */
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	pthread_join(PFrthread,NULL);
+	close(PFrwake[0]);
+	close(PFrwake[1]);
+	PFrClose(&PFrcsv);
+	PFrClose(&PFrprom);
+	PFrrunning = FALSE;
+	return(PFE_OK);
+}
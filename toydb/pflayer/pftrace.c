@@ -0,0 +1,190 @@
+/* pftrace.c: event tracing. The interface routines are:
+PF_TraceStart(), PF_TraceStop() and PF_TraceDump().
+
+The tracepoints are the macros of pftrace.h. While tracing is on, each
+records its event through PFtraceRecord() into the ring of the calling
+thread, allocated at the thread's first event and never freed, so that
+the rings of threads that have exited can still be dumped. Rings are
+linked into one list with an atomic push; recording itself takes no
+lock, so the rings should be dumped only when the other threads are
+done with the PF layer. */
+
+/* clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "pf.h"
+#include "pftypes.h"
+#include "pftrace.h"
+
+PFtraceinfo PFtraceEvents[PFTR_NEVENTS] = {
+	{ "buf_hit",		"pf",	{ "fd", "page" } },
+	{ "buf_miss",		"pf",	{ "fd", "page" } },
+	{ "buf_evict",		"pf",	{ "fd", "page" } },
+	{ "page_read",		"pf",	{ "fd", "page" } },
+	{ "page_write",		"pf",	{ "fd", "page" } },
+	{ "am_leaf_split",	"am",	{ "fd", "newpage" } },
+	{ "am_int_split",	"am",	{ "fd", "page" } },
+	{ "am_scan",		"am",	{ "scan", "fd" } },
+	{ "sp_scan",		"sp",	{ "scan", "fd" } },
+	{ "sp_compact",		"sp",	{ "fd", "page" } },
+};
+
+#define PF_TRACE_DEFEVENTS	65536	/* ring size if none is given */
+
+typedef struct PFtring {
+	int	tid;
+	int	cap;		/* records; a power of 2 */
+	long	next;		/* records made; the next goes at next % cap */
+	PFtracerec *rec;
+	struct PFtring *link;	/* all rings */
+} PFtring;
+
+int PFtraceOn = 0;
+static int PFtracecap = PF_TRACE_DEFEVENTS;	/* size of new rings */
+static PFtring *PFtrings = NULL;	/* all rings, newest first */
+static int PFtracetids = 0;		/* threads with a ring */
+static __thread PFtring *PFtself = NULL;	/* ring of this thread */
+
+static PFtring *PFtraceAttach()
+/****************************************************************************
+SPECIFICATIONS:
+	Allocate the ring of the calling thread and add it to the list.
+
+RETURN VALUE:
+	the ring, or NULL if out of memory.
+*****************************************************************************/
+{
+PFtring *r;
+
+	if ((r=(PFtring *)malloc(sizeof(PFtring))) == NULL)
+		return(NULL);
+	r->cap = PFtracecap;
+	r->next = 0;
+	if ((r->rec=(PFtracerec *)malloc(r->cap * sizeof(PFtracerec))) == NULL){
+		free((char *)r);
+		return(NULL);
+	}
+	r->tid = __sync_add_and_fetch(&PFtracetids,1);
+	do
+		r->link = PFtrings;
+	while (!__sync_bool_compare_and_swap(&PFtrings,r->link,r));
+	PFtself = r;
+	return(r);
+}
+
+void PFtraceRecord(event,phase,a,b)
+int event;	/* PFTR_* */
+int phase;	/* PFTR_INSTANT, ... */
+int a,b;	/* arguments */
+/****************************************************************************
+SPECIFICATIONS:
+	Record an event in the ring of the calling thread, over its
+	oldest record if the ring is full. Called by the tracepoints
+	while tracing is on; events are dropped if there is no memory
+	for the ring.
+*****************************************************************************/
+{
+PFtring *r;
+PFtracerec *rec;
+struct timespec ts;
+
+	if ((r=PFtself) == NULL && (r=PFtraceAttach()) == NULL)
+		return;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	rec = &r->rec[r->next & (r->cap - 1)];
+	rec->ts = ts.tv_sec * 1000000000L + ts.tv_nsec;
+	rec->a = a;
+	rec->b = b;
+	rec->event = event;
+	rec->phase = phase;
+	rec->pad = 0;
+	r->next++;
+}
+
+PF_TraceStart(nevents)
+int nevents;	/* ring size per thread, or <= 0 for the default */
+/****************************************************************************
+SPECIFICATIONS:
+	Empty the rings and start recording. nevents, rounded up to a
+	power of 2, is the size of the rings of threads yet to record
+	their first event; threads that already have a ring keep it.
+
+RETURN VALUE:
+	PFE_OK
+*****************************************************************************/
+{
+PFtring *r;
+int cap;
+
+	if (nevents <= 0)
+		nevents = PF_TRACE_DEFEVENTS;
+	for (cap=1; cap < nevents && cap < (1 << 30); cap <<= 1)
+		;
+	PFtracecap = cap;
+	for (r=PFtrings; r != NULL; r=r->link)
+		r->next = 0;
+	PFtraceOn = TRUE;
+	return(PFE_OK);
+}
+
+void PF_TraceStop()
+/****************************************************************************
+SPECIFICATIONS:
+	Stop recording. The rings keep their events for PF_TraceDump().
+*****************************************************************************/
+{
+	PFtraceOn = FALSE;
+}
+
+PF_TraceDump(fname)
+char *fname;	/* file to write */
+/****************************************************************************
+SPECIFICATIONS:
+	Stop recording and write the events in the rings to "fname", in
+	the format of pftrace.h.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_UNIX if the file could not be written.
+*****************************************************************************/
+{
+FILE *f;
+PFtring *r;
+PFtracehdr hdr;
+PFtraceringhdr rh;
+long first;
+int start, n;
+
+	PF_TraceStop();
+	if ((f=fopen(fname,"wb")) == NULL){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	hdr.magic = PF_TRACE_MAGIC;
+	hdr.nrings = 0;
+	for (r=PFtrings; r != NULL; r=r->link)
+		hdr.nrings++;
+	fwrite((char *)&hdr,sizeof(hdr),1,f);
+	for (r=PFtrings; r != NULL; r=r->link){
+		rh.tid = r->tid;
+		rh.total = r->next;
+		rh.nrec = r->next < r->cap ? (int)r->next : r->cap;
+		fwrite((char *)&rh,sizeof(rh),1,f);
+
+		/* oldest first: from first to the end of the ring, then
+		from its start */
+		first = r->next - rh.nrec;
+		start = first & (r->cap - 1);
+		n = r->cap - start < rh.nrec ? r->cap - start : rh.nrec;
+		fwrite((char *)&r->rec[start],sizeof(PFtracerec),n,f);
+		fwrite((char *)r->rec,sizeof(PFtracerec),rh.nrec - n,f);
+	}
+	if (ferror(f) | fclose(f)){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
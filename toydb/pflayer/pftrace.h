@@ -0,0 +1,110 @@
+/* pftrace.h: event tracing for the PF, SP and AM layers (pftrace.c)
+
+Tracepoints in the hot paths record events of two ints each:
+
+	buf_hit, buf_miss	fd, page	PFbufGet()
+	buf_evict		fd, page	victim chosen by PFbufInternalAlloc()
+	page_read, page_write	fd, page	physical I/O of the buffer manager
+	am_leaf_split		fd, new page	AM_SplitLeaf()
+	am_int_split		fd, page	internal node split by AM_AddtoParent()
+	am_scan			scan, fd	AM_OpenIndexScan() to AM_CloseIndexScan()
+	sp_scan			scan, fd	SP_ScanOpen() to SP_ScanClose()
+	sp_compact		fd, page	SP_ReclaimPage()
+
+Each is a USDT probe "toydb:<name>" where <sys/sdt.h> is available
+(page_read_begin / page_read_end for durations, am_scan_open /
+am_scan_close for scans), and, while PF_TraceStart() is in effect, a
+record in a ring of the calling thread. A full ring overwrites its oldest
+records. PF_TraceDump() writes the rings to a file, which pftrace2json
+converts into Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+
+Disabled, a tracepoint costs a load and a branch, plus a nop for the
+probe. Compiled with -DPF_NOTRACE, it is gone. */
+
+#ifndef PFTRACE_H
+#define PFTRACE_H
+
+/* events; the names follow the probes */
+#define PFTR_buf_hit		0
+#define PFTR_buf_miss		1
+#define PFTR_buf_evict		2
+#define PFTR_page_read		3
+#define PFTR_page_write		4
+#define PFTR_am_leaf_split	5
+#define PFTR_am_int_split	6
+#define PFTR_am_scan		7
+#define PFTR_sp_scan		8
+#define PFTR_sp_compact		9
+#define PFTR_NEVENTS		10
+
+/* phases, as in Chrome trace JSON */
+#define PFTR_INSTANT	'i'
+#define PFTR_BEGIN	'B'	/* duration, ended on the same thread */
+#define PFTR_END	'E'
+#define PFTR_OPEN	'b'	/* async: matched by the first argument */
+#define PFTR_CLOSE	'e'
+
+typedef struct PFtraceinfo {
+	char	*name;
+	char	*cat;		/* layer: "pf", "sp" or "am" */
+	char	*arg[2];	/* names of the two arguments */
+} PFtraceinfo;
+
+extern PFtraceinfo PFtraceEvents[PFTR_NEVENTS];	/* indexed by PFTR_* */
+
+/* Dump file: a PFtracehdr, then for each of its nrings rings a
+PFtraceringhdr followed by its nrec records, oldest first. Timestamps
+are CLOCK_MONOTONIC nanoseconds. */
+#define PF_TRACE_MAGIC	0x31544650	/* "PFT1" */
+typedef struct PFtracehdr {
+	int	magic;
+	int	nrings;
+} PFtracehdr;
+
+typedef struct PFtraceringhdr {
+	int	tid;		/* threads numbered from 1, in order of first event */
+	int	nrec;		/* records that follow */
+	long	total;		/* records ever made; total - nrec were lost */
+} PFtraceringhdr;
+
+typedef struct PFtracerec {
+	long	ts;		/* ns */
+	int	a;
+	int	b;
+	short	event;		/* PFTR_* */
+	char	phase;		/* PFTR_INSTANT, ... */
+	char	pad;
+} PFtracerec;
+
+extern int PFtraceOn;		/* PF_TraceStart() in effect */
+extern void PFtraceRecord(int event, int phase, int a, int b);
+
+/* USDT probes */
+#if !defined(PF_NOTRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PF_PROBE(probe,a,b)	DTRACE_PROBE2(toydb,probe,a,b)
+#endif
+#endif
+#ifndef PF_PROBE
+#define PF_PROBE(probe,a,b)	((void)0)
+#endif
+
+#ifdef PF_NOTRACE
+#define PF_TRACEPOINT(ev,probe,ph,a,b)	((void)0)
+#else
+#define PF_TRACEPOINT(ev,probe,ph,a,b) do { \
+	PF_PROBE(probe,a,b); \
+	if (PFtraceOn) \
+		PFtraceRecord(PFTR_##ev,ph,a,b); \
+} while (0)
+#endif
+
+/* the tracepoints: an instant, a duration, an async span */
+#define PF_TRACE(ev,a,b)	PF_TRACEPOINT(ev,ev,PFTR_INSTANT,a,b)
+#define PF_TRACE_BEGIN(ev,a,b)	PF_TRACEPOINT(ev,ev##_begin,PFTR_BEGIN,a,b)
+#define PF_TRACE_END(ev,a,b)	PF_TRACEPOINT(ev,ev##_end,PFTR_END,a,b)
+#define PF_TRACE_OPEN(ev,id,b)	PF_TRACEPOINT(ev,ev##_open,PFTR_OPEN,id,b)
+#define PF_TRACE_CLOSE(ev,id,b)	PF_TRACEPOINT(ev,ev##_close,PFTR_CLOSE,id,b)
+
+#endif
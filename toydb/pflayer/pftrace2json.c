@@ -0,0 +1,76 @@
+/* pftrace2json.c
+ * Converts a PF_TraceDump() file into Chrome trace JSON, for timeline
+ * viewing in chrome://tracing or ui.perfetto.dev. Timestamps are made
+ * relative to the earliest event. Rings that overflowed are reported on
+ * stderr; their oldest events are missing, and with them possibly the
+ * begin of a duration whose end is shown.
+ *
+ * Usage: pftrace2json dumpfile [out.json]    (default: stdout)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pf.h"
+#include "pftrace.h"
+
+int main(int argc, char **argv) {
+    FILE *in, *out = stdout;
+    PFtracehdr hdr;
+    PFtraceringhdr *rh;
+    PFtracerec **rec;
+    long t0 = -1, events = 0;
+    int i, j, first = 1;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s dumpfile [out.json]\n", argv[0]);
+        return 2;
+    }
+    if (!(in = fopen(argv[1], "rb")) || fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        hdr.magic != PF_TRACE_MAGIC || hdr.nrings < 0) {
+        fprintf(stderr, "%s: not a trace dump\n", argv[1]);
+        return 1;
+    }
+    rh = calloc(hdr.nrings + 1, sizeof(*rh));
+    rec = calloc(hdr.nrings + 1, sizeof(*rec));
+    for (i = 0; i < hdr.nrings; i++) {
+        if (fread(&rh[i], sizeof(rh[i]), 1, in) != 1 || rh[i].nrec < 0 ||
+            !(rec[i] = malloc((rh[i].nrec + 1) * sizeof(PFtracerec))) ||
+            fread(rec[i], sizeof(PFtracerec), rh[i].nrec, in) != (size_t)rh[i].nrec) {
+            fprintf(stderr, "%s: truncated\n", argv[1]);
+            return 1;
+        }
+        for (j = 0; j < rh[i].nrec; j++)
+            if (t0 < 0 || rec[i][j].ts < t0) t0 = rec[i][j].ts;
+        if (rh[i].total > rh[i].nrec)
+            fprintf(stderr, "thread %d: %ld of %ld events lost to ring overflow\n",
+                rh[i].tid, rh[i].total - rh[i].nrec, rh[i].total);
+    }
+    fclose(in);
+    if (argc > 2 && !(out = fopen(argv[2], "w"))) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (i = 0; i < hdr.nrings; i++)
+        for (j = 0; j < rh[i].nrec; j++) {
+            PFtracerec *r = &rec[i][j];
+            PFtraceinfo *e;
+            if (r->event < 0 || r->event >= PFTR_NEVENTS) continue;
+            e = &PFtraceEvents[r->event];
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":1,\"tid\":%d,", first ? "" : ",\n", e->name, e->cat,
+                r->phase, (r->ts - t0) / 1e3, rh[i].tid);
+            if (r->phase == PFTR_INSTANT)
+                fprintf(out, "\"s\":\"t\",");
+            else if (r->phase == PFTR_OPEN || r->phase == PFTR_CLOSE)
+                fprintf(out, "\"id\":%d,", r->a);
+            fprintf(out, "\"args\":{\"%s\":%d,\"%s\":%d}}", e->arg[0], r->a, e->arg[1], r->b);
+            first = 0;
+            events++;
+        }
+    fprintf(out, "\n]}\n");
+    if (out != stdout) fclose(out);
+    fprintf(stderr, "%ld events from %d threads\n", events, hdr.nrings);
+    return 0;
+}
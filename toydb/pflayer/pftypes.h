@@ -4,10 +4,15 @@
 #define PFTYPES_H
 
 /**************************** File Page Decls *********************/
-/* Each file contains a header, which is a integer pointing
-to the first free page, or -1 if no more free pages in the file.
-Followed by this header are the file pages as declared in struct PFfpage */
+/* Each file contains a header, which is PF_FILE_MAGIC, an integer pointing
+to the first free page, or -1 if no more free pages in the file, and the
+number of pages.
+Followed by this header are the file pages as declared in struct PFfpage.
+Pages carry the LSN of the log (pflog.c), which made them 8 bytes longer
+than in files without the magic; PF_OpenFile() refuses those files. */
+#define PF_FILE_MAGIC	0x32465070	/* "pPF2" */
 typedef struct PFhdr_str {
+	int	magic;		/* PF_FILE_MAGIC */
 	int	firstfree;	/* first free page in the linked list of
 				free pages */
 	int	numpages;	/* # of pages in the file */
@@ -22,9 +27,199 @@ typedef struct PFfpage {
 	int nextfree;	/* page number of next free page in the linked
 			list of free pages, or PF_PAGE_LIST_END if
 			end of list, or PF_PAGE_USED if this page is not free */
+	long lsn;	/* LSN of the last logged change, or 0 */
 	char pagebuf[PF_PAGE_SIZE];	/* actual page data */
 } PFfpage;
 
+/************************** Compressed Files ************************/
+/* A compressed file (PF_CreateCompressedFile) starts with a PFhdr_str whose
+firstfree is PF_COMPRESSED_FILE, followed by a PFchdr_str. Each PFfpage is
+stored LZ-compressed (pflz.c) in an extent of its own, found through the
+page map. The map is written after the last extent when the file is
+closed; when it is opened again, new extents go after that map, which
+the header names until the next close. A page rewritten larger than its extent moves to a new extent at
+the end; the old one is not reused. */
+#define PF_COMPRESSED_FILE	-3	/* PFhdr_str.firstfree of such a file */
+#define PF_EXTENT_ALIGN	16	/* extent sizes are multiples of this */
+typedef struct PFchdr_str {
+	int	firstfree;	/* as in PFhdr_str */
+	int	numpages;
+	long	mapoff;		/* offset of the page map: numpages PFextent */
+	long	end;		/* end of the last extent */
+} PFchdr_str;
+
+typedef struct PFextent {
+	long	off;	/* offset in the file, or 0 if never written */
+	int	len;	/* bytes used; sizeof(PFfpage) if not compressed */
+	int	cap;	/* bytes reserved */
+} PFextent;
+
+/* most bytes PFlzCompress() makes of n bytes */
+#define PF_LZ_BOUND(n)	((n) + (n) / 255 + 16)
+
+/**************************** Shadow Files **************************/
+/* A shadow file (PF_CreateShadowFile) starts with a PFhdr_str whose
+firstfree is PF_SHADOW_FILE, followed by two PFshdr_str; of those whose
+check is right, the one with the larger version is current. Pages are
+stored in slots of sizeof(PFfpage) bytes after them, found through the
+page table of the current header. The table is a chain of slots, each
+an int with the next slot of the chain, or -1, then PF_SHADOW_PERSLOT
+entries.
+Between PF_ShadowBegin() and PF_ShadowCommit() every page fixed and
+written goes to a free slot, so the pages of the last commit are left as
+they are. PF_ShadowAbort() drops the pages fixed from the buffer and puts
+the table back, so the slots written are free again.
+The commit writes a new table to free slots, then the other header:
+until that one write is done the file is as of the commit before. Slots
+no longer in the table are free from then on. Pages written outside an
+update are written in place. */
+#define PF_SHADOW_FILE	-4	/* PFhdr_str.firstfree of such a file */
+typedef struct PFshdr_str {
+	int	version;	/* larger is newer */
+	int	firstfree;	/* as in PFhdr_str */
+	int	numpages;
+	int	nslots;		/* slots in the file */
+	int	tableslot;	/* first slot of the page table, or -1 */
+	int	check;		/* of the fields above, by PFscheck() */
+} PFshdr_str;
+
+#define PF_SHADOW_DATA	(PF_HDR_SIZE + 2 * sizeof(PFshdr_str)) /* slot 0 */
+#define PF_SHADOW_PERSLOT ((int)(sizeof(PFfpage) / sizeof(int)) - 1)
+
+#define PF_SLOT_FREE	0	/* slot states */
+#define PF_SLOT_USED	1	/* in the current table */
+#define PF_SLOT_NEW	2	/* written since the last commit */
+#define PF_SLOT_OLD	3	/* in the current table, free after the next
+				commit */
+
+typedef struct PFssaved {
+	int	page;
+	PFfpage	fpage;
+} PFssaved;
+
+typedef struct PFshadow {
+	int	version;	/* of the current header */
+	int	*table;		/* slot of each page, or -1 if never
+				written; tablecap entries */
+	int	tablecap;
+	int	*slots;		/* state of each slot, slotcap entries */
+	int	nslots;		/* slots in the file */
+	int	slotcap;
+	int	nfree;		/* slots PF_SLOT_FREE */
+	int	nextslot;	/* where the search for a free slot starts */
+	int	*tslots;	/* slots of the current page table */
+	int	ntslots;
+	int	updating;	/* TRUE between PF_ShadowBegin() and
+				PF_ShadowCommit() or PF_ShadowAbort() */
+	int	*touched;	/* pages fixed in the update, ntouched */
+	int	ntouched;
+	int	touchedcap;
+	int	moved;		/* pages written to new slots in the update */
+	int	*undo;		/* for each page of the update written to a
+				new slot: page, slot before (or -1), new
+				slot; nundo triples */
+	int	nundo;
+	int	undocap;
+	struct PFssaved *saved;	/* pages dirty when first fixed in the
+				update, as they were then; nsaved */
+	int	nsaved;
+	int	savedcap;
+	PFhdr_str begin;	/* file header at PF_ShadowBegin() */
+	int	changed;	/* TRUE if the table changed since the last
+				commit */
+} PFshadow;
+
+/**************************** Memory Files **************************/
+/* A memory file (PF_CreateMemFile, or PF_CreateFile of a name starting
+with PF_MEM_PREFIX) keeps its header and pages in an array that grows as
+pages are written, instead of in a unix file. It lives until
+PF_DestroyFile() or the end of the process, and is used like any other
+paged file: the buffer, its statistics and PF_GetIOBytes() count its
+reads and writes as for a unix file. It is not logged. */
+#define PF_MEM_PREFIX	"mem:"
+
+typedef struct PFmemfile {
+	char	*name;
+	PFhdr_str hdr;		/* as of the last close */
+	PFfpage	*pages;		/* npages written, cap allocated */
+	int	npages;
+	int	cap;
+	int	nopen;		/* PFftab entries it is open in */
+	struct PFmemfile *next;	/* all memory files */
+} PFmemfile;
+
+/*************************** Write-ahead Log ************************/
+/* The log (pflog.c) starts with a PFloghdr_str, followed by records. The
+record with LSN l is at byte l - base + PF_LOG_HDR_SIZE. LSNs start at 1, so
+that 0 means no record, and keep growing when the log is emptied: pages
+carry the LSN of their last logged change. Each record is a PFlogrec
+followed by its data:
+	PF_LOG_FILE	the file name, of len bytes
+	PF_LOG_UPDATE	len bytes of pagebuf at off before the change,
+			then the same bytes after it
+	PF_LOG_CKPT	a PFlogckpt and its ndirty PFdirty; the nfiles
+			files in the log are named by the PF_LOG_FILE
+			records after it
+A record is at most sizeof(PFlogrec) + 2 * PF_PAGE_SIZE bytes.
+The header points to the last checkpoint; recovery starts from it. */
+#define PF_LOG_MAGIC	0x324c4650	/* "PFL2" */
+typedef struct PFloghdr_str {
+	int	magic;
+	long	base;		/* LSN of the first record */
+	long	ckpt;		/* LSN of the last checkpoint, or 0 */
+} PFloghdr_str;
+
+#define PF_LOG_HDR_SIZE sizeof(PFloghdr_str)
+
+#define PF_LOG_BEGIN	1	/* record types */
+#define PF_LOG_COMMIT	2
+#define PF_LOG_ABORT	3
+#define PF_LOG_UPDATE	4
+#define PF_LOG_FILE	5	/* file "fileid" of later records is named */
+#define PF_LOG_CKPT	6	/* fuzzy checkpoint */
+
+typedef struct PFlogrec {
+	int	size;		/* bytes in the record, data included */
+	short	type;
+	short	fileid;		/* PF_LOG_UPDATE, PF_LOG_FILE: file in the log */
+	int	txn;		/* transaction, or 0 */
+	int	page;		/* PF_LOG_UPDATE: page number */
+	long	prevlsn;	/* previous record of txn, or 0 */
+	short	off;		/* PF_LOG_UPDATE: first byte of pagebuf changed */
+	short	len;		/* bytes of data, or of each image */
+	int	nextfree[2];	/* PF_LOG_UPDATE: nextfree before and after */
+} PFlogrec;
+
+/* a dirty page: in the buffer, file is a PF fd; in the log, a file id */
+typedef struct PFdirty {
+	int	file;
+	int	page;
+	long	reclsn;		/* LSN of the first change not yet written */
+} PFdirty;
+
+typedef struct PFlogckpt {
+	int	txn;		/* transaction active, or 0 */
+	int	ndirty;		/* dirty pages of files in the log */
+	long	txnlast;	/* LSN of the last record of txn */
+	int	nfiles;		/* PF_LOG_FILE records that follow */
+} PFlogckpt;
+
+#define PF_LOG_BUFSIZE	65536	/* log records kept in memory */
+#define PF_LOG_MAXFILES	256	/* files in one log */
+
+/* Statistics collected by the log manager */
+typedef struct PFlogstats {
+	int	records;	/* records appended */
+	long	bytes;		/* bytes appended */
+	int	commits;	/* transactions committed */
+	int	aborts;		/* transactions aborted */
+	int	forces;		/* log writes followed by fsync() */
+	int	checkpoints;	/* checkpoints taken */
+	int	trickled;	/* dirty pages written after checkpoints */
+	int	recovered;	/* records read by recovery */
+	int	redone;		/* updates put on pages by recovery */
+} PFlogstats;
+
 /*************************** Opened File Table **********************/
 #define PF_FTAB_SIZE	20	/* size of open file table */
 
@@ -34,6 +229,12 @@ typedef struct PFftab_ele {
 	int unixfd;	/* unix file descriptor*/
 	PFhdr_str hdr;	/* file header */
 	short hdrchanged; /* TRUE if file header has changed */
+	short compressed; /* TRUE if a compressed file */
+	PFextent *map;	/* compressed: page map, mapcap entries */
+	int mapcap;
+	long end;	/* compressed: end of the last extent */
+	PFshadow *shadow; /* shadow file: page table and slots, or NULL */
+	PFmemfile *mem;	/* memory file, or NULL */
 } PFftab_ele;
 
 /************************** Buffer Page Decls *********************/
@@ -46,10 +247,16 @@ typedef struct PFbpage {
 	struct PFbpage *prevpage;	/* previous in the linked list
 					of buffer pages */
 	short	dirty:1,		/* TRUE if page is dirty */
-		fixed:1;		/* TRUE if page is fixed in buffer*/
+		fixed:1,		/* TRUE if page is fixed in buffer*/
+		captured:1;		/* TRUE if "before" holds the page
+					as it was fixed, for the log */
 	int	page;			/* page number of this page */
 	int	fd;			/* file desciptor of this page */
 	PFfpage fpage; /* page data from the file */
+	PFfpage *before; /* copy of fpage when fixed in a transaction, or
+			 NULL until a page of a logged file is fixed */
+	long	reclsn;		/* LSN of the first logged change since
+				the page was written, or 0 */
 } PFbpage;
 
 /* Replacement policy enum */
@@ -66,6 +273,17 @@ typedef struct PFstats {
 	int page_misses;     /* buffer misses */
 } PFstats;
 
+#define PF_STATS_NAMELEN	64	/* file names kept with per-file stats */
+
+/* Occupancy of the buffer pool (PF_GetPoolStats); clean = used - dirty */
+typedef struct PFpoolstats {
+	int size;            /* pages allowed (PF_SetBufferParams) */
+	int policy;          /* PF_REPL_LRU or PF_REPL_MRU */
+	int used;            /* pages holding file pages */
+	int dirty;           /* ... of which dirty */
+	int fixed;           /* ... and fixed (pinned) */
+} PFpoolstats;
+
 
 
 /******************** Hash Table Decls ****************************/
@@ -91,6 +309,25 @@ extern int PFhashDelete(int fd, int page);
 extern void PFhashPrint(void);
 
 
+/****************** Interface functions from LZ codec *******************/
+extern int PFlzCompress(char *src, int n, char *dst, int cap);
+extern int PFlzDecompress(char *src, int n, char *dst, int cap);
+
+/****************** Interface functions from Log Manager ****************/
+extern int PFlogCapturing(int fd);
+extern int PFlogCheckFile(int fd);
+extern int PFlogPage(int fd, int pagenum, PFfpage *before, PFfpage *after, long *first);
+extern int PFlogFlush(long lsn);
+extern void PFlogFileOpened(int fd, char *fname, int compressed);
+extern int PFlogFileClosed(int fd);
+
+/********** Interface functions from PF for the Log Manager and SP layer */
+extern int PFfixPage(int fd, int pagenum, PFfpage **fpage, int extend);
+extern int PFflushPage(int fd, int pagenum);
+extern int PFflushHdr(int fd);
+extern int PFgetHdr(int fd, PFhdr_str *hdr);
+extern int PFputHdr(int fd, PFhdr_str *hdr);
+
 /****************** Interface functions from Buffer Manager *************/
 /* prototypes matching implementations in buf.c */
 extern int PFbufGet(int fd, int pagenum, PFfpage **fpage, int (*readfcn)(), int (*writefcn)());
@@ -98,6 +335,13 @@ extern int PFbufUnfix(int fd, int pagenum, int dirty);
 extern int PFbufAlloc(int fd, int pagenum, PFfpage **fpage, int (*writefcn)());
 extern int PFbufReleaseFile(int fd, int (*writefcn)());
 extern int PFbufUsed(int fd, int pagenum);
+extern int PFbufDirty(PFdirty *dirty, int max);
+extern int PFbufWritePage(int fd, int pagenum, int (*writefcn)());
+extern int PFbufIsDirty(int fd, int pagenum);
+extern int PFbufDiscard(int fd, int pagenum);
 extern void PFbufPrint(void);
+extern void PFbufFileOpened(int fd, char *fname);
+extern void PFbufFileClosed(int fd);
+extern int PFbufFileStats(int fd, PFstats *st, char *name);
 
 #endif /* PFTYPES_H */
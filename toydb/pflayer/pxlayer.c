@@ -0,0 +1,238 @@
+/* pxlayer.c
+ * PAX (partition attributes across) pages on top of the PF layer.
+ *
+ * Page 0 of a PAX file holds its header: the column widths, the # of rows
+ * a page holds and where each minipage starts. Every other page is
+ *   [ int nrows ]
+ *   [ col 0 null bitmap ][ col 0 values ] [ col 1 null bitmap ][ col 1 values ] ...
+ * where column c's values are `capacity` slots of widths[c] bytes, and
+ * every minipage starts 4-byte aligned. Rows are only appended, so a page
+ * is full before the next one is started.
+ *
+ * A scan keeps its current page fixed and hands out pointers into it
+ * instead of copying rows as SP_ScanNext does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pxlayer.h"
+#include "pftypes.h"
+
+#define PX_MAGIC 0x50415831 /* "PAX1" */
+#define PX_HDR_SZ (sizeof(int)) /* nrows at the start of a data page */
+#define ALIGN4(n) (((n) + 3) & ~3)
+
+typedef struct {
+    int magic;
+    int ncols;
+    int capacity;
+    int widths[PX_MAXCOLS];
+    int valoff[PX_MAXCOLS];
+    int nulloff[PX_MAXCOLS];
+} px_header_t;
+
+struct PXscan {
+    int fd;
+    int ncols;
+    int cols[PX_MAXCOLS];
+    px_header_t h;
+    int curpage;
+    int currow;
+    int nrows;      /* rows on curpage */
+    char *pagebuf;  /* curpage, while it is fixed */
+};
+
+/* place the minipages for capacity rows; returns the bytes they take */
+static int layout(px_header_t *h) {
+    int c, off = PX_HDR_SZ;
+    for (c = 0; c < h->ncols; c++) {
+        h->nulloff[c] = off;
+        off = ALIGN4(off + (h->capacity + 7) / 8);
+        h->valoff[c] = off;
+        off = ALIGN4(off + h->capacity * h->widths[c]);
+    }
+    return off;
+}
+
+static int read_header(int fd, px_header_t *h) {
+    char *pagebuf;
+    if (PF_GetThisPage(fd, 0, &pagebuf) != PFE_OK) return -1;
+    memcpy(h, pagebuf, sizeof(*h));
+    PF_UnfixPage(fd, 0, FALSE);
+    return h->magic == PX_MAGIC ? 0 : -1;
+}
+
+int PX_CreateFile(const char *fname, int ncols, const int *widths) {
+    px_header_t h;
+    char *pagebuf;
+    int c, rowbytes = 0, fd, pagenum;
+
+    if (ncols <= 0 || ncols > PX_MAXCOLS) return -1;
+    memset(&h, 0, sizeof(h));
+    h.magic = PX_MAGIC;
+    h.ncols = ncols;
+    for (c = 0; c < ncols; c++) {
+        if (widths[c] <= 0) return -1;
+        h.widths[c] = widths[c];
+        rowbytes += widths[c];
+    }
+    /* as many rows as fit once the bitmaps and alignment are paid for */
+    h.capacity = (PF_PAGE_SIZE - PX_HDR_SZ) * 8 / (8 * rowbytes + ncols);
+    while (h.capacity > 0 && layout(&h) > PF_PAGE_SIZE) h.capacity--;
+    if (h.capacity == 0) return -1;
+
+    if (PF_CreateFile((char *)fname) != PFE_OK) return -1;
+    if ((fd = PF_OpenFile((char *)fname)) < 0) return -1;
+    if (PF_AllocPage(fd, &pagenum, &pagebuf) != PFE_OK) {
+        PF_CloseFile(fd);
+        return -1;
+    }
+    memset(pagebuf, 0, PF_PAGE_SIZE);
+    memcpy(pagebuf, &h, sizeof(h));
+    PF_UnfixPage(fd, pagenum, TRUE);
+    return PF_CloseFile(fd) == PFE_OK && pagenum == 0 ? 0 : -1;
+}
+
+int PX_OpenFile(const char *fname) {
+    px_header_t h;
+    int fd = PF_OpenFile((char *)fname);
+    if (fd < 0) return fd;
+    if (read_header(fd, &h) != 0) {
+        PF_CloseFile(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int PX_CloseFile(int fd) {
+    return PF_CloseFile(fd);
+}
+
+int PX_GetLayout(int fd, int *ncols, int *widths, int *capacity) {
+    px_header_t h;
+    if (read_header(fd, &h) != 0) return -1;
+    *ncols = h.ncols;
+    memcpy(widths, h.widths, h.ncols * sizeof(int));
+    *capacity = h.capacity;
+    return 0;
+}
+
+int PX_AppendRow(int fd, const char *const *vals) {
+    px_header_t h;
+    char *pagebuf;
+    int last, nrows, c;
+
+    if (read_header(fd, &h) != 0) return -1;
+    if ((last = PF_GetNumPages(fd) - 1) < 0) return -1;
+    nrows = h.capacity;
+    if (last > 0) {
+        if (PF_GetThisPage(fd, last, &pagebuf) != PFE_OK) return -1;
+        memcpy(&nrows, pagebuf, sizeof(int));
+        if (nrows >= h.capacity) PF_UnfixPage(fd, last, FALSE);
+    }
+    if (nrows >= h.capacity) {
+        if (PF_AllocPage(fd, &last, &pagebuf) != PFE_OK) return -1;
+        /* a page from the PF free list may carry stale bytes */
+        memset(pagebuf, 0, PF_PAGE_SIZE);
+        nrows = 0;
+    }
+    for (c = 0; c < h.ncols; c++) {
+        char *v = pagebuf + h.valoff[c] + nrows * h.widths[c];
+        if (vals[c]) memcpy(v, vals[c], h.widths[c]);
+        else {
+            memset(v, 0, h.widths[c]);
+            pagebuf[h.nulloff[c] + nrows / 8] |= 1 << (nrows % 8);
+        }
+    }
+    nrows++;
+    memcpy(pagebuf, &nrows, sizeof(int));
+    PF_UnfixPage(fd, last, TRUE);
+    return 0;
+}
+
+int PX_ScanOpen(int fd, const int *cols, int ncols, PXscan **scanptr) {
+    PXscan *s;
+    int i;
+
+    if (ncols < 0 || ncols > PX_MAXCOLS) return -1;
+    if (!(s = (PXscan *)malloc(sizeof(PXscan)))) return -1;
+    if (read_header(fd, &s->h) != 0) {
+        free(s);
+        return -1;
+    }
+    for (i = 0; i < ncols; i++) {
+        if (cols[i] < 0 || cols[i] >= s->h.ncols) {
+            free(s);
+            return -1;
+        }
+        s->cols[i] = cols[i];
+    }
+    s->fd = fd;
+    s->ncols = ncols;
+    s->curpage = 0;
+    s->currow = 0;
+    s->nrows = 0;
+    s->pagebuf = NULL;
+    *scanptr = s;
+    return 0;
+}
+
+/* unfix the current page and fix the next one */
+static int next_page(PXscan *s) {
+    int error;
+
+    if (s->pagebuf) PF_UnfixPage(s->fd, s->curpage, FALSE);
+    s->pagebuf = NULL;
+    s->curpage++;
+    error = PF_GetThisPage(s->fd, s->curpage, &s->pagebuf);
+    if (error == PFE_INVALIDPAGE) {
+        s->pagebuf = NULL;
+        return PFE_EOF;
+    }
+    if (error != PFE_OK) {
+        s->pagebuf = NULL;
+        return -1;
+    }
+    memcpy(&s->nrows, s->pagebuf, sizeof(int));
+    s->currow = 0;
+    return 0;
+}
+
+int PX_ScanNext(PXscan *s, const char **vals) {
+    int i, c, error;
+
+    while (!s->pagebuf || s->currow >= s->nrows)
+        if ((error = next_page(s)) != 0) return error;
+    for (i = 0; i < s->ncols; i++) {
+        c = s->cols[i];
+        if ((s->pagebuf[s->h.nulloff[c] + s->currow / 8] >> (s->currow % 8)) & 1)
+            vals[i] = NULL;
+        else
+            vals[i] = s->pagebuf + s->h.valoff[c] + s->currow * s->h.widths[c];
+    }
+    s->currow++;
+    return 0;
+}
+
+int PX_ScanNextPage(PXscan *s, int *nrows, const char **values,
+                    const unsigned char **nulls) {
+    int i, error;
+
+    do {
+        if ((error = next_page(s)) != 0) return error;
+    } while (s->nrows == 0);
+    for (i = 0; i < s->ncols; i++) {
+        values[i] = s->pagebuf + s->h.valoff[s->cols[i]];
+        nulls[i] = (const unsigned char *)s->pagebuf + s->h.nulloff[s->cols[i]];
+    }
+    *nrows = s->nrows;
+    s->currow = s->nrows;
+    return 0;
+}
+
+int PX_ScanClose(PXscan *s) {
+    if (s->pagebuf) PF_UnfixPage(s->fd, s->curpage, FALSE);
+    free(s);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/* pxlayer.h: PAX pages on top of PF
+ * Rows of fixed-width columns, stored page by page with each column of a
+ * page's rows in its own minipage, so a scan of a few columns touches only
+ * their bytes.
+ */
+#ifndef PXLAYER_H
+#define PXLAYER_H
+
+#include "pf.h"
+
+#define PX_MAXCOLS 32
+
+/* Scan descriptor (opaque) */
+typedef struct PXscan PXscan;
+
+/* API */
+/* widths[c] is the # of bytes of every value of column c */
+int PX_CreateFile(const char *fname, int ncols, const int *widths);
+int PX_OpenFile(const char *fname);
+int PX_CloseFile(int fd);
+
+/* # of columns, their widths and the # of rows a page holds */
+int PX_GetLayout(int fd, int *ncols, int *widths, int *capacity);
+
+/* Append a row to the last page (or a new one). vals[c] points to the
+ * widths[c] bytes of column c, or is NULL for a null. */
+int PX_AppendRow(int fd, const char *const *vals);
+
+/* Scan of columns cols[0..ncols-1] only */
+int PX_ScanOpen(int fd, const int *cols, int ncols, PXscan **scan);
+/* Next row: vals[i] points at its value of column cols[i], or is NULL for
+ * a null. The pointers stay valid until the next call. Returns PFE_EOF at
+ * the end. */
+int PX_ScanNext(PXscan *scan, const char **vals);
+/* All rows of the next page at once: values[i] points to the *nrows
+ * values of column cols[i] one after another (4-byte aligned), and nulls[i]
+ * to its null bitmap, bit r of byte r/8 set if row r is null. The pointers
+ * stay valid until the next call. A scan uses either this or
+ * PX_ScanNext. Returns PFE_EOF at the end. */
+int PX_ScanNextPage(PXscan *scan, int *nrows, const char **values,
+                    const unsigned char **nulls);
+int PX_ScanClose(PXscan *scan);
+
+#endif
@@ -6,6 +6,13 @@ Runs the `testpf_policy` binary across different write mixes and policies,
 collects results and plots graphs (requires matplotlib).
 
 Usage: python3 run_pf_experiments.py --bins 11 --ops 200 --pages 10 --pools 5,10 --task-name pf_task1
+       python3 run_pf_experiments.py --ops 20000 --pages 200 --pools 10 --patterns loop,zipf:0.99,hotspot:0.8:0.2,scan:0.5 --files 4
+
+--patterns takes the access patterns of testpf_policy (loop, uniform, zipf[:theta],
+hotspot[:x:y], scan[:f]); --files spreads the pages over that many files.
+--sweep runs all the points in one `testpf_policy sweep` process instead of one
+process per point; its counters cover the operations only, without the page
+allocation each single run starts with. The sweep wall time is printed either way.
 
 Produces: timestamped output directory under toydb/output/<task>_YYYYmmdd_HHMMSS containing CSV and PNGs.
 """
@@ -14,6 +21,7 @@ import argparse
 import csv
 import os
 import sys
+import time
 
 try:
     import matplotlib.pyplot as plt
@@ -28,11 +36,15 @@ parser.add_argument('--bins', type=int, default=11, help='number of write-mix po
 parser.add_argument('--ops', type=int, default=200, help='operations per run')
 parser.add_argument('--pages', type=int, default=10, help='distinct pages')
 parser.add_argument('--pools', type=str, default='5', help='comma-separated pool sizes, e.g. 5,10')
+parser.add_argument('--patterns', type=str, default='loop', help='comma-separated access patterns, e.g. loop,zipf:0.99,hotspot:0.8:0.2')
+parser.add_argument('--files', type=int, default=1, help='files the pages are spread over')
+parser.add_argument('--sweep', action='store_true', help='run every point in one testpf_policy process (counters then exclude page allocation)')
 parser.add_argument('--task-name', type=str, default='pf_task1', help='task name used for output folder')
 parser.add_argument('--out', type=str, default='', help='(optional) CSV output file path; if empty, runner creates output dir')
 args = parser.parse_args()
 
 pools = [int(x) for x in args.pools.split(',') if x.strip()]
+patterns = [x.strip() for x in args.patterns.split(',') if x.strip()]
 write_fracs = [i/(args.bins-1) for i in range(args.bins)]
 policies = ['lru','mru']
 
@@ -52,46 +64,56 @@ else:
     csv_path = os.path.join(out_dir, 'pf_results.csv')
 
 # CSV header
-header = ['policy','pool','ops','pages','write_frac','logical_reads','logical_writes','phys_reads','phys_writes','page_hits','page_misses']
+header = ['policy','pool','ops','pages','write_frac','logical_reads','logical_writes','phys_reads','phys_writes','page_hits','page_misses','pattern','files']
 
 with open(csv_path, 'w', newline='') as csvfile:
     writer = csv.writer(csvfile)
     writer.writerow(header)
+    # the binary appends to the file: the header must be there first
+    csvfile.flush()
+
+
+def run(cmd):
+    print('Running:', ' '.join(cmd))
+    try:
+        return subprocess.check_output(cmd, cwd=os.path.dirname(__file__)).decode('utf-8')
+    except subprocess.CalledProcessError as e:
+        print('Execution failed:', e)
+        print('stdout:', e.output.decode('utf-8'))
+        sys.exit(1)
 
+
+t0 = time.monotonic()
+if args.sweep:
+    # one process runs every point and appends all the rows
+    run([BIN, 'sweep', ','.join(map(str, pools)), ','.join(policies), str(args.ops), str(args.pages),
+         ','.join(str(wf) for wf in write_fracs), csv_path, ','.join(patterns), str(args.files)])
+else:
+    for pattern in patterns:
+        for policy in policies:
+            for pool in pools:
+                for wf in write_fracs:
+                    # call binary: pass CSV path so the binary appends its line
+                    run([BIN, str(pool), policy, str(args.ops), str(args.pages), str(wf), csv_path, pattern, str(args.files)])
+elapsed = time.monotonic() - t0
+npoints = len(patterns) * len(policies) * len(pools) * len(write_fracs)
+print(f'Sweep wall time: {elapsed:.3f} s for {npoints} points ({"in-process" if args.sweep else "one process per point"})')
+
+# rows of each (pattern, policy, pool), in write_frac order
+results = {}
+with open(csv_path, 'r') as f:
+    for row in list(csv.reader(f))[1:]:
+        results.setdefault((row[11], row[0].lower(), int(row[1])), []).append(row)
+
+for pattern in patterns:
     for policy in policies:
         for pool in pools:
-            x_vals = []
-            y_reads = []
-            y_writes = []
-            y_phys_reads = []
-            y_phys_writes = []
-            for wf in write_fracs:
-                # call binary: pass CSV path so the binary appends its line
-                cmd = [BIN, str(pool), policy, str(args.ops), str(args.pages), str(wf), csv_path]
-                print('Running:', ' '.join(cmd))
-                try:
-                    out = subprocess.check_output(cmd, cwd=os.path.dirname(__file__)).decode('utf-8')
-                except subprocess.CalledProcessError as e:
-                    print('Execution failed:', e)
-                    print('stdout:', e.output.decode('utf-8'))
-                    sys.exit(1)
-
-                # read last written CSV line from file
-                with open(csv_path,'r') as f:
-                    last = list(csv.reader(f))[-1]
-
-                logical_reads = int(last[5])
-                logical_writes = int(last[6])
-                phys_reads = int(last[7])
-                phys_writes = int(last[8])
-                page_hits = int(last[9])
-                page_misses = int(last[10])
-
-                x_vals.append(wf)
-                y_reads.append(logical_reads)
-                y_writes.append(logical_writes)
-                y_phys_reads.append(phys_reads)
-                y_phys_writes.append(phys_writes)
+            rows = results.get((pattern, policy, pool), [])
+            x_vals = [float(r[4]) for r in rows]
+            y_reads = [int(r[5]) for r in rows]
+            y_writes = [int(r[6]) for r in rows]
+            y_phys_reads = [int(r[7]) for r in rows]
+            y_phys_writes = [int(r[8]) for r in rows]
 
             # plot reads and writes vs write_frac
             plt.figure()
@@ -101,11 +123,10 @@ with open(csv_path, 'w', newline='') as csvfile:
             plt.plot(x_vals, y_phys_writes, label='phys_writes')
             plt.xlabel('write fraction')
             plt.ylabel('counts')
-            plt.title(f'PF stats policy={policy.upper()} pool={pool}')
+            plt.title(f'PF stats policy={policy.upper()} pool={pool} pattern={pattern} files={args.files}')
             plt.legend()
-            png = os.path.join(out_dir, f'pf_{policy}_pool{pool}.png')
+            png = os.path.join(out_dir, f"pf_{policy}_pool{pool}_{pattern.replace(':', '_')}_files{args.files}.png")
             plt.savefig(png)
             print('Saved', png)
 
 print('All runs finished. CSV:', csv_path)
-print('Output folder:', out_dir)
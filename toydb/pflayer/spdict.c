@@ -0,0 +1,395 @@
+/* spdict.c
+ * Dictionary-encoded slotted-page heaps.
+ *
+ * Records are ';'-separated text as in data/. Some of their fields are
+ * declared when the file is created, and each distinct value of such a
+ * field gets a 2-byte code from a dictionary kept per file and per field.
+ * An encoded record is
+ *   [ code of declared field 0 ] ... [ code of declared field n-1 ] [ text ]
+ * where the text is the record with the declared fields left empty. A
+ * value longer than SP_DICT_MAXLEN, or one of a field whose dictionary is
+ * full, is kept in the text instead and has the code SP_DICT_INLINE.
+ *
+ * The dictionary lives in a side PF file, <heap>.dict: page 0 is a header
+ * with the declared fields, and the other pages hold the entries in the
+ * order they were added, each as
+ *   [ short field index ][ short length ][ bytes ]
+ * behind an int count of the bytes used on the page. An entry's code is
+ * its position among the entries of its field. The whole dictionary is
+ * read into memory on open. New entries are written to the file, pages
+ * and header, by the SP_DictEncode that adds them, so a heap page holding
+ * their codes cannot reach the file before them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "splayer.h"
+#include "pftypes.h"
+
+#define SD_MAGIC 0x53504431 /* "SPD1" */
+#define SD_HDR_SZ (sizeof(int)) /* bytes used, at the start of a page */
+#define SD_ENTRY_SZ (2 * sizeof(short)) /* field index and length */
+
+typedef struct {
+    int magic;
+    int nfields;
+    int fields[SP_MAXDICTFIELDS]; /* ascending */
+} sd_header_t;
+
+/* dictionary of one field */
+typedef struct {
+    int n;          /* codes 0..n-1 */
+    int cap;
+    int *off;       /* value of code c: text + off[c], len[c] bytes */
+    int *len;
+    char *text;
+    int textlen, textcap;
+    int *slot;      /* hash table of code + 1, 0 if empty */
+    int nslots;
+} sd_field_t;
+
+struct SPdict {
+    int dictfd;
+    sd_header_t h;
+    sd_field_t f[SP_MAXDICTFIELDS];
+    short *order;   /* field index of every entry, in the order added */
+    int nentries, ordercap;
+    int written;    /* entries already on the dictionary pages */
+    int lastpage;   /* last dictionary page */
+};
+
+static void dict_name(const char *fname, char *out, int outsize) {
+    snprintf(out, outsize, "%s.dict", fname);
+}
+
+static unsigned hash(const char *s, int len) {
+    unsigned h = 2166136261u; /* FNV-1a */
+    int i;
+    for (i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+/* code of s in f, or -1 */
+static int find(const sd_field_t *f, const char *s, int len) {
+    unsigned i;
+    int c;
+
+    if (f->nslots == 0) return -1;
+    for (i = hash(s, len) & (f->nslots - 1); f->slot[i]; i = (i + 1) & (f->nslots - 1)) {
+        c = f->slot[i] - 1;
+        if (f->len[c] == len && memcmp(f->text + f->off[c], s, len) == 0) return c;
+    }
+    return -1;
+}
+
+static void put_slot(sd_field_t *f, int c) {
+    unsigned i = hash(f->text + f->off[c], f->len[c]) & (f->nslots - 1);
+    while (f->slot[i]) i = (i + 1) & (f->nslots - 1);
+    f->slot[i] = c + 1;
+}
+
+/* give s the next code of f; returns it, or -1 if out of memory */
+static int add(sd_field_t *f, const char *s, int len) {
+    int c;
+
+    if (f->n == f->cap) {
+        int cap = f->cap ? 2 * f->cap : 64;
+        int *off = realloc(f->off, cap * sizeof(int));
+        if (!off) return -1;
+        f->off = off;
+        if (!(off = realloc(f->len, cap * sizeof(int)))) return -1;
+        f->len = off;
+        f->cap = cap;
+    }
+    if (f->textlen + len > f->textcap) {
+        int cap = f->textcap ? f->textcap : 1024;
+        char *text;
+        while (cap < f->textlen + len) cap *= 2;
+        if (!(text = realloc(f->text, cap))) return -1;
+        f->text = text;
+        f->textcap = cap;
+    }
+    /* keep the hash table at most half full */
+    if (2 * (f->n + 1) > f->nslots) {
+        int nslots = f->nslots ? 2 * f->nslots : 128;
+        int *slot = calloc(nslots, sizeof(int));
+        if (!slot) return -1;
+        free(f->slot);
+        f->slot = slot;
+        f->nslots = nslots;
+        for (c = 0; c < f->n; c++) put_slot(f, c);
+    }
+    c = f->n++;
+    f->off[c] = f->textlen;
+    f->len[c] = len;
+    memcpy(f->text + f->textlen, s, len);
+    f->textlen += len;
+    put_slot(f, c);
+    return c;
+}
+
+/* remember that the newest entry belongs to field index i */
+static int add_order(SPdict *d, int i) {
+    if (d->nentries == d->ordercap) {
+        int cap = d->ordercap ? 2 * d->ordercap : 256;
+        short *order = realloc(d->order, cap * sizeof(short));
+        if (!order) return -1;
+        d->order = order;
+        d->ordercap = cap;
+    }
+    d->order[d->nentries++] = i;
+    return 0;
+}
+
+/* index of field in d's declared fields, or -1 */
+static int field_index(const SPdict *d, int field) {
+    int i;
+    for (i = 0; i < d->h.nfields; i++)
+        if (d->h.fields[i] == field) return i;
+    return -1;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+int SP_DictCreateFile(const char *fname, int nfields, const int *fields) {
+    sd_header_t h;
+    char dname[512], *pagebuf;
+    int fd, pagenum, i;
+
+    if (nfields <= 0 || nfields > SP_MAXDICTFIELDS) return -1;
+    memset(&h, 0, sizeof(h));
+    h.magic = SD_MAGIC;
+    h.nfields = nfields;
+    memcpy(h.fields, fields, nfields * sizeof(int));
+    qsort(h.fields, nfields, sizeof(int), cmp_int);
+    for (i = 0; i < nfields; i++)
+        if (h.fields[i] < 0 || (i > 0 && h.fields[i] == h.fields[i-1])) return -1;
+
+    dict_name(fname, dname, sizeof(dname));
+    if (SP_CreateFile(fname) != PFE_OK) return -1;
+    if (PF_CreateFile(dname) != PFE_OK) return -1;
+    if ((fd = PF_OpenFile(dname)) < 0) return -1;
+    if (PF_AllocPage(fd, &pagenum, &pagebuf) != PFE_OK) {
+        PF_CloseFile(fd);
+        return -1;
+    }
+    memset(pagebuf, 0, PF_PAGE_SIZE);
+    memcpy(pagebuf, &h, sizeof(h));
+    PF_UnfixPage(fd, pagenum, TRUE);
+    return PF_CloseFile(fd) == PFE_OK && pagenum == 0 ? 0 : -1;
+}
+
+/* read the entries of dictionary page pagenum into d */
+static int read_entries(SPdict *d, int pagenum) {
+    char *pagebuf;
+    int used, pos = SD_HDR_SZ;
+    short i, len;
+
+    if (PF_GetThisPage(d->dictfd, pagenum, &pagebuf) != PFE_OK) return -1;
+    memcpy(&used, pagebuf, sizeof(int));
+    while (pos < used) {
+        memcpy(&i, pagebuf + pos, sizeof(short));
+        memcpy(&len, pagebuf + pos + sizeof(short), sizeof(short));
+        pos += SD_ENTRY_SZ;
+        if (i < 0 || i >= d->h.nfields || add(&d->f[i], pagebuf + pos, len) < 0
+                || add_order(d, i) != 0) {
+            PF_UnfixPage(d->dictfd, pagenum, FALSE);
+            return -1;
+        }
+        pos += len;
+    }
+    PF_UnfixPage(d->dictfd, pagenum, FALSE);
+    return 0;
+}
+
+static void free_dict(SPdict *d) {
+    int i;
+    for (i = 0; i < SP_MAXDICTFIELDS; i++) {
+        free(d->f[i].off);
+        free(d->f[i].len);
+        free(d->f[i].text);
+        free(d->f[i].slot);
+    }
+    free(d->order);
+    free(d);
+}
+
+int SP_DictOpenFile(const char *fname, SPdict **dictptr) {
+    SPdict *d;
+    char dname[512], *pagebuf;
+    int fd, p, npages;
+
+    if (!(d = (SPdict *)calloc(1, sizeof(SPdict)))) return -1;
+    dict_name(fname, dname, sizeof(dname));
+    if ((d->dictfd = PF_OpenFile(dname)) < 0) {
+        free(d);
+        return -1;
+    }
+    if (PF_GetThisPage(d->dictfd, 0, &pagebuf) != PFE_OK) goto fail;
+    memcpy(&d->h, pagebuf, sizeof(d->h));
+    PF_UnfixPage(d->dictfd, 0, FALSE);
+    if (d->h.magic != SD_MAGIC) goto fail;
+    npages = PF_GetNumPages(d->dictfd);
+    for (p = 1; p < npages; p++)
+        if (read_entries(d, p) != 0) goto fail;
+    d->written = d->nentries;
+    d->lastpage = npages - 1;
+    if ((fd = SP_OpenFile(fname)) < 0) goto fail;
+    *dictptr = d;
+    return fd;
+fail:
+    PF_CloseFile(d->dictfd);
+    free_dict(d);
+    return -1;
+}
+
+/* append the entries not yet on the dictionary pages, and write the pages
+ * changed and the file header */
+static int write_entries(SPdict *d) {
+    char *pagebuf = NULL;
+    int pagenum = d->lastpage, used = PF_PAGE_SIZE, e;
+    int next[SP_MAXDICTFIELDS], i;
+
+    /* code of each field's first unwritten entry */
+    for (i = 0; i < d->h.nfields; i++) next[i] = d->f[i].n;
+    for (e = d->nentries - 1; e >= d->written; e--) next[d->order[e]]--;
+
+    if (pagenum > 0) {
+        if (PF_GetThisPage(d->dictfd, pagenum, &pagebuf) != PFE_OK) return -1;
+        memcpy(&used, pagebuf, sizeof(int));
+    }
+    for (e = d->written; e < d->nentries; e++) {
+        sd_field_t *f = &d->f[d->order[e]];
+        short fi = d->order[e], len = f->len[next[fi]];
+        if (used + (int)SD_ENTRY_SZ + len > PF_PAGE_SIZE) {
+            if (pagebuf) {
+                memcpy(pagebuf, &used, sizeof(int));
+                PF_UnfixPage(d->dictfd, pagenum, TRUE);
+                if (PFflushPage(d->dictfd, pagenum) != PFE_OK) return -1;
+            }
+            if (PF_AllocPage(d->dictfd, &pagenum, &pagebuf) != PFE_OK) return -1;
+            memset(pagebuf, 0, PF_PAGE_SIZE);
+            used = SD_HDR_SZ;
+        }
+        memcpy(pagebuf + used, &fi, sizeof(short));
+        memcpy(pagebuf + used + sizeof(short), &len, sizeof(short));
+        memcpy(pagebuf + used + SD_ENTRY_SZ, f->text + f->off[next[fi]], len);
+        used += SD_ENTRY_SZ + len;
+        next[fi]++;
+    }
+    if (pagebuf) {
+        memcpy(pagebuf, &used, sizeof(int));
+        PF_UnfixPage(d->dictfd, pagenum, TRUE);
+        if (PFflushPage(d->dictfd, pagenum) != PFE_OK) return -1;
+    }
+    d->written = d->nentries;
+    d->lastpage = pagenum;
+    return PFflushHdr(d->dictfd) == PFE_OK ? 0 : -1;
+}
+
+int SP_DictCloseFile(int fd, SPdict *d) {
+    int error = write_entries(d);
+    if (PF_CloseFile(d->dictfd) != PFE_OK) error = -1;
+    if (SP_CloseFile(fd) != PFE_OK) error = -1;
+    free_dict(d);
+    return error;
+}
+
+int SP_DictDestroyFile(const char *fname) {
+    char dname[512];
+    dict_name(fname, dname, sizeof(dname));
+    PF_DestroyFile(dname);
+    return PF_DestroyFile((char *)fname);
+}
+
+int SP_DictNumPages(SPdict *d) {
+    return PF_GetNumPages(d->dictfd);
+}
+
+int SP_DictEncode(SPdict *d, const char *rec, int reclen, char *out, int outsize) {
+    int i = 0, field = 0, start = 0, pos, n;
+    int prefix = d->h.nfields * (int)sizeof(unsigned short);
+    unsigned short code;
+
+    if (prefix + reclen > outsize) return -1;
+    n = prefix;
+    for (pos = 0; pos <= reclen; pos++) {
+        if (pos < reclen && rec[pos] != ';') continue;
+        /* field `field` is rec[start..pos) */
+        if (i < d->h.nfields && d->h.fields[i] == field) {
+            sd_field_t *f = &d->f[i];
+            int c = find(f, rec + start, pos - start);
+            if (c < 0 && f->n < SP_DICT_INLINE && pos - start <= SP_DICT_MAXLEN) {
+                if ((c = add(f, rec + start, pos - start)) < 0 || add_order(d, i) != 0)
+                    return -1;
+            }
+            if (c < 0) {
+                code = SP_DICT_INLINE;
+                memcpy(out + n, rec + start, pos - start);
+                n += pos - start;
+            } else code = (unsigned short)c;
+            memcpy(out + i * sizeof(code), &code, sizeof(code));
+            i++;
+        } else {
+            memcpy(out + n, rec + start, pos - start);
+            n += pos - start;
+        }
+        if (pos < reclen) out[n++] = ';';
+        field++;
+        start = pos + 1;
+    }
+    /* declared fields past the end of the record */
+    code = SP_DICT_INLINE;
+    for (; i < d->h.nfields; i++) memcpy(out + i * sizeof(code), &code, sizeof(code));
+    /* new entries reach the file before the record can */
+    if (d->written < d->nentries && write_entries(d) != 0) return -1;
+    return n;
+}
+
+int SP_DictDecode(SPdict *d, const char *rec, int reclen, char *out, int outsize) {
+    int i = 0, field = 0, pos, n = 0, len;
+    int prefix = d->h.nfields * (int)sizeof(unsigned short);
+    unsigned short code;
+
+    for (pos = prefix; ; field++) {
+        if (i < d->h.nfields && d->h.fields[i] == field) {
+            memcpy(&code, rec + i * sizeof(code), sizeof(code));
+            if (code != SP_DICT_INLINE) {
+                const sd_field_t *f = &d->f[i];
+                if (code >= f->n || n + f->len[code] > outsize) return -1;
+                memcpy(out + n, f->text + f->off[code], f->len[code]);
+                n += f->len[code];
+            }
+            i++;
+        }
+        /* the rest of the field is in the text */
+        for (len = 0; pos + len < reclen && rec[pos + len] != ';'; len++)
+            ;
+        if (n + len + 1 > outsize) return -1;
+        memcpy(out + n, rec + pos, len);
+        n += len;
+        pos += len;
+        if (pos >= reclen) break;
+        out[n++] = ';';
+        pos++;
+    }
+    return n;
+}
+
+int SP_DictLookup(SPdict *d, int field, const char *value, int len) {
+    int i = field_index(d, field), c;
+    if (i < 0) return -1;
+    c = find(&d->f[i], value, len);
+    return c < 0 ? SP_DICT_INLINE : c;
+}
+
+int SP_DictGetCode(SPdict *d, const char *rec, int field) {
+    unsigned short code;
+    int i = field_index(d, field);
+    if (i < 0) return -1;
+    memcpy(&code, rec + i * sizeof(code), sizeof(code));
+    return code;
+}
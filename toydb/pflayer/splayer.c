@@ -17,6 +17,7 @@
 #include <string.h>
 #include "splayer.h"
 #include "pftypes.h"
+#include "pftrace.h"
 
 /* Internal constants */
 #define SP_SLOT_SZ (sizeof(int)*2) /* offset + length */
@@ -28,6 +29,7 @@ typedef struct {
 } sp_slot_t;
 
 struct SPscan {
+    int id;         /* for tracing */
     int fd;
     int curpage;
     int curslot;
@@ -63,6 +65,15 @@ static void write_slot(char *pagebuf, int idx, sp_slot_t *s) {
     memcpy(pagebuf + pos + sizeof(int), &s->length, sizeof(int));
 }
 
+char *SP_PageRec(char *pagebuf, int slot, int *reclen) {
+    sp_slot_t s;
+    if (slot < 0 || slot >= read_nslots(pagebuf)) return NULL;
+    read_slot(pagebuf, slot, &s);
+    if (s.length <= 0) return NULL;
+    *reclen = s.length;
+    return pagebuf + s.offset;
+}
+
 int SP_CreateFile(const char *fname) {
     return PF_CreateFile((char*)fname);
 }
@@ -85,42 +96,72 @@ static int page_free_space(char *pagebuf) {
     return slot_dir_start - freeStart;
 }
 
+/* initialise an empty page's header if it has never been used */
+static void init_page(char *pagebuf) {
+    int freeStart;
+    memcpy(&freeStart, pagebuf + 0, sizeof(int));
+    if (freeStart == 0) {
+        freeStart = SP_HDR_SZ;
+        memcpy(pagebuf + 0, &freeStart, sizeof(int));
+        write_nslots(pagebuf, 0);
+    }
+}
+
+/* place rec on the page if it fits; returns the new slot number or -1 */
+static int page_insert(char *pagebuf, const char *rec, int reclen) {
+    int freeStart;
+    int nslots;
+    sp_slot_t s;
+
+    init_page(pagebuf);
+    if (reclen + (int)SP_SLOT_SZ > page_free_space(pagebuf)) return -1;
+    memcpy(&freeStart, pagebuf + 0, sizeof(int));
+    nslots = read_nslots(pagebuf);
+    s.offset = freeStart;
+    s.length = reclen;
+    memcpy(pagebuf + s.offset, rec, reclen);
+    write_slot(pagebuf, nslots, &s);
+    write_nslots(pagebuf, nslots + 1);
+    freeStart += reclen;
+    memcpy(pagebuf + 0, &freeStart, sizeof(int));
+    return nslots;
+}
+
+/* allocate a fresh page at the end of the file and put rec on it */
+static int insert_new_page(int fd, const char *rec, int reclen, SPRID *rid) {
+    int newp;
+    char *nbuf;
+    int slot;
+
+    if (PF_AllocPage(fd, &newp, &nbuf) != PFE_OK) return -1;
+    /* a page from the PF free list may carry stale bytes */
+    memset(nbuf, 0, PF_PAGE_SIZE);
+    slot = page_insert(nbuf, rec, reclen);
+    PF_UnfixPage(fd, newp, TRUE);
+    if (slot < 0) return -1;
+    if (rid) { rid->page = newp; rid->slot = slot; }
+    return 0;
+}
+
 int SP_InsertRec(int fd, const char *rec, int reclen, SPRID *rid) {
-    int pagenum = 0;
+    int hint = 0;
+    return SP_InsertRecFrom(fd, &hint, rec, reclen, rid);
+}
+
+int SP_InsertRecFrom(int fd, int *hint, const char *rec, int reclen, SPRID *rid) {
+    int pagenum;
     char *pagebuf;
     int error;
 
-    for (pagenum = 0; ; pagenum++) {
+    for (pagenum = *hint; ; pagenum++) {
         error = PF_GetThisPage(fd, pagenum, &pagebuf);
         if (error == PFE_OK) {
-            /* ensure headers present */
-            int freeStart;
-            memcpy(&freeStart, pagebuf + 0, sizeof(int));
-            if (freeStart == 0) {
-                freeStart = SP_HDR_SZ;
-                memcpy(pagebuf + 0, &freeStart, sizeof(int));
-                write_nslots(pagebuf, 0);
-            }
-            int nslots = read_nslots(pagebuf);
-            int free = page_free_space(pagebuf);
-            int need = reclen + SP_SLOT_SZ;
-            if (need <= free) {
-                /* insert here */
-                sp_slot_t s;
-                s.offset = freeStart;
-                s.length = reclen;
-                /* copy record data */
-                memcpy(pagebuf + s.offset, rec, reclen);
-                /* write slot */
-                write_slot(pagebuf, nslots, &s);
-                nslots++;
-                write_nslots(pagebuf, nslots);
-                /* update freeStart */
-                freeStart += reclen;
-                memcpy(pagebuf + 0, &freeStart, sizeof(int));
+            int slot = page_insert(pagebuf, rec, reclen);
+            if (slot >= 0) {
                 /* unfix page as dirty */
                 PF_UnfixPage(fd, pagenum, TRUE);
-                if (rid) { rid->page = pagenum; rid->slot = nslots-1; }
+                if (rid) { rid->page = pagenum; rid->slot = slot; }
+                *hint = pagenum;
                 return 0;
             }
             /* not enough space, unfix and continue */
@@ -128,24 +169,10 @@ int SP_InsertRec(int fd, const char *rec, int reclen, SPRID *rid) {
             continue;
         } else if (error == PFE_INVALIDPAGE) {
             /* need to allocate a new page */
-            int newp;
-            char *nbuf;
-            if ((error = PF_AllocPage(fd, &newp, &nbuf)) != PFE_OK) return -1;
-            /* init header */
-            int freeStart = SP_HDR_SZ;
-            memcpy(nbuf + 0, &freeStart, sizeof(int));
-            write_nslots(nbuf, 0);
-            /* insert into this new page (same logic) */
-            sp_slot_t s;
-            s.offset = freeStart;
-            s.length = reclen;
-            memcpy(nbuf + s.offset, rec, reclen);
-            write_slot(nbuf, 0, &s);
-            write_nslots(nbuf, 1);
-            freeStart += reclen;
-            memcpy(nbuf + 0, &freeStart, sizeof(int));
-            PF_UnfixPage(fd, newp, TRUE);
-            if (rid) { rid->page = newp; rid->slot = 0; }
+            SPRID r;
+            if (insert_new_page(fd, rec, reclen, &r) != 0) return -1;
+            if (rid) *rid = r;
+            *hint = r.page;
             return 0;
         } else {
             /* other error */
@@ -154,6 +181,39 @@ int SP_InsertRec(int fd, const char *rec, int reclen, SPRID *rid) {
     }
 }
 
+int SP_AppendRec(int fd, const char *rec, int reclen, SPRID *rid) {
+    char *pagebuf;
+    int last;
+    int slot;
+
+    if ((last = PF_GetNumPages(fd) - 1) < -1) return -1;
+    if (last >= 0 && PF_GetThisPage(fd, last, &pagebuf) == PFE_OK) {
+        slot = page_insert(pagebuf, rec, reclen);
+        PF_UnfixPage(fd, last, slot >= 0);
+        if (slot >= 0) {
+            if (rid) { rid->page = last; rid->slot = slot; }
+            return 0;
+        }
+    }
+    return insert_new_page(fd, rec, reclen, rid);
+}
+
+int SP_GetRec(int fd, SPRID rid, char *buf, int bufsize, int *reclen) {
+    char *pagebuf, *rec;
+    int len;
+
+    if (PF_GetThisPage(fd, rid.page, &pagebuf) != PFE_OK) return -1;
+    rec = SP_PageRec(pagebuf, rid.slot, &len);
+    if (!rec || len > bufsize) {
+        PF_UnfixPage(fd, rid.page, FALSE);
+        return -1;
+    }
+    memcpy(buf, rec, len);
+    *reclen = len;
+    PF_UnfixPage(fd, rid.page, FALSE);
+    return 0;
+}
+
 int SP_DeleteRec(int fd, SPRID rid) {
     char *pagebuf;
     int error;
@@ -169,10 +229,76 @@ int SP_DeleteRec(int fd, SPRID rid) {
     return 0;
 }
 
+int SP_OverwriteRec(int fd, SPRID rid, int off, const char *bytes, int len) {
+    char *pagebuf;
+    sp_slot_t s;
+
+    if (PF_GetThisPage(fd, rid.page, &pagebuf) != PFE_OK) return -1;
+    if (rid.slot < 0 || rid.slot >= read_nslots(pagebuf)) {
+        PF_UnfixPage(fd, rid.page, FALSE);
+        return -1;
+    }
+    read_slot(pagebuf, rid.slot, &s);
+    if (s.length <= 0 || off < 0 || len < 0 || off + len > s.length) {
+        PF_UnfixPage(fd, rid.page, FALSE);
+        return -1;
+    }
+    memcpy(pagebuf + s.offset + off, bytes, len);
+    PF_UnfixPage(fd, rid.page, TRUE);
+    return 0;
+}
+
+int SP_ReclaimPage(int fd, int pagenum,
+                   int (*dead)(const char *rec, int reclen, void *arg), void *arg) {
+    char *pagebuf;
+    char tmp[PF_PAGE_SIZE];
+    int nslots, freeStart, used, i, error;
+    int dropped = 0;
+    sp_slot_t s;
+
+    if ((error = PF_GetThisPage(fd, pagenum, &pagebuf)) != PFE_OK)
+        return error == PFE_INVALIDPAGE ? PFE_EOF : -1;
+    PF_TRACE_BEGIN(sp_compact, fd, pagenum);
+    init_page(pagebuf);
+    nslots = read_nslots(pagebuf);
+    memcpy(&freeStart, pagebuf + 0, sizeof(int));
+    for (i = 0; i < nslots; i++) {
+        read_slot(pagebuf, i, &s);
+        if (s.length > 0 && dead && dead(pagebuf + s.offset, s.length, arg)) {
+            s.length = -1;
+            write_slot(pagebuf, i, &s);
+            dropped++;
+        }
+    }
+    /* slide the live records down; slot numbers, and so rids, stay */
+    used = SP_HDR_SZ;
+    for (i = 0; i < nslots; i++) {
+        read_slot(pagebuf, i, &s);
+        if (s.length <= 0) continue;
+        memcpy(tmp + used, pagebuf + s.offset, s.length);
+        s.offset = used;
+        write_slot(pagebuf, i, &s);
+        used += s.length;
+    }
+    if (used == freeStart && !dropped) {
+        PF_TRACE_END(sp_compact, fd, pagenum);
+        PF_UnfixPage(fd, pagenum, FALSE);
+        return 0;
+    }
+    memcpy(pagebuf + SP_HDR_SZ, tmp + SP_HDR_SZ, used - SP_HDR_SZ);
+    memcpy(pagebuf + 0, &used, sizeof(int));
+    PF_TRACE_END(sp_compact, fd, pagenum);
+    PF_UnfixPage(fd, pagenum, TRUE);
+    return freeStart - used;
+}
+
 int SP_ScanOpen(int fd, SPscan **scanptr) {
+    static int nextid = 0;
     SPscan *s = (SPscan*)malloc(sizeof(SPscan));
     if (!s) return -1;
+    s->id = __sync_add_and_fetch(&nextid, 1);
     s->fd = fd; s->curpage = 0; s->curslot = 0;
+    PF_TRACE_OPEN(sp_scan, s->id, fd);
     *scanptr = s; return 0;
 }
 
@@ -187,13 +313,14 @@ int SP_ScanNext(SPscan *scan, char **recbuf, int *reclen, SPRID *rid) {
         int nslots = read_nslots(pagebuf);
         int sidx = (p == scan->curpage) ? scan->curslot : 0;
         for (int i = sidx; i < nslots; i++) {
-            sp_slot_t sst; read_slot(pagebuf, i, &sst);
-            if (sst.length > 0) {
+            int len;
+            char *rec = SP_PageRec(pagebuf, i, &len);
+            if (rec) {
                 /* return copy of record */
-                char *buf = (char*)malloc(sst.length);
+                char *buf = (char*)malloc(len);
                 if (!buf) { PF_UnfixPage(scan->fd, p, FALSE); return -1; }
-                memcpy(buf, pagebuf + sst.offset, sst.length);
-                *recbuf = buf; *reclen = sst.length; if (rid) { rid->page = p; rid->slot = i; }
+                memcpy(buf, rec, len);
+                *recbuf = buf; *reclen = len; if (rid) { rid->page = p; rid->slot = i; }
                 /* prepare scan state */
                 scan->curpage = p; scan->curslot = i+1;
                 PF_UnfixPage(scan->fd, p, FALSE);
@@ -208,7 +335,11 @@ int SP_ScanNext(SPscan *scan, char **recbuf, int *reclen, SPRID *rid) {
     }
 }
 
-int SP_ScanClose(SPscan *scan) { free(scan); return 0; }
+int SP_ScanClose(SPscan *scan) {
+    PF_TRACE_CLOSE(sp_scan, scan->id, scan->fd);
+    free(scan);
+    return 0;
+}
 
 int SP_PageUsedBytes(char *pagebuf) {
     if (!pagebuf) return -1;
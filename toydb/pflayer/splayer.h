@@ -12,6 +12,14 @@ typedef struct {
     int slot;
 } SPRID;
 
+/* AM index entries carry an int record id; a heap RID is packed into it as
+ * page * SP_MAXSLOTS + slot. A slot needs at least 9 bytes of a page, so
+ * no page can hold SP_MAXSLOTS records. */
+#define SP_MAXSLOTS 1024
+#define SP_RidToInt(rid) ((rid).page * SP_MAXSLOTS + (rid).slot)
+#define SP_IntToRid(i, rid) ((rid)->page = (i) / SP_MAXSLOTS, \
+                             (rid)->slot = (i) % SP_MAXSLOTS)
+
 /* Scan descriptor (opaque) */
 typedef struct SPscan SPscan;
 
@@ -23,11 +31,120 @@ int SP_CloseFile(int fd);
 int SP_InsertRec(int fd, const char *rec, int reclen, SPRID *rid);
 int SP_DeleteRec(int fd, SPRID rid);
 
+/* Bulk-load path: only tries the last page of the file before allocating
+ * a new one, instead of first-fit from page 0 as SP_InsertRec does. */
+int SP_AppendRec(int fd, const char *rec, int reclen, SPRID *rid);
+
+/* First-fit from page *hint instead of page 0; *hint is set to the page
+ * the record went to. Callers that never free space keep one hint per
+ * file and insert in time independent of the file's size. */
+int SP_InsertRecFrom(int fd, int *hint, const char *rec, int reclen, SPRID *rid);
+
+/* Overwrite bytes off..off+len-1 of the record at rid in place. Returns -1
+ * if the rid is invalid, deleted, or the record is shorter than off+len. */
+int SP_OverwriteRec(int fd, SPRID rid, int off, const char *bytes, int len);
+
+/* Delete the records of page pagenum for which dead() returns nonzero
+ * (none if dead is NULL) and compact the page, so the space of these and
+ * of earlier SP_DeleteRec'd records can be reused. Slot numbers do not
+ * change. Returns the bytes freed, PFE_EOF past the end, or -1. */
+int SP_ReclaimPage(int fd, int pagenum,
+                   int (*dead)(const char *rec, int reclen, void *arg), void *arg);
+
+/* Copy the record at rid into buf (bufsize bytes). Returns -1 if the rid is
+ * invalid, deleted, or the record does not fit. */
+int SP_GetRec(int fd, SPRID rid, char *buf, int bufsize, int *reclen);
+
 int SP_ScanOpen(int fd, SPscan **scan);
 int SP_ScanNext(SPscan *scan, char **recbuf, int *reclen, SPRID *rid);
 int SP_ScanClose(SPscan *scan);
 
+/* Dictionary-encoded heaps (spdict.c): records are ';'-separated text,
+ * and the values of the declared fields are replaced by 2-byte codes from
+ * a per-file dictionary kept in the side PF file <fname>.dict. Records are
+ * encoded and decoded by the caller and stored with SP_InsertRec /
+ * SP_AppendRec, so scans return encoded records. */
+#define SP_MAXDICTFIELDS 16
+#define SP_DICT_MAXLEN 255      /* longer values are not put in the dictionary */
+#define SP_DICT_INLINE 0xffff   /* code of a value kept in the record's text */
+
+typedef struct SPdict SPdict;
+
+/* creates the heap and its dictionary */
+int SP_DictCreateFile(const char *fname, int nfields, const int *fields);
+/* opens both; returns the heap's fd, and the dictionary in *dict */
+int SP_DictOpenFile(const char *fname, SPdict **dict);
+/* writes the dictionary entries added since open, closes both */
+int SP_DictCloseFile(int fd, SPdict *dict);
+int SP_DictDestroyFile(const char *fname);
+/* # of pages of the dictionary file */
+int SP_DictNumPages(SPdict *dict);
+
+/* Record rec -> encoded record in out, adding new values to the
+ * dictionary and writing them to its file. Returns its length, or -1 if
+ * it does not fit in outsize or the dictionary cannot be written. */
+int SP_DictEncode(SPdict *dict, const char *rec, int reclen, char *out, int outsize);
+/* inverse of SP_DictEncode */
+int SP_DictDecode(SPdict *dict, const char *rec, int reclen, char *out, int outsize);
+/* Code of value in the dictionary of field: SP_DICT_INLINE if it is not
+ * there, -1 if field is not declared. A record's field equals value iff
+ * its code (SP_DictGetCode) is the same, except when both are
+ * SP_DICT_INLINE and the text has to be compared. */
+int SP_DictLookup(SPdict *dict, int field, const char *value, int len);
+int SP_DictGetCode(SPdict *dict, const char *rec, int field);
+
+/* Multi-version heaps (spmvcc.c): every record is a version of a tuple
+ * stamped with the timestamps of the transactions that created and
+ * deleted it. Readers take a snapshot and see the tuples committed before
+ * it, while one writer at a time inserts and deletes under a new
+ * timestamp; SP_MvccGC reclaims the versions no snapshot can see. Page 0
+ * slot 0 holds the file's meta record, so MVCC heaps are opened and
+ * written only through these functions. */
+typedef unsigned int SPts;
+typedef struct SPmvccscan SPmvccscan;
+
+int SP_MvccCreateFile(const char *fname);
+/* opens the heap, undoing the versions of a transaction left uncommitted */
+int SP_MvccOpenFile(const char *fname);
+/* a transaction in progress is undone in the file at its next open */
+int SP_MvccCloseFile(int fd);
+
+/* Starts the writer's transaction and returns its timestamp, or 0 if a
+ * transaction is already in progress. */
+SPts SP_MvccBegin(void);
+int SP_MvccInsert(int fd, const char *rec, int reclen, SPRID *rid);
+/* -1 if the version at rid is not visible to the writer or is deleted */
+int SP_MvccDelete(int fd, SPRID rid);
+int SP_MvccCommit(void);
+int SP_MvccAbort(void);
+
+/* Timestamp of the last commit, held until SP_MvccRelease so that GC
+ * keeps the versions it sees. */
+SPts SP_MvccSnapshot(void);
+void SP_MvccRelease(SPts snap);
+/* oldest snapshot held, or the last commit if none */
+SPts SP_MvccHorizon(void);
+
+/* The tuple at rid if its version is visible to snap: 0 if it is, 1 if it
+ * is not or there is no version at rid, -1 if the tuple does not fit in
+ * bufsize. This is the check made on the rid of an index entry. */
+int SP_MvccGetRec(int fd, SPRID rid, SPts snap, char *buf, int bufsize, int *reclen);
+/* Heap scan of the tuples visible to snap. *recbuf stays valid until the
+ * next call; returns PFE_EOF at the end. */
+int SP_MvccScanOpen(int fd, SPts snap, SPmvccscan **scan);
+int SP_MvccScanNext(SPmvccscan *scan, char **recbuf, int *reclen, SPRID *rid);
+int SP_MvccScanClose(SPmvccscan *scan);
+
+/* Deletes the versions deleted at or before SP_MvccHorizon() and compacts
+ * their pages. Returns the bytes freed, or -1; *nversions gets the # of
+ * versions reclaimed. */
+long SP_MvccGC(int fd, int *nversions);
+
 /* Utility: compute per-page used bytes (for reporting). Returns -1 on error. */
 int SP_PageUsedBytes(char *pagebuf);
 
+/* Utility: the record in slot of the SP page pagebuf, in place, and its
+ * length in *reclen; NULL if there is no such slot or it was deleted. */
+char *SP_PageRec(char *pagebuf, int slot, int *reclen);
+
 #endif
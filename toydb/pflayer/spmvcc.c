@@ -0,0 +1,428 @@
+/* spmvcc.c
+ * Multi-version slotted-page heaps.
+ *
+ * Every record of an MVCC heap is a version of a tuple:
+ *   [ SPts xmin ][ SPts xmax ][ tuple bytes ]
+ * xmin is the timestamp of the transaction that created it and xmax that
+ * of the transaction that deleted it, 0 while it is live. A version is
+ * visible to a snapshot s if xmin <= s and not (xmax != 0 && xmax <= s),
+ * so a reader holding s sees the heap exactly as the last transaction
+ * committed before s left it, whatever is written after.
+ *
+ * Timestamps come from one clock per process, the timestamp of the last
+ * committed transaction. There is one writer at a time: SP_MvccBegin gives
+ * it clock + 1, which no snapshot covers until SP_MvccCommit advances the
+ * clock. Its versions can be read by the writer itself with that timestamp
+ * as the snapshot. An update is a delete plus an insert of the new tuple
+ * under a new rid.
+ *
+ * Record 0 of page 0 is the file's meta record: the last timestamp
+ * committed to the file, which the clock joins on open, and the timestamp
+ * of a transaction that wrote the file and has not committed. The versions
+ * of such a transaction, left by a process that exited without committing,
+ * are undone when the file is next opened. Page 0 is written to the file
+ * when a transaction first writes the file, before any of its versions
+ * can be; it is not fsync()ed, so this holds for a process that exits,
+ * not for a machine that stops.
+ *
+ * SP_MvccGC deletes the versions no snapshot can see any more, those with
+ * xmax at or before the oldest snapshot held, and compacts their pages.
+ * Their slots stay behind as deleted slots, so an index entry still
+ * pointing at one finds nothing rather than a later tuple.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "splayer.h"
+#include "pftypes.h"
+
+#define MV_MAGIC 0x53504d31 /* "SPM1" */
+#define MV_HDR_SZ (2 * sizeof(SPts))
+
+typedef struct {
+    SPts xmin, xmax;    /* 0, so that GC never takes it for a dead version */
+    int magic;
+    SPts committed;     /* last timestamp committed to the file */
+    SPts inflight;      /* timestamp writing the file, or 0 */
+} mv_meta_t;
+
+/* open MVCC heaps, by fd */
+static struct {
+    int open;
+    int hint;           /* no page before it has room for an insert */
+    mv_meta_t meta;
+} mv_files[PF_FTAB_SIZE];
+
+/* a change of the transaction in progress */
+typedef struct {
+    int fd;
+    SPRID rid;
+    int deleted;        /* xmax set on an existing version, else inserted */
+} mv_change_t;
+
+static SPts mv_clock;           /* last committed timestamp */
+static SPts mv_writer;          /* transaction in progress, or 0 */
+static mv_change_t *mv_changes;
+static int mv_nchanges, mv_changecap;
+
+/* snapshots held, with the # of holders of each */
+static struct {
+    SPts ts;
+    int count;
+} *mv_snaps;
+static int mv_nsnaps, mv_snapcap;
+
+static const SPRID mv_metarid = { 0, 0 };
+
+static int valid_fd(int fd) {
+    return fd >= 0 && fd < PF_FTAB_SIZE && mv_files[fd].open;
+}
+
+static int write_meta(int fd) {
+    return SP_OverwriteRec(fd, mv_metarid, 0, (char *)&mv_files[fd].meta, sizeof(mv_meta_t));
+}
+
+static int visible(const char *rec, SPts snap) {
+    SPts xmin, xmax;
+    memcpy(&xmin, rec, sizeof(SPts));
+    memcpy(&xmax, rec + sizeof(SPts), sizeof(SPts));
+    return xmin <= snap && !(xmax != 0 && xmax <= snap);
+}
+
+/* undo the versions of transaction ts in fd: drop those it created and
+ * clear xmax on those it deleted */
+static int undo(int fd, SPts ts) {
+    SPscan *scan;
+    char *rec;
+    int reclen, error;
+    SPRID rid;
+    SPts xmin, xmax, zero = 0;
+
+    if (SP_ScanOpen(fd, &scan) != 0) return -1;
+    while ((error = SP_ScanNext(scan, &rec, &reclen, &rid)) == 0) {
+        if ((rid.page != 0 || rid.slot != 0) && reclen >= (int)MV_HDR_SZ) {
+            memcpy(&xmin, rec, sizeof(SPts));
+            memcpy(&xmax, rec + sizeof(SPts), sizeof(SPts));
+            if (xmin == ts) error = SP_DeleteRec(fd, rid);
+            else if (xmax == ts)
+                error = SP_OverwriteRec(fd, rid, sizeof(SPts), (char *)&zero, sizeof(SPts));
+        }
+        free(rec);
+        if (error != 0) break;
+    }
+    SP_ScanClose(scan);
+    return error == PFE_EOF ? 0 : -1;
+}
+
+int SP_MvccCreateFile(const char *fname) {
+    mv_meta_t m;
+    int fd;
+
+    if (SP_CreateFile(fname) != PFE_OK) return -1;
+    if ((fd = SP_OpenFile(fname)) < 0) return -1;
+    m.xmin = m.xmax = 0;
+    m.magic = MV_MAGIC;
+    m.committed = 0;
+    m.inflight = 0;
+    if (SP_InsertRec(fd, (char *)&m, sizeof(m), NULL) != 0) {
+        SP_CloseFile(fd);
+        return -1;
+    }
+    return SP_CloseFile(fd) == PFE_OK ? 0 : -1;
+}
+
+int SP_MvccOpenFile(const char *fname) {
+    int fd, len;
+
+    if ((fd = SP_OpenFile(fname)) < 0) return -1;
+    if (fd >= PF_FTAB_SIZE ||
+        SP_GetRec(fd, mv_metarid, (char *)&mv_files[fd].meta, sizeof(mv_meta_t), &len) != 0 ||
+        len != sizeof(mv_meta_t) || mv_files[fd].meta.magic != MV_MAGIC) {
+        SP_CloseFile(fd);
+        return -1;
+    }
+    mv_files[fd].open = 1;
+    mv_files[fd].hint = 0;
+    if (mv_files[fd].meta.inflight != 0) {
+        if (undo(fd, mv_files[fd].meta.inflight) != 0) {
+            SP_MvccCloseFile(fd);
+            return -1;
+        }
+        mv_files[fd].meta.inflight = 0;
+        write_meta(fd);
+    }
+    if (mv_files[fd].meta.committed > mv_clock) mv_clock = mv_files[fd].meta.committed;
+    return fd;
+}
+
+int SP_MvccCloseFile(int fd) {
+    int i;
+
+    if (!valid_fd(fd)) return -1;
+    /* changes of a transaction in progress are undone at the next open */
+    for (i = 0; i < mv_nchanges; i++)
+        if (mv_changes[i].fd == fd) mv_changes[i].fd = -1;
+    mv_files[fd].open = 0;
+    return SP_CloseFile(fd) == PFE_OK ? 0 : -1;
+}
+
+SPts SP_MvccBegin(void) {
+    if (mv_writer != 0) return 0;
+    mv_writer = mv_clock + 1;
+    mv_nchanges = 0;
+    return mv_writer;
+}
+
+static int log_change(int fd, SPRID rid, int deleted) {
+    mv_change_t *n;
+
+    if (mv_nchanges == mv_changecap) {
+        int cap = mv_changecap ? 2 * mv_changecap : 256;
+        if ((n = (mv_change_t *)realloc(mv_changes, cap * sizeof(mv_change_t))) == NULL)
+            return -1;
+        mv_changes = n;
+        mv_changecap = cap;
+    }
+    mv_changes[mv_nchanges].fd = fd;
+    mv_changes[mv_nchanges].rid = rid;
+    mv_changes[mv_nchanges].deleted = deleted;
+    mv_nchanges++;
+    return 0;
+}
+
+/* mark fd as written by the transaction in progress; the mark reaches
+ * the file before any page the transaction changes can */
+static int join_writer(int fd) {
+    if (mv_files[fd].meta.inflight == mv_writer) return 0;
+    mv_files[fd].meta.inflight = mv_writer;
+    if (write_meta(fd) != 0) return -1;
+    return PFflushPage(fd, mv_metarid.page) == PFE_OK ? 0 : -1;
+}
+
+int SP_MvccInsert(int fd, const char *rec, int reclen, SPRID *rid) {
+    char buf[PF_PAGE_SIZE];
+    SPts zero = 0;
+    SPRID r;
+
+    if (!valid_fd(fd) || mv_writer == 0 || reclen < 0 ||
+        reclen > PF_PAGE_SIZE - (int)MV_HDR_SZ) return -1;
+    if (join_writer(fd) != 0) return -1;
+    memcpy(buf, &mv_writer, sizeof(SPts));
+    memcpy(buf + sizeof(SPts), &zero, sizeof(SPts));
+    memcpy(buf + MV_HDR_SZ, rec, reclen);
+    if (SP_InsertRecFrom(fd, &mv_files[fd].hint, buf, reclen + MV_HDR_SZ, &r) != 0)
+        return -1;
+    if (log_change(fd, r, 0) != 0) {
+        SP_DeleteRec(fd, r);
+        return -1;
+    }
+    if (rid) *rid = r;
+    return 0;
+}
+
+int SP_MvccDelete(int fd, SPRID rid) {
+    char buf[PF_PAGE_SIZE];
+    SPts xmax;
+    int len;
+
+    if (!valid_fd(fd) || mv_writer == 0) return -1;
+    if ((rid.page == 0 && rid.slot == 0) ||
+        SP_GetRec(fd, rid, buf, sizeof(buf), &len) != 0) return -1;
+    memcpy(&xmax, buf + sizeof(SPts), sizeof(SPts));
+    /* deleted already, by this or a committed transaction */
+    if (xmax != 0 || !visible(buf, mv_writer)) return -1;
+    if (join_writer(fd) != 0) return -1;
+    if (SP_OverwriteRec(fd, rid, sizeof(SPts), (char *)&mv_writer, sizeof(SPts)) != 0)
+        return -1;
+    if (log_change(fd, rid, 1) != 0) {
+        xmax = 0;
+        SP_OverwriteRec(fd, rid, sizeof(SPts), (char *)&xmax, sizeof(SPts));
+        return -1;
+    }
+    return 0;
+}
+
+int SP_MvccCommit(void) {
+    int fd, error = 0;
+
+    if (mv_writer == 0) return -1;
+    /* every open file records the new timestamp, so one opened on its own
+       later still starts the clock past it */
+    for (fd = 0; fd < PF_FTAB_SIZE; fd++) {
+        if (!mv_files[fd].open) continue;
+        mv_files[fd].meta.committed = mv_writer;
+        mv_files[fd].meta.inflight = 0;
+        if (write_meta(fd) != 0) error = -1;
+    }
+    mv_clock = mv_writer;
+    mv_writer = 0;
+    mv_nchanges = 0;
+    return error;
+}
+
+int SP_MvccAbort(void) {
+    SPts zero = 0;
+    int i, fd, error = 0;
+
+    if (mv_writer == 0) return -1;
+    for (i = mv_nchanges - 1; i >= 0; i--) {
+        mv_change_t *c = &mv_changes[i];
+        if (c->fd < 0) continue;
+        if (!c->deleted) {
+            if (SP_DeleteRec(c->fd, c->rid) != 0) error = -1;
+            /* its space is reused once the page is compacted */
+            if (c->rid.page < mv_files[c->fd].hint) mv_files[c->fd].hint = c->rid.page;
+        } else if (SP_OverwriteRec(c->fd, c->rid, sizeof(SPts), (char *)&zero,
+                                   sizeof(SPts)) != 0)
+            error = -1;
+    }
+    for (fd = 0; fd < PF_FTAB_SIZE; fd++) {
+        if (!mv_files[fd].open || mv_files[fd].meta.inflight != mv_writer) continue;
+        mv_files[fd].meta.inflight = 0;
+        if (write_meta(fd) != 0) error = -1;
+    }
+    mv_writer = 0;
+    mv_nchanges = 0;
+    return error;
+}
+
+SPts SP_MvccSnapshot(void) {
+    int i;
+
+    for (i = 0; i < mv_nsnaps; i++)
+        if (mv_snaps[i].ts == mv_clock) {
+            mv_snaps[i].count++;
+            return mv_clock;
+        }
+    if (mv_nsnaps == mv_snapcap) {
+        int cap = mv_snapcap ? 2 * mv_snapcap : 16;
+        void *n = realloc(mv_snaps, cap * sizeof(*mv_snaps));
+        /* an unregistered snapshot is still read correctly until GC */
+        if (n == NULL) return mv_clock;
+        mv_snaps = n;
+        mv_snapcap = cap;
+    }
+    mv_snaps[mv_nsnaps].ts = mv_clock;
+    mv_snaps[mv_nsnaps].count = 1;
+    mv_nsnaps++;
+    return mv_clock;
+}
+
+void SP_MvccRelease(SPts snap) {
+    int i;
+
+    for (i = 0; i < mv_nsnaps; i++)
+        if (mv_snaps[i].ts == snap) {
+            if (--mv_snaps[i].count == 0) mv_snaps[i] = mv_snaps[--mv_nsnaps];
+            return;
+        }
+}
+
+SPts SP_MvccHorizon(void) {
+    SPts h = mv_clock;
+    int i;
+
+    for (i = 0; i < mv_nsnaps; i++)
+        if (mv_snaps[i].ts < h) h = mv_snaps[i].ts;
+    return h;
+}
+
+int SP_MvccGetRec(int fd, SPRID rid, SPts snap, char *buf, int bufsize, int *reclen) {
+    char tmp[PF_PAGE_SIZE];
+    int len;
+
+    if (!valid_fd(fd)) return -1;
+    /* a deleted slot is a version GC reclaimed */
+    if ((rid.page == 0 && rid.slot == 0) ||
+        SP_GetRec(fd, rid, tmp, sizeof(tmp), &len) != 0) return 1;
+    if (len < (int)MV_HDR_SZ || !visible(tmp, snap)) return 1;
+    len -= MV_HDR_SZ;
+    if (len > bufsize) return -1;
+    memcpy(buf, tmp + MV_HDR_SZ, len);
+    *reclen = len;
+    return 0;
+}
+
+struct SPmvccscan {
+    SPscan *scan;
+    SPts snap;
+    char *cur;      /* version returned by the last SP_ScanNext */
+};
+
+int SP_MvccScanOpen(int fd, SPts snap, SPmvccscan **scanptr) {
+    SPmvccscan *s;
+
+    if (!valid_fd(fd)) return -1;
+    if ((s = (SPmvccscan *)malloc(sizeof(SPmvccscan))) == NULL) return -1;
+    if (SP_ScanOpen(fd, &s->scan) != 0) {
+        free(s);
+        return -1;
+    }
+    s->snap = snap;
+    s->cur = NULL;
+    *scanptr = s;
+    return 0;
+}
+
+int SP_MvccScanNext(SPmvccscan *scan, char **recbuf, int *reclen, SPRID *rid) {
+    char *rec;
+    int len, error;
+    SPRID r;
+
+    free(scan->cur);
+    scan->cur = NULL;
+    while ((error = SP_ScanNext(scan->scan, &rec, &len, &r)) == 0) {
+        if ((r.page != 0 || r.slot != 0) && len >= (int)MV_HDR_SZ &&
+            visible(rec, scan->snap)) {
+            scan->cur = rec;
+            *recbuf = rec + MV_HDR_SZ;
+            *reclen = len - MV_HDR_SZ;
+            if (rid) *rid = r;
+            return 0;
+        }
+        free(rec);
+    }
+    return error;
+}
+
+int SP_MvccScanClose(SPmvccscan *scan) {
+    free(scan->cur);
+    SP_ScanClose(scan->scan);
+    free(scan);
+    return 0;
+}
+
+typedef struct {
+    SPts horizon;
+    int ndead;
+} mv_gc_t;
+
+static int gc_dead(const char *rec, int reclen, void *arg) {
+    mv_gc_t *gc = (mv_gc_t *)arg;
+    SPts xmax;
+
+    if (reclen < (int)MV_HDR_SZ) return 0;
+    memcpy(&xmax, rec + sizeof(SPts), sizeof(SPts));
+    /* versions deleted by the writer have xmax past the clock, so stay */
+    if (xmax == 0 || xmax > gc->horizon) return 0;
+    gc->ndead++;
+    return 1;
+}
+
+long SP_MvccGC(int fd, int *nversions) {
+    mv_gc_t gc;
+    long freed = 0;
+    int p, n;
+
+    if (!valid_fd(fd)) return -1;
+    gc.horizon = SP_MvccHorizon();
+    gc.ndead = 0;
+    for (p = 0; (n = SP_ReclaimPage(fd, p, gc_dead, &gc)) != PFE_EOF; p++) {
+        if (n < 0) return -1;
+        if (n > 0 && p < mv_files[fd].hint) mv_files[fd].hint = p;
+        freed += n;
+    }
+    if (nversions) *nversions = gc.ndead;
+    return freed;
+}
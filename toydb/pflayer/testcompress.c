@@ -0,0 +1,264 @@
+/* testcompress.c
+ * Compressed PF files (PF_CreateCompressedFile) vs. ordinary ones.
+ *
+ * student.txt is loaded with SP_AppendRec into an ordinary heap and into a
+ * compressed one. Reported: the pages and bytes on disk of both, whether
+ * every record of the compressed heap equals the ordinary one, and for the
+ * best of REPEAT full scans
+ *  - wall and CPU time
+ *  - pages and bytes read from the file (PF_GetStats, PF_GetIOBytes)
+ *  - read amplification: bytes read per byte of record returned
+ *  - CPU per page read, the difference being the cost of decompression
+ * Both heaps are read cold: the buffer pool is emptied by the close.
+ *
+ * Crash: a compressed file of REOPENPAGES pages is closed, then a child
+ * opens it again, allocates GROWPAGES more pages, so that most are written
+ * out, and exits without closing it. The first pages must still be read
+ * back as they were.
+ *
+ * Usage: testcompress [datadir]
+ */
+
+/* getline(), fork() and clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "splayer.h"
+#include "pf.h"
+
+#define PLAIN "/tmp/pf_lz_plain"
+#define COMPRESSED "/tmp/pf_lz_compressed"
+#define REPEAT 5
+#define REOPENPAGES 5
+#define GROWPAGES 40
+
+extern int PF_DestroyFile(char *fname);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+extern int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+
+static const char *files[] = { PLAIN, COMPRESSED };
+
+static long disk_bytes(const char *fname) {
+    struct stat st;
+    return stat(fname, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static int npages(const char *fname) {
+    int fd = SP_OpenFile(fname), n = PF_GetNumPages(fd);
+    SP_CloseFile(fd);
+    return n;
+}
+
+/* load the data lines into both heaps; returns the # of records */
+static int load(const char *path) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    int fd, cfd, n = 0;
+
+    if (!f) return -1;
+    PF_DestroyFile(PLAIN);
+    PF_DestroyFile(COMPRESSED);
+    if (SP_CreateFile(PLAIN) != 0 || PF_CreateCompressedFile(COMPRESSED) != PFE_OK
+            || (fd = SP_OpenFile(PLAIN)) < 0 || (cfd = SP_OpenFile(COMPRESSED)) < 0) {
+        fclose(f);
+        return -1;
+    }
+    while (getline(&line, &cap, f) > 0) {
+        int L = strlen(line);
+        while (L > 0 && (line[L-1] == '\n' || line[L-1] == '\r')) line[--L] = '\0';
+        if (L == 0 || !memchr(line, ';', L)) continue;
+        if (SP_AppendRec(fd, line, L, NULL) != 0 || SP_AppendRec(cfd, line, L, NULL) != 0) {
+            n = -1;
+            break;
+        }
+        n++;
+    }
+    free(line);
+    fclose(f);
+    if (SP_CloseFile(fd) != 0 || SP_CloseFile(cfd) != 0) return -1;
+    return n;
+}
+
+/* records of the compressed heap that differ from the ordinary one */
+static int compare_errors(void) {
+    int fd = SP_OpenFile(PLAIN), cfd = SP_OpenFile(COMPRESSED), bad = 0, lp, lc;
+    char *rp, *rc;
+    SPscan *sp, *sc;
+
+    SP_ScanOpen(fd, &sp);
+    SP_ScanOpen(cfd, &sc);
+    while (SP_ScanNext(sp, &rp, &lp, NULL) == 0) {
+        if (SP_ScanNext(sc, &rc, &lc, NULL) != 0) {
+            free(rp);
+            bad++;
+            break;
+        }
+        if (lp != lc || memcmp(rp, rc, lp) != 0) bad++;
+        free(rp);
+        free(rc);
+    }
+    if (SP_ScanNext(sc, &rc, &lc, NULL) == 0) {
+        free(rc);
+        bad++;
+    }
+    SP_ScanClose(sp);
+    SP_ScanClose(sc);
+    SP_CloseFile(fd);
+    SP_CloseFile(cfd);
+    return bad;
+}
+
+/* page p of the crash test: its number, then bytes that compress */
+static void fill_page(char *buf, int p) {
+    memset(buf, 'a' + p % 26, PF_PAGE_SIZE);
+    memcpy(buf, &p, sizeof(p));
+}
+
+/* the child: more pages in the file opened again, and no close */
+static void grow_child(void) {
+    char *buf;
+    int fd, p, i;
+
+    PF_Init();
+    if ((fd = PF_OpenFile(COMPRESSED)) < 0) _exit(1);
+    for (i = 0; i < GROWPAGES; i++) {
+        if (PF_AllocPage(fd, &p, &buf) != PFE_OK) _exit(1);
+        fill_page(buf, p);
+        if (PF_UnfixPage(fd, p, TRUE) != PFE_OK) _exit(1);
+    }
+    _exit(0);
+}
+
+/* pages of a closed file that are not read back after the crash */
+static int reopen_errors(void) {
+    char *buf, want[PF_PAGE_SIZE];
+    int fd, p, i, status, bad = 0;
+    pid_t pid;
+
+    PF_DestroyFile(COMPRESSED);
+    if (PF_CreateCompressedFile(COMPRESSED) != PFE_OK ||
+            (fd = PF_OpenFile(COMPRESSED)) < 0) return REOPENPAGES;
+    for (i = 0; i < REOPENPAGES; i++) {
+        if (PF_AllocPage(fd, &p, &buf) != PFE_OK) return REOPENPAGES;
+        fill_page(buf, p);
+        PF_UnfixPage(fd, p, TRUE);
+    }
+    if (PF_CloseFile(fd) != PFE_OK) return REOPENPAGES;
+
+    if ((pid = fork()) == 0) grow_child();
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return REOPENPAGES;
+
+    if ((fd = PF_OpenFile(COMPRESSED)) < 0) return REOPENPAGES;
+    for (p = 0; p < REOPENPAGES; p++) {
+        fill_page(want, p);
+        if (PF_GetThisPage(fd, p, &buf) != PFE_OK) {
+            bad++;
+            continue;
+        }
+        if (memcmp(buf, want, PF_PAGE_SIZE) != 0) bad++;
+        PF_UnfixPage(fd, p, FALSE);
+    }
+    PF_CloseFile(fd);
+    PF_DestroyFile(COMPRESSED);
+    return bad;
+}
+
+typedef struct {
+    double wall_ms, cpu_ms;
+    int pages;          /* physical page reads */
+    long bytes;         /* bytes read from the file */
+    long recbytes;      /* bytes of records returned */
+    long recs;
+} scanres;
+
+static void scan(const char *fname, scanres *r) {
+    PFstats s0, s1;
+    long b0, b1, w;
+    struct timespec t0, t1;
+    clock_t c0;
+    int fd, len;
+    char *rec;
+    SPscan *s;
+
+    r->recs = r->recbytes = 0;
+    PF_GetStats(&s0);
+    PF_GetIOBytes(&b0, &w);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = clock();
+    fd = SP_OpenFile(fname);
+    SP_ScanOpen(fd, &s);
+    while (SP_ScanNext(s, &rec, &len, NULL) == 0) {
+        r->recs++;
+        r->recbytes += len;
+        free(rec);
+    }
+    SP_ScanClose(s);
+    SP_CloseFile(fd);
+    r->cpu_ms = (double)(clock() - c0) * 1e3 / CLOCKS_PER_SEC;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r->wall_ms = PF_MsBetween(t0, t1);
+    PF_GetStats(&s1);
+    PF_GetIOBytes(&b1, &w);
+    r->pages = s1.phys_reads - s0.phys_reads;
+    r->bytes = b1 - b0;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512];
+    int n, i, k, bad;
+    scanres best[2], r;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    snprintf(path, sizeof(path), "%s/student.txt", datadir);
+    if ((n = load(path)) < 0) {
+        fprintf(stderr, "load of %s failed\n", path);
+        return 1;
+    }
+    bad = compare_errors();
+
+    printf("student records=%d, record-errors=%d\n", n, bad);
+    printf("file, pages, disk-bytes, bytes/page\n");
+    for (i = 0; i < 2; i++)
+        printf("%s,%d,%ld,%.0f\n", files[i], npages(files[i]), disk_bytes(files[i]),
+            (double)disk_bytes(files[i]) / npages(files[i]));
+    printf("footprint ratio %.2f\n",
+        (double)disk_bytes(PLAIN) / disk_bytes(COMPRESSED));
+
+    for (i = 0; i < 2; i++) {
+        best[i].wall_ms = -1;
+        for (k = 0; k < REPEAT; k++) {
+            scan(files[i], &r);
+            if (best[i].wall_ms < 0 || r.wall_ms < best[i].wall_ms) best[i] = r;
+        }
+    }
+    printf("\nscan, wall-ms, cpu-ms, pages-read, bytes-read, read-amplification, cpu-us/page, records\n");
+    for (i = 0; i < 2; i++)
+        printf("%s,%.2f,%.2f,%d,%ld,%.2f,%.2f,%ld%s\n", files[i], best[i].wall_ms,
+            best[i].cpu_ms, best[i].pages, best[i].bytes,
+            (double)best[i].bytes / best[i].recbytes,
+            best[i].cpu_ms * 1e3 / best[i].pages, best[i].recs,
+            best[i].recs == n ? "" : " MISMATCH");
+    printf("decompression cost %.2f us/page\n",
+        (best[1].cpu_ms - best[0].cpu_ms) * 1e3 / best[1].pages);
+
+    PF_DestroyFile(PLAIN);
+    PF_DestroyFile(COMPRESSED);
+
+    k = reopen_errors();
+    printf("\ncrash after reopen: %d of %d pages wrong %s\n", k, REOPENPAGES,
+        k == 0 ? "OK" : "FAILED");
+    return bad != 0 || k != 0;
+}
@@ -0,0 +1,243 @@
+/* testmem.c
+ * PF memory files (PF_CreateMemFile) vs. ordinary ones.
+ *
+ * student.txt is loaded with SP_AppendRec into an ordinary heap and into a
+ * memory heap, one after the other, each from an empty buffer pool.
+ * Reported: whether the two loads and the scans made the same page
+ * requests, reads and writes (PF_GetStats, PF_GetIOBytes) and returned the
+ * same records, and for the best of REPEAT full scans the wall and CPU
+ * time of each, the difference being the cost of the disk I/O.
+ * Then the file semantics are checked on a memory file: it keeps its
+ * pages across close and reopen, cannot be created twice or destroyed
+ * while open, and is gone once destroyed.
+ *
+ * Usage: testmem [datadir]
+ */
+
+/* getline() and clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "splayer.h"
+#include "pf.h"
+
+#define DISK "/tmp/pf_mem_disk"
+#define MEM PF_MEM_PREFIX "pf_mem_heap"
+#define REPEAT 5
+
+extern int PF_DestroyFile(char *fname);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+extern int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+extern int PF_DisposePage(int fd, int pagenum);
+
+static const char *files[] = { DISK, MEM };
+
+typedef struct {
+    PFstats st;         /* deltas */
+    long rbytes, wbytes;
+} iores;
+
+static void io_begin(iores *r) {
+    PF_GetStats(&r->st);
+    PF_GetIOBytes(&r->rbytes, &r->wbytes);
+}
+
+static void io_end(iores *r) {
+    PFstats s;
+    long rb, wb;
+    PF_GetStats(&s);
+    PF_GetIOBytes(&rb, &wb);
+    r->st.logical_reads = s.logical_reads - r->st.logical_reads;
+    r->st.logical_writes = s.logical_writes - r->st.logical_writes;
+    r->st.phys_reads = s.phys_reads - r->st.phys_reads;
+    r->st.phys_writes = s.phys_writes - r->st.phys_writes;
+    r->st.page_hits = s.page_hits - r->st.page_hits;
+    r->st.page_misses = s.page_misses - r->st.page_misses;
+    r->rbytes = rb - r->rbytes;
+    r->wbytes = wb - r->wbytes;
+}
+
+static int io_same(const iores *a, const iores *b) {
+    return memcmp(&a->st, &b->st, sizeof(PFstats)) == 0 &&
+        a->rbytes == b->rbytes && a->wbytes == b->wbytes;
+}
+
+static void io_print(const char *what, const char *fname, const iores *r) {
+    printf("%s,%s,%d,%d,%d,%d,%d,%d,%ld,%ld\n", what, fname,
+        r->st.logical_reads, r->st.logical_writes, r->st.phys_reads,
+        r->st.phys_writes, r->st.page_hits, r->st.page_misses, r->rbytes, r->wbytes);
+}
+
+/* load the data lines into fname; returns the # of records */
+static int load(const char *path, const char *fname, iores *r) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    int fd, n = 0;
+
+    if (!f) return -1;
+    PF_DestroyFile((char *)fname);
+    io_begin(r);
+    if (SP_CreateFile(fname) != 0 || (fd = SP_OpenFile(fname)) < 0) {
+        fclose(f);
+        return -1;
+    }
+    while (getline(&line, &cap, f) > 0) {
+        int L = strlen(line);
+        while (L > 0 && (line[L-1] == '\n' || line[L-1] == '\r')) line[--L] = '\0';
+        if (L == 0 || !memchr(line, ';', L)) continue;
+        if (SP_AppendRec(fd, line, L, NULL) != 0) {
+            n = -1;
+            break;
+        }
+        n++;
+    }
+    free(line);
+    fclose(f);
+    if (SP_CloseFile(fd) != 0) return -1;
+    io_end(r);
+    return n;
+}
+
+/* records of the memory heap that differ from the ordinary one */
+static int compare_errors(void) {
+    int fd = SP_OpenFile(DISK), mfd = SP_OpenFile(MEM), bad = 0, ld, lm;
+    char *rd, *rm;
+    SPscan *sd, *sm;
+
+    SP_ScanOpen(fd, &sd);
+    SP_ScanOpen(mfd, &sm);
+    while (SP_ScanNext(sd, &rd, &ld, NULL) == 0) {
+        if (SP_ScanNext(sm, &rm, &lm, NULL) != 0) {
+            free(rd);
+            bad++;
+            break;
+        }
+        if (ld != lm || memcmp(rd, rm, ld) != 0) bad++;
+        free(rd);
+        free(rm);
+    }
+    if (SP_ScanNext(sm, &rm, &lm, NULL) == 0) {
+        free(rm);
+        bad++;
+    }
+    SP_ScanClose(sd);
+    SP_ScanClose(sm);
+    SP_CloseFile(fd);
+    SP_CloseFile(mfd);
+    return bad;
+}
+
+typedef struct {
+    double wall_ms, cpu_ms;
+    iores io;
+    long recs;
+} scanres;
+
+static void scan(const char *fname, scanres *r) {
+    struct timespec t0, t1;
+    clock_t c0;
+    int fd, len;
+    char *rec;
+    SPscan *s;
+
+    r->recs = 0;
+    io_begin(&r->io);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = clock();
+    fd = SP_OpenFile(fname);
+    SP_ScanOpen(fd, &s);
+    while (SP_ScanNext(s, &rec, &len, NULL) == 0) {
+        r->recs++;
+        free(rec);
+    }
+    SP_ScanClose(s);
+    SP_CloseFile(fd);
+    r->cpu_ms = (double)(clock() - c0) * 1e3 / CLOCKS_PER_SEC;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r->wall_ms = PF_MsBetween(t0, t1);
+    io_end(&r->io);
+}
+
+/* file semantics of a memory file; returns the # of failed checks */
+static int semantics(void) {
+    char *name = "pf_mem_check", *buf;
+    int fd, page, bad = 0, i;
+
+    PF_DestroyFile(name);
+    if (PF_CreateMemFile(name) != PFE_OK) return 1;
+    bad += PF_CreateMemFile(name) == PFE_OK;                /* exists */
+    if ((fd = PF_OpenFile(name)) < 0) return bad + 1;
+    for (i = 0; i < 3; i++) {
+        if (PF_AllocPage(fd, &page, &buf) != PFE_OK) return bad + 1;
+        snprintf(buf, PF_PAGE_SIZE, "page %d", page);
+        PF_UnfixPage(fd, page, TRUE);
+    }
+    PF_DisposePage(fd, 1);
+    bad += PF_DestroyFile(name) != PFE_FILEOPEN;
+    PF_CloseFile(fd);
+
+    /* reopened: the pages, and the free page reused */
+    if ((fd = PF_OpenFile(name)) < 0) return bad + 1;
+    bad += PF_GetNumPages(fd) != 3;
+    bad += PF_GetThisPage(fd, 2, &buf) != PFE_OK || strcmp(buf, "page 2") != 0;
+    PF_UnfixPage(fd, 2, FALSE);
+    bad += PF_AllocPage(fd, &page, &buf) != PFE_OK || page != 1;
+    PF_UnfixPage(fd, page, TRUE);
+    PF_CloseFile(fd);
+
+    bad += PF_DestroyFile(name) != PFE_OK;
+    bad += PF_OpenFile(name) >= 0;                          /* gone */
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512];
+    int n[2], i, k, bad, badsem;
+    iores ld[2];
+    scanres best[2], r;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    snprintf(path, sizeof(path), "%s/student.txt", datadir);
+    for (i = 0; i < 2; i++)
+        if ((n[i] = load(path, files[i], &ld[i])) < 0) {
+            fprintf(stderr, "load of %s into %s failed\n", path, files[i]);
+            return 1;
+        }
+    bad = compare_errors() + (n[0] != n[1]);
+
+    for (i = 0; i < 2; i++) {
+        best[i].wall_ms = -1;
+        for (k = 0; k < REPEAT; k++) {
+            scan(files[i], &r);
+            if (best[i].wall_ms < 0 || r.wall_ms < best[i].wall_ms) best[i] = r;
+        }
+    }
+    badsem = semantics();
+
+    printf("student records=%d, record-errors=%d\n", n[1], bad);
+    printf("\nphase, file, logical_reads, logical_writes, phys_reads, phys_writes, page_hits, page_misses, bytes-read, bytes-written\n");
+    for (i = 0; i < 2; i++) io_print("load", files[i], &ld[i]);
+    for (i = 0; i < 2; i++) io_print("scan", files[i], &best[i].io);
+    printf("same page I/O: load %s, scan %s\n",
+        io_same(&ld[0], &ld[1]) ? "yes" : "NO", io_same(&best[0].io, &best[1].io) ? "yes" : "NO");
+    printf("\nscan, wall-ms, cpu-ms, records\n");
+    for (i = 0; i < 2; i++)
+        printf("%s,%.2f,%.2f,%ld\n", files[i], best[i].wall_ms, best[i].cpu_ms, best[i].recs);
+    printf("disk I/O cost %.2f us/page read\n",
+        (best[0].wall_ms - best[1].wall_ms) * 1e3 / best[0].io.st.phys_reads);
+    printf("memory file semantics: %d failed checks\n", badsem);
+
+    PF_DestroyFile(DISK);
+    PF_DestroyFile(MEM);
+    return bad != 0 || badsem != 0 || !io_same(&ld[0], &ld[1]) ||
+        !io_same(&best[0].io, &best[1].io);
+}
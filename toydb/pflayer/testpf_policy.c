@@ -5,122 +5,432 @@
    Test harness to exercise PF buffer with configurable parameters.
    Usage:
      testpf_policy [pool] [policy] [ops] [pages] [write_frac] [out_csv]
+                   [pattern] [files]
    where:
      pool      - buffer pool size (int)
      policy    - lru or mru
      ops       - number of operations (int)
      pages     - number of distinct pages to use (int)
      write_frac- fraction of operations that are writes (0..1)
-     out_csv   - optional path to append CSV results
+     out_csv   - optional path to append CSV results ("-" for none)
+     pattern   - which page each operation uses:
+                   loop            pages 0..pages-1 in turn (default)
+                   uniform         any page alike
+                   zipf[:theta]    page of rank r with weight 1/(r+1)^theta,
+                                   0 < theta < 1 (default 0.99)
+                   hotspot[:x:y]   fraction x of the operations go to the
+                                   first fraction y of the pages, uniformly
+                                   (default 0.8:0.2)
+                   scan[:f]        fraction f of the operations continue a
+                                   sequential scan over all the pages, the
+                                   others are zipf:0.99 lookups (default 0.5)
+     files     - the pages are spread over this many files (default 1),
+                 page g being page g/files of file g%files
+
+   Sweep mode runs every point of a parameter grid in one process:
+     testpf_policy sweep [pools] [policies] [ops] [pages] [write_fracs]
+                         [out_csv] [patterns] [files]
+   where pools, policies, write_fracs and patterns are comma-separated
+   lists (e.g. 5,10 lru,mru 0,0.5,1 loop,zipf:0.9). The files are built
+   once and kept as a pristine image; each point copies that image back
+   over the files (copy-on-reset), reinitializes the PF layer and runs
+   the operations, printing the same row as a single run. The counters
+   of a sweep row cover the operations only: the pages were allocated
+   before the point, so they lack the allocation writes of a single run.
+   The total wall time goes to stderr.
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <math.h>
 #include <time.h>
+#include <fcntl.h>
 #include "pf.h"
 #include "pftypes.h"
 
-int main(int argc, char **argv)
-{
-    int fd;
-    char *buf;
-    int i, page;
-    struct PFstats stats;
-    int pool = 5;
-    int policy = PF_REPL_LRU;
-    int ops = 50;
-    int npages = 10;
-    double write_frac = 0.3;
-    const char *out_csv = NULL;
+#define MAXFILES 8
 
-    if (argc > 1) pool = atoi(argv[1]);
-    if (argc > 2) {
-        if (strcasecmp(argv[2], "mru") == 0) policy = PF_REPL_MRU;
-        else policy = PF_REPL_LRU;
-    }
-    if (argc > 3) ops = atoi(argv[3]);
-    if (argc > 4) npages = atoi(argv[4]);
-    if (argc > 5) write_frac = atof(argv[5]);
-    if (argc > 6) out_csv = argv[6];
+enum { P_LOOP, P_UNIFORM, P_ZIPF, P_HOTSPOT, P_SCAN };
 
-    PF_Init();
-    PF_SetBufferParams(pool, policy);
+static int pattern = P_LOOP;
+static double theta = 0.99;     /* zipf, and the lookups of scan */
+static double hot_ops = 0.8, hot_pages = 0.2;   /* hotspot */
+static double scan_frac = 0.5;  /* scan */
+static double zetan, zeta2, alpha, eta;
+static int scanpos;             /* scan */
 
-    /* create and open a file */
-    unlink("/tmp/pftestfile");
-    if (PF_CreateFile("/tmp/pftestfile")!= PFE_OK){
-        PF_PrintError("create");
-        return 1;
-    }
-    if ((fd=PF_OpenFile("/tmp/pftestfile"))<0){
-        PF_PrintError("open");
-        return 1;
+/* n numbers separated by ':', the whole of s; 0 if it is not that */
+static int parse_numbers(const char *s, double *v, int n)
+{
+    char *end;
+    int i;
+    for (i = 0; i < n; i++) {
+        v[i] = strtod(s, &end);
+        if (end == s || *end != (i < n - 1 ? ':' : '\0')) return 0;
+        s = end + 1;
     }
+    return 1;
+}
 
-    /* allocate npages pages and write something */
-    for (i=0;i<npages;i++){
-        if (PF_AllocPage(fd,&page,&buf)!= PFE_OK){
-            PF_PrintError("alloc");
-            return 1;
-        }
-        snprintf(buf, PF_PAGE_SIZE, "page-%d", i);
-        if (PF_UnfixPage(fd,page,1)!= PFE_OK){
-            PF_PrintError("unfix");
-            return 1;
+/* arg past pattern name: "" for name alone, ":..." for its parameters;
+   NULL if arg is neither */
+static const char *pattern_args(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0) return NULL;
+    return arg[len] == '\0' || arg[len] == ':' ? arg + len : NULL;
+}
+
+/* parse a pattern argument; returns 0 if it is not one */
+static int parse_pattern(const char *arg)
+{
+    const char *args;
+    double v[2];
+
+    theta = 0.99;
+    hot_ops = 0.8, hot_pages = 0.2;
+    scan_frac = 0.5;
+    if (strcmp(arg, "loop") == 0) pattern = P_LOOP;
+    else if (strcmp(arg, "uniform") == 0) pattern = P_UNIFORM;
+    else if ((args = pattern_args(arg, "zipf")) != NULL) {
+        pattern = P_ZIPF;
+        if (*args && !parse_numbers(args + 1, &theta, 1)) return 0;
+        /* the generator below only holds for 0 < theta < 1 */
+        return theta > 0 && theta < 1;
+    } else if ((args = pattern_args(arg, "hotspot")) != NULL) {
+        pattern = P_HOTSPOT;
+        if (*args) {
+            if (!parse_numbers(args + 1, v, 2)) return 0;
+            hot_ops = v[0], hot_pages = v[1];
         }
+        return hot_ops >= 0 && hot_ops <= 1 && hot_pages > 0 && hot_pages <= 1;
+    } else if ((args = pattern_args(arg, "scan")) != NULL) {
+        pattern = P_SCAN;
+        if (*args && !parse_numbers(args + 1, &scan_frac, 1)) return 0;
+        return scan_frac >= 0 && scan_frac <= 1;
+    } else return 0;
+    return 1;
+}
+
+static double rand01(void)
+{
+    return rand() / ((double)RAND_MAX + 1);
+}
+
+/* Zipf(theta) ranks over 0..n-1 (Gray et al., "Quickly generating
+   billion-record synthetic databases") */
+static void zipf_init(int n)
+{
+    int i;
+    zetan = 0;
+    for (i = 1; i <= n; i++) zetan += 1.0 / pow((double)i, theta);
+    zeta2 = 1 + 1 / pow(2.0, theta);
+    alpha = 1 / (1 - theta);
+    eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+}
+
+static int zipf_next(int n)
+{
+    double u = rand01(), uz = u * zetan;
+    int r;
+    if (uz < 1) return 0;
+    if (uz < zeta2) return n > 1;
+    r = (int)(n * pow(eta * u - eta + 1, alpha));
+    return r < n ? r : n - 1;
+}
+
+/* page (0..npages-1) of operation i */
+static int next_page(int i, int npages)
+{
+    int nhot;
+
+    switch (pattern) {
+    case P_UNIFORM:
+        return (int)(rand01() * npages);
+    case P_ZIPF:
+        return zipf_next(npages);
+    case P_HOTSPOT:
+        nhot = (int)(hot_pages * npages + 0.5);
+        if (nhot < 1) nhot = 1;
+        if (nhot >= npages || rand01() < hot_ops) return (int)(rand01() * nhot);
+        return nhot + (int)(rand01() * (npages - nhot));
+    case P_SCAN:
+        if (rand01() < scan_frac) return scanpos++ % npages;
+        return zipf_next(npages);
+    default:
+        return i % npages; /* simple working set */
     }
+}
+
+static const char *file_name(char *fname, int size, int nfiles, int f)
+{
+    if (nfiles == 1) snprintf(fname, size, "/tmp/pftestfile");
+    else snprintf(fname, size, "/tmp/pftestfile%d", f);
+    return fname;
+}
+
+/* ops accesses over pages 0..npages-1 of the open files; decide write vs
+   read by write_frac. Returns 0, or 1 after a PF error. */
+static int run_ops(int *fd, int nfiles, int ops, int npages, double write_frac)
+{
+    char *buf;
+    int i;
 
     /* deterministic pseudo-random sequence */
     srand(42);
+    scanpos = 0;
 
-    /* perform ops accesses; decide write vs read by write_frac */
     for (i=0;i<ops;i++){
-        int p = i % npages; /* simple working set */
-        if (PF_GetThisPage(fd,p,&buf)!= PFE_OK){
+        int g = next_page(i, npages);
+        int file = fd[g % nfiles], p = g / nfiles;
+        if (PF_GetThisPage(file,p,&buf)!= PFE_OK){
             PF_PrintError("getthis");
             return 1;
         }
         double r = (double)rand() / (double)RAND_MAX;
         if (r < write_frac){
             /* write */
-            snprintf(buf, PF_PAGE_SIZE, "page-%d-mod-%d", p, i);
-            if (PF_UnfixPage(fd,p,1)!= PFE_OK){
+            snprintf(buf, PF_PAGE_SIZE, "page-%d-mod-%d", g, i);
+            if (PF_UnfixPage(file,p,1)!= PFE_OK){
                 PF_PrintError("unfix_write");
                 return 1;
             }
         } else {
             /* read-only */
-            if (PF_UnfixPage(fd,p,0)!= PFE_OK){
+            if (PF_UnfixPage(file,p,0)!= PFE_OK){
                 PF_PrintError("unfix_read");
                 return 1;
             }
         }
     }
+    return 0;
+}
 
-    PF_GetStats(&stats);
+/* print the result line to stdout for the runner, and append it to
+   out_csv if given */
+static void report(int policy, int pool, int ops, int npages, double write_frac,
+                   const char *out_csv, const char *patname, int nfiles)
+{
+    struct PFstats stats;
 
-    /* Print a single CSV line to stdout for easy parsing by runner */
-    printf("policy=%s,pool=%d,ops=%d,pages=%d,write_frac=%.2f,logical_reads=%d,logical_writes=%d,phys_reads=%d,phys_writes=%d,page_hits=%d,page_misses=%d\n",
+    PF_GetStats(&stats);
+    printf("policy=%s,pool=%d,ops=%d,pages=%d,write_frac=%.2f,logical_reads=%d,logical_writes=%d,phys_reads=%d,phys_writes=%d,page_hits=%d,page_misses=%d,pattern=%s,files=%d\n",
         (policy==PF_REPL_MRU)?"MRU":"LRU", pool, ops, npages, write_frac,
-        stats.logical_reads, stats.logical_writes, stats.phys_reads, stats.phys_writes, stats.page_hits, stats.page_misses);
+        stats.logical_reads, stats.logical_writes, stats.phys_reads, stats.phys_writes, stats.page_hits, stats.page_misses,
+        patname, nfiles);
 
-    /* optionally append to CSV file */
     if (out_csv){
         FILE *f = fopen(out_csv, "a");
         if (f){
-            fprintf(f, "%s,%d,%d,%d,%.2f,%d,%d,%d,%d,%d,%d\n",
+            fprintf(f, "%s,%d,%d,%d,%.2f,%d,%d,%d,%d,%d,%d,%s,%d\n",
                 (policy==PF_REPL_MRU)?"MRU":"LRU", pool, ops, npages, write_frac,
-                stats.logical_reads, stats.logical_writes, stats.phys_reads, stats.phys_writes, stats.page_hits, stats.page_misses);
+                stats.logical_reads, stats.logical_writes, stats.phys_reads, stats.phys_writes, stats.page_hits, stats.page_misses,
+                patname, nfiles);
             fclose(f);
         }
     }
+}
 
-    if (PF_CloseFile(fd)!= PFE_OK){
-        PF_PrintError("close");
+/* create the files and allocate npages pages over them, left open in fd */
+static int build_files(int *fd, int nfiles, int npages)
+{
+    char fname[64];
+    char *buf;
+    int i, f, page;
+
+    for (f=0;f<nfiles;f++){
+        file_name(fname, sizeof(fname), nfiles, f);
+        unlink(fname);
+        if (PF_CreateFile(fname)!= PFE_OK){
+            PF_PrintError("create");
+            return 1;
+        }
+        if ((fd[f]=PF_OpenFile(fname))<0){
+            PF_PrintError("open");
+            return 1;
+        }
+    }
+
+    /* allocate npages pages and write something */
+    for (i=0;i<npages;i++){
+        if (PF_AllocPage(fd[i % nfiles],&page,&buf)!= PFE_OK){
+            PF_PrintError("alloc");
+            return 1;
+        }
+        snprintf(buf, PF_PAGE_SIZE, "page-%d", i);
+        if (PF_UnfixPage(fd[i % nfiles],page,1)!= PFE_OK){
+            PF_PrintError("unfix");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int close_files(int *fd, int nfiles, int destroy)
+{
+    char fname[64];
+    int f;
+
+    for (f=0;f<nfiles;f++){
+        if (PF_CloseFile(fd[f])!= PFE_OK){
+            PF_PrintError("close");
+            return 1;
+        }
+        if (destroy) PF_DestroyFile(file_name(fname, sizeof(fname), nfiles, f));
+    }
+    return 0;
+}
+
+/* the next item of a comma-separated list, NULL at its end */
+static char *next_item(char **list)
+{
+    char *item = *list;
+    if (item == NULL) return NULL;
+    *list = strchr(item, ',');
+    if (*list) *(*list)++ = '\0';
+    return item;
+}
+
+static int sweep(int argc, char **argv)
+{
+    int fd[MAXFILES];
+    char *image[MAXFILES];
+    long imagelen[MAXFILES];
+    char fname[64];
+    char *pools = "5", *policies = "lru", *fracs = "0.3", *patterns = "loop";
+    char *pl, *pol, *fr, *pat, *l1, *l2, *l3, *l4, *c2, *c3, *c4;
+    const char *out_csv = NULL;
+    int ops = 50, npages = 10, nfiles = 1, npoints = 0, f, ufd;
+    struct timespec t0, t1;
+
+    if (argc > 2) pools = argv[2];
+    if (argc > 3) policies = argv[3];
+    if (argc > 4) ops = atoi(argv[4]);
+    if (argc > 5) npages = atoi(argv[5]);
+    if (argc > 6) fracs = argv[6];
+    if (argc > 7 && strcmp(argv[7], "-") != 0) out_csv = argv[7];
+    if (argc > 8) patterns = argv[8];
+    if (argc > 9) nfiles = atoi(argv[9]);
+    if (nfiles < 1 || nfiles > MAXFILES || npages < 1){
+        fprintf(stderr, "testpf_policy: bad files (1..%d) or pages\n", MAXFILES);
         return 1;
     }
-    PF_DestroyFile("/tmp/pftestfile");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* build the files once and keep their bytes as the pristine image */
+    PF_Init();
+    if (build_files(fd, nfiles, npages) || close_files(fd, nfiles, 0))
+        return 1;
+    for (f=0;f<nfiles;f++){
+        FILE *in = fopen(file_name(fname, sizeof(fname), nfiles, f), "rb");
+        if (in == NULL) { perror(fname); return 1; }
+        fseek(in, 0, SEEK_END);
+        imagelen[f] = ftell(in);
+        rewind(in);
+        image[f] = malloc(imagelen[f]);
+        if (image[f] == NULL || fread(image[f], 1, imagelen[f], in) != (size_t)imagelen[f]){
+            fprintf(stderr, "testpf_policy: cannot read %s\n", fname);
+            return 1;
+        }
+        fclose(in);
+    }
+
+    for (l1 = patterns; (pat = next_item(&l1)) != NULL; ){
+        if (!parse_pattern(pat)){
+            fprintf(stderr, "testpf_policy: bad pattern %s (zipf needs 0 < theta < 1)\n", pat);
+            return 1;
+        }
+        if (pattern == P_ZIPF || pattern == P_SCAN) zipf_init(npages);
+        /* next_item cuts the list up: walk copies of the inner ones */
+        for (l2 = c2 = strdup(policies); (pol = next_item(&l2)) != NULL; ){
+            int policy = strcasecmp(pol, "mru") == 0 ? PF_REPL_MRU : PF_REPL_LRU;
+            for (l3 = c3 = strdup(pools); (pl = next_item(&l3)) != NULL; ){
+                int pool = atoi(pl);
+                for (l4 = c4 = strdup(fracs); (fr = next_item(&l4)) != NULL; ){
+                    double write_frac = atof(fr);
+
+                    /* reset: the pristine bytes back over the files */
+                    for (f=0;f<nfiles;f++){
+                        ufd = open(file_name(fname, sizeof(fname), nfiles, f),
+                                   O_WRONLY | O_TRUNC);
+                        if (ufd < 0 || write(ufd, image[f], imagelen[f]) != imagelen[f]){
+                            perror(fname);
+                            return 1;
+                        }
+                        close(ufd);
+                    }
+                    PF_Init();
+                    if (PF_SetBufferParams(pool, policy) != PFE_OK){
+                        fprintf(stderr, "testpf_policy: bad pool %d\n", pool);
+                        return 1;
+                    }
+                    for (f=0;f<nfiles;f++)
+                        if ((fd[f]=PF_OpenFile(file_name(fname, sizeof(fname), nfiles, f)))<0){
+                            PF_PrintError("open");
+                            return 1;
+                        }
+                    if (run_ops(fd, nfiles, ops, npages, write_frac)) return 1;
+                    report(policy, pool, ops, npages, write_frac, out_csv, pat, nfiles);
+                    if (close_files(fd, nfiles, 0)) return 1;
+                    npoints++;
+                }
+                free(c4);
+            }
+            free(c3);
+        }
+        free(c2);
+    }
+
+    for (f=0;f<nfiles;f++){
+        PF_DestroyFile(file_name(fname, sizeof(fname), nfiles, f));
+        free(image[f]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(stderr, "sweep: %d points in %.1f ms\n", npoints,
+        (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    int fd[MAXFILES];
+    int pool = 5;
+    int policy = PF_REPL_LRU;
+    int ops = 50;
+    int npages = 10;
+    double write_frac = 0.3;
+    const char *out_csv = NULL;
+    const char *patname = "loop";
+    int nfiles = 1;
+
+    if (argc > 1 && strcmp(argv[1], "sweep") == 0) return sweep(argc, argv);
+    if (argc > 1) pool = atoi(argv[1]);
+    if (argc > 2) {
+        if (strcasecmp(argv[2], "mru") == 0) policy = PF_REPL_MRU;
+        else policy = PF_REPL_LRU;
+    }
+    if (argc > 3) ops = atoi(argv[3]);
+    if (argc > 4) npages = atoi(argv[4]);
+    if (argc > 5) write_frac = atof(argv[5]);
+    if (argc > 6 && strcmp(argv[6], "-") != 0) out_csv = argv[6];
+    if (argc > 7) patname = argv[7];
+    if (argc > 8) nfiles = atoi(argv[8]);
+    if (!parse_pattern(patname) || nfiles < 1 || nfiles > MAXFILES || npages < 1){
+        fprintf(stderr, "testpf_policy: bad pattern (zipf needs 0 < theta < 1), files (1..%d) or pages\n", MAXFILES);
+        return 1;
+    }
+    if (pattern == P_ZIPF || pattern == P_SCAN) zipf_init(npages);
+
+    PF_Init();
+    PF_SetBufferParams(pool, policy);
+
+    if (build_files(fd, nfiles, npages)) return 1;
+    if (run_ops(fd, nfiles, ops, npages, write_frac)) return 1;
+    report(policy, pool, ops, npages, write_frac, out_csv, patname, nfiles);
+    return close_files(fd, nfiles, 1);
+}
@@ -0,0 +1,312 @@
+/* testreport.c
+ * Stats reporter (pfreport.c): the time series it writes, and its cost.
+ *
+ * Two files of NPAGES pages are read and updated at random, NOPS page
+ * requests in all, with a pool of POOL pages, while the reporter samples
+ * every INTERVAL ms to a CSV file and to a Prometheus socket, which is
+ * scraped during the run. Checked:
+ *   - the CSV has a header and, per sample, a "*" row and a row per file;
+ *     the elapsed times and the counters never go down
+ *   - the last sample equals PF_GetStats(), its file rows add up to it,
+ *     and the Prometheus file and a scrape of the socket carry its values
+ *   - PF_GetPoolStats() counts the fixed and dirty pages it should
+ *   - a CSV socket client that never reads is dropped once its socket is
+ *     full, and PF_ReportStop() still returns (under an alarm)
+ * Then the same operations are timed with and without the reporter, the
+ * best of REPEAT runs each.
+ *
+ * Usage: testreport [nops]
+ */
+
+/* sockets and clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "pf.h"
+
+#define FILE1 "/tmp/pf_report_a"
+#define FILE2 "/tmp/pf_report_b"
+#define CSV "/tmp/pf_report.csv"
+#define PROM "/tmp/pf_report.prom"
+#define SOCK "/tmp/pf_report.sock"
+#define NPAGES 200
+#define POOL 10
+#define INTERVAL 2
+#define REPEAT 5
+
+extern int PF_CreateFile(char *fname);
+extern int PF_DestroyFile(char *fname);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+extern int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+
+static const char *names[2] = { FILE1, FILE2 };
+static int fds[2];
+
+static void check(int error, const char *what) {
+    if (error < 0) {
+        PF_PrintError((char *)what);
+        exit(1);
+    }
+}
+
+static void setup(void) {
+    char *buf;
+    int i, k, page;
+
+    for (k = 0; k < 2; k++) {
+        PF_DestroyFile((char *)names[k]);
+        check(PF_CreateFile((char *)names[k]), "create");
+        check(fds[k] = PF_OpenFile((char *)names[k]), "open");
+        for (i = 0; i < NPAGES; i++) {
+            check(PF_AllocPage(fds[k], &page, &buf), "alloc");
+            check(PF_UnfixPage(fds[k], page, TRUE), "unfix");
+        }
+        check(PF_CloseFile(fds[k]), "close");
+    }
+}
+
+static void open_files(void) {
+    int k;
+    for (k = 0; k < 2; k++) check(fds[k] = PF_OpenFile((char *)names[k]), "open");
+}
+
+static void close_files(void) {
+    int k;
+    for (k = 0; k < 2; k++) check(PF_CloseFile(fds[k]), "close");
+}
+
+/* a client of socket path, or -1 */
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (s >= 0 && connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(s);
+        s = -1;
+    }
+    return s;
+}
+
+/* nops random requests, a quarter of them updates; the same ones per seed */
+static void run_ops(long nops, int scrape_every, char *scraped, int cap) {
+    char *buf;
+    long i;
+    int k, page;
+
+    srand(7);
+    for (i = 0; i < nops; i++) {
+        k = rand() % 2;
+        page = rand() % NPAGES;
+        check(PF_GetThisPage(fds[k], page, &buf), "get");
+        buf[0]++;
+        check(PF_UnfixPage(fds[k], page, rand() % 4 == 0), "unfix");
+        if (scrape_every && i % scrape_every == scrape_every - 1) {
+            /* read the socket as a Prometheus server would */
+            int s = connect_to(SOCK), n, len = 0;
+            if (s >= 0)
+                while (len < cap - 1 && (n = read(s, scraped + len, cap - 1 - len)) > 0)
+                    len += n;
+            scraped[len] = '\0';
+            if (s >= 0) close(s);
+        }
+    }
+}
+
+/* the value of the line of text starting with metric */
+static long metric(const char *text, const char *name) {
+    const char *p = text;
+    size_t n = strlen(name);
+    for (; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL)
+        if (strncmp(p, name, n) == 0 && p[n] == ' ') return atol(p + n + 1);
+    return -1;
+}
+
+static int counters_of(const char *line, long c[6]) {
+    const char *p = line;
+    int i;
+    for (i = 0; i < 5; i++) {               /* skip to logical_reads */
+        if (*p == '"') p = strchr(p + 1, '"') + 1;
+        p = strchr(p, ',');
+        if (!p) return -1;
+        p++;
+    }
+    for (i = 0; i < 6; i++) {
+        c[i] = strtol(p, (char **)&p, 10);
+        if (*p++ != ',') return -1;
+    }
+    return 0;
+}
+
+/* check the CSV; returns the # of errors and sets the last "*" row */
+static int check_csv(long last[6], int *samples) {
+    FILE *f = fopen(CSV, "r");
+    char line[1024];
+    long prev[6] = { 0 }, c[6], files[6] = { 0 }, t, prevt = -1;
+    int bad = 0, i, nfile = 0;
+
+    *samples = 0;
+    if (!f) return 1;
+    if (!fgets(line, sizeof(line), f) || strncmp(line, "elapsed_ms,", 11) != 0) bad++;
+    while (fgets(line, sizeof(line), f)) {
+        t = atol(line);
+        if (counters_of(line, c) < 0) { bad++; continue; }
+        if (strstr(line, ",\"*\",")) {
+            if (*samples > 0 && nfile != 2) bad++;
+            bad += t < prevt;
+            for (i = 0; i < 6; i++) bad += c[i] < prev[i];
+            memcpy(prev, c, sizeof(prev));
+            prevt = t;
+            nfile = 0;
+            memset(files, 0, sizeof(files));
+            (*samples)++;
+        } else {
+            nfile++;
+            for (i = 0; i < 6; i++) files[i] += c[i];
+        }
+    }
+    fclose(f);
+    /* the last sample: the file rows add up to the totals */
+    for (i = 0; i < 6; i++) bad += files[i] != prev[i];
+    memcpy(last, prev, sizeof(prev));
+    return bad + (nfile != 2);
+}
+
+/* pool counts: fixed and dirty pages as made here */
+static int check_pool(void) {
+    PFpoolstats p;
+    char *buf;
+    int bad = 0, i;
+
+    for (i = 0; i < 3; i++) check(PF_GetThisPage(fds[0], i, &buf), "get");
+    PF_GetPoolStats(&p);
+    bad += p.fixed != 3;
+    for (i = 0; i < 3; i++) check(PF_UnfixPage(fds[0], i, i == 0), "unfix");
+    PF_GetPoolStats(&p);
+    bad += p.fixed != 0 || p.dirty < 1 || p.used != POOL || p.size != POOL;
+    close_files();
+    PF_GetPoolStats(&p);
+    bad += p.fixed != 0 || p.dirty != 0 || p.used != 0;
+    open_files();
+    return bad;
+}
+
+/* Two CSV clients that do not read, while samples of the open files are
+ * written every ms: once their sockets are full they must be dropped (the
+ * first drains to end of file while the reporter still runs), and stopping
+ * the reporter must not hang on the second, still full. 1 if not. */
+static int idle_client(void) {
+    struct timespec pause = { 0, 2000000 };
+    struct pollfd pfd;
+    char buf[4096];
+    int s[2], n, i, eof = 0;
+    long len = 0;
+
+    open_files();
+    check(PF_ReportStart("unix:" SOCK, NULL, 1), "report");
+    for (i = 0; i < 2; i++)
+        if ((s[i] = connect_to(SOCK)) < 0) {
+            fprintf(stderr, "idle client: cannot connect\n");
+            return 1;
+        }
+    /* a few hundred KB of rows fill them, in well under a second */
+    for (i = 0; i < 1000; i++) nanosleep(&pause, NULL);
+    /* what the first was sent, then end of file if it was dropped */
+    pfd.fd = s[0];
+    pfd.events = POLLIN;
+    while (!eof && len < (1L << 24) && poll(&pfd, 1, 100) == 1 &&
+           (n = read(s[0], buf, sizeof(buf))) >= 0) {
+        eof = n == 0;
+        len += n;
+    }
+    alarm(10);
+    check(PF_ReportStop(), "stop");
+    alarm(0);
+    for (i = 0; i < 2; i++) close(s[i]);
+    close_files();
+    return !eof;
+}
+
+static double timed(long nops, int report) {
+    struct timespec t0, t1;
+    open_files();
+    if (report) check(PF_ReportStart("/dev/null", NULL, 1), "report");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    run_ops(nops, 0, NULL, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (report) check(PF_ReportStop(), "stop");
+    close_files();
+    return PF_MsBetween(t0, t1);
+}
+
+int main(int argc, char **argv) {
+    long nops = argc > 1 ? atol(argv[1]) : 200000, last[6], prom[6];
+    static char scraped[65536], text[65536];
+    const char *names6[6] = { "logical_reads", "logical_writes", "phys_reads",
+        "phys_writes", "page_hits", "page_misses" };
+    char mname[64];
+    PFstats st;
+    FILE *f;
+    int bad, badprom = 0, badscrape = 0, badpool, badidle, samples, i, k, n;
+    double best[2] = { -1, -1 }, ms;
+
+    PF_Init();
+    setup();
+    check(PF_SetBufferParams(POOL, PF_REPL_LRU), "params");
+    unlink(CSV);
+    open_files();
+    check(PF_ReportStart(CSV, "unix:" SOCK, INTERVAL), "report");
+    run_ops(nops, nops / 4, scraped, sizeof(scraped));
+    check(PF_ReportStop(), "stop");
+    PF_GetStats(&st);
+    /* the last sample is also in a Prometheus file */
+    check(PF_ReportStart(NULL, PROM, 1000), "report");
+    check(PF_ReportStop(), "stop");
+    badpool = check_pool();
+    close_files();
+    badidle = idle_client();
+
+    bad = check_csv(last, &samples);
+    for (i = 0; i < 6; i++) bad += last[i] != (&st.logical_reads)[i];
+    f = fopen(PROM, "r");
+    n = f ? (int)fread(text, 1, sizeof(text) - 1, f) : 0;
+    text[n] = '\0';
+    if (f) fclose(f);
+    for (i = 0; i < 6; i++) {
+        snprintf(mname, sizeof(mname), "toydb_pf_%s_total", names6[i]);
+        prom[i] = metric(text, mname);
+        badprom += prom[i] != (&st.logical_reads)[i];
+        badscrape += metric(scraped, mname) < 0;
+    }
+    badscrape += strstr(scraped, "toydb_pf_file_logical_reads_total{file=\"" FILE1 "\"}") == NULL;
+
+    printf("samples=%d, csv-errors=%d, prometheus-file-errors=%d, scrape-errors=%d, pool-errors=%d, idle-client-errors=%d\n",
+        samples, bad, badprom, badscrape, badpool, badidle);
+    printf("last sample: logical_reads=%ld logical_writes=%ld phys_reads=%ld phys_writes=%ld page_hits=%ld page_misses=%ld\n",
+        last[0], last[1], last[2], last[3], last[4], last[5]);
+
+    for (k = 0; k < REPEAT; k++)
+        for (i = 0; i < 2; i++) {
+            ms = timed(nops, i);
+            if (best[i] < 0 || ms < best[i]) best[i] = ms;
+        }
+    printf("\nreporter, ms, ns/op\n");
+    for (i = 0; i < 2; i++)
+        printf("%s,%.2f,%.1f\n", i ? "every 1 ms" : "off", best[i], best[i] * 1e6 / nops);
+
+    for (k = 0; k < 2; k++) PF_DestroyFile((char *)names[k]);
+    unlink(CSV);
+    unlink(PROM);
+    return bad || badprom || badscrape || badpool || badidle || samples < 2;
+}
@@ -0,0 +1,272 @@
+/* testspdict.c
+ * Dictionary-encoded heaps (spdict.c) vs. plain slotted-page heaps.
+ *
+ * Each table is loaded twice with SP_AppendRec: as its text lines, and
+ * encoded with the string fields listed below in a dictionary. Reported:
+ * the pages of both (the dictionary file counted with the encoded heap),
+ * whether every decoded record equals its line, and best-of-REPEAT times of
+ *  - scan:   a full scan; the encoded heap decodes every record
+ *  - equal:  count the records whose field equals a value; the plain heap
+ *            finds the field in the text, the encoded heap compares codes
+ *
+ * Crash: a child appends NEWRECS records with new values to the encoded
+ * heap, closes the heap but not the dictionary, and exits. Every record
+ * must still decode, the new ones to what was appended.
+ *
+ * Usage: testspdict [datadir]
+ */
+
+/* getline(), fork() and clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "splayer.h"
+
+#define PLAIN "/tmp/sp_dict_plain"
+#define ENCODED "/tmp/sp_dict_encoded"
+#define REPEAT 5
+#define MAXREC PF_PAGE_SIZE
+#define NEWRECS 500
+
+static struct {
+    const char *table;
+    int nfields;
+    int fields[SP_MAXDICTFIELDS];
+    int eqfield;
+    const char *eqvalue;
+} tables[] = {
+    { "studregn", 2, { 2, 3 }, 2, "CH 831" },
+    { "student", 9, { 2, 3, 4, 5, 6, 7, 8, 9, 12 }, 12, "BTECH" },
+};
+
+/* start and length of field k of rec; 0 if rec has no field k */
+static int find_field(const char *rec, int reclen, int k, const char **f, int *flen) {
+    int pos = 0, i;
+    for (i = 0; i < k; i++) {
+        const char *p = memchr(rec + pos, ';', reclen - pos);
+        if (!p) return 0;
+        pos = p - rec + 1;
+    }
+    *f = rec + pos;
+    for (*flen = 0; pos + *flen < reclen && rec[pos + *flen] != ';'; (*flen)++)
+        ;
+    return 1;
+}
+
+static int npages(const char *fname) {
+    int fd = SP_OpenFile(fname), n = PF_GetNumPages(fd);
+    SP_CloseFile(fd);
+    return n;
+}
+
+/* load the data lines into both heaps; returns the # of records */
+static int load(const char *path, int t) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL, enc[MAXREC];
+    size_t cap = 0;
+    int fd, efd, n = 0, len;
+    SPdict *d;
+
+    if (!f) return -1;
+    PF_DestroyFile(PLAIN);
+    SP_DictDestroyFile(ENCODED);
+    if (SP_CreateFile(PLAIN) != 0
+            || SP_DictCreateFile(ENCODED, tables[t].nfields, tables[t].fields) != 0
+            || (fd = SP_OpenFile(PLAIN)) < 0 || (efd = SP_DictOpenFile(ENCODED, &d)) < 0) {
+        fclose(f);
+        return -1;
+    }
+    while (getline(&line, &cap, f) > 0) {
+        int L = strlen(line);
+        while (L > 0 && (line[L-1] == '\n' || line[L-1] == '\r')) line[--L] = '\0';
+        if (L == 0 || !memchr(line, ';', L)) continue;
+        if (SP_AppendRec(fd, line, L, NULL) != 0
+                || (len = SP_DictEncode(d, line, L, enc, sizeof(enc))) < 0
+                || SP_AppendRec(efd, enc, len, NULL) != 0) {
+            n = -1;
+            break;
+        }
+        n++;
+    }
+    free(line);
+    fclose(f);
+    SP_CloseFile(fd);
+    if (SP_DictCloseFile(efd, d) != 0) return -1;
+    return n;
+}
+
+/* decode every encoded record and compare it with the plain one */
+static int roundtrip_errors(void) {
+    int fd = SP_OpenFile(PLAIN), efd, bad = 0, lp, le, ld;
+    char out[MAXREC], *rp, *re;
+    SPscan *sp, *se;
+    SPdict *d;
+
+    efd = SP_DictOpenFile(ENCODED, &d);
+    SP_ScanOpen(fd, &sp);
+    SP_ScanOpen(efd, &se);
+    while (SP_ScanNext(sp, &rp, &lp, NULL) == 0) {
+        if (SP_ScanNext(se, &re, &le, NULL) != 0) {
+            free(rp);
+            bad++;
+            break;
+        }
+        ld = SP_DictDecode(d, re, le, out, sizeof(out));
+        if (ld != lp || memcmp(out, rp, lp) != 0) bad++;
+        free(rp);
+        free(re);
+    }
+    SP_ScanClose(sp);
+    SP_ScanClose(se);
+    SP_CloseFile(fd);
+    SP_DictCloseFile(efd, d);
+    return bad;
+}
+
+/* one full scan (eq < 0) or equality count on heap `encoded`; returns the
+   # of records counted */
+static long scan(int t, int encoded, int eq) {
+    int fd, len, flen, code = 0;
+    long n = 0;
+    char *rec, out[MAXREC];
+    const char *f;
+    const char *value = tables[t].eqvalue;
+    int vlen = strlen(value);
+    SPscan *s;
+    SPdict *d = NULL;
+
+    fd = encoded ? SP_DictOpenFile(ENCODED, &d) : SP_OpenFile(PLAIN);
+    if (encoded && eq) code = SP_DictLookup(d, tables[t].eqfield, value, vlen);
+    SP_ScanOpen(fd, &s);
+    while (SP_ScanNext(s, &rec, &len, NULL) == 0) {
+        if (!eq) {
+            if (encoded) len = SP_DictDecode(d, rec, len, out, sizeof(out));
+            n += len > 0;
+        } else if (!encoded) {
+            n += find_field(rec, len, tables[t].eqfield, &f, &flen)
+                 && flen == vlen && memcmp(f, value, vlen) == 0;
+        } else if (code != SP_DICT_INLINE) {
+            n += SP_DictGetCode(d, rec, tables[t].eqfield) == code;
+        } else if (SP_DictGetCode(d, rec, tables[t].eqfield) == SP_DICT_INLINE) {
+            /* neither is in the dictionary: compare the text */
+            char *dec = out;
+            int dlen = SP_DictDecode(d, rec, len, dec, sizeof(out));
+            n += find_field(dec, dlen, tables[t].eqfield, &f, &flen)
+                 && flen == vlen && memcmp(f, value, vlen) == 0;
+        }
+        free(rec);
+    }
+    SP_ScanClose(s);
+    if (encoded) SP_DictCloseFile(fd, d);
+    else SP_CloseFile(fd);
+    return n;
+}
+
+static double best_ms(int t, int encoded, int eq, long *n) {
+    double best = -1;
+    int r;
+    for (r = 0; r < REPEAT; r++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        *n = scan(t, encoded, eq);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (best < 0 || PF_MsBetween(t0, t1) < best) best = PF_MsBetween(t0, t1);
+    }
+    return best;
+}
+
+/* the child: new values in the heap, and no dictionary close */
+static void append_child(void) {
+    char rec[64], enc[MAXREC];
+    int efd, i, len;
+    SPdict *d;
+
+    PF_Init();
+    if ((efd = SP_DictOpenFile(ENCODED, &d)) < 0) _exit(1);
+    for (i = 0; i < NEWRECS; i++) {
+        len = snprintf(rec, sizeof(rec), "%d;%d;new value %d", i, i, i);
+        if ((len = SP_DictEncode(d, rec, len, enc, sizeof(enc))) < 0 ||
+                SP_AppendRec(efd, enc, len, NULL) != 0) _exit(1);
+    }
+    _exit(SP_CloseFile(efd) == PFE_OK ? 0 : 1);
+}
+
+/* records that do not decode after the child, plus new ones missing */
+static int crash_errors(void) {
+    char out[MAXREC], want[64], *re;
+    int efd, le, ld, i, k, status, bad = 0, found = 0;
+    SPscan *se;
+    SPdict *d;
+    pid_t pid;
+
+    if ((pid = fork()) == 0) append_child();
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return NEWRECS;
+    if ((efd = SP_DictOpenFile(ENCODED, &d)) < 0) return NEWRECS;
+    SP_ScanOpen(efd, &se);
+    while (SP_ScanNext(se, &re, &le, NULL) == 0) {
+        ld = SP_DictDecode(d, re, le, out, sizeof(out) - 1);
+        free(re);
+        if (ld < 0) {
+            bad++;
+            continue;
+        }
+        out[ld] = '\0';
+        if (sscanf(out, "%d;%d;new value %d", &i, &k, &k) == 3) {
+            snprintf(want, sizeof(want), "%d;%d;new value %d", i, i, i);
+            if (strcmp(out, want) == 0) found++;
+            else bad++;
+        }
+    }
+    SP_ScanClose(se);
+    SP_DictCloseFile(efd, d);
+    return bad + NEWRECS - found;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512];
+    int t, n, i, fd, pp, ep, dp;
+    long np, ne;
+    double tp, te;
+    SPdict *d;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    printf("table, records, plain-pages, encoded-pages, dict-pages, ratio, decode-errors\n");
+    for (t = 0; t < (int)(sizeof(tables) / sizeof(tables[0])); t++) {
+        snprintf(path, sizeof(path), "%s/%s.txt", datadir, tables[t].table);
+        if ((n = load(path, t)) < 0) {
+            fprintf(stderr, "load of %s failed\n", path);
+            return 1;
+        }
+        pp = npages(PLAIN);
+        ep = npages(ENCODED);
+        fd = SP_DictOpenFile(ENCODED, &d);
+        dp = SP_DictNumPages(d);
+        SP_DictCloseFile(fd, d);
+        printf("%s (fields", tables[t].table);
+        for (i = 0; i < tables[t].nfields; i++) printf(" %d", tables[t].fields[i]);
+        printf("),%d,%d,%d,%d,%.2f,%d\n", n, pp, ep, dp, (double)pp / (ep + dp),
+            roundtrip_errors());
+
+        printf("  test, plain-ms, encoded-ms, plain-rows, encoded-rows\n");
+        tp = best_ms(t, 0, 0, &np);
+        te = best_ms(t, 1, 0, &ne);
+        printf("  scan,%.2f,%.2f,%ld,%ld%s\n", tp, te, np, ne, np == ne ? "" : " MISMATCH");
+        tp = best_ms(t, 0, 1, &np);
+        te = best_ms(t, 1, 1, &ne);
+        printf("  f%d = %s,%.2f,%.2f,%ld,%ld%s\n", tables[t].eqfield, tables[t].eqvalue,
+            tp, te, np, ne, np == ne ? "" : " MISMATCH");
+    }
+    n = crash_errors();
+    printf("\ncrash without dictionary close: %d errors %s\n", n, n == 0 ? "OK" : "FAILED");
+    PF_DestroyFile(PLAIN);
+    SP_DictDestroyFile(ENCODED);
+    return n != 0;
+}
@@ -0,0 +1,434 @@
+/* testwal.c
+ * Write-ahead log (pflog.c): group commit throughput and crash recovery.
+ *
+ * A file of NPAGES pages holds a counter in each page. A transaction adds
+ * 1 to the counters of two random pages and 2 to the total in page 0, so a
+ * consistent file has total == the sum of the other counters.
+ *
+ * Throughput: NTXN transactions committed with each group size (commits
+ * per fsync of the log), against the same updates with no log, as
+ * commits/sec, forces and log bytes per commit.
+ *
+ * Recovery: a child process commits CRASHTXN transactions, then makes a
+ * transaction that changes every page with a small buffer pool, so its
+ * changes are written to the file before it commits, and exits without
+ * closing anything. The parent recovers with PF_LogOpen() and checks that
+ * the file is consistent and holds every commit forced before the crash.
+ * An aborted transaction is checked the same way, without a crash.
+ * Aborting a page dispose and a page alloc must leave the free list and
+ * page count as they were: the next two allocs get new pages past the end.
+ * A file with the header of the format before page LSNs must be refused.
+ *
+ * Files: one more file than a log can name (PF_LOG_MAXFILES) is changed in
+ * turn. The last one must fail with PFE_LOGFULL, and succeed once the log
+ * has been emptied; files opened again must not use up more of the log.
+ * Then a child names PF_LOG_MAXFILES files in the log, takes a checkpoint
+ * with CKPTOPEN of them open, commits again and exits; the parent checks
+ * that recovery keeps the commits on both sides of the checkpoint.
+ *
+ * Usage: testwal [ntxn]
+ */
+
+/* fork(), _exit() and clock_gettime() under -std=c99 -pedantic */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "pf.h"
+
+#define DATA "/tmp/pf_wal_data"
+#define LOG "/tmp/pf_wal_log"
+#define NPAGES 64
+#define CRASHTXN 205
+#define LOSERPAGES 32
+#define FILES "/tmp/pf_wal_file_with_a_long_name_for_the_checkpoint_"
+#define PATHLEN 128
+#define CKPTOPEN 8
+
+extern int PF_CreateFile(char *fname);
+extern int PF_DestroyFile(char *fname);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+extern int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+extern int PF_DisposePage(int fd, int pagenum);
+
+static void check(int error, const char *what) {
+    if (error < 0) {
+        PF_PrintError((char *)what);
+        exit(1);
+    }
+}
+
+/* a new file of NPAGES zero counters, and an empty log */
+static void setup(void) {
+    char *buf;
+    int fd, p, i;
+
+    PF_DestroyFile(DATA);
+    unlink(LOG);
+    check(PF_CreateFile(DATA), "create");
+    check(fd = PF_OpenFile(DATA), "open");
+    for (i = 0; i < NPAGES; i++) {
+        check(PF_AllocPage(fd, &p, &buf), "alloc");
+        memset(buf, 0, PF_PAGE_SIZE);
+        check(PF_UnfixPage(fd, p, TRUE), "unfix");
+    }
+    check(PF_CloseFile(fd), "close");
+}
+
+static void add(int fd, int page, int n) {
+    char *buf;
+    int v;
+    check(PF_GetThisPage(fd, page, &buf), "get");
+    memcpy(&v, buf, sizeof(v));
+    v += n;
+    memcpy(buf, &v, sizeof(v));
+    check(PF_UnfixPage(fd, page, TRUE), "unfix");
+}
+
+/* one transaction's updates */
+static void update(int fd) {
+    int a = 1 + rand() % (NPAGES - 1), b = 1 + rand() % (NPAGES - 1);
+    add(fd, a, 1);
+    add(fd, b, 1);
+    add(fd, 0, 2);
+}
+
+/* total in page 0, and the sum of the other counters in *sum */
+static int totals(int *sum) {
+    char *buf;
+    int fd, p, v, total = 0;
+
+    check(fd = PF_OpenFile(DATA), "open");
+    *sum = 0;
+    for (p = 0; p < NPAGES; p++) {
+        check(PF_GetThisPage(fd, p, &buf), "get");
+        memcpy(&v, buf, sizeof(v));
+        if (p == 0) total = v;
+        else *sum += v;
+        check(PF_UnfixPage(fd, p, FALSE), "unfix");
+    }
+    check(PF_CloseFile(fd), "close");
+    return total;
+}
+
+/* NTXN transactions with group size g, or with no log if g == 0 */
+static void throughput(int g, int ntxn) {
+    struct timespec t0, t1;
+    PFlogstats st;
+    int fd, i, txn;
+    double ms;
+
+    setup();
+    if (g > 0) {
+        check(PF_LogOpen(LOG), "log open");
+        check(PF_LogSetGroupSize(g), "group");
+    }
+    check(fd = PF_OpenFile(DATA), "open");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < ntxn; i++) {
+        if (g > 0) check(txn = PF_LogBegin(), "begin");
+        update(fd);
+        if (g > 0) check(PF_LogCommit(txn), "commit");
+    }
+    if (g > 0) check(PF_LogForce(), "force");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ms = PF_MsBetween(t0, t1);
+    check(PF_CloseFile(fd), "close");
+    if (g > 0) {
+        PF_LogGetStats(&st);
+        check(PF_LogClose(), "log close");
+        printf("%d,%.0f,%d,%.0f\n", g, ntxn / ms * 1e3, st.forces,
+            (double)st.bytes / st.commits);
+    } else {
+        printf("none,%.0f,0,0\n", ntxn / ms * 1e3);
+    }
+}
+
+/* in a child: commit CRASHTXN transactions with group size g, change every
+   page in one more and exit without closing */
+static void crash_child(int g) {
+    int fd, i, txn;
+
+    PF_Init();
+    check(PF_SetBufferParams(4, PF_REPL_LRU), "buffers");
+    check(PF_LogOpen(LOG), "log open");
+    check(PF_LogSetGroupSize(g), "group");
+    check(fd = PF_OpenFile(DATA), "open");
+    for (i = 0; i < CRASHTXN; i++) {
+        check(txn = PF_LogBegin(), "begin");
+        update(fd);
+        check(PF_LogCommit(txn), "commit");
+    }
+    check(txn = PF_LogBegin(), "begin");
+    for (i = 1; i <= LOSERPAGES; i++) add(fd, i, 1000);
+    add(fd, 0, 1000 * LOSERPAGES);
+    _exit(0);
+}
+
+static int crash(int g) {
+    int status, total, sum, ok, lo = CRASHTXN / g * g;
+    PFlogstats st;
+    pid_t pid;
+
+    setup();
+    if ((pid = fork()) == 0) crash_child(g);
+    waitpid(pid, &status, 0);
+    PF_Init();
+    check(PF_LogOpen(LOG), "recovery");
+    PF_LogGetStats(&st);
+    check(PF_LogClose(), "log close");
+    total = totals(&sum);
+    /* the loser's changes forced the log, so every commit was durable */
+    ok = total == sum && total >= 2 * lo && total <= 2 * CRASHTXN;
+    printf("crash g=%d: committed=%d forced-at-least=%d recovered=%d sum=%d %s\n",
+        g, CRASHTXN, lo, total / 2, sum / 2, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+static int abort_test(void) {
+    int fd, i, txn, total, sum, ok;
+
+    setup();
+    PF_Init();
+    check(PF_SetBufferParams(4, PF_REPL_LRU), "buffers");
+    check(PF_LogOpen(LOG), "log open");
+    check(fd = PF_OpenFile(DATA), "open");
+    for (i = 0; i < 10; i++) {
+        check(txn = PF_LogBegin(), "begin");
+        update(fd);
+        check(PF_LogCommit(txn), "commit");
+    }
+    check(txn = PF_LogBegin(), "begin");
+    for (i = 1; i <= LOSERPAGES; i++) add(fd, i, 1000);
+    add(fd, 0, 1000 * LOSERPAGES);
+    check(PF_LogAbort(txn), "abort");
+    check(PF_CloseFile(fd), "close");
+    check(PF_LogClose(), "log close");
+    total = totals(&sum);
+    ok = total == 20 && sum == 20;
+    printf("abort: recovered=%d sum=%d %s\n", total / 2, sum / 2, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+/* a page disposed and a page allocated, each aborted; then two allocs */
+static int free_list_test(void) {
+    char *buf;
+    int fd, txn, a, a1, a2, v, n, ok;
+
+    setup();
+    PF_Init();
+    check(PF_LogOpen(LOG), "log open");
+    check(fd = PF_OpenFile(DATA), "open");
+    check(txn = PF_LogBegin(), "begin");
+    add(fd, 5, 7);
+    check(PF_LogCommit(txn), "commit");
+    check(txn = PF_LogBegin(), "begin");
+    check(PF_DisposePage(fd, 5), "dispose");
+    check(PF_LogAbort(txn), "abort");
+    check(txn = PF_LogBegin(), "begin");
+    check(PF_AllocPage(fd, &a, &buf), "alloc");
+    check(PF_UnfixPage(fd, a, TRUE), "unfix");
+    check(PF_LogAbort(txn), "abort");
+    check(txn = PF_LogBegin(), "begin");
+    check(PF_AllocPage(fd, &a1, &buf), "alloc");
+    memset(buf, 0, PF_PAGE_SIZE);
+    check(PF_UnfixPage(fd, a1, TRUE), "unfix");
+    check(PF_AllocPage(fd, &a2, &buf), "alloc");
+    memset(buf, 0, PF_PAGE_SIZE);
+    check(PF_UnfixPage(fd, a2, TRUE), "unfix");
+    check(PF_LogCommit(txn), "commit");
+    check(PF_CloseFile(fd), "close");
+    check(PF_LogClose(), "log close");
+
+    check(fd = PF_OpenFile(DATA), "open");
+    check(PF_GetThisPage(fd, 5, &buf), "get");
+    memcpy(&v, buf, sizeof(v));
+    check(PF_UnfixPage(fd, 5, FALSE), "unfix");
+    n = PF_GetNumPages(fd);
+    check(PF_CloseFile(fd), "close");
+    ok = a1 == NPAGES && a2 == NPAGES + 1 && v == 7 && n == NPAGES + 2;
+    printf("free list: dispose and alloc aborted, then allocs got %d and %d of %d pages,"
+        " page 5 holds %d %s\n", a1, a2, n, v, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+/* a file of the format before page LSNs: no magic, 4100-byte pages */
+static int format_test(void) {
+    int hdr[2] = { -1, 1 }, f, error, ok;
+    char page[sizeof(int) + PF_PAGE_SIZE];
+
+    PF_DestroyFile(DATA);
+    memset(page, 0, sizeof(page));
+    f = open(DATA, O_CREAT | O_WRONLY | O_TRUNC, 0664);
+    ok = f >= 0 && write(f, hdr, sizeof(hdr)) == sizeof(hdr) &&
+        write(f, page, sizeof(page)) == sizeof(page);
+    if (f >= 0) close(f);
+    error = PF_OpenFile(DATA);
+    if (error >= 0) PF_CloseFile(error);
+    ok = ok && error == PFE_MAGIC;
+    printf("old format: open returned %d %s\n", error, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+/* PF_LOG_MAXFILES + 1 files of one zero counter, with long names */
+static void make_files(void) {
+    char name[PATHLEN], *buf;
+    int fd, p, i;
+
+    for (i = 0; i <= PF_LOG_MAXFILES; i++) {
+        sprintf(name, "%s%d", FILES, i);
+        PF_DestroyFile(name);
+        check(PF_CreateFile(name), "create");
+        check(fd = PF_OpenFile(name), "open");
+        check(PF_AllocPage(fd, &p, &buf), "alloc");
+        memset(buf, 0, PF_PAGE_SIZE);
+        check(PF_UnfixPage(fd, p, TRUE), "unfix");
+        check(PF_CloseFile(fd), "close");
+    }
+}
+
+static void destroy_files(void) {
+    char name[PATHLEN];
+    int i;
+
+    for (i = 0; i <= PF_LOG_MAXFILES; i++) {
+        sprintf(name, "%s%d", FILES, i);
+        PF_DestroyFile(name);
+    }
+}
+
+/* the counter of file i */
+static int file_counter(int i) {
+    char name[PATHLEN], *buf;
+    int fd, v;
+
+    sprintf(name, "%s%d", FILES, i);
+    check(fd = PF_OpenFile(name), "open");
+    check(PF_GetThisPage(fd, 0, &buf), "get");
+    memcpy(&v, buf, sizeof(v));
+    check(PF_UnfixPage(fd, 0, FALSE), "unfix");
+    check(PF_CloseFile(fd), "close");
+    return v;
+}
+
+/* adds 1 to the counter of file i in a transaction; returns the PF error */
+static int change_file(int i) {
+    char name[PATHLEN], *buf;
+    int fd, txn, error, v;
+
+    sprintf(name, "%s%d", FILES, i);
+    check(fd = PF_OpenFile(name), "open");
+    check(txn = PF_LogBegin(), "begin");
+    if ((error = PF_GetThisPage(fd, 0, &buf)) == PFE_OK) {
+        memcpy(&v, buf, sizeof(v));
+        v++;
+        memcpy(buf, &v, sizeof(v));
+        check(PF_UnfixPage(fd, 0, TRUE), "unfix");
+        check(PF_LogCommit(txn), "commit");
+    } else check(PF_LogAbort(txn), "abort");
+    check(PF_CloseFile(fd), "close");
+    return error;
+}
+
+static int files_test(void) {
+    int i, n = 0, error, ok;
+
+    make_files();
+    unlink(LOG);
+    check(PF_LogOpen(LOG), "log open");
+    for (i = 0; i < PF_LOG_MAXFILES; i++) n += change_file(i) == PFE_OK;
+    for (i = 0; i < PF_LOG_MAXFILES; i++) n += change_file(i) == PFE_OK;
+    error = change_file(PF_LOG_MAXFILES);
+    check(PF_LogClose(), "log close");
+    check(PF_LogOpen(LOG), "log open");
+    ok = n == 2 * PF_LOG_MAXFILES && error == PFE_LOGFULL &&
+        change_file(PF_LOG_MAXFILES) == PFE_OK;
+    check(PF_LogClose(), "log close");
+    printf("files: %d of %d changed twice, one more %s, after emptying %s\n",
+        n / 2, PF_LOG_MAXFILES, error == PFE_LOGFULL ? "refused" : "NOT refused",
+        ok ? "OK" : "FAILED");
+    destroy_files();
+    return ok;
+}
+
+/* in a child: name every file in the log, keep CKPTOPEN of them open
+   through a checkpoint with a commit on each side of it, and exit */
+static void ckpt_child(void) {
+    int fds[CKPTOPEN], i, txn;
+
+    PF_Init();
+    check(PF_LogOpen(LOG), "log open");
+    for (i = 0; i < PF_LOG_MAXFILES; i++) check(change_file(i), "change");
+    for (i = 0; i < CKPTOPEN; i++) {
+        char name[PATHLEN];
+        sprintf(name, "%s%d", FILES, i);
+        check(fds[i] = PF_OpenFile(name), "open");
+    }
+    check(txn = PF_LogBegin(), "begin");
+    for (i = 0; i < CKPTOPEN; i++) add(fds[i], 0, 1);
+    check(PF_LogCommit(txn), "commit");
+    check(PF_LogCheckpoint(), "checkpoint");
+    check(txn = PF_LogBegin(), "begin");
+    for (i = 0; i < CKPTOPEN; i++) add(fds[i], 0, 1);
+    check(PF_LogCommit(txn), "commit");
+    check(PF_LogForce(), "force");
+    _exit(0);
+}
+
+/* a checkpoint of a log naming PF_LOG_MAXFILES long names is more than one
+   record can hold; the commits after it must still be recovered */
+static int ckpt_files_test(void) {
+    PFlogstats st;
+    int status, i, v, bad = 0;
+    pid_t pid;
+
+    make_files();
+    unlink(LOG);
+    if ((pid = fork()) == 0) ckpt_child();
+    waitpid(pid, &status, 0);
+    PF_Init();
+    check(PF_LogOpen(LOG), "recovery");
+    PF_LogGetStats(&st);
+    check(PF_LogClose(), "log close");
+    for (i = 0; i <= PF_LOG_MAXFILES; i++) {
+        v = file_counter(i);
+        bad += v != (i < CKPTOPEN ? 3 : i < PF_LOG_MAXFILES ? 1 : 0);
+    }
+    printf("checkpoint naming %d files, %d open: %d records recovered, %d files wrong %s\n",
+        PF_LOG_MAXFILES, CKPTOPEN, st.recovered, bad, bad ? "FAILED" : "OK");
+    destroy_files();
+    return bad == 0;
+}
+
+int main(int argc, char **argv) {
+    static int groups[] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    int ntxn = 2000, i, ok = 1;
+
+    if (argc > 1) ntxn = atoi(argv[1]);
+    PF_Init();
+    printf("group-size, commits/sec, forces, log-bytes/commit\n");
+    throughput(0, ntxn);
+    for (i = 0; i < (int)(sizeof(groups) / sizeof(groups[0])); i++)
+        throughput(groups[i], ntxn);
+
+    printf("\n");
+    ok &= crash(1);
+    ok &= crash(16);
+    ok &= abort_test();
+    ok &= free_list_test();
+    ok &= format_test();
+    ok &= files_test();
+    ok &= ckpt_files_test();
+
+    PF_DestroyFile(DATA);
+    unlink(LOG);
+    return !ok;
+}
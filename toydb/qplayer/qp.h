@@ -0,0 +1,479 @@
+/* qp.h: query processing layer on top of SP heap files and AM indexes.
+ *
+ * Operators follow the iterator model: an operator is opened by its
+ * constructor, produces one tuple per next() call and is released with
+ * QP_Close(), which also closes its inputs. A constructor that fails
+ * returns NULL and leaves its inputs open. Tuples are text records in the
+ * same ';'-delimited form as the files in data/, so a field is addressed by
+ * its position in the line.
+ */
+#ifndef QP_H
+#define QP_H
+
+#include <stdio.h>
+#include "splayer.h"
+#include "pxlayer.h"
+
+/************** Error Codes *********************************/
+#define QPE_OK		0	/* OK */
+#define QPE_EOF		-1	/* no more tuples */
+#define QPE_NOMEM	-2	/* no memory */
+#define QPE_PF		-3	/* error from the PF or SP layer */
+#define QPE_AM		-4	/* error from the AM layer */
+#define QPE_UNIX	-5	/* unix error */
+#define QPE_INVALIDARG	-6	/* invalid argument */
+
+extern int QPerrno;	/* error number of last error */
+extern void QP_PrintError(const char *s);
+
+/* attribute types, same letters as the AM layer */
+#define QP_INT		'i'
+#define QP_FLOAT	'f'
+#define QP_CHAR		'c'
+
+/* comparison operators, same codes as the AM scan operators in am.h */
+#define QP_ALL		0
+#define QP_EQ		1
+#define QP_LT		2
+#define QP_GT		3
+#define QP_LE		4
+#define QP_GE		5
+
+#define QP_MAXFIELDS	32	/* max # of fields in a record */
+#define QP_MAXNAME	128	/* max length of a table or file name */
+#define QP_MAXINDEX	4	/* max # of indexes opened per table */
+#define QP_MAXREC	PF_PAGE_SIZE	/* max record length */
+#define QP_MAXKEY	256	/* max AM key length (AM_MAXATTRLENGTH) */
+
+/* a tuple handed out by next(); the bytes stay valid until the next call
+   on the same operator */
+typedef struct QPtuple {
+	char *rec;
+	int reclen;
+	SPRID rid;	/* heap rid, or page -1 for derived tuples */
+} QPtuple;
+
+typedef struct QPop QPop;
+struct QPop {
+	const char *name;	/* operator name for plan printing */
+	int (*next)(QPop *op, QPtuple *tup); /* QPE_OK, QPE_EOF or error */
+	void (*close)(QPop *op);	/* release state (not the children) */
+	QPop *child[2];		/* inputs, or NULL */
+	int orderfield;		/* output is ordered on this field, or -1 */
+	char ordertype;		/* type of orderfield */
+	char orderdesc;		/* 1 if that order is descending */
+	long nrows;		/* tuples produced so far */
+	long peakbytes;		/* most memory held for buffered tuples */
+	void *state;		/* operator private state */
+};
+
+extern int QP_Next(QPop *op, QPtuple *tup);
+extern void QP_Close(QPop *op);
+extern void QP_PrintPlan(QPop *op, int depth);
+extern QPop *QP_NewOp(const char *name, int statesize);
+
+/****************** Fields (qpfield.c) *************************************/
+extern const char *QP_GetField(const char *rec, int reclen, int field,
+		int *flen);
+extern int QP_FieldInt(const char *rec, int reclen, int field);
+extern float QP_FieldFloat(const char *rec, int reclen, int field);
+extern int QP_CompareField(const char *rec1, int len1, int field1,
+		const char *rec2, int len2, int field2, char type);
+
+/****************** Statistics (qpstats.c) *********************************/
+#define QP_HISTBUCKETS	20	/* buckets per equi-depth histogram */
+#define QP_MAXSTATCOLS	16	/* analyzed columns per table */
+
+/* statistics of one numeric column. Bucket b holds the values in
+   (hi[b-1], hi[b]] (lo <= v <= hi[0] for b = 0), about nrows/nbuckets of
+   them; a value never spans two buckets. */
+typedef struct QPcolstats {
+	int field;
+	char type;		/* QP_INT or QP_FLOAT */
+	long ndistinct;
+	int nbuckets;
+	double lo;		/* smallest value */
+	double hi[QP_HISTBUCKETS];	/* largest value in each bucket */
+	long depth[QP_HISTBUCKETS];	/* # of rows in each bucket */
+	long distinct[QP_HISTBUCKETS];	/* # of distinct values in each */
+	long pages[QP_HISTBUCKETS];	/* # of heap pages holding its rows */
+} QPcolstats;
+
+typedef struct QPtablestats {
+	int analyzed;
+	long nrows;
+	int npages;		/* heap pages */
+	int ncols;
+	QPcolstats col[QP_MAXSTATCOLS];
+} QPtablestats;
+
+/****************** Tables (qptable.c) *************************************/
+typedef struct QPindex {
+	int indexno;	/* AM index number: file is <heapname>.<indexno> */
+	int field;	/* indexed field */
+	char type;	/* QP_INT, QP_FLOAT or QP_CHAR */
+	int len;	/* attribute length */
+	int desc;	/* keys are negated, so a scan runs high to low */
+	int fd;		/* PF fd of the open index */
+	/* set by QP_Analyze */
+	int height;	/* levels from the root to the leaves */
+	int nleaves;	/* leaf pages */
+	long nkeys;	/* distinct keys */
+	long clusterfactor; /* heap page changes along the key order */
+} QPindex;
+
+typedef struct QPtable {
+	char name[QP_MAXNAME];	/* heap file name */
+	int heapfd;
+	int nindex;
+	QPindex index[QP_MAXINDEX];
+	QPtablestats stats;	/* valid once stats.analyzed is set */
+} QPtable;
+
+/* next record line of a data/ file, or -1 at its end (qptable.c) */
+extern int QP_ReadLine(FILE *f, char **line, size_t *cap);
+extern int QP_LoadHeap(const char *datafile, const char *heapname,
+		int maxrecs);
+extern int QP_BuildIndex(const char *heapname, int indexno, int field,
+		char type, int len, int desc);
+extern void QP_MakeKey(const char *rec, int reclen, int field, char type,
+		int len, int desc, char *key);
+extern int QP_OpenTable(QPtable *t, const char *heapname);
+extern int QP_AddIndex(QPtable *t, int indexno, int field, char type,
+		int len, int desc);
+extern QPindex *QP_FindIndex(QPtable *t, int field, int desc);
+extern int QP_CloseTable(QPtable *t);
+
+/****************** Schemas and binary tuples (qptuple.c) ******************/
+/* A binary tuple holds the fields of a text record typed by a schema:
+     null bitmap	(ncols + 7) / 8 bytes, bit c set if field c is empty
+     fixed area		4 bytes per int or float column, in column order
+     offset table	nvar + 1 unsigned shorts: where each char column's
+			bytes start, and where the last one ends
+     char data
+   so every field is found at an offset computed once per schema. */
+typedef struct QPschema {
+	char table[QP_MAXNAME];
+	int ncols;
+	char type[QP_MAXFIELDS];	/* QP_INT, QP_FLOAT or QP_CHAR */
+	int width[QP_MAXFIELDS];	/* bytes: 4, or the longest char value */
+	char scale[QP_MAXFIELDS];	/* float: digits after the point */
+	/* set by QP_SchemaLayout */
+	int nvar;		/* char columns */
+	int fixedoff[QP_MAXFIELDS]; /* int/float: offset in the tuple;
+				   char: offset of its offset-table entry */
+	int varstart;		/* offset of the offset table */
+} QPschema;
+
+extern void QP_SchemaLayout(QPschema *s);
+/* type every field of datafile: int if every non-empty value is an int
+   written as printf("%d") writes it, else float if every one is written
+   as printf("%.*f") writes it with the same number (> 0) of decimals,
+   else char. So a column with "01", "+1", "1e3" or an int past INT_MAX
+   is char, and decoding gives the text back */
+extern int QP_SchemaInfer(const char *datafile, const char *table,
+		QPschema *s);
+/* one record per table; the file may be shared with QP_CatalogPut's */
+extern int QP_SchemaPut(const char *catalog, const QPschema *s);
+/* QPE_EOF if the catalog has no schema for table */
+extern int QP_SchemaGet(const char *catalog, const char *table, QPschema *s);
+
+/* text record -> binary tuple in out (QP_MAXREC bytes); returns its length,
+   or QPE_INVALIDARG if a field does not fit its type (as QP_SchemaInfer
+   types a column), the record has more fields than the schema (past
+   QP_MAXFIELDS) or the tuple is too long */
+extern int QP_EncodeTuple(const QPschema *s, const char *rec, int reclen,
+		char *out);
+/* binary tuple -> text record in out (QP_MAXREC bytes), floats with the
+   decimals of their column: the record it was encoded from, but for
+   fields missing from its end; returns its length */
+extern int QP_DecodeTuple(const QPschema *s, const char *tup, char *out);
+extern int QP_TupleIsNull(const QPschema *s, const char *tup, int col);
+extern int QP_TupleInt(const QPschema *s, const char *tup, int col);
+extern float QP_TupleFloat(const QPschema *s, const char *tup, int col);
+extern const char *QP_TupleChar(const QPschema *s, const char *tup, int col,
+		int *len);
+
+/* QP_LoadHeap storing binary tuples */
+extern int QP_LoadBinaryHeap(const char *datafile, const char *heapname,
+		const QPschema *s, int maxrecs);
+/* QP_FilterOpen over binary tuples; empty fields never match */
+extern QPop *QP_TupleFilterOpen(QPop *child, const QPschema *s, int field,
+		int scanop, const char *value);
+
+/****************** PAX heaps (qppax.c) ************************************/
+/* A PAX heap (pxlayer.h) stores column c in width[c]-byte slots, char
+   values padded with '\0'. Loads like QP_LoadBinaryHeap. */
+extern int QP_LoadPaxHeap(const char *datafile, const char *paxname,
+		const QPschema *s, int maxrecs);
+/* scan producing binary tuples (qptuple.c) with only fields cols[0..ncols-1]
+   filled in and the rest null; only those columns' minipages are read */
+extern QPop *QP_PaxScanOpen(int paxfd, const QPschema *s, const int *cols,
+		int ncols);
+
+/****************** Column files (qpcolumn.c) ******************************/
+/* A column file holds a table column by column, each column cut into
+   segments of QP_COLSEGROWS rows that are compressed on their own and keep
+   their min/max. Built once from a data file; read only. */
+#define QP_COLSEGROWS	4096	/* rows per segment */
+
+typedef struct QPcolfile QPcolfile;
+typedef struct QPcolscan QPcolscan;
+
+/* one segment of a column scan. The arrays have nrows entries and stay
+   valid until the next call. */
+typedef struct {
+	int firstrow;		/* row # of entry 0 */
+	int nrows;
+	const unsigned char *null;	/* null[r] != 0 if row r is null */
+	const unsigned char *match;	/* match[r] != 0 if row r passes */
+	int nmatch;
+	/* values, if the scan decodes them; nulls read as 0 or "" */
+	const int *ival;	/* QP_INT */
+	const float *fval;	/* QP_FLOAT */
+	const char *const *sval;	/* QP_CHAR, slen[r] bytes each */
+	const int *slen;
+} QPcolbatch;
+
+/* load datafile typed by s into a new column file; returns the # of rows */
+extern int QP_ColBuild(const char *datafile, const char *colname,
+		const QPschema *s, int maxrecs);
+extern QPcolfile *QP_ColOpen(const char *colname);
+extern void QP_ColClose(QPcolfile *cf);
+extern const QPschema *QP_ColSchema(QPcolfile *cf);
+extern int QP_ColNumRows(QPcolfile *cf);
+/* bytes of column col; encs gets its encodings and their segment counts,
+   e.g. "for:14 dict+rle:1" */
+extern long QP_ColInfo(QPcolfile *cf, int col, char *encs, int enclen);
+/* scan of column col for rows with (col scanop value), QP_ALL for all
+   rows. Segments without a matching row are not returned, and are not
+   read if their min/max rule them out. With decode == 0 only null and
+   match are filled in, and the predicate is tested on the codes. */
+extern QPcolscan *QP_ColScanOpen(QPcolfile *cf, int col, int scanop,
+		const char *value, int decode);
+/* QPE_OK, QPE_EOF or error */
+extern int QP_ColScanNext(QPcolscan *cs, QPcolbatch *b);
+/* segments passed over without a match so far */
+extern int QP_ColScanSkipped(QPcolscan *cs);
+extern void QP_ColScanClose(QPcolscan *cs);
+
+/****************** Bulk loading (qpload.c) ********************************/
+#define QP_LOADCHUNK	(256 * 1024)	/* bytes of input parsed per work unit */
+
+/* an index built by QP_BulkLoad: <heapname>.<indexno> on field */
+typedef struct QPloadindex {
+	int indexno;
+	int field;
+	char type;
+	int len;
+	int desc;
+} QPloadindex;
+
+typedef struct QPloadstats {
+	long bytes;		/* size of the data file */
+	long nrecs;		/* records loaded */
+	int nchunks;		/* work units the file was split into */
+	double parsems;		/* CPU time of the parse workers, summed */
+	double heapms;		/* wall time of parsing and appending to the heap */
+	double indexms;		/* sorting the keys and building the indexes */
+	double totalms;		/* wall time of the whole load */
+} QPloadstats;
+
+/* Load datafile like QP_LoadHeap (all records) and build the given indexes
+   on it. The file is memory-mapped and cut into chunks at line boundaries;
+   nthreads workers split and parse the chunks while the calling thread
+   appends their records to the heap in file order, so the heap comes out
+   exactly as QP_LoadHeap leaves it. Indexes are built bottom up with
+   AM_BulkLoad from the sorted keys. st, if given, is filled in. Returns the
+   # of records loaded or a QP error code. */
+extern int QP_BulkLoad(const char *datafile, const char *heapname,
+		int nthreads, const QPloadindex *idx, int nidx, QPloadstats *st);
+
+/****************** Scans (qpscan.c) ***************************************/
+extern QPop *QP_HeapScanOpen(int heapfd);
+extern QPop *QP_IndexScanOpen(int heapfd, QPindex *idx, int scanop,
+		char *value);
+/* scans of an MVCC heap as of snapshot snap (SP_MvccSnapshot) */
+extern QPop *QP_MvccHeapScanOpen(int heapfd, SPts snap);
+extern QPop *QP_MvccIndexScanOpen(int heapfd, QPindex *idx, int scanop,
+		char *value, SPts snap);
+extern QPop *QP_BitmapScanOpen(int heapfd, QPindex *idx, int scanop,
+		char *value);
+/* tuples of child whose field satisfies `scanop value`; value is text in
+   the same form as a record field */
+extern QPop *QP_FilterOpen(QPop *child, int field, char type, int scanop,
+		const char *value);
+
+/****************** Sort (qpsort.c) ****************************************/
+#define QP_SORT_MEM	(1 << 20)	/* default run-generation memory */
+#define QP_SORT_FANIN	8	/* runs merged per pass */
+#ifndef QP_SORT_RUNS
+#define QP_SORT_RUNS	PF_MEM_PREFIX	/* run file name prefix: memory
+					files; "/tmp/" puts them on disk */
+#endif
+
+extern QPop *QP_SortOpen(QPop *child, int field, char type, int desc,
+		long membytes);
+
+/****************** Top-N (qptopn.c) ***************************************/
+/* the first n tuples of child in (field, desc) order; an input already in
+   that order is cut off after n tuples, any other goes through a bounded
+   heap of n tuples */
+extern QPop *QP_TopNOpen(QPop *child, int field, char type, int desc, int n);
+
+/****************** Joins (qpjoin.c) ***************************************/
+extern QPop *QP_MergeJoinOpen(QPop *left, int lfield, QPop *right,
+		int rfield, char type);
+
+#define QP_INLJ_BATCH	1024	/* default outer tuples per batched probe */
+
+/* outer JOIN heap ON outer.ofield = heap.(idx->field); batch <= 1 probes
+   the index once per outer tuple, otherwise `batch` outer tuples are probed
+   together in key order and the heap is read in rid order */
+extern QPop *QP_IndexNLJoinOpen(QPop *outer, int ofield, int heapfd,
+		QPindex *idx, int batch);
+
+/****************** ANALYZE and estimates (qpstats.c) **********************/
+/* Fill t->stats with the row and page counts and the statistics of each
+   given numeric field, and the shape and clustering of every open index */
+extern int QP_Analyze(QPtable *t, const int *fields, const char *types,
+		int nfields);
+extern QPcolstats *QP_GetColStats(QPtable *t, int field);
+/* estimated # of rows of t where field `scanop` value, and # of distinct
+   heap pages holding them */
+extern double QP_EstimateRows(QPtable *t, int field, int scanop,
+		const char *value);
+extern double QP_EstimatePages(QPtable *t, int field, int scanop,
+		const char *value);
+
+/****************** Sampled statistics and catalog (qpsketch.c) ************/
+#define QP_HLLBITS	10	/* log2 of HyperLogLog registers per column */
+#define QP_SAMPLEROWS	1024	/* reservoir sample size */
+#define QP_STATKEYLEN	16	/* bytes kept of a sampled value or a bound */
+#define QP_SKETCHSTRIDE	128	/* a piggybacked scan sketches 1 row in this many,
+				   unless QP_SketchStride() picks one */
+#define QP_SKETCHBUDGET	0.01	/* share of a scan QP_SketchStride() allows */
+
+/* sampled statistics of one column: a HyperLogLog distinct count over every
+   row and an equi-depth histogram of a reservoir sample, scaled to the
+   table. Bounds are kept as text, as the values appear in the records;
+   bucket b holds the values in (hi[b-1], hi[b]] (lo <= v <= hi[0] for b = 0).
+   Empty fields are counted in nnull and left out of the histogram. */
+typedef struct QPcolsketch {
+	int field;
+	char type;		/* inferred from the sample (or the index type) */
+	double nnull;
+	double ndistinct;
+	int nbuckets;
+	char lo[QP_STATKEYLEN];
+	char hi[QP_HISTBUCKETS][QP_STATKEYLEN];
+	double depth[QP_HISTBUCKETS];	/* estimated # of rows in each bucket */
+	double distinct[QP_HISTBUCKETS]; /* estimated # of distinct values */
+} QPcolsketch;
+
+typedef struct QPtablesketch {
+	char table[QP_MAXNAME];
+	long nrows;
+	int npages;
+	int ncols;
+	QPcolsketch col[QP_MAXFIELDS];
+} QPtablesketch;
+
+/* Collector. Fields 0..ncols-1 of every record are sketched (all fields if
+   ncols <= 0). A pass is one scan of the table that sketches the rows whose
+   position in the scan is pass (mod stride), so the table is covered after
+   stride passes, each costing 1/stride of a full sketch. */
+typedef struct QPsketch QPsketch;
+
+extern QPsketch *QP_SketchCreate(int ncols, int stride);
+extern void QP_SketchReset(QPsketch *sk);
+extern void QP_SketchDestroy(QPsketch *sk);
+/* both return the # of rows the caller passes over before the next
+   QP_SketchRow() call */
+extern int QP_SketchBeginPass(QPsketch *sk);
+extern int QP_SketchRow(QPsketch *sk, const char *rec, int reclen);
+/* 1 once every row has been sketched */
+extern int QP_SketchEndPass(QPsketch *sk);
+extern int QP_SketchDone(QPsketch *sk);
+extern int QP_SketchFinish(QPsketch *sk, QPtablesketch *ts);
+
+/* the stride that keeps a pass over t within QP_SKETCHBUDGET of the scan,
+   from the fields and bytes of its first rows */
+extern int QP_SketchStride(QPtable *t);
+
+/* pass-through operator that runs a sketch pass over child's tuples; the
+   pass counts only if child is read to its end */
+extern QPop *QP_SketchScanOpen(QPop *child, QPsketch *sk);
+/* sketch t with as many heap scans as sk needs */
+extern int QP_SketchTable(QPtable *t, QPsketch *sk, QPtablesketch *ts);
+/* sketch the indexed field by walking the leaves of idx */
+extern int QP_SketchIndex(QPindex *idx, QPcolsketch *cs);
+
+/* the catalog is an SP file holding one record per sketched column */
+extern int QP_CatalogPut(const char *catalog, const QPtablesketch *ts);
+/* QPE_EOF if the catalog has nothing on table */
+extern int QP_CatalogGet(const char *catalog, const char *table,
+		QPtablesketch *ts);
+
+/* Fill t->stats from a sketch instead of QP_Analyze: the numeric columns
+   become QPcolstats, indexes get their shape from a tree walk and are taken
+   as unclustered */
+extern int QP_UseSketch(QPtable *t, const QPtablesketch *ts);
+
+/****************** Planner (qpplan.c) *************************************/
+#define QP_JOIN_MERGE		0	/* both inputs already ordered */
+#define QP_JOIN_SORTMERGE	1	/* at least one input sorted first */
+
+extern QPop *QP_PlanJoin(QPtable *left, int lfield, QPtable *right,
+		int rfield, char type, long membytes, int *method);
+
+/* first n rows of t in (field, desc) order: a cut-off index scan when t has
+   a matching index, otherwise a bounded-heap Top-N over a heap scan */
+extern QPop *QP_PlanTopN(QPtable *t, int field, char type, int desc, int n);
+
+/* access paths for a single-column predicate */
+#define QP_PATH_HEAP	0	/* heap scan + filter */
+#define QP_PATH_INDEX	1	/* AM index scan, heap fetch per entry */
+#define QP_PATH_BITMAP	2	/* AM index scan, rids sorted, heap in page order */
+#define QP_NPATHS	3
+
+typedef struct QPcost {
+	double rows;			/* estimated result rows */
+	double cost[QP_NPATHS];		/* estimated page reads; < 0: no path */
+	int best;			/* cheapest path */
+} QPcost;
+
+/* Rows of t where field `scanop` value. The path is chosen from the
+   statistics (path < 0), or forced. *est, if given, is filled with the
+   estimates the choice was made from. */
+extern QPop *QP_PlanSelect(QPtable *t, int field, char type, int scanop,
+		const char *value, int path, QPcost *est);
+
+/****************** PF and AM entry points used by this layer **************/
+extern int PF_CreateFile(char *fname);
+extern int PF_DestroyFile(char *fname);
+extern int PF_OpenFile(char *fname);
+extern int PF_CloseFile(int fd);
+extern int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
+extern int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
+extern int PF_UnfixPage(int fd, int pagenum, int dirty);
+
+/* char arguments of the K&R definitions are promoted to int */
+extern int AM_CreateIndex(char *fileName, int indexNo, int attrType,
+		int attrLength);
+extern int AM_DestroyIndex(char *fileName, int indexNo);
+extern int AM_InsertEntry(int fileDesc, int attrType, int attrLength,
+		char *value, int recId);
+extern int AM_OpenIndexScan(int fileDesc, int attrType, int attrLength,
+		int op, char *value);
+extern int AM_FindNextEntry(int scanDesc);
+extern int AM_CloseIndexScan(int scanDesc);
+extern int AM_Search(int fileDesc, int attrType, int attrLength, char *value,
+		int *pageNum, char **pageBuf, int *indexPtr);
+extern int AM_BatchSearch(int fileDesc, int attrType, int attrLength,
+		char *keys, int nKeys, int *recIds, int maxRecIds, int *counts);
+extern int AM_BulkLoad(int fileDesc, int attrType, int attrLength,
+		char *keys, int *recIds, int nEntries);
+extern int AM_EmptyStack();
+
+#endif /* QP_H */
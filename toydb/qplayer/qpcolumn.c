@@ -0,0 +1,890 @@
+/* qpcolumn.c
+ * Column files: read-mostly tables stored column by column, compressed.
+ *
+ * Every column is cut into segments of QP_COLSEGROWS rows, and each
+ * segment is encoded on its own with whichever of these is smallest:
+ *  - frame of reference: value - min as a bit-packed code; floats with
+ *    few decimals are scaled to ints first (2.50 -> 250 with scale 100)
+ *  - dictionary: the segment's sorted distinct values, and each row's
+ *    index into them as a bit-packed code
+ *  - either of the two with the codes run-length encoded as
+ *    (code, run length) pairs
+ *  - plain: the values as they are
+ * A segment also keeps its min/max, and a null bitmap if some but not all
+ * of its rows are null.
+ *
+ * The file is a PF file: page 0 is a header, and the pages after it hold
+ * one byte stream made of column 0's segments, column 1's, ..., and then
+ * the segment directory. A scan reads one column's segments and hands them
+ * out a segment at a time as arrays. A predicate is tested on min/max
+ * first, so segments that cannot match are never read, and then on the
+ * codes: both encodings keep the order of the values, so the predicate
+ * becomes a range of codes found by binary search, and each row is one
+ * unsigned compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include "qp.h"
+
+#define COL_MAGIC	0x434f4c31	/* "COL1" */
+#define ALIGN4(n)	(((n) + 3) & ~3L)
+#define PACKED(n, bits)	(((long)(n) * (bits) + 7) / 8)
+#define BIT(map, r)	(((map)[(r) / 8] >> ((r) % 8)) & 1)
+
+enum { ENC_PLAIN, ENC_FOR, ENC_DICT };
+static const char *encname[] = { "plain", "for", "dict" };
+
+typedef struct {
+    int col;
+    int firstrow;
+    int nrows;
+    int enc;            /* ENC_* */
+    int rle;            /* codes stored as (code, run length) pairs */
+    int nruns;
+    int bits;           /* bits per packed code */
+    int scale;          /* ENC_FOR: value = (ref + code) / scale */
+    int ncodes;         /* codes are 0..ncodes-1 */
+    int nnull;
+    long long ref;
+    double min, max;    /* of the non-null values; int and float columns */
+    long off, len;      /* the segment's bytes in the stream */
+} colseg_t;
+
+typedef struct {
+    int magic;
+    int nrows;
+    int nsegs;
+    long diroff;        /* segment directory in the stream */
+    QPschema schema;
+} colheader_t;
+
+struct QPcolfile {
+    int fd;
+    colheader_t h;
+    colseg_t *seg;      /* sorted by column, then row */
+};
+
+/* bytes in memory, grown as needed */
+typedef struct {
+    char *p;
+    long len, cap;
+} bytes_t;
+
+static int put(bytes_t *b, const void *src, long n) {
+    if (b->len + n > b->cap) {
+        long cap = b->cap ? b->cap : 4096;
+        char *p;
+        while (cap < b->len + n) cap *= 2;
+        if ((p = realloc(b->p, cap)) == NULL) return -1;
+        b->p = p;
+        b->cap = cap;
+    }
+    if (src) memcpy(b->p + b->len, src, n);
+    else memset(b->p + b->len, 0, n);
+    b->len += n;
+    return 0;
+}
+
+static int pad4(bytes_t *b) {
+    return put(b, NULL, ALIGN4(b->len) - b->len);
+}
+
+static int bitwidth(unsigned long long x) {
+    int b = 0;
+    while (x) {
+        b++;
+        x >>= 1;
+    }
+    return b;
+}
+
+/* write n codes of `bits` bits each, LSB first, into out (zeroed) */
+static void pack(const unsigned *code, int n, int bits, unsigned char *out) {
+    int r, i;
+    for (r = 0; r < n; r++) {
+        unsigned long long bit = (unsigned long long)r * bits;
+        unsigned long long v = (unsigned long long)code[r] << (bit & 7);
+        for (i = 0; v; i++, v >>= 8) out[(bit >> 3) + i] |= v & 0xff;
+    }
+}
+
+/* inverse of pack; reads up to 7 bytes past the codes. One unaligned
+   64-bit load, a shift and a mask per code, with no branches. */
+static void unpack(const unsigned char *in, int n, int bits, unsigned *out) {
+    unsigned long long mask = ((unsigned long long)1 << bits) - 1, w;
+    int r;
+    for (r = 0; r < n; r++) {
+        unsigned long long bit = (unsigned long long)r * bits;
+        memcpy(&w, in + (bit >> 3), sizeof(w));
+        out[r] = (unsigned)((w >> (bit & 7)) & mask);
+    }
+}
+
+static int runs(const unsigned *code, int n) {
+    int r, k = n > 0;
+    for (r = 1; r < n; r++) k += code[r] != code[r-1];
+    return k;
+}
+
+/* bytes of n codes below ncodes: packed, or as runs if *rle is set */
+static long codebytes(const unsigned *code, int n, int ncodes, int *rle) {
+    long packed = PACKED(n, bitwidth(ncodes > 0 ? ncodes - 1 : 0));
+    long rl = (long)runs(code, n) * 2 * sizeof(unsigned);
+    *rle = rl < packed;
+    return *rle ? rl : packed;
+}
+
+/* float value of FOR code k */
+static float for_float(long long ref, long long k, int scale) {
+    return (float)((double)(ref + k) / scale);
+}
+
+/******************** building ********************/
+
+/* append segment g: null bitmap, dictionary, codes or plain values */
+static int emit(bytes_t *out, colseg_t *g, const unsigned char *nulls,
+                const void *dict, long dictlen, const unsigned *code,
+                const void *plain, long plainlen) {
+    int r, n = g->nrows;
+
+    g->off = out->len;
+    if (g->nnull && g->nnull < n && (put(out, nulls, (n + 7) / 8) || pad4(out)))
+        return -1;
+    if (g->enc == ENC_DICT && (put(out, dict, dictlen) || pad4(out))) return -1;
+    if (g->enc == ENC_PLAIN) {
+        if (put(out, plain, plainlen) || pad4(out)) return -1;
+    } else if (g->rle) {
+        unsigned run[2];
+        g->nruns = 0;
+        for (r = 0; r < n; r += run[1]) {
+            run[0] = code[r];
+            for (run[1] = 1; r + (int)run[1] < n && code[r + run[1]] == run[0]; run[1]++)
+                ;
+            if (put(out, run, sizeof(run))) return -1;
+            g->nruns++;
+        }
+    } else {
+        long at = out->len;
+        g->bits = bitwidth(g->ncodes > 0 ? g->ncodes - 1 : 0);
+        if (put(out, NULL, PACKED(n, g->bits)) || pad4(out)) return -1;
+        pack(code, n, g->bits, (unsigned char *)out->p + at);
+    }
+    g->len = out->len - g->off;
+    return 0;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_float(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/* int or float column c of tuples tup[0..n-1] */
+static int encode_numeric(const QPschema *s, int c, char *const *tup, int n,
+                          colseg_t *g, bytes_t *out) {
+    int isint = s->type[c] == QP_INT, r, i, nd = 0, rle;
+    int (*cmp)(const void *, const void *) = isint ? cmp_int : cmp_float;
+    unsigned char nulls[QP_COLSEGROWS / 8];
+    int raw[QP_COLSEGROWS], dict[QP_COLSEGROWS];    /* ints, or float bits */
+    long long sv[QP_COLSEGROWS], kmin = 0, kmax = 0;
+    unsigned forcode[QP_COLSEGROWS], dictcode[QP_COLSEGROWS];
+    long plainsz = (long)n * 4, forsz = -1, dictsz;
+    int forrle = 0, scale = 0;
+    static const int scales[] = { 1, 10, 100, 1000 };
+
+    memset(nulls, 0, sizeof(nulls));
+    for (r = 0; r < n; r++) {
+        double v;
+        if (QP_TupleIsNull(s, tup[r], c)) {
+            nulls[r / 8] |= 1 << (r % 8);
+            raw[r] = 0;
+            g->nnull++;
+            continue;
+        }
+        memcpy(&raw[r], tup[r] + s->fixedoff[c], 4);
+        v = isint ? raw[r] : QP_TupleFloat(s, tup[r], c);
+        if (nd == 0 || v < g->min) g->min = v;
+        if (nd == 0 || v > g->max) g->max = v;
+        dict[nd++] = raw[r];
+    }
+
+    /* frame of reference, for ints and for floats that scale exactly */
+    for (i = 0; i < (isint ? 1 : 4) && !scale; i++) {
+        scale = scales[i];
+        for (r = 0; r < n && scale; r++) {
+            float f;
+            if (BIT(nulls, r)) {
+                sv[r] = 0;
+                continue;
+            }
+            if (isint) {
+                sv[r] = raw[r];
+                continue;
+            }
+            memcpy(&f, &raw[r], 4);
+            sv[r] = llround((double)f * scale);
+            if (llabs(sv[r]) > INT_MAX || for_float(0, sv[r], scale) != f) scale = 0;
+        }
+    }
+    if (scale) {
+        for (r = 0, i = 0; r < n; r++) {
+            if (BIT(nulls, r)) continue;
+            if (i == 0 || sv[r] < kmin) kmin = sv[r];
+            if (i == 0 || sv[r] > kmax) kmax = sv[r];
+            i++;
+        }
+        if (kmax - kmin >= INT_MAX) scale = 0;
+    }
+    if (scale) {
+        for (r = 0; r < n; r++) forcode[r] = BIT(nulls, r) ? 0 : (unsigned)(sv[r] - kmin);
+        forsz = codebytes(forcode, n, i ? (int)(kmax - kmin + 1) : 0, &forrle);
+    }
+
+    /* dictionary of the distinct values */
+    qsort(dict, nd, sizeof(int), cmp);
+    for (r = 0, i = 0; r < nd; r++)
+        if (i == 0 || cmp(&dict[r], &dict[i-1]) != 0) dict[i++] = dict[r];
+    nd = i;
+    for (r = 0; r < n; r++)
+        dictcode[r] = BIT(nulls, r) ? 0
+            : (unsigned)((int *)bsearch(&raw[r], dict, nd, sizeof(int), cmp) - dict);
+    dictsz = (long)nd * 4 + codebytes(dictcode, n, nd, &rle);
+
+    if (forsz >= 0 && forsz <= dictsz && forsz <= plainsz) {
+        g->enc = ENC_FOR;
+        g->rle = forrle;
+        g->scale = scale;
+        g->ref = kmin;
+        g->ncodes = g->nnull < n ? (int)(kmax - kmin + 1) : 0;
+        return emit(out, g, nulls, NULL, 0, forcode, NULL, 0);
+    }
+    if (dictsz <= plainsz) {
+        g->enc = ENC_DICT;
+        g->rle = rle;
+        g->ncodes = nd;
+        return emit(out, g, nulls, dict, (long)nd * 4, dictcode, NULL, 0);
+    }
+    g->enc = ENC_PLAIN;
+    return emit(out, g, nulls, NULL, 0, NULL, raw, plainsz);
+}
+
+typedef struct {
+    const char *p;
+    int len;
+    int row;
+} str_t;
+
+static int cmp_str(const void *a, const void *b) {
+    const str_t *x = (const str_t *)a, *y = (const str_t *)b;
+    int c = memcmp(x->p, y->p, x->len < y->len ? x->len : y->len);
+    return c ? c : (x->len > y->len) - (x->len < y->len);
+}
+
+/* char column c of tuples tup[0..n-1] */
+static int encode_char(const QPschema *s, int c, char *const *tup, int n,
+                       colseg_t *g, bytes_t *out) {
+    unsigned char nulls[QP_COLSEGROWS / 8];
+    str_t str[QP_COLSEGROWS];
+    unsigned code[QP_COLSEGROWS], off;
+    bytes_t dict = { NULL, 0, 0 }, plain = { NULL, 0, 0 }, text = { NULL, 0, 0 };
+    int r, nv = 0, nd = 0, rle, error = -1;
+    long dictsz;
+
+    memset(nulls, 0, sizeof(nulls));
+    for (r = 0; r < n; r++) {
+        if (QP_TupleIsNull(s, tup[r], c)) {
+            nulls[r / 8] |= 1 << (r % 8);
+            g->nnull++;
+            code[r] = 0;
+            continue;
+        }
+        str[nv].p = QP_TupleChar(s, tup[r], c, &str[nv].len);
+        str[nv++].row = r;
+    }
+    /* plain: n+1 offsets, then the values */
+    for (r = 0, off = 0, nv = 0; r <= n; r++) {
+        if (put(&plain, &off, sizeof(off))) goto done;
+        if (r < n && !BIT(nulls, r)) off += str[nv++].len;
+    }
+    for (r = 0; r < nv; r++)
+        if (put(&text, str[r].p, str[r].len)) goto done;
+    if (put(&plain, text.p, text.len)) goto done;
+
+    /* dictionary: nd+1 offsets, then the sorted distinct values */
+    qsort(str, nv, sizeof(str_t), cmp_str);
+    text.len = 0;
+    for (r = 0, off = 0; r < nv; r++) {
+        if (r == 0 || cmp_str(&str[r], &str[r-1]) != 0) {
+            if (put(&dict, &off, sizeof(off)) || put(&text, str[r].p, str[r].len))
+                goto done;
+            off += str[r].len;
+            nd++;
+        }
+        code[str[r].row] = nd - 1;
+    }
+    if (put(&dict, &off, sizeof(off)) || put(&dict, text.p, text.len)) goto done;
+    dictsz = dict.len + codebytes(code, n, nd, &rle);
+
+    if (dictsz < plain.len) {
+        g->enc = ENC_DICT;
+        g->rle = rle;
+        g->ncodes = nd;
+        error = emit(out, g, nulls, dict.p, dict.len, code, NULL, 0);
+    } else {
+        g->enc = ENC_PLAIN;
+        error = emit(out, g, nulls, NULL, 0, NULL, plain.p, plain.len);
+    }
+done:
+    free(dict.p);
+    free(plain.p);
+    free(text.p);
+    return error;
+}
+
+static int cmp_seg(const void *a, const void *b) {
+    const colseg_t *x = (const colseg_t *)a, *y = (const colseg_t *)b;
+    if (x->col != y->col) return x->col - y->col;
+    return x->firstrow - y->firstrow;
+}
+
+/* encode the n tuples of the segment starting at row first */
+static int add_segment(const QPschema *s, char *const *tup, int n, int first,
+                       bytes_t *stream, bytes_t *dir) {
+    colseg_t g;
+    int c;
+
+    for (c = 0; c < s->ncols; c++) {
+        memset(&g, 0, sizeof(g));
+        g.col = c;
+        g.firstrow = first;
+        g.nrows = n;
+        g.scale = 1;
+        if ((s->type[c] == QP_CHAR ? encode_char(s, c, tup, n, &g, &stream[c])
+                : encode_numeric(s, c, tup, n, &g, &stream[c])) != 0
+                || put(dir, &g, sizeof(g)) != 0)
+            return (QPerrno = QPE_NOMEM);
+    }
+    return QPE_OK;
+}
+
+/* write header h and stream to a new PF file */
+static int write_file(const char *colname, const colheader_t *h,
+                      const bytes_t *stream) {
+    char *pagebuf;
+    int fd, pagenum, expect;
+    long off;
+
+    PF_DestroyFile((char *)colname);
+    if (PF_CreateFile((char *)colname) != PFE_OK
+            || (fd = PF_OpenFile((char *)colname)) < 0)
+        return (QPerrno = QPE_PF);
+    for (expect = 0, off = -1; off < stream->len; expect++) {
+        if (PF_AllocPage(fd, &pagenum, &pagebuf) != PFE_OK || pagenum != expect) {
+            PF_CloseFile(fd);
+            return (QPerrno = QPE_PF);
+        }
+        memset(pagebuf, 0, PF_PAGE_SIZE);
+        if (off < 0) {
+            memcpy(pagebuf, h, sizeof(*h));
+            off = 0;
+        } else {
+            long n = stream->len - off < PF_PAGE_SIZE ? stream->len - off : PF_PAGE_SIZE;
+            memcpy(pagebuf, stream->p + off, n);
+            off += n;
+        }
+        PF_UnfixPage(fd, pagenum, TRUE);
+    }
+    return PF_CloseFile(fd) == PFE_OK ? QPE_OK : (QPerrno = QPE_PF);
+}
+
+int QP_ColBuild(const char *datafile, const char *colname, const QPschema *s,
+                int maxrecs) {
+    FILE *f;
+    char *line = NULL, *tup[QP_COLSEGROWS];
+    size_t cap = 0;
+    long tupoff[QP_COLSEGROWS];
+    bytes_t tuples = { NULL, 0, 0 }, stream[QP_MAXFIELDS], all = { NULL, 0, 0 };
+    bytes_t dir = { NULL, 0, 0 };
+    colheader_t h;
+    int n = 0, k = 0, c, i, len, L, error = QPE_OK;
+
+    if ((f = fopen(datafile, "r")) == NULL) return (QPerrno = QPE_UNIX);
+    memset(stream, 0, sizeof(stream));
+    while ((maxrecs <= 0 || n < maxrecs) && (L = QP_ReadLine(f, &line, &cap)) >= 0) {
+        char buf[QP_MAXREC];
+        if ((len = QP_EncodeTuple(s, line, L, buf)) < 0) {
+            error = QPerrno = len;
+            break;
+        }
+        tupoff[k++] = tuples.len;
+        if (put(&tuples, buf, len)) {
+            error = QPerrno = QPE_NOMEM;
+            break;
+        }
+        n++;
+        if (k == QP_COLSEGROWS) {
+            for (i = 0; i < k; i++) tup[i] = tuples.p + tupoff[i];
+            if ((error = add_segment(s, tup, k, n - k, stream, &dir)) != QPE_OK) break;
+            k = 0;
+            tuples.len = 0;
+        }
+    }
+    free(line);
+    fclose(f);
+    if (error == QPE_OK && k > 0) {
+        for (i = 0; i < k; i++) tup[i] = tuples.p + tupoff[i];
+        error = add_segment(s, tup, k, n - k, stream, &dir);
+    }
+
+    /* the columns one after another, then the directory */
+    if (error == QPE_OK) {
+        colseg_t *seg = (colseg_t *)dir.p;
+        long base[QP_MAXFIELDS];
+        memset(&h, 0, sizeof(h));
+        h.magic = COL_MAGIC;
+        h.nrows = n;
+        h.nsegs = dir.len / sizeof(colseg_t);
+        h.schema = *s;
+        for (c = 0; c < s->ncols && error == QPE_OK; c++) {
+            base[c] = all.len;
+            if (put(&all, stream[c].p, stream[c].len)) error = QPerrno = QPE_NOMEM;
+        }
+        for (i = 0; i < h.nsegs; i++) seg[i].off += base[seg[i].col];
+        qsort(seg, h.nsegs, sizeof(colseg_t), cmp_seg);
+        h.diroff = all.len;
+        if (error == QPE_OK && (put(&all, dir.p, dir.len) || put(&all, NULL, 8)))
+            error = QPerrno = QPE_NOMEM;
+        if (error == QPE_OK) error = write_file(colname, &h, &all);
+    }
+    free(tuples.p);
+    free(all.p);
+    free(dir.p);
+    for (c = 0; c < QP_MAXFIELDS; c++) free(stream[c].p);
+    return error == QPE_OK ? n : error;
+}
+
+/******************** reading ********************/
+
+/* copy len bytes at off in the stream to dst */
+static int read_stream(int fd, long off, long len, void *dst) {
+    char *pagebuf;
+    int pagenum;
+
+    while (len > 0) {
+        long at = off % PF_PAGE_SIZE, n = PF_PAGE_SIZE - at < len ? PF_PAGE_SIZE - at : len;
+        pagenum = 1 + off / PF_PAGE_SIZE;
+        if (PF_GetThisPage(fd, pagenum, &pagebuf) != PFE_OK) return (QPerrno = QPE_PF);
+        memcpy(dst, pagebuf + at, n);
+        PF_UnfixPage(fd, pagenum, FALSE);
+        dst = (char *)dst + n;
+        off += n;
+        len -= n;
+    }
+    return QPE_OK;
+}
+
+QPcolfile *QP_ColOpen(const char *colname) {
+    QPcolfile *cf;
+    char *pagebuf;
+
+    if ((cf = (QPcolfile *)calloc(1, sizeof(QPcolfile))) == NULL) {
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    if ((cf->fd = PF_OpenFile((char *)colname)) < 0) {
+        free(cf);
+        QPerrno = QPE_PF;
+        return NULL;
+    }
+    if (PF_GetThisPage(cf->fd, 0, &pagebuf) != PFE_OK) goto fail;
+    memcpy(&cf->h, pagebuf, sizeof(cf->h));
+    PF_UnfixPage(cf->fd, 0, FALSE);
+    if (cf->h.magic != COL_MAGIC) goto fail;
+    if ((cf->seg = (colseg_t *)malloc(cf->h.nsegs * sizeof(colseg_t) + 1)) == NULL
+            || read_stream(cf->fd, cf->h.diroff, cf->h.nsegs * sizeof(colseg_t),
+                           cf->seg) != QPE_OK)
+        goto fail;
+    return cf;
+fail:
+    PF_CloseFile(cf->fd);
+    free(cf->seg);
+    free(cf);
+    QPerrno = QPE_PF;
+    return NULL;
+}
+
+void QP_ColClose(QPcolfile *cf) {
+    PF_CloseFile(cf->fd);
+    free(cf->seg);
+    free(cf);
+}
+
+const QPschema *QP_ColSchema(QPcolfile *cf) {
+    return &cf->h.schema;
+}
+
+int QP_ColNumRows(QPcolfile *cf) {
+    return cf->h.nrows;
+}
+
+long QP_ColInfo(QPcolfile *cf, int col, char *encs, int enclen) {
+    int count[3][2], i, k, n = 0;
+    long bytes = 0;
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < cf->h.nsegs; i++)
+        if (cf->seg[i].col == col) {
+            bytes += cf->seg[i].len;
+            count[cf->seg[i].enc][cf->seg[i].rle]++;
+        }
+    if (enclen > 0) encs[0] = '\0';
+    for (i = 0; i < 3; i++)
+        for (k = 0; k < 2; k++)
+            if (count[i][k] && n < enclen)
+                n += snprintf(encs + n, enclen - n, "%s%s%s:%d", n ? " " : "",
+                              encname[i], k ? "+rle" : "", count[i][k]);
+    return bytes;
+}
+
+/******************** scan ********************/
+
+struct QPcolscan {
+    QPcolfile *cf;
+    int col;
+    char type;
+    int scanop;
+    int decode;
+    int ival;               /* the predicate's constant */
+    float fval;
+    char *value;
+    int vlen;
+    int next, end;          /* segments of col left: seg[next..end-1] */
+    int skipped;
+    const colseg_t *g;      /* current segment */
+    unsigned char *buf;     /* its bytes, and 8 zero bytes for unpack */
+    long bufcap;
+    const char *dict;
+    unsigned code[QP_COLSEGROWS];
+    unsigned char null[QP_COLSEGROWS];
+    unsigned char match[QP_COLSEGROWS];
+    int ivals[QP_COLSEGROWS];
+    float fvals[QP_COLSEGROWS];
+    const char *svals[QP_COLSEGROWS];
+    int slens[QP_COLSEGROWS];
+};
+
+QPcolscan *QP_ColScanOpen(QPcolfile *cf, int col, int scanop, const char *value,
+                          int decode) {
+    QPcolscan *cs;
+    char *end;
+    int i;
+
+    if (col < 0 || col >= cf->h.schema.ncols || scanop < QP_ALL || scanop > QP_GE
+            || (scanop != QP_ALL && !value)) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    if ((cs = (QPcolscan *)calloc(1, sizeof(QPcolscan))) == NULL) {
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    cs->cf = cf;
+    cs->col = col;
+    cs->type = cf->h.schema.type[col];
+    cs->scanop = scanop;
+    cs->decode = decode;
+    if (scanop != QP_ALL) {
+        errno = 0;
+        if (cs->type == QP_INT) {
+            long l = strtol(value, &end, 10);
+            if (!*value || *end || errno || l < INT_MIN || l > INT_MAX) goto invalid;
+            cs->ival = (int)l;
+        } else if (cs->type == QP_FLOAT) {
+            cs->fval = strtof(value, &end);
+            if (!*value || *end) goto invalid;
+        }
+        cs->vlen = strlen(value);
+        if ((cs->value = strdup(value)) == NULL) {
+            free(cs);
+            QPerrno = QPE_NOMEM;
+            return NULL;
+        }
+    }
+    for (i = 0; i < cf->h.nsegs && cf->seg[i].col < col; i++)
+        ;
+    cs->next = i;
+    for (; i < cf->h.nsegs && cf->seg[i].col == col; i++)
+        ;
+    cs->end = i;
+    return cs;
+invalid:
+    free(cs);
+    QPerrno = QPE_INVALIDARG;
+    return NULL;
+}
+
+/* does the predicate hold for no row (-1), every non-null row (1), or
+   maybe some (0) of segment g, from its min/max alone */
+static int zone(const QPcolscan *cs, const colseg_t *g) {
+    double c = cs->type == QP_INT ? cs->ival : cs->fval;
+
+    if (cs->scanop == QP_ALL) return 1;
+    if (g->nnull == g->nrows) return -1;
+    if (cs->type == QP_CHAR) return 0;
+    switch (cs->scanop) {
+    case QP_EQ: return c < g->min || c > g->max ? -1 : g->min == c && g->max == c;
+    case QP_LT: return g->min >= c ? -1 : g->max < c;
+    case QP_LE: return g->min > c ? -1 : g->max <= c;
+    case QP_GT: return g->max <= c ? -1 : g->min > c;
+    default:    return g->max < c ? -1 : g->min >= c;
+    }
+}
+
+/* sign of (value of code k) - (the predicate's constant) */
+static int code_cmp(const QPcolscan *cs, unsigned k) {
+    const colseg_t *g = cs->g;
+
+    if (cs->type == QP_CHAR) {
+        const unsigned *off = (const unsigned *)cs->dict;
+        const char *v = cs->dict + (g->ncodes + 1) * sizeof(unsigned) + off[k];
+        int len = off[k+1] - off[k];
+        int c = memcmp(v, cs->value, len < cs->vlen ? len : cs->vlen);
+        return c ? c : (len > cs->vlen) - (len < cs->vlen);
+    }
+    if (cs->type == QP_INT) {
+        long long v = g->enc == ENC_DICT ? ((const int *)cs->dict)[k] : g->ref + k;
+        return (v > cs->ival) - (v < cs->ival);
+    } else {
+        float v = g->enc == ENC_DICT ? ((const float *)cs->dict)[k]
+                                     : for_float(g->ref, k, g->scale);
+        return (v > cs->fval) - (v < cs->fval);
+    }
+}
+
+/* first code whose value is >= (or > if strict) the constant */
+static unsigned code_bound(const QPcolscan *cs, int strict) {
+    unsigned lo = 0, hi = cs->g->ncodes;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        int c = code_cmp(cs, mid);
+        if (c < 0 || (strict && c == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* codes [*lo, *hi) of the values the predicate holds for */
+static void code_range(const QPcolscan *cs, unsigned *lo, unsigned *hi) {
+    unsigned n = cs->g->ncodes;
+    switch (cs->scanop) {
+    case QP_EQ: *lo = code_bound(cs, 0); *hi = code_bound(cs, 1); break;
+    case QP_LT: *lo = 0; *hi = code_bound(cs, 0); break;
+    case QP_LE: *lo = 0; *hi = code_bound(cs, 1); break;
+    case QP_GT: *lo = code_bound(cs, 1); *hi = n; break;
+    case QP_GE: *lo = code_bound(cs, 0); *hi = n; break;
+    default:    *lo = 0; *hi = n; break;
+    }
+}
+
+/* match[r] for the plain values of the current segment */
+static int plain_match(QPcolscan *cs) {
+    int r, n = cs->g->nrows, nmatch = 0, c;
+
+    for (r = 0; r < n; r++) {
+        if (cs->type == QP_INT) c = (cs->ivals[r] > cs->ival) - (cs->ivals[r] < cs->ival);
+        else if (cs->type == QP_FLOAT) c = (cs->fvals[r] > cs->fval) - (cs->fvals[r] < cs->fval);
+        else {
+            c = memcmp(cs->svals[r], cs->value, cs->slens[r] < cs->vlen ? cs->slens[r] : cs->vlen);
+            if (c == 0) c = (cs->slens[r] > cs->vlen) - (cs->slens[r] < cs->vlen);
+        }
+        switch (cs->scanop) {
+        case QP_EQ: cs->match[r] = c == 0; break;
+        case QP_LT: cs->match[r] = c < 0; break;
+        case QP_GT: cs->match[r] = c > 0; break;
+        case QP_LE: cs->match[r] = c <= 0; break;
+        default:    cs->match[r] = c >= 0; break;
+        }
+        cs->match[r] &= !cs->null[r];
+        nmatch += cs->match[r];
+    }
+    return nmatch;
+}
+
+/* values of the current segment from its codes or plain bytes */
+static void decode_values(QPcolscan *cs, const unsigned char *p) {
+    const colseg_t *g = cs->g;
+    int r, n = g->nrows;
+
+    if (g->enc == ENC_PLAIN) {
+        if (cs->type == QP_INT) memcpy(cs->ivals, p, n * sizeof(int));
+        else if (cs->type == QP_FLOAT) memcpy(cs->fvals, p, n * sizeof(float));
+        else {
+            const unsigned *off = (const unsigned *)p;
+            const char *text = (const char *)p + (n + 1) * sizeof(unsigned);
+            for (r = 0; r < n; r++) {
+                cs->svals[r] = text + off[r];
+                cs->slens[r] = off[r+1] - off[r];
+            }
+        }
+    } else if (g->enc == ENC_FOR) {
+        if (cs->type == QP_INT)
+            for (r = 0; r < n; r++) cs->ivals[r] = (int)(g->ref + cs->code[r]);
+        else
+            for (r = 0; r < n; r++) cs->fvals[r] = for_float(g->ref, cs->code[r], g->scale);
+    } else if (cs->type == QP_INT) {
+        const int *dict = (const int *)cs->dict;
+        for (r = 0; r < n; r++) cs->ivals[r] = dict[cs->code[r]];
+    } else if (cs->type == QP_FLOAT) {
+        const float *dict = (const float *)cs->dict;
+        for (r = 0; r < n; r++) cs->fvals[r] = dict[cs->code[r]];
+    } else {
+        const unsigned *off = (const unsigned *)cs->dict;
+        const char *text = cs->dict + (g->ncodes + 1) * sizeof(unsigned);
+        for (r = 0; r < n; r++) {
+            cs->svals[r] = text + off[cs->code[r]];
+            cs->slens[r] = off[cs->code[r] + 1] - off[cs->code[r]];
+        }
+    }
+    /* nulls read as 0 or "" */
+    if (g->nnull)
+        for (r = 0; r < n; r++)
+            if (cs->null[r]) {
+                if (cs->type == QP_INT) cs->ivals[r] = 0;
+                else if (cs->type == QP_FLOAT) cs->fvals[r] = 0;
+                else cs->slens[r] = 0;
+            }
+}
+
+/* read the current segment and fill in null[] and, if some codes are
+   needed, code[]; p is left at the plain values */
+static int read_segment(QPcolscan *cs, int needcodes, const unsigned char **p) {
+    const colseg_t *g = cs->g;
+    const unsigned char *q;
+    int r, n = g->nrows;
+
+    if (g->len + 8 > cs->bufcap) {
+        unsigned char *b = realloc(cs->buf, g->len + 8);
+        if (!b) return (QPerrno = QPE_NOMEM);
+        cs->buf = b;
+        cs->bufcap = g->len + 8;
+    }
+    if (read_stream(cs->cf->fd, g->off, g->len, cs->buf) != QPE_OK) return QPerrno;
+    memset(cs->buf + g->len, 0, 8);
+    q = cs->buf;
+    if (g->nnull == n) memset(cs->null, 1, n);
+    else if (g->nnull) {
+        for (r = 0; r < n; r++) cs->null[r] = BIT(q, r);
+        q += ALIGN4((n + 7) / 8);
+    } else memset(cs->null, 0, n);
+    if (g->enc == ENC_DICT) {
+        cs->dict = (const char *)q;
+        if (cs->type == QP_CHAR) {
+            const unsigned *off = (const unsigned *)q;
+            q += ALIGN4((g->ncodes + 1) * sizeof(unsigned) + off[g->ncodes]);
+        } else q += (long)g->ncodes * 4;
+    }
+    *p = q;
+    if (g->enc != ENC_PLAIN && needcodes) {
+        if (g->rle) {
+            const unsigned *run = (const unsigned *)q;
+            unsigned i, k;
+            for (i = 0, r = 0; i < (unsigned)g->nruns; i++)
+                for (k = 0; k < run[2*i+1]; k++) cs->code[r++] = run[2*i];
+        } else unpack(q, n, g->bits, cs->code);
+    }
+    return QPE_OK;
+}
+
+int QP_ColScanNext(QPcolscan *cs, QPcolbatch *b) {
+    const unsigned char *p;
+    unsigned lo, hi;
+    int r, n, z, nmatch;
+
+    for (; cs->next < cs->end; cs->next++) {
+        const colseg_t *g = cs->g = &cs->cf->seg[cs->next];
+        n = g->nrows;
+        if ((z = zone(cs, g)) < 0) {
+            cs->skipped++;
+            continue;
+        }
+        memset(b, 0, sizeof(*b));
+        if (z > 0 && !g->nnull && !cs->decode) {
+            /* every row matches; nothing to read */
+            memset(cs->match, 1, n);
+            memset(cs->null, 0, n);
+            nmatch = n;
+        } else {
+            int codes = cs->decode || (z == 0 && !g->rle);
+            if (read_segment(cs, codes, &p) != QPE_OK) return QPerrno;
+            if (g->enc == ENC_PLAIN) {
+                decode_values(cs, p);
+                if (z > 0) {
+                    for (r = 0, nmatch = 0; r < n; r++) nmatch += cs->match[r] = !cs->null[r];
+                } else nmatch = plain_match(cs);
+            } else {
+                if (z > 0) {
+                    lo = 0;
+                    hi = UINT_MAX;
+                } else code_range(cs, &lo, &hi);
+                if (lo >= hi) {
+                    cs->skipped++;
+                    continue;
+                }
+                nmatch = 0;
+                if (z > 0) {
+                    for (r = 0; r < n; r++) nmatch += cs->match[r] = !cs->null[r];
+                } else if (!codes) {
+                    /* one test per run */
+                    const unsigned *run = (const unsigned *)p;
+                    int i;
+                    for (i = 0, r = 0; i < g->nruns; r += run[2*i+1], i++) {
+                        unsigned char m = run[2*i] - lo < hi - lo;
+                        memset(cs->match + r, m, run[2*i+1]);
+                    }
+                    for (r = 0; r < n; r++) nmatch += cs->match[r] &= !cs->null[r];
+                } else {
+                    unsigned w = hi - lo;
+                    for (r = 0; r < n; r++)
+                        nmatch += cs->match[r] = (cs->code[r] - lo < w) & !cs->null[r];
+                }
+                if (cs->decode) decode_values(cs, p);
+            }
+        }
+        if (nmatch == 0 && cs->scanop != QP_ALL) continue;
+        b->firstrow = g->firstrow;
+        b->nrows = n;
+        b->null = cs->null;
+        b->match = cs->match;
+        b->nmatch = nmatch;
+        if (cs->decode) {
+            if (cs->type == QP_INT) b->ival = cs->ivals;
+            else if (cs->type == QP_FLOAT) b->fval = cs->fvals;
+            else {
+                b->sval = cs->svals;
+                b->slen = cs->slens;
+            }
+        }
+        cs->next++;
+        return QPE_OK;
+    }
+    return QPE_EOF;
+}
+
+int QP_ColScanSkipped(QPcolscan *cs) {
+    return cs->skipped;
+}
+
+void QP_ColScanClose(QPcolscan *cs) {
+    free(cs->buf);
+    free(cs->value);
+    free(cs);
+}
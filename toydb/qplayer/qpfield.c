@@ -0,0 +1,134 @@
+/* qpfield.c
+ * Field access on ';'-delimited text records, plus the generic operator
+ * entry points (QP_Next / QP_Close / QP_PrintPlan) and error reporting.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qp.h"
+
+int QPerrno = QPE_OK;
+
+/* error messages, indexed by -QPerrno */
+static const char *QPerrormsg[] = {
+    "No error",
+    "end of input",
+    "no memory",
+    "PF/SP layer error",
+    "AM layer error",
+    "unix error",
+    "invalid argument"
+};
+
+void QP_PrintError(const char *s) {
+    int e = -QPerrno;
+    if (e < 0 || e >= (int)(sizeof(QPerrormsg) / sizeof(QPerrormsg[0])))
+        e = 0;
+    fprintf(stderr, "%s:%s\n", s, QPerrormsg[e]);
+}
+
+/* Return a pointer to the start of field number `field` (0-based) and set
+ * *flen to its length. Returns NULL if the record has fewer fields. */
+const char *QP_GetField(const char *rec, int reclen, int field, int *flen) {
+    const char *p = rec;
+    const char *end = rec + reclen;
+    const char *semi;
+
+    while (field > 0) {
+        semi = memchr(p, ';', end - p);
+        if (!semi) return NULL;
+        p = semi + 1;
+        field--;
+    }
+    semi = memchr(p, ';', end - p);
+    *flen = (int)((semi ? semi : end) - p);
+    return p;
+}
+
+int QP_FieldInt(const char *rec, int reclen, int field) {
+    char tmp[32];
+    int flen;
+    const char *f = QP_GetField(rec, reclen, field, &flen);
+    if (!f) return 0;
+    if (flen >= (int)sizeof(tmp)) flen = sizeof(tmp) - 1;
+    memcpy(tmp, f, flen);
+    tmp[flen] = '\0';
+    return atoi(tmp);
+}
+
+float QP_FieldFloat(const char *rec, int reclen, int field) {
+    char tmp[32];
+    int flen;
+    const char *f = QP_GetField(rec, reclen, field, &flen);
+    if (!f) return 0.0f;
+    if (flen >= (int)sizeof(tmp)) flen = sizeof(tmp) - 1;
+    memcpy(tmp, f, flen);
+    tmp[flen] = '\0';
+    return (float)atof(tmp);
+}
+
+/* Compare field1 of rec1 with field2 of rec2; returns <0, 0 or >0.
+ * A missing field sorts before any present one. */
+int QP_CompareField(const char *rec1, int len1, int field1,
+                    const char *rec2, int len2, int field2, char type) {
+    switch (type) {
+    case QP_INT: {
+        int a = QP_FieldInt(rec1, len1, field1);
+        int b = QP_FieldInt(rec2, len2, field2);
+        return (a > b) - (a < b);
+    }
+    case QP_FLOAT: {
+        float a = QP_FieldFloat(rec1, len1, field1);
+        float b = QP_FieldFloat(rec2, len2, field2);
+        return (a > b) - (a < b);
+    }
+    default: {
+        int la, lb, c;
+        const char *a = QP_GetField(rec1, len1, field1, &la);
+        const char *b = QP_GetField(rec2, len2, field2, &lb);
+        if (!a || !b) return (a != NULL) - (b != NULL);
+        c = memcmp(a, b, la < lb ? la : lb);
+        return c ? c : la - lb;
+    }
+    }
+}
+
+/******************** generic operator entry points ********************/
+
+int QP_Next(QPop *op, QPtuple *tup) {
+    int error = op->next(op, tup);
+    if (error == QPE_OK) op->nrows++;
+    else QPerrno = error;
+    return error;
+}
+
+void QP_Close(QPop *op) {
+    int i;
+    if (!op) return;
+    for (i = 0; i < 2; i++) QP_Close(op->child[i]);
+    if (op->close) op->close(op);
+    free(op);
+}
+
+void QP_PrintPlan(QPop *op, int depth) {
+    int i;
+    if (!op) return;
+    printf("%*s%s", depth * 2, "", op->name);
+    if (op->orderfield >= 0) printf(" order=%d", op->orderfield);
+    printf(" rows=%ld", op->nrows);
+    if (op->peakbytes) printf(" peak_bytes=%ld", op->peakbytes);
+    printf("\n");
+    for (i = 0; i < 2; i++) QP_PrintPlan(op->child[i], depth + 1);
+}
+
+/* Allocate an operator with zeroed private state of statesize bytes; the
+ * state lives in the same block, so QP_Close()'s free releases both. */
+QPop *QP_NewOp(const char *name, int statesize) {
+    QPop *op = (QPop *)calloc(1, sizeof(QPop) + statesize);
+    if (!op) { QPerrno = QPE_NOMEM; return NULL; }
+    op->name = name;
+    op->orderfield = -1;
+    op->state = op + 1;
+    return op;
+}
@@ -0,0 +1,454 @@
+/* qpjoin.c
+ * Join operators. Output tuples are the left record, ';', then the right
+ * record, so right-side field k is field (nfields(left) + k) of the result.
+ *
+ * Merge join: both inputs must be ascending on their join fields (an AM
+ * index scan or a Sort). The right input's run of equal keys is buffered so
+ * that duplicate keys on both sides produce their full cross product; this
+ * run is the only memory the join holds.
+ *
+ * Index nested-loop join: the inner side is an AM index on its join field
+ * plus the heap it points into. The naive form opens one AM equality scan
+ * per outer tuple. The batched form reads `batch` outer tuples, sorts their
+ * keys, looks them all up with one AM_BatchSearch pass (neighbouring keys
+ * share the root-to-leaf path) and fetches the matching heap records in
+ * rid order, so every inner heap page is read once per batch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qp.h"
+#include "am.h"
+
+/* growable copy of one record */
+typedef struct {
+    char *rec;
+    int reclen, cap;
+} recbuf_t;
+
+static int recbuf_set(recbuf_t *b, const char *rec, int reclen) {
+    if (reclen > b->cap) {
+        char *n = (char *)realloc(b->rec, reclen);
+        if (!n) return QPE_NOMEM;
+        b->rec = n;
+        b->cap = reclen;
+    }
+    memcpy(b->rec, rec, reclen);
+    b->reclen = reclen;
+    return QPE_OK;
+}
+
+/* write left;right into out */
+static int concat(recbuf_t *out, const char *l, int llen, const char *r, int rlen) {
+    int len = llen + 1 + rlen;
+    if (len > out->cap) {
+        char *n = (char *)realloc(out->rec, len);
+        if (!n) return QPE_NOMEM;
+        out->rec = n;
+        out->cap = len;
+    }
+    memcpy(out->rec, l, llen);
+    out->rec[llen] = ';';
+    memcpy(out->rec + llen + 1, r, rlen);
+    out->reclen = len;
+    return QPE_OK;
+}
+
+/******************** merge join ********************/
+
+typedef struct {
+    int lfield, rfield;
+    char type;
+    recbuf_t left;          /* current left tuple */
+    int haveleft;
+    recbuf_t right;         /* right tuple following the buffered run */
+    int haveright, righteof;
+    recbuf_t *run;          /* right tuples sharing the current key */
+    int nrun, caprun;
+    long runbytes;
+    int inrun;              /* left matches run; next output is run[pos] */
+    int pos;
+    recbuf_t out;
+} mergejoin_t;
+
+static int fetch(QPop *child, recbuf_t *b, int *have) {
+    QPtuple t;
+    int error = QP_Next(child, &t);
+    *have = 0;
+    if (error != QPE_OK) return error;
+    if ((error = recbuf_set(b, t.rec, t.reclen)) != QPE_OK) return error;
+    *have = 1;
+    return QPE_OK;
+}
+
+/* buffer every right tuple whose key equals the current right tuple's */
+static int load_run(QPop *op) {
+    mergejoin_t *st = (mergejoin_t *)op->state;
+    int error, have;
+
+    st->nrun = 0;
+    st->runbytes = 0;
+    do {
+        if (st->nrun == st->caprun) {
+            int cap = st->caprun ? 2 * st->caprun : 16;
+            recbuf_t *n = (recbuf_t *)realloc(st->run, cap * sizeof(recbuf_t));
+            if (!n) return QPE_NOMEM;
+            memset(n + st->caprun, 0, (cap - st->caprun) * sizeof(recbuf_t));
+            st->run = n;
+            st->caprun = cap;
+        }
+        if ((error = recbuf_set(&st->run[st->nrun], st->right.rec,
+                                st->right.reclen)) != QPE_OK)
+            return error;
+        st->runbytes += st->right.reclen;
+        st->nrun++;
+        error = fetch(op->child[1], &st->right, &have);
+        if (error == QPE_EOF) { st->haveright = 0; st->righteof = 1; break; }
+        if (error != QPE_OK) return error;
+        st->haveright = 1;
+    } while (QP_CompareField(st->right.rec, st->right.reclen, st->rfield,
+                             st->run[0].rec, st->run[0].reclen, st->rfield,
+                             st->type) == 0);
+    if (st->runbytes > op->peakbytes) op->peakbytes = st->runbytes;
+    return QPE_OK;
+}
+
+static int mergejoin_next(QPop *op, QPtuple *tup) {
+    mergejoin_t *st = (mergejoin_t *)op->state;
+    int error, c;
+
+    for (;;) {
+        if (st->inrun) {
+            if (st->pos < st->nrun) {
+                recbuf_t *r = &st->run[st->pos++];
+                if ((error = concat(&st->out, st->left.rec, st->left.reclen,
+                                    r->rec, r->reclen)) != QPE_OK)
+                    return error;
+                tup->rec = st->out.rec;
+                tup->reclen = st->out.reclen;
+                tup->rid.page = tup->rid.slot = -1;
+                return QPE_OK;
+            }
+            /* run exhausted for this left tuple: does the next one match? */
+            if ((error = fetch(op->child[0], &st->left, &st->haveleft)) != QPE_OK)
+                return error;
+            if (QP_CompareField(st->left.rec, st->left.reclen, st->lfield,
+                                st->run[0].rec, st->run[0].reclen, st->rfield,
+                                st->type) == 0) {
+                st->pos = 0;
+                continue;
+            }
+            st->inrun = 0;
+        }
+
+        if (!st->haveleft
+                && (error = fetch(op->child[0], &st->left, &st->haveleft)) != QPE_OK)
+            return error;
+        if (!st->haveright) {
+            if (st->righteof) return QPE_EOF;
+            if ((error = fetch(op->child[1], &st->right, &st->haveright)) != QPE_OK) {
+                if (error == QPE_EOF) st->righteof = 1;
+                return error;
+            }
+        }
+
+        c = QP_CompareField(st->left.rec, st->left.reclen, st->lfield,
+                            st->right.rec, st->right.reclen, st->rfield, st->type);
+        if (c < 0) {
+            st->haveleft = 0;
+        } else if (c > 0) {
+            st->haveright = 0;
+        } else {
+            if ((error = load_run(op)) != QPE_OK) return error;
+            st->inrun = 1;
+            st->pos = 0;
+        }
+    }
+}
+
+static void mergejoin_close(QPop *op) {
+    mergejoin_t *st = (mergejoin_t *)op->state;
+    int i;
+    for (i = 0; i < st->caprun; i++) free(st->run[i].rec);
+    free(st->run);
+    free(st->left.rec);
+    free(st->right.rec);
+    free(st->out.rec);
+}
+
+QPop *QP_MergeJoinOpen(QPop *left, int lfield, QPop *right, int rfield,
+                       char type) {
+    QPop *op;
+    mergejoin_t *st;
+
+    if (!left || !right) return NULL;
+    if (left->orderfield != lfield || right->orderfield != rfield
+            || left->orderdesc || right->orderdesc) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    if ((op = QP_NewOp("MergeJoin", sizeof(mergejoin_t))) == NULL) return NULL;
+    st = (mergejoin_t *)op->state;
+    st->lfield = lfield;
+    st->rfield = rfield;
+    st->type = type;
+    op->next = mergejoin_next;
+    op->close = mergejoin_close;
+    op->child[0] = left;
+    op->child[1] = right;
+    op->orderfield = lfield;
+    op->ordertype = type;
+    return op;
+}
+
+/******************** index nested-loop join ********************/
+
+typedef struct {
+    int recid;              /* packed inner heap rid */
+    int outer;              /* position of the outer tuple in the batch */
+} match_t;
+
+typedef struct {
+    int ofield;
+    int heapfd;
+    QPindex *idx;
+    int batch;              /* outer tuples per batch; <= 1 is naive */
+    int outereof;
+    char inner[QP_MAXREC];  /* current inner heap record */
+    recbuf_t out;
+    /* naive: current outer tuple and its open AM scan */
+    recbuf_t left;
+    int sd;
+    /* batched */
+    recbuf_t *outers;
+    int nouter;
+    int *order;             /* batch positions sorted on key */
+    char *keys;             /* keys in sorted order, idx->len bytes each */
+    int *counts;            /* # of inner matches per sorted key */
+    int *recids;
+    int caprecids;
+    match_t *matches;
+    int nmatch, capmatch, pos;
+} indexnl_t;
+
+/* qsort() has no context argument; the batch being sorted is kept here */
+static indexnl_t *sort_batch;
+
+static int compare_key(const char *a, const char *b, char type, int len) {
+    switch (type) {
+    case QP_INT: {
+        int x, y;
+        memcpy(&x, a, sizeof(int));
+        memcpy(&y, b, sizeof(int));
+        return (x > y) - (x < y);
+    }
+    case QP_FLOAT: {
+        float x, y;
+        memcpy(&x, a, sizeof(float));
+        memcpy(&y, b, sizeof(float));
+        return (x > y) - (x < y);
+    }
+    default:
+        return strncmp(a, b, len);  /* same as AM_Compare */
+    }
+}
+
+/* before sorting, keys[] holds the key of batch position i at slot i */
+static int order_cmp(const void *a, const void *b) {
+    indexnl_t *st = sort_batch;
+    int len = st->idx->len;
+    return compare_key(st->keys + *(const int *)a * len,
+                       st->keys + *(const int *)b * len, st->idx->type, len);
+}
+
+static int match_cmp(const void *a, const void *b) {
+    const match_t *x = (const match_t *)a, *y = (const match_t *)b;
+    if (x->recid != y->recid) return (x->recid > y->recid) - (x->recid < y->recid);
+    return x->outer - y->outer;
+}
+
+/* emit outer tuple `l` joined with the inner record at recid */
+static int emit_inner(indexnl_t *st, recbuf_t *l, int recid, QPtuple *tup) {
+    SPRID rid;
+    int reclen, error;
+
+    SP_IntToRid(recid, &rid);
+    if (SP_GetRec(st->heapfd, rid, st->inner, QP_MAXREC, &reclen) != 0)
+        return QPE_PF;
+    if ((error = concat(&st->out, l->rec, l->reclen, st->inner, reclen)) != QPE_OK)
+        return error;
+    tup->rec = st->out.rec;
+    tup->reclen = st->out.reclen;
+    tup->rid.page = tup->rid.slot = -1;
+    return QPE_OK;
+}
+
+static int naive_next(QPop *op, QPtuple *tup) {
+    indexnl_t *st = (indexnl_t *)op->state;
+    char key[QP_MAXKEY];
+    int error, recid, have;
+
+    for (;;) {
+        if (st->sd >= 0) {
+            recid = AM_FindNextEntry(st->sd);
+            if (recid >= 0) return emit_inner(st, &st->left, recid, tup);
+            AM_CloseIndexScan(st->sd);
+            st->sd = -1;
+            if (recid != AME_EOF) return QPE_AM;
+        }
+        if ((error = fetch(op->child[0], &st->left, &have)) != QPE_OK)
+            return error;
+        QP_MakeKey(st->left.rec, st->left.reclen, st->ofield, st->idx->type,
+                   st->idx->len, st->idx->desc, key);
+        st->sd = AM_OpenIndexScan(st->idx->fd, st->idx->type, st->idx->len,
+                                  QP_EQ, key);
+        AM_EmptyStack();
+        if (st->sd < 0) return QPE_AM;
+    }
+}
+
+/* read the next batch of outer tuples and resolve all their matches */
+static int load_batch(QPop *op) {
+    indexnl_t *st = (indexnl_t *)op->state;
+    int len = st->idx->len;
+    char *sorted;
+    long bytes = 0;
+    int i, j, k, done, n, have, error = QPE_OK;
+
+    st->nouter = st->nmatch = st->pos = 0;
+    while (st->nouter < st->batch) {
+        recbuf_t *b = &st->outers[st->nouter];
+        if ((error = fetch(op->child[0], b, &have)) != QPE_OK) break;
+        QP_MakeKey(b->rec, b->reclen, st->ofield, st->idx->type, len,
+                   st->idx->desc, st->keys + st->nouter * len);
+        st->order[st->nouter] = st->nouter;
+        bytes += b->reclen;
+        st->nouter++;
+    }
+    if (error != QPE_OK && error != QPE_EOF) return error;
+    if (st->nouter == 0) return QPE_EOF;
+
+    /* sort batch positions on key, then lay the keys out in that order */
+    sort_batch = st;
+    qsort(st->order, st->nouter, sizeof(int), order_cmp);
+    if ((sorted = (char *)malloc((size_t)st->nouter * len)) == NULL)
+        return QPE_NOMEM;
+    for (i = 0; i < st->nouter; i++)
+        memcpy(sorted + i * len, st->keys + st->order[i] * len, len);
+    memcpy(st->keys, sorted, (size_t)st->nouter * len);
+    free(sorted);
+
+    for (done = 0; done < st->nouter; done += n) {
+        n = AM_BatchSearch(st->idx->fd, st->idx->type, len,
+                           st->keys + done * len, st->nouter - done,
+                           st->recids, st->caprecids, st->counts + done);
+        if (n == AME_INVALIDVALUE) {
+            /* one key has more matches than recids can hold */
+            int *r = (int *)realloc(st->recids, 2 * st->caprecids * sizeof(int));
+            if (!r) return QPE_NOMEM;
+            st->recids = r;
+            st->caprecids *= 2;
+            n = 0;
+            continue;
+        }
+        if (n < 0) return QPE_AM;
+        for (i = done, k = 0; i < done + n; i++)
+            for (j = 0; j < st->counts[i]; j++, k++) {
+                if (st->nmatch == st->capmatch) {
+                    int cap = st->capmatch ? 2 * st->capmatch : 1024;
+                    match_t *m = (match_t *)realloc(st->matches,
+                                                    cap * sizeof(match_t));
+                    if (!m) return QPE_NOMEM;
+                    st->matches = m;
+                    st->capmatch = cap;
+                }
+                st->matches[st->nmatch].recid = st->recids[k];
+                st->matches[st->nmatch].outer = st->order[i];
+                st->nmatch++;
+            }
+    }
+
+    /* visit the inner heap in page order */
+    qsort(st->matches, st->nmatch, sizeof(match_t), match_cmp);
+    bytes += (long)st->nmatch * sizeof(match_t);
+    if (bytes > op->peakbytes) op->peakbytes = bytes;
+    return QPE_OK;
+}
+
+static int batch_next(QPop *op, QPtuple *tup) {
+    indexnl_t *st = (indexnl_t *)op->state;
+    match_t *m;
+    int error;
+
+    while (st->pos >= st->nmatch) {
+        if (st->outereof) return QPE_EOF;
+        if ((error = load_batch(op)) == QPE_EOF) st->outereof = 1;
+        if (error != QPE_OK) return error;
+        if (st->nouter < st->batch) st->outereof = 1;
+    }
+    m = &st->matches[st->pos++];
+    return emit_inner(st, &st->outers[m->outer], m->recid, tup);
+}
+
+static void indexnl_close(QPop *op) {
+    indexnl_t *st = (indexnl_t *)op->state;
+    int i;
+    if (st->sd >= 0) AM_CloseIndexScan(st->sd);
+    if (st->outers)
+        for (i = 0; i < st->batch; i++) free(st->outers[i].rec);
+    free(st->outers);
+    free(st->order);
+    free(st->keys);
+    free(st->counts);
+    free(st->recids);
+    free(st->matches);
+    free(st->left.rec);
+    free(st->out.rec);
+}
+
+QPop *QP_IndexNLJoinOpen(QPop *outer, int ofield, int heapfd, QPindex *idx,
+                         int batch) {
+    QPop *op;
+    indexnl_t *st;
+
+    if (!outer) return NULL;
+    if (!idx) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    if ((op = QP_NewOp(batch > 1 ? "BatchIndexNLJoin" : "IndexNLJoin",
+                       sizeof(indexnl_t))) == NULL)
+        return NULL;
+    st = (indexnl_t *)op->state;
+    st->ofield = ofield;
+    st->heapfd = heapfd;
+    st->idx = idx;
+    st->batch = batch;
+    st->sd = -1;
+    op->close = indexnl_close;
+    op->child[0] = outer;
+    if (batch > 1) {
+        st->caprecids = batch;
+        st->outers = (recbuf_t *)calloc(batch, sizeof(recbuf_t));
+        st->order = (int *)malloc(batch * sizeof(int));
+        st->keys = (char *)malloc((size_t)batch * idx->len);
+        st->counts = (int *)malloc(batch * sizeof(int));
+        st->recids = (int *)malloc(st->caprecids * sizeof(int));
+        if (!st->outers || !st->order || !st->keys || !st->counts
+                || !st->recids) {
+            QPerrno = QPE_NOMEM;
+            op->child[0] = NULL;
+            QP_Close(op);
+            return NULL;
+        }
+        op->next = batch_next;
+    } else {
+        op->next = naive_next;
+        /* inner matches follow each outer tuple in outer order */
+        op->orderfield = outer->orderfield;
+        op->ordertype = outer->ordertype;
+        op->orderdesc = outer->orderdesc;
+    }
+    return op;
+}
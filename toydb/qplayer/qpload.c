@@ -0,0 +1,380 @@
+/* qpload.c
+ * Bulk loader: a memory-mapped data file is cut into chunks at line
+ * boundaries, worker threads find the lines and fields of a chunk with
+ * memchr (vectorised in libc) and encode the index keys, and the calling
+ * thread is the single writer that appends the records to the heap in file
+ * order and collects (key, rid) pairs. Each index is then sorted and built
+ * bottom up with AM_BulkLoad instead of one AM_InsertEntry per record.
+ *
+ * Workers stay at most a few chunks ahead of the writer, so only that many
+ * parsed chunks are held in memory at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "qp.h"
+
+#define AHEAD	2	/* chunks a worker may parse ahead, per worker */
+
+/* a record of a parsed chunk: offset into the chunk and length */
+typedef struct {
+    int off, len;
+} line_t;
+
+typedef struct {
+    const char *start;
+    int size;
+    int nrecs;
+    line_t *lines;
+    char *keys;             /* keys of index i start at keys + keyoff(i) * keycap */
+    int keycap;             /* records the keys were laid out for */
+    int done;               /* parsed (or failed) */
+} chunk_t;
+
+typedef struct {
+    chunk_t *chunks;
+    int nchunks;
+    int claimed;            /* chunks handed to workers */
+    int written;            /* chunks the writer is done with */
+    int window;             /* workers stay below written + window */
+    int error;
+    const QPloadindex *idx;
+    int nidx;
+    double parsems;         /* CPU time of the workers */
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+} loader_t;
+
+/* keys of one index collected by the writer */
+typedef struct {
+    char *keys;
+    int *rids;
+    long n, cap;
+} keyset_t;
+
+/* find the records of c and encode their keys; QPE_NOMEM or QPE_OK */
+static int parse_chunk(loader_t *ld, chunk_t *c) {
+    const char *p = c->start, *end = c->start + c->size, *nl;
+    int cap = 0, keylen = 0, i, L;
+
+    for (i = 0; i < ld->nidx; i++) keylen += ld->idx[i].len;
+    while (p < end) {
+        nl = memchr(p, '\n', end - p);
+        L = (int)((nl ? nl : end) - p);
+        while (L > 0 && p[L-1] == '\r') L--;
+        if (L > 0 && L <= QP_MAXREC && memchr(p, ';', L)) {
+            if (c->nrecs == cap) {
+                line_t *lines;
+                char *keys;
+                cap = cap ? 2 * cap : 1024;
+                if (!(lines = realloc(c->lines, cap * sizeof(line_t))))
+                    return QPE_NOMEM;
+                c->lines = lines;
+                if (keylen && !(keys = realloc(c->keys, (size_t)cap * keylen)))
+                    return QPE_NOMEM;
+                if (keylen) c->keys = keys;
+            }
+            c->lines[c->nrecs].off = (int)(p - c->start);
+            c->lines[c->nrecs].len = L;
+            c->nrecs++;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    /* keys of an index are adjacent, so the writer copies them in one go */
+    c->keycap = cap;
+    for (i = 0, keylen = 0; i < ld->nidx; i++) {
+        const QPloadindex *x = &ld->idx[i];
+        char *k = c->keys + (size_t)keylen * cap;
+        int r;
+        for (r = 0; r < c->nrecs; r++, k += x->len)
+            QP_MakeKey(c->start + c->lines[r].off, c->lines[r].len, x->field,
+                x->type, x->len, x->desc, k);
+        keylen += x->len;
+    }
+    return QPE_OK;
+}
+
+static void *worker(void *arg) {
+    loader_t *ld = arg;
+    struct timespec t0, t1;
+    int n, error;
+
+    for (;;) {
+        pthread_mutex_lock(&ld->mu);
+        while (!ld->error && ld->claimed < ld->nchunks
+                && ld->claimed >= ld->written + ld->window)
+            pthread_cond_wait(&ld->cv, &ld->mu);
+        if (ld->error || ld->claimed == ld->nchunks) {
+            pthread_mutex_unlock(&ld->mu);
+            return NULL;
+        }
+        n = ld->claimed++;
+        pthread_mutex_unlock(&ld->mu);
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+        error = parse_chunk(ld, &ld->chunks[n]);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+
+        pthread_mutex_lock(&ld->mu);
+        ld->parsems += PF_MsBetween(t0, t1);
+        ld->chunks[n].done = 1;
+        if (error != QPE_OK) ld->error = error;
+        pthread_cond_broadcast(&ld->cv);
+        pthread_mutex_unlock(&ld->mu);
+    }
+}
+
+static int add_keys(keyset_t *ks, const char *keys, int len, const int *rids,
+                    int n) {
+    if (ks->n + n > ks->cap) {
+        long cap = ks->cap ? ks->cap : 4096;
+        char *k;
+        int *r;
+        while (cap < ks->n + n) cap *= 2;
+        if (!(k = realloc(ks->keys, (size_t)cap * len))) return QPE_NOMEM;
+        ks->keys = k;
+        if (!(r = realloc(ks->rids, cap * sizeof(int)))) return QPE_NOMEM;
+        ks->rids = r;
+        ks->cap = cap;
+    }
+    memcpy(ks->keys + (size_t)ks->n * len, keys, (size_t)n * len);
+    memcpy(ks->rids + ks->n, rids, n * sizeof(int));
+    ks->n += n;
+    return QPE_OK;
+}
+
+/* qsort context: the keyset being sorted */
+static const keyset_t *sort_keys;
+static const QPloadindex *sort_idx;
+
+/* key order as AM_Compare sees it, then rid, which keeps each key's rids
+   in heap order */
+static int cmp_entry(const void *a, const void *b) {
+    int i = *(const int *)a, j = *(const int *)b, c;
+    const char *x = sort_keys->keys + (size_t)i * sort_idx->len;
+    const char *y = sort_keys->keys + (size_t)j * sort_idx->len;
+
+    switch (sort_idx->type) {
+    case QP_INT: {
+        int u, v;
+        memcpy(&u, x, sizeof(int));
+        memcpy(&v, y, sizeof(int));
+        c = (u > v) - (u < v);
+        break;
+    }
+    case QP_FLOAT: {
+        float u, v;
+        memcpy(&u, x, sizeof(float));
+        memcpy(&v, y, sizeof(float));
+        c = (u > v) - (u < v);
+        break;
+    }
+    default:
+        c = strncmp(x, y, sort_idx->len);
+        break;
+    }
+    if (c) return c;
+    return (sort_keys->rids[i] > sort_keys->rids[j])
+        - (sort_keys->rids[i] < sort_keys->rids[j]);
+}
+
+/* sort ks and build index x on heapname from it */
+static int build_index(const char *heapname, const QPloadindex *x,
+                       const keyset_t *ks) {
+    char idxname[QP_MAXNAME + 8];
+    int *order, *rids;
+    char *keys;
+    long i;
+    int fd, error = QPE_OK;
+
+    order = malloc((ks->n ? ks->n : 1) * sizeof(int));
+    rids = malloc((ks->n ? ks->n : 1) * sizeof(int));
+    keys = malloc((size_t)(ks->n ? ks->n : 1) * x->len);
+    if (!order || !rids || !keys) {
+        free(order);
+        free(rids);
+        free(keys);
+        return QPE_NOMEM;
+    }
+    for (i = 0; i < ks->n; i++) order[i] = i;
+    sort_keys = ks;
+    sort_idx = x;
+    qsort(order, ks->n, sizeof(int), cmp_entry);
+    for (i = 0; i < ks->n; i++) {
+        memcpy(keys + (size_t)i * x->len, ks->keys + (size_t)order[i] * x->len,
+            x->len);
+        rids[i] = ks->rids[order[i]];
+    }
+    free(order);
+
+    AM_DestroyIndex((char *)heapname, x->indexno);
+    if (AM_CreateIndex((char *)heapname, x->indexno, x->type, x->len) != 0)
+        error = QPE_AM;
+    else {
+        snprintf(idxname, sizeof(idxname), "%s.%d", heapname, x->indexno);
+        if ((fd = PF_OpenFile(idxname)) < 0) error = QPE_PF;
+        else {
+            if (AM_BulkLoad(fd, x->type, x->len, keys, rids, ks->n) != 0)
+                error = QPE_AM;
+            if (PF_CloseFile(fd) != PFE_OK && error == QPE_OK) error = QPE_PF;
+        }
+    }
+    free(keys);
+    free(rids);
+    return error;
+}
+
+/* append the records of c to the heap and their keys to ks */
+static int write_chunk(loader_t *ld, chunk_t *c, int heapfd, keyset_t *ks,
+                       int **rids, int *ridcap) {
+    SPRID rid;
+    int r, i, keyoff = 0;
+
+    if (c->nrecs > *ridcap) {
+        int *p = realloc(*rids, c->nrecs * sizeof(int));
+        if (!p) return QPE_NOMEM;
+        *rids = p;
+        *ridcap = c->nrecs;
+    }
+    for (r = 0; r < c->nrecs; r++) {
+        if (SP_AppendRec(heapfd, c->start + c->lines[r].off, c->lines[r].len,
+                &rid) != 0)
+            return QPE_PF;
+        (*rids)[r] = SP_RidToInt(rid);
+    }
+    for (i = 0; i < ld->nidx; i++) {
+        if (add_keys(&ks[i], c->keys + (size_t)keyoff * c->keycap,
+                ld->idx[i].len, *rids, c->nrecs) != QPE_OK)
+            return QPE_NOMEM;
+        keyoff += ld->idx[i].len;
+    }
+    return QPE_OK;
+}
+
+int QP_BulkLoad(const char *datafile, const char *heapname, int nthreads,
+                const QPloadindex *idx, int nidx, QPloadstats *st) {
+    loader_t ld;
+    keyset_t ks[QP_MAXINDEX];
+    pthread_t tid[64];
+    struct stat sb;
+    struct timespec t0, t1, t2;
+    const char *base = NULL, *p, *end;
+    int *rids = NULL, ridcap = 0;
+    int fd, heapfd = -1, i, n, nstarted = 0, error = QPE_OK;
+    long nrecs = 0;
+
+    if (nidx < 0 || nidx > QP_MAXINDEX) return (QPerrno = QPE_INVALIDARG);
+    for (i = 0; i < nidx; i++)
+        if (idx[i].desc && idx[i].type == QP_CHAR)
+            return (QPerrno = QPE_INVALIDARG);
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > (int)(sizeof(tid) / sizeof(tid[0])))
+        nthreads = sizeof(tid) / sizeof(tid[0]);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if ((fd = open(datafile, O_RDONLY)) < 0) return (QPerrno = QPE_UNIX);
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return (QPerrno = QPE_UNIX);
+    }
+    if (sb.st_size > 0) {
+        base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return (QPerrno = QPE_UNIX);
+        }
+        madvise((void *)base, sb.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    /* chunks end just after a '\n' (or at the end of the file) */
+    memset(&ld, 0, sizeof(ld));
+    n = (int)(sb.st_size / QP_LOADCHUNK) + 1;
+    if (!(ld.chunks = calloc(n, sizeof(chunk_t)))) {
+        if (base) munmap((void *)base, sb.st_size);
+        return (QPerrno = QPE_NOMEM);
+    }
+    for (p = base, end = base + sb.st_size; p < end; ld.nchunks++) {
+        const char *e = p + QP_LOADCHUNK < end ? p + QP_LOADCHUNK : end;
+        const char *nl = e < end ? memchr(e, '\n', end - e) : NULL;
+        if (e < end) e = nl ? nl + 1 : end;
+        ld.chunks[ld.nchunks].start = p;
+        ld.chunks[ld.nchunks].size = (int)(e - p);
+        p = e;
+    }
+    ld.window = AHEAD * nthreads;
+    ld.idx = idx;
+    ld.nidx = nidx;
+    pthread_mutex_init(&ld.mu, NULL);
+    pthread_cond_init(&ld.cv, NULL);
+    memset(ks, 0, sizeof(ks));
+
+    PF_DestroyFile((char *)heapname);
+    if (SP_CreateFile(heapname) != PFE_OK || (heapfd = SP_OpenFile(heapname)) < 0)
+        error = QPE_PF;
+    for (i = 0; error == QPE_OK && i < nthreads; i++, nstarted++)
+        if (pthread_create(&tid[i], NULL, worker, &ld) != 0) {
+            if (i == 0) error = QPE_UNIX;
+            break;
+        }
+
+    /* the writer takes the chunks in file order */
+    for (n = 0; error == QPE_OK && n < ld.nchunks; n++) {
+        chunk_t *c = &ld.chunks[n];
+        pthread_mutex_lock(&ld.mu);
+        while (!c->done && !ld.error) pthread_cond_wait(&ld.cv, &ld.mu);
+        error = ld.error;
+        pthread_mutex_unlock(&ld.mu);
+        if (error == QPE_OK) error = write_chunk(&ld, c, heapfd, ks, &rids, &ridcap);
+        nrecs += c->nrecs;
+        free(c->lines);
+        free(c->keys);
+        c->lines = NULL;
+        c->keys = NULL;
+
+        pthread_mutex_lock(&ld.mu);
+        ld.written++;
+        if (error != QPE_OK) ld.error = error;
+        pthread_cond_broadcast(&ld.cv);
+        pthread_mutex_unlock(&ld.mu);
+    }
+    for (i = 0; i < nstarted; i++) pthread_join(tid[i], NULL);
+    for (n = 0; n < ld.nchunks; n++) {
+        free(ld.chunks[n].lines);
+        free(ld.chunks[n].keys);
+    }
+    free(ld.chunks);
+    free(rids);
+    if (base) munmap((void *)base, sb.st_size);
+    pthread_mutex_destroy(&ld.mu);
+    pthread_cond_destroy(&ld.cv);
+    if (heapfd >= 0 && SP_CloseFile(heapfd) != PFE_OK && error == QPE_OK)
+        error = QPE_PF;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (i = 0; i < nidx; i++) {
+        if (error == QPE_OK) error = build_index(heapname, &idx[i], &ks[i]);
+        free(ks[i].keys);
+        free(ks[i].rids);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    if (st) {
+        st->bytes = sb.st_size;
+        st->nrecs = nrecs;
+        st->nchunks = ld.nchunks;
+        st->parsems = ld.parsems;
+        st->heapms = PF_MsBetween(t0, t1);
+        st->indexms = PF_MsBetween(t1, t2);
+        st->totalms = PF_MsBetween(t0, t2);
+    }
+    if (error != QPE_OK) return (QPerrno = error);
+    return (int)nrecs;
+}
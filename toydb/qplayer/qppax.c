@@ -0,0 +1,162 @@
+/* qppax.c
+ * Heaps in PAX pages (pxlayer.c) typed by a schema, and the scan that
+ * reads only some of their columns.
+ *
+ * A row scan of an SP heap copies every record whole; a PaxScan reads the
+ * minipages of the requested columns and builds each tuple from those
+ * values alone, so the bytes it touches grow with the columns asked for,
+ * not with the width of the row.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qp.h"
+
+/* PAX column widths of schema s */
+static void pax_widths(const QPschema *s, int *widths) {
+    int c;
+    for (c = 0; c < s->ncols; c++)
+        widths[c] = s->width[c] > 0 ? s->width[c] : 1;
+}
+
+int QP_LoadPaxHeap(const char *datafile, const char *paxname,
+                   const QPschema *s, int maxrecs) {
+    FILE *f;
+    char *line = NULL, tup[QP_MAXREC], pad[QP_MAXREC];
+    const char *vals[QP_MAXFIELDS];
+    int widths[QP_MAXFIELDS];
+    size_t cap = 0;
+    int fd, n = 0, len, c, padlen, L;
+
+    if ((f = fopen(datafile, "r")) == NULL) return (QPerrno = QPE_UNIX);
+    pax_widths(s, widths);
+    PF_DestroyFile((char *)paxname);
+    if (PX_CreateFile(paxname, s->ncols, widths) != 0
+            || (fd = PX_OpenFile(paxname)) < 0) {
+        fclose(f);
+        return (QPerrno = QPE_PF);
+    }
+    while ((maxrecs <= 0 || n < maxrecs) && (L = QP_ReadLine(f, &line, &cap)) >= 0) {
+        if ((len = QP_EncodeTuple(s, line, L, tup)) < 0) {
+            n = QPerrno = len;
+            break;
+        }
+        /* int and float values are used in place, char values padded */
+        padlen = 0;
+        for (c = 0; c < s->ncols; c++) {
+            if (QP_TupleIsNull(s, tup, c)) vals[c] = NULL;
+            else if (s->type[c] != QP_CHAR) vals[c] = tup + s->fixedoff[c];
+            else {
+                const char *v = QP_TupleChar(s, tup, c, &len);
+                if (len > widths[c]) len = widths[c];
+                memset(pad + padlen, 0, widths[c]);
+                memcpy(pad + padlen, v, len);
+                vals[c] = pad + padlen;
+                padlen += widths[c];
+            }
+        }
+        if (PX_AppendRow(fd, vals) != 0) {
+            n = QPerrno = QPE_PF;
+            break;
+        }
+        n++;
+    }
+    free(line);
+    fclose(f);
+    if (PX_CloseFile(fd) != PFE_OK) return (QPerrno = QPE_PF);
+    return n;
+}
+
+/******************** PAX scan ********************/
+
+typedef struct {
+    const QPschema *schema;
+    PXscan *scan;
+    int ncols;
+    int cols[QP_MAXFIELDS];
+    char empty[QP_MAXREC];  /* a tuple with every field null */
+    int emptylen;
+    char buf[QP_MAXREC];    /* current tuple */
+} paxscan_t;
+
+static int paxscan_next(QPop *op, QPtuple *tup) {
+    paxscan_t *st = (paxscan_t *)op->state;
+    const QPschema *s = st->schema;
+    const char *vals[QP_MAXFIELDS];
+    unsigned short off, end;
+    int i, c, n, len, error;
+
+    if ((error = PX_ScanNext(st->scan, vals)) == PFE_EOF) return QPE_EOF;
+    if (error != 0) return QPE_PF;
+    memcpy(st->buf, st->empty, st->emptylen);
+    n = st->emptylen;
+    for (i = 0; i < st->ncols; i++) {
+        c = st->cols[i];
+        if (!vals[i]) continue;
+        st->buf[c / 8] &= ~(1 << (c % 8));
+        if (s->type[c] != QP_CHAR) {
+            memcpy(st->buf + s->fixedoff[c], vals[i], 4);
+            continue;
+        }
+        /* char columns are filled in column order, so this one's bytes go
+           at the end and the later ones start after them */
+        len = strnlen(vals[i], s->width[c]);
+        memcpy(&off, st->buf + s->fixedoff[c], sizeof(off));
+        memmove(st->buf + off + len, st->buf + off, n - off);
+        memcpy(st->buf + off, vals[i], len);
+        n += len;
+        for (off = s->fixedoff[c] + sizeof(off);
+                off <= s->varstart + s->nvar * sizeof(off); off += sizeof(off)) {
+            memcpy(&end, st->buf + off, sizeof(end));
+            end += len;
+            memcpy(st->buf + off, &end, sizeof(end));
+        }
+    }
+    tup->rec = st->buf;
+    tup->reclen = n;
+    tup->rid.page = -1;
+    tup->rid.slot = 0;
+    return QPE_OK;
+}
+
+static void paxscan_close(QPop *op) {
+    PX_ScanClose(((paxscan_t *)op->state)->scan);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+QPop *QP_PaxScanOpen(int paxfd, const QPschema *s, const int *cols, int ncols) {
+    QPop *op;
+    paxscan_t *st;
+    int c;
+
+    if (ncols < 0 || ncols > s->ncols) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    if ((op = QP_NewOp("PaxScan", sizeof(paxscan_t))) == NULL) return NULL;
+    st = (paxscan_t *)op->state;
+    st->schema = s;
+    st->ncols = ncols;
+    memcpy(st->cols, cols, ncols * sizeof(int));
+    qsort(st->cols, ncols, sizeof(int), cmp_int);
+    if (PX_ScanOpen(paxfd, st->cols, ncols, &st->scan) != 0) {
+        free(op);
+        QPerrno = QPE_PF;
+        return NULL;
+    }
+    /* all null: every bitmap bit set, every char column empty */
+    memset(st->empty, 0, s->varstart);
+    for (c = 0; c < s->ncols; c++) st->empty[c / 8] |= 1 << (c % 8);
+    st->emptylen = s->varstart + (s->nvar + 1) * sizeof(unsigned short);
+    for (c = 0; c <= s->nvar; c++) {
+        unsigned short off = st->emptylen;
+        memcpy(st->empty + s->varstart + c * sizeof(off), &off, sizeof(off));
+    }
+    op->next = paxscan_next;
+    op->close = paxscan_close;
+    return op;
+}
@@ -0,0 +1,141 @@
+/* qpplan.c
+ * Plan selection. The layer has two ways to get a join input ordered on
+ * its join field: an AM index scan on that field, or a Sort over a heap
+ * scan. The planner uses an index whenever one exists so that no sort
+ * memory or run files are needed, and falls back to sorting otherwise.
+ *
+ * Selections are costed from the QP_Analyze statistics in page reads:
+ *  - heap scan:   every heap page
+ *  - index scan:  the tree height, the matching fraction of the leaves and
+ *                 one heap read per heap page change in key order, which
+ *                 the index's clustering factor gives
+ *  - bitmap scan: the same index pages, then each distinct heap page once
+ *                 (QP_EstimatePages)
+ * plus a small per-row CPU charge.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "qp.h"
+
+#define QP_CPU_ROW	0.001	/* cost of handling a row, in page reads */
+
+/* an input of t ascending on field; *sorted is set if a Sort was needed */
+static QPop *ordered_input(QPtable *t, int field, char type, long membytes,
+                           int *sorted) {
+    QPindex *idx = QP_FindIndex(t, field, 0);
+    QPop *scan, *sort;
+
+    if (idx && idx->type == type) {
+        *sorted = 0;
+        return QP_IndexScanOpen(t->heapfd, idx, QP_ALL, NULL);
+    }
+    *sorted = 1;
+    if ((scan = QP_HeapScanOpen(t->heapfd)) == NULL) return NULL;
+    /* an operator that fails to open leaves its input to the caller */
+    if ((sort = QP_SortOpen(scan, field, type, 0, membytes)) == NULL)
+        QP_Close(scan);
+    return sort;
+}
+
+/* Plan left JOIN right ON left.lfield = right.rfield. *method is set to
+ * QP_JOIN_MERGE when both sides come from indexes, QP_JOIN_SORTMERGE
+ * otherwise. */
+QPop *QP_PlanJoin(QPtable *left, int lfield, QPtable *right, int rfield,
+                  char type, long membytes, int *method) {
+    QPop *l, *r, *join;
+    int lsorted, rsorted;
+
+    if ((l = ordered_input(left, lfield, type, membytes, &lsorted)) == NULL)
+        return NULL;
+    if ((r = ordered_input(right, rfield, type, membytes, &rsorted)) == NULL) {
+        QP_Close(l);
+        return NULL;
+    }
+    if ((join = QP_MergeJoinOpen(l, lfield, r, rfield, type)) == NULL) {
+        QP_Close(l);
+        QP_Close(r);
+        return NULL;
+    }
+    if (method) *method = (lsorted || rsorted) ? QP_JOIN_SORTMERGE : QP_JOIN_MERGE;
+    return join;
+}
+
+/* First n rows of t in (field, desc) order. An index scanning in that
+ * direction makes the Top-N a Limit that stops the scan after n rows;
+ * without one the whole heap goes through the bounded heap. */
+QPop *QP_PlanTopN(QPtable *t, int field, char type, int desc, int n) {
+    QPindex *idx = QP_FindIndex(t, field, desc != 0);
+    QPop *in, *topn;
+
+    if (idx && idx->type == type)
+        in = QP_IndexScanOpen(t->heapfd, idx, QP_ALL, NULL);
+    else
+        in = QP_HeapScanOpen(t->heapfd);
+    if (!in) return NULL;
+    if ((topn = QP_TopNOpen(in, field, type, desc, n)) == NULL) QP_Close(in);
+    return topn;
+}
+
+/* fill est with the cost of each access path for field `scanop` value */
+static void cost_select(QPtable *t, QPindex *idx, int field, int scanop,
+                        const char *value, QPcost *est) {
+    double n = t->stats.nrows, P = t->stats.npages, rows, sel, probe, pages;
+    int i;
+
+    for (i = 0; i < QP_NPATHS; i++) est->cost[i] = -1;
+    rows = est->rows = QP_EstimateRows(t, field, scanop, value);
+    est->cost[QP_PATH_HEAP] = P + n * QP_CPU_ROW;
+    est->best = QP_PATH_HEAP;
+    if (!idx) return;
+
+    sel = n > 0 ? rows / n : 0;
+    probe = idx->height + ceil(sel * idx->nleaves);
+    est->cost[QP_PATH_INDEX] = probe + sel * idx->clusterfactor
+        + rows * QP_CPU_ROW;
+    pages = QP_EstimatePages(t, field, scanop, value);
+    if (sel * idx->clusterfactor < pages) pages = sel * idx->clusterfactor;
+    est->cost[QP_PATH_BITMAP] = probe + pages + 2 * rows * QP_CPU_ROW;
+
+    for (i = 0; i < QP_NPATHS; i++)
+        if (est->cost[i] < est->cost[est->best]) est->best = i;
+}
+
+QPop *QP_PlanSelect(QPtable *t, int field, char type, int scanop,
+                    const char *value, int path, QPcost *est) {
+    QPindex *idx = QP_FindIndex(t, field, 0);
+    char key[QP_MAXKEY];
+    QPcost c;
+    QPop *scan, *filter;
+
+    if (idx && idx->type != type) idx = NULL;
+    if (t->stats.analyzed) {
+        cost_select(t, idx, field, scanop, value, &c);
+    } else {
+        /* no statistics: an index for equality, a heap scan otherwise */
+        memset(&c, 0, sizeof(c));
+        c.rows = -1;
+        c.best = idx && scanop == QP_EQ ? QP_PATH_INDEX : QP_PATH_HEAP;
+        c.cost[QP_PATH_HEAP] = c.cost[QP_PATH_INDEX] = c.cost[QP_PATH_BITMAP] = -1;
+    }
+    if (est) *est = c;
+    if (path < 0) path = c.best;
+
+    if (path == QP_PATH_HEAP || scanop == QP_ALL) {
+        if ((scan = QP_HeapScanOpen(t->heapfd)) == NULL || scanop == QP_ALL)
+            return scan;
+        if ((filter = QP_FilterOpen(scan, field, type, scanop, value)) == NULL)
+            QP_Close(scan);
+        return filter;
+    }
+    if (!idx) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    QP_MakeKey(value, strlen(value), 0, type, idx->len, 0, key);
+    return path == QP_PATH_INDEX
+        ? QP_IndexScanOpen(t->heapfd, idx, scanop, key)
+        : QP_BitmapScanOpen(t->heapfd, idx, scanop, key);
+}
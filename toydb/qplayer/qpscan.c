@@ -0,0 +1,312 @@
+/* qpscan.c
+ * Leaf operators: a sequential scan of an SP heap file, an AM index scan
+ * that returns heap records in key order by following each entry's packed
+ * rid into the heap, and a bitmap scan that collects the rids of an index
+ * range first and visits the heap in rid order. The heap scan, and an
+ * index scan that collects its rids like the bitmap scan, also read MVCC
+ * heaps (spmvcc.c) as of a snapshot. Also the Filter operator that
+ * applies a single-field predicate to its input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qp.h"
+#include "am.h"
+
+/******************** heap scan ********************/
+
+typedef struct {
+    SPscan *scan;
+    char *cur;      /* record returned by the last SP_ScanNext */
+    SPmvccscan *mvscan; /* instead of scan, for an MVCC heap */
+} heapscan_t;
+
+static int heapscan_next(QPop *op, QPtuple *tup) {
+    heapscan_t *st = (heapscan_t *)op->state;
+    int error;
+
+    if (st->mvscan) {
+        error = SP_MvccScanNext(st->mvscan, &tup->rec, &tup->reclen, &tup->rid);
+        if (error == PFE_EOF) return QPE_EOF;
+        return error == 0 ? QPE_OK : QPE_PF;
+    }
+    free(st->cur);
+    st->cur = NULL;
+    error = SP_ScanNext(st->scan, &tup->rec, &tup->reclen, &tup->rid);
+    if (error == PFE_EOF) return QPE_EOF;
+    if (error != 0) return QPE_PF;
+    st->cur = tup->rec;
+    return QPE_OK;
+}
+
+static void heapscan_close(QPop *op) {
+    heapscan_t *st = (heapscan_t *)op->state;
+    if (st->mvscan) {
+        SP_MvccScanClose(st->mvscan);
+        return;
+    }
+    free(st->cur);
+    SP_ScanClose(st->scan);
+}
+
+QPop *QP_HeapScanOpen(int heapfd) {
+    QPop *op = QP_NewOp("HeapScan", sizeof(heapscan_t));
+    heapscan_t *st;
+
+    if (!op) return NULL;
+    st = (heapscan_t *)op->state;
+    if (SP_ScanOpen(heapfd, &st->scan) != 0) {
+        free(op);
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    op->next = heapscan_next;
+    op->close = heapscan_close;
+    return op;
+}
+
+/* the tuples of an MVCC heap visible to snap */
+QPop *QP_MvccHeapScanOpen(int heapfd, SPts snap) {
+    QPop *op = QP_NewOp("MvccHeapScan", sizeof(heapscan_t));
+    heapscan_t *st;
+
+    if (!op) return NULL;
+    st = (heapscan_t *)op->state;
+    if (SP_MvccScanOpen(heapfd, snap, &st->mvscan) != 0) {
+        free(op);
+        QPerrno = QPE_PF;
+        return NULL;
+    }
+    op->next = heapscan_next;
+    op->close = heapscan_close;
+    return op;
+}
+
+/******************** index scan ********************/
+
+typedef struct {
+    int heapfd;
+    int sd;                 /* AM scan descriptor */
+    char buf[QP_MAXREC];    /* current heap record */
+} indexscan_t;
+
+static int indexscan_next(QPop *op, QPtuple *tup) {
+    indexscan_t *st = (indexscan_t *)op->state;
+    int recid;
+
+    recid = AM_FindNextEntry(st->sd);
+    if (recid == AME_EOF) return QPE_EOF;
+    if (recid < 0) return QPE_AM;
+    SP_IntToRid(recid, &tup->rid);
+    if (SP_GetRec(st->heapfd, tup->rid, st->buf, QP_MAXREC, &tup->reclen) != 0)
+        return QPE_PF;
+    tup->rec = st->buf;
+    return QPE_OK;
+}
+
+static void indexscan_close(QPop *op) {
+    AM_CloseIndexScan(((indexscan_t *)op->state)->sd);
+}
+
+/* Scan heap records whose indexed key satisfies `op value`, in ascending
+ * key order (descending field order for a desc index, whose keys are
+ * negated). With op QP_ALL and value NULL every entry is returned. */
+QPop *QP_IndexScanOpen(int heapfd, QPindex *idx, int scanop, char *value) {
+    QPop *op = QP_NewOp("IndexScan", sizeof(indexscan_t));
+    indexscan_t *st;
+
+    if (!op) return NULL;
+    st = (indexscan_t *)op->state;
+    st->heapfd = heapfd;
+    st->sd = AM_OpenIndexScan(idx->fd, idx->type, idx->len, scanop, value);
+    /* AM_OpenIndexScan leaves the search path on the AM stack */
+    AM_EmptyStack();
+    if (st->sd < 0) {
+        free(op);
+        QPerrno = QPE_AM;
+        return NULL;
+    }
+    op->next = indexscan_next;
+    op->close = indexscan_close;
+    op->orderfield = idx->field;
+    op->ordertype = idx->type;
+    op->orderdesc = idx->desc;
+    return op;
+}
+
+/******************** bitmap scan ********************/
+
+typedef struct {
+    int heapfd;
+    int *recids;            /* packed rids, sorted unless mvcc */
+    int nrecids, pos;
+    int mvcc;               /* the heap is an MVCC heap read as of snap */
+    SPts snap;
+    char buf[QP_MAXREC];
+} bitmapscan_t;
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int bitmapscan_next(QPop *op, QPtuple *tup) {
+    bitmapscan_t *st = (bitmapscan_t *)op->state;
+    int error;
+
+    for (;;) {
+        if (st->pos >= st->nrecids) return QPE_EOF;
+        SP_IntToRid(st->recids[st->pos], &tup->rid);
+        st->pos++;
+        tup->rec = st->buf;
+        if (!st->mvcc)
+            return SP_GetRec(st->heapfd, tup->rid, st->buf, QP_MAXREC,
+                             &tup->reclen) == 0 ? QPE_OK : QPE_PF;
+        /* skip the entries of versions the snapshot does not see */
+        error = SP_MvccGetRec(st->heapfd, tup->rid, st->snap, st->buf,
+                              QP_MAXREC, &tup->reclen);
+        if (error < 0) return QPE_PF;
+        if (error == 0) return QPE_OK;
+    }
+}
+
+static void bitmapscan_close(QPop *op) {
+    free(((bitmapscan_t *)op->state)->recids);
+}
+
+/* read the rids of the index entries satisfying `scanop value` into
+   op's state, in key order; returns op, or NULL after closing it */
+static QPop *collect_rids(QPop *op, QPindex *idx, int scanop, char *value) {
+    bitmapscan_t *st = (bitmapscan_t *)op->state;
+    int sd, recid, cap = 0;
+
+    sd = AM_OpenIndexScan(idx->fd, idx->type, idx->len, scanop, value);
+    AM_EmptyStack();
+    if (sd < 0) {
+        free(op);
+        QPerrno = QPE_AM;
+        return NULL;
+    }
+    while ((recid = AM_FindNextEntry(sd)) >= 0) {
+        if (st->nrecids == cap) {
+            int *n;
+            cap = cap ? 2 * cap : 1024;
+            if ((n = (int *)realloc(st->recids, cap * sizeof(int))) == NULL) {
+                recid = QPE_NOMEM;
+                break;
+            }
+            st->recids = n;
+        }
+        st->recids[st->nrecids++] = recid;
+    }
+    AM_CloseIndexScan(sd);
+    if (recid != AME_EOF) {
+        QPerrno = recid == QPE_NOMEM ? QPE_NOMEM : QPE_AM;
+        QP_Close(op);
+        return NULL;
+    }
+    op->peakbytes = (long)st->nrecids * sizeof(int);
+    return op;
+}
+
+/* Heap records whose indexed key satisfies `op value`, in heap (rid)
+ * order: the matching rids are read from the index and sorted before any
+ * heap page is touched, so every heap page is read at most once. */
+QPop *QP_BitmapScanOpen(int heapfd, QPindex *idx, int scanop, char *value) {
+    QPop *op = QP_NewOp("BitmapScan", sizeof(bitmapscan_t));
+    bitmapscan_t *st;
+
+    if (!op) return NULL;
+    st = (bitmapscan_t *)op->state;
+    st->heapfd = heapfd;
+    op->close = bitmapscan_close;
+    op->next = bitmapscan_next;
+    if ((op = collect_rids(op, idx, scanop, value)) == NULL) return NULL;
+    qsort(st->recids, st->nrecids, sizeof(int), cmp_int);
+    return op;
+}
+
+/* QP_IndexScanOpen over an MVCC heap as of snap. An AM scan does not
+ * survive inserts into its index, which a load makes at any time, so the
+ * entries are read when the scan opens; those of versions the snapshot
+ * does not see, left in the index by uncommitted, deleted or reclaimed
+ * versions, are skipped. */
+QPop *QP_MvccIndexScanOpen(int heapfd, QPindex *idx, int scanop, char *value,
+                           SPts snap) {
+    QPop *op = QP_NewOp("MvccIndexScan", sizeof(bitmapscan_t));
+    bitmapscan_t *st;
+
+    if (!op) return NULL;
+    st = (bitmapscan_t *)op->state;
+    st->heapfd = heapfd;
+    st->mvcc = 1;
+    st->snap = snap;
+    op->close = bitmapscan_close;
+    op->next = bitmapscan_next;
+    if ((op = collect_rids(op, idx, scanop, value)) == NULL) return NULL;
+    op->orderfield = idx->field;
+    op->ordertype = idx->type;
+    op->orderdesc = idx->desc;
+    return op;
+}
+
+/******************** filter ********************/
+
+typedef struct {
+    int field;
+    char type;
+    int scanop;
+    char *value;
+    int vlen;
+} filter_t;
+
+static int filter_next(QPop *op, QPtuple *tup) {
+    filter_t *st = (filter_t *)op->state;
+    int error, c, match;
+
+    while ((error = QP_Next(op->child[0], tup)) == QPE_OK) {
+        c = QP_CompareField(tup->rec, tup->reclen, st->field,
+                            st->value, st->vlen, 0, st->type);
+        switch (st->scanop) {
+        case QP_EQ: match = c == 0; break;
+        case QP_LT: match = c < 0; break;
+        case QP_GT: match = c > 0; break;
+        case QP_LE: match = c <= 0; break;
+        case QP_GE: match = c >= 0; break;
+        default: match = 1; break;
+        }
+        if (match) return QPE_OK;
+    }
+    return error;
+}
+
+static void filter_close(QPop *op) {
+    free(((filter_t *)op->state)->value);
+}
+
+QPop *QP_FilterOpen(QPop *child, int field, char type, int scanop,
+                    const char *value) {
+    QPop *op;
+    filter_t *st;
+
+    if (!child) return NULL;
+    if ((op = QP_NewOp("Filter", sizeof(filter_t))) == NULL) return NULL;
+    st = (filter_t *)op->state;
+    st->field = field;
+    st->type = type;
+    st->scanop = scanop;
+    st->vlen = value ? strlen(value) : 0;
+    if (value && (st->value = strdup(value)) == NULL) {
+        free(op);
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    op->next = filter_next;
+    op->close = filter_close;
+    op->child[0] = child;
+    op->orderfield = child->orderfield;
+    op->ordertype = child->ordertype;
+    op->orderdesc = child->orderdesc;
+    return op;
+}
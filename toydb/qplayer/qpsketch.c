@@ -0,0 +1,658 @@
+/* qpsketch.c
+ * Sampled column statistics collected while scanning, and the catalog file
+ * they are kept in.
+ *
+ * Every sketched row adds each field to a per-column HyperLogLog (FNV-1a
+ * over 8-byte words of the field, finished with a 64-bit mixer), and Vitter's
+ * Algorithm L decides from a precomputed skip whether the row replaces a
+ * reservoir sample slot, so rows that are not taken cost one comparison.
+ * The histogram is built only when the sketch is finished, from the sorted
+ * sample. Hashing every field of every row costs one to three times as
+ * much as the scan, so a scan that sketches on the side takes 1 row in
+ * `stride`: HyperLogLog registers only ever grow, and each row is offered
+ * to the reservoir in exactly one pass, so stride passes give the same
+ * statistics as one full pass. QP_SketchStride() picks the stride of a
+ * table from the shape of its rows, to keep each pass within a fixed share
+ * of its scan.
+ *
+ * An AM leaf walk sketches one indexed column: each key is hashed once and
+ * offered to the reservoir as often as its recId list is long.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include "qp.h"
+#include "am.h"
+
+#define HLLREGS	(1 << QP_HLLBITS)
+
+/* a sampled record, kept whole and split only when the sketch finishes */
+typedef struct {
+    char *rec;
+    int len, cap;
+} samplerow_t;
+
+struct QPsketch {
+    int ncols;
+    int maxcols;            /* most fields seen in a record */
+    int stride, pass;       /* this pass takes rows pass, pass+stride, ... */
+    int done;
+    long nrows;             /* rows sketched by committed passes */
+    long *nnull;            /* empty fields per column, committed */
+    long passrows;          /* rows and empty fields of the current pass */
+    long *passnull;
+    unsigned char *hll;     /* HLLREGS registers per column */
+    samplerow_t *sample;    /* QP_SAMPLEROWS rows */
+    int nsample;
+    long seen, next;        /* Algorithm L: rows offered, next one taken */
+    double w;
+    long seen0, next0;      /* their values when the pass began */
+    double w0;
+    uint64_t rng;
+};
+
+/******************** hashing and sampling ********************/
+
+#define FNV_OFFSET	0xcbf29ce484222325ULL
+#define FNV_PRIME	0x100000001b3ULL
+
+/* h goes through the 64-bit finalizer of MurmurHash3 first */
+static void hll_add(unsigned char *reg, uint64_t h) {
+    uint64_t x = h;
+    unsigned idx;
+    unsigned char rank;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    idx = (unsigned)(x >> (64 - QP_HLLBITS));
+    /* 1 + leading zeros of the remaining bits */
+    x = (x << QP_HLLBITS) | (1ULL << (QP_HLLBITS - 1));
+#ifdef __GNUC__
+    rank = (unsigned char)(__builtin_clzll(x) + 1);
+#else
+    for (rank = 1; !(x & 0x8000000000000000ULL); rank++) x <<= 1;
+#endif
+    if (reg[idx] < rank) reg[idx] = rank;
+}
+
+static double hll_estimate(const unsigned char *reg) {
+    double m = HLLREGS, sum = 0, e;
+    int j, zeros = 0;
+
+    for (j = 0; j < HLLREGS; j++) {
+        sum += ldexp(1.0, -reg[j]);
+        if (reg[j] == 0) zeros++;
+    }
+    e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) e = m * log(m / zeros);  /* small range */
+    return e;
+}
+
+/* uniform in (0, 1) */
+static double uniform(QPsketch *sk) {
+    sk->rng ^= sk->rng << 13;
+    sk->rng ^= sk->rng >> 7;
+    sk->rng ^= sk->rng << 17;
+    return ((sk->rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* Algorithm L: after the reservoir is full, the next row to take */
+static void next_taken(QPsketch *sk) {
+    sk->w *= exp(log(uniform(sk)) / QP_SAMPLEROWS);
+    sk->next += (long)floor(log(uniform(sk)) / log(1 - sk->w)) + 1;
+}
+
+/* sample slot for the row just offered, or -1 */
+static int sample_slot(QPsketch *sk) {
+    sk->seen++;
+    if (sk->nsample < QP_SAMPLEROWS) {
+        if (sk->nsample == QP_SAMPLEROWS - 1) {
+            sk->w = exp(log(uniform(sk)) / QP_SAMPLEROWS);
+            sk->next = QP_SAMPLEROWS;
+            next_taken(sk);
+        }
+        return sk->nsample++;
+    }
+    if (sk->seen < sk->next) return -1;
+    next_taken(sk);
+    return (int)(uniform(sk) * QP_SAMPLEROWS);
+}
+
+static void keep_row(QPsketch *sk, int slot, const char *rec, int len) {
+    samplerow_t *r = &sk->sample[slot];
+    if (len > r->cap) {
+        char *n = (char *)realloc(r->rec, len);
+        if (!n) {
+            r->len = 0;
+            return;
+        }
+        r->rec = n;
+        r->cap = len;
+    }
+    memcpy(r->rec, rec, len);
+    r->len = len;
+}
+
+static void set_val(char *dst, const char *src, int len) {
+    if (len > QP_STATKEYLEN - 1) len = QP_STATKEYLEN - 1;
+    memcpy(dst, src, len);
+    memset(dst + len, 0, QP_STATKEYLEN - len);
+}
+
+/* The bytes of the field at f (ending at a ';' or at end) in the next
+ * word: returns how many, 8 if the field goes on past them, and puts them
+ * in *w with zeros above. A whole word is tested for ';' at once. */
+static int field_word(const char *f, const char *end, uint64_t *w) {
+    int n;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (end - f >= 8) {
+        uint64_t x, semis;
+        memcpy(w, f, 8);
+        x = *w ^ 0x3b3b3b3b3b3b3b3bULL;     /* ';' bytes become 0 */
+        semis = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+        if (semis == 0) return 8;
+        n = __builtin_ctzll(semis) / 8;
+        *w &= n ? ~0ULL >> (64 - 8 * n) : 0;
+        return n;
+    }
+#endif
+    *w = 0;
+    for (n = 0; n < 8 && f + n < end && f[n] != ';'; n++)
+        *w |= (uint64_t)(unsigned char)f[n] << (8 * n);
+    return n == 8 && (f + n >= end || f[n] == ';') ? 8 : n;
+}
+
+/******************** collector ********************/
+
+QPsketch *QP_SketchCreate(int ncols, int stride) {
+    QPsketch *sk;
+
+    if (ncols <= 0 || ncols > QP_MAXFIELDS) ncols = QP_MAXFIELDS;
+    if ((sk = (QPsketch *)calloc(1, sizeof(QPsketch))) == NULL) {
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    sk->ncols = ncols;
+    sk->stride = stride > 0 ? stride : 1;
+    sk->nnull = (long *)calloc(ncols, sizeof(long));
+    sk->passnull = (long *)calloc(ncols, sizeof(long));
+    sk->hll = (unsigned char *)calloc(ncols, HLLREGS);
+    sk->sample = (samplerow_t *)calloc(QP_SAMPLEROWS, sizeof(samplerow_t));
+    if (!sk->nnull || !sk->passnull || !sk->hll || !sk->sample) {
+        QP_SketchDestroy(sk);
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    QP_SketchReset(sk);
+    return sk;
+}
+
+/* start over, e.g. to refresh the statistics of a changed table */
+void QP_SketchReset(QPsketch *sk) {
+    sk->maxcols = 0;
+    sk->pass = 0;
+    sk->done = 0;
+    sk->nrows = sk->passrows = 0;
+    memset(sk->nnull, 0, sk->ncols * sizeof(long));
+    memset(sk->passnull, 0, sk->ncols * sizeof(long));
+    memset(sk->hll, 0, (long)sk->ncols * HLLREGS);
+    sk->nsample = 0;
+    sk->seen = sk->next = sk->seen0 = sk->next0 = 0;
+    sk->w = sk->w0 = 0;
+    sk->rng = 0x9e3779b97f4a7c15ULL;
+}
+
+void QP_SketchDestroy(QPsketch *sk) {
+    int i;
+
+    if (!sk) return;
+    if (sk->sample)
+        for (i = 0; i < QP_SAMPLEROWS; i++) free(sk->sample[i].rec);
+    free(sk->nnull);
+    free(sk->passnull);
+    free(sk->hll);
+    free(sk->sample);
+    free(sk);
+}
+
+/* A pass that was not ended is dropped: its row counts are discarded and
+ * the reservoir is rewound to where it was. Slots that pass replaced stay,
+ * which only matters if scans keep stopping early. Returns the # of rows
+ * to pass over before the first QP_SketchRow() call. */
+int QP_SketchBeginPass(QPsketch *sk) {
+    sk->passrows = 0;
+    /* the fields past maxcols are still 0 from QP_SketchReset() */
+    memset(sk->passnull, 0, sk->maxcols * sizeof(long));
+    sk->seen = sk->seen0;
+    sk->next = sk->next0;
+    sk->w = sk->w0;
+    if (sk->nsample > sk->seen) sk->nsample = (int)sk->seen;
+    return sk->done ? INT_MAX : sk->pass;
+}
+
+/* Sketch one row. Returns the # of rows the caller passes over before the
+ * next call, so rows outside this pass cost the scan nothing. */
+int QP_SketchRow(QPsketch *sk, const char *rec, int reclen) {
+    const char *f = rec, *end = rec + reclen;
+    unsigned char *reg = sk->hll;
+    uint64_t h, w;
+    int col, slot, len, k;
+
+    if (sk->done) return INT_MAX;
+    sk->passrows++;
+
+    if ((slot = sample_slot(sk)) >= 0) keep_row(sk, slot, rec, reclen);
+
+    /* FNV-style over the 8-byte words of each field, found 8 bytes at a
+       time; hll_add() mixes the result */
+    for (col = 0; col < sk->ncols && f; col++, reg += HLLREGS) {
+        len = 0;
+        h = 0;
+        while ((k = field_word(f + len, end, &w)) == 8) {
+            h = (h ^ w) * FNV_PRIME;
+            len += 8;
+        }
+        if (k > 0) h = (h ^ w) * FNV_PRIME;
+        len += k;
+        if (len == 0) sk->passnull[col]++;
+        else hll_add(reg, h ^ FNV_OFFSET ^ len);
+        f += len;
+        f = f < end ? f + 1 : NULL;
+    }
+    if (col > sk->maxcols) sk->maxcols = col;
+    return sk->stride - 1;
+}
+
+int QP_SketchEndPass(QPsketch *sk) {
+    int i;
+
+    if (sk->done) return 1;
+    /* a pass that found no row means the table has at most pass rows, so
+       the passes after it would find none either */
+    if (sk->passrows == 0 && sk->pass > 0) sk->done = 1;
+    sk->nrows += sk->passrows;
+    for (i = 0; i < sk->maxcols; i++) sk->nnull[i] += sk->passnull[i];
+    sk->passrows = 0;
+    sk->seen0 = sk->seen;
+    sk->next0 = sk->next;
+    sk->w0 = sk->w;
+    if (++sk->pass == sk->stride) sk->done = 1;
+    return sk->done;
+}
+
+int QP_SketchDone(QPsketch *sk) {
+    return sk->done;
+}
+
+/******************** histograms ********************/
+
+/* qsort() has no context argument; the type being sorted is kept here */
+static char sort_type;
+
+static int numeric(const char *v, char type) {
+    char *e;
+    if (type == QP_INT) strtol(v, &e, 10);
+    else strtod(v, &e);
+    return e != v && *e == '\0';
+}
+
+static int compare_vals(const char *a, const char *b, char type) {
+    double x, y;
+    if (type == QP_CHAR) return strcmp(a, b);
+    x = atof(a);
+    y = atof(b);
+    return (x > y) - (x < y);
+}
+
+static int qsort_vals(const void *a, const void *b) {
+    return compare_vals(*(char * const *)a, *(char * const *)b, sort_type);
+}
+
+/* histogram of column col from the sample; type 0 means infer it */
+static int finish_col(QPsketch *sk, int col, char type, QPcolsketch *cs) {
+    char **v, *buf;
+    long n = 0, i, start, end, target, sdistinct = 0;
+    int flen;
+    double nonnull, scale;
+    int b;
+
+    memset(cs, 0, sizeof(*cs));
+    cs->field = col;
+    cs->nnull = sk->nnull[col];
+    nonnull = sk->nrows - cs->nnull;
+    cs->ndistinct = hll_estimate(sk->hll + (long)col * HLLREGS);
+    if (cs->ndistinct > nonnull) cs->ndistinct = nonnull;
+
+    v = (char **)malloc((sk->nsample + 1) * sizeof(char *));
+    buf = (char *)malloc((long)(sk->nsample + 1) * QP_STATKEYLEN);
+    if (!v || !buf) {
+        free(v);
+        free(buf);
+        return QPE_NOMEM;
+    }
+    for (i = 0; i < sk->nsample; i++) {
+        samplerow_t *r = &sk->sample[i];
+        const char *f = QP_GetField(r->rec, r->len, col, &flen);
+        if (r->len > 0 && f && flen > 0) {
+            v[n] = buf + n * QP_STATKEYLEN;
+            set_val(v[n], f, flen);
+            n++;
+        }
+    }
+    if (!type) {
+        type = QP_INT;
+        for (i = 0; i < n && type == QP_INT; i++)
+            if (!numeric(v[i], QP_INT)) type = QP_FLOAT;
+        for (i = 0; i < n && type == QP_FLOAT; i++)
+            if (!numeric(v[i], QP_FLOAT)) type = QP_CHAR;
+        if (n == 0) type = QP_CHAR;
+    }
+    cs->type = type;
+    if (n == 0) {
+        free(v);
+        free(buf);
+        return QPE_OK;
+    }
+    sort_type = type;
+    qsort(v, n, sizeof(char *), qsort_vals);
+    strcpy(cs->lo, v[0]);
+    for (i = 0; i < n; i++)
+        if (i == 0 || compare_vals(v[i], v[i-1], type) != 0) sdistinct++;
+
+    /* as in QP_Analyze, a value never spans two buckets */
+    scale = nonnull / n;
+    for (start = 0, b = 0; start < n && b < QP_HISTBUCKETS; b++) {
+        long sd = 0;
+        target = (long)((double)(b + 1) * n / QP_HISTBUCKETS);
+        end = target > start ? target - 1 : start;
+        if (b == QP_HISTBUCKETS - 1 || end >= n) end = n - 1;
+        while (end + 1 < n && compare_vals(v[end + 1], v[end], type) == 0) end++;
+        for (i = start; i <= end; i++)
+            if (i == start || compare_vals(v[i], v[i-1], type) != 0) sd++;
+        strcpy(cs->hi[b], v[end]);
+        cs->depth[b] = (end - start + 1) * scale;
+        cs->distinct[b] = cs->ndistinct * sd / sdistinct;
+        if (cs->distinct[b] < 1) cs->distinct[b] = 1;
+        if (cs->distinct[b] > cs->depth[b]) cs->distinct[b] = cs->depth[b];
+        start = end + 1;
+    }
+    cs->nbuckets = b;
+    free(v);
+    free(buf);
+    return QPE_OK;
+}
+
+int QP_SketchFinish(QPsketch *sk, QPtablesketch *ts) {
+    int i, error;
+
+    memset(ts, 0, sizeof(*ts));
+    ts->nrows = sk->nrows;
+    ts->ncols = sk->maxcols;
+    for (i = 0; i < ts->ncols; i++)
+        if ((error = finish_col(sk, i, 0, &ts->col[i])) != QPE_OK)
+            return (QPerrno = error);
+    return QPE_OK;
+}
+
+/******************** sketch operator ********************/
+
+typedef struct {
+    QPsketch *sk;
+    int skip;       /* rows before the next one sketched */
+    int ended;      /* EOF seen: the pass is over */
+} sketchscan_t;
+
+static int sketchscan_next(QPop *op, QPtuple *tup) {
+    sketchscan_t *st = (sketchscan_t *)op->state;
+    int error = QP_Next(op->child[0], tup);
+
+    if (error == QPE_OK && !st->ended) {
+        if (st->skip-- == 0)
+            st->skip = QP_SketchRow(st->sk, tup->rec, tup->reclen);
+    } else if (error == QPE_EOF && !st->ended) {
+        /* next() may be called again at EOF; that is not another pass */
+        st->ended = 1;
+        QP_SketchEndPass(st->sk);
+    }
+    return error;
+}
+
+QPop *QP_SketchScanOpen(QPop *child, QPsketch *sk) {
+    QPop *op;
+
+    if (!child) return NULL;
+    if ((op = QP_NewOp("Sketch", sizeof(sketchscan_t))) == NULL) return NULL;
+    ((sketchscan_t *)op->state)->sk = sk;
+    ((sketchscan_t *)op->state)->skip = QP_SketchBeginPass(sk);
+    op->next = sketchscan_next;
+    op->child[0] = child;
+    op->orderfield = child->orderfield;
+    op->ordertype = child->ordertype;
+    op->orderdesc = child->orderdesc;
+    return op;
+}
+
+int QP_SketchTable(QPtable *t, QPsketch *sk, QPtablesketch *ts) {
+    SPscan *scan;
+    char *rec;
+    int reclen, error, skip;
+
+    while (!sk->done) {
+        if (SP_ScanOpen(t->heapfd, &scan) != 0) return (QPerrno = QPE_NOMEM);
+        skip = QP_SketchBeginPass(sk);
+        while ((error = SP_ScanNext(scan, &rec, &reclen, NULL)) == 0) {
+            if (skip-- == 0) skip = QP_SketchRow(sk, rec, reclen);
+            free(rec);
+        }
+        SP_ScanClose(scan);
+        if (error != PFE_EOF) return (QPerrno = QPE_PF);
+        QP_SketchEndPass(sk);
+    }
+    if ((error = QP_SketchFinish(sk, ts)) != QPE_OK) return error;
+    strncpy(ts->table, t->name, QP_MAXNAME - 1);
+    if ((ts->npages = PF_GetNumPages(t->heapfd)) < 0) return (QPerrno = QPE_PF);
+    return QPE_OK;
+}
+
+/* rows of t read by QP_SketchStride() */
+#define STRIDEROWS	64
+
+/* A sketched row costs about 0.4 + 0.12 per field + 0.008 per byte of
+ * the time a scan takes for a row, and twice that when rows are sketched
+ * 1 in stride, as their registers and sample slots have left the cache
+ * (teststats). The stride keeps a pass under QP_SKETCHBUDGET of its scan
+ * for rows like the first STRIDEROWS of t: about 190 passes for a table of
+ * 4 short fields, 620 for one of 16. */
+int QP_SketchStride(QPtable *t) {
+    SPscan *scan;
+    char *rec;
+    int reclen, i, n = 0;
+    long fields = 0, bytes = 0;
+    double cost;
+
+    if (SP_ScanOpen(t->heapfd, &scan) != 0) return QP_SKETCHSTRIDE;
+    while (n < STRIDEROWS && SP_ScanNext(scan, &rec, &reclen, NULL) == 0) {
+        fields++;
+        for (i = 0; i < reclen; i++) fields += rec[i] == ';';
+        bytes += reclen;
+        free(rec);
+        n++;
+    }
+    SP_ScanClose(scan);
+    if (n == 0) return QP_SKETCHSTRIDE;
+    cost = 2 * (0.4 + 0.12 * fields / n + 0.008 * bytes / n);
+    return (int)ceil(cost / QP_SKETCHBUDGET);
+}
+
+/******************** AM leaf walk ********************/
+
+/* key as text, the way it appears in the records */
+static void key_text(const char *key, char type, int len, int desc, char *buf) {
+    int i;
+    float f;
+
+    switch (type) {
+    case QP_INT:
+        memcpy(&i, key, sizeof(int));
+        snprintf(buf, QP_STATKEYLEN, "%d", desc ? -i : i);
+        break;
+    case QP_FLOAT:
+        memcpy(&f, key, sizeof(float));
+        snprintf(buf, QP_STATKEYLEN, "%g", desc ? -f : f);
+        break;
+    default:
+        set_val(buf, key, (int)strnlen(key, len));
+        break;
+    }
+}
+
+int QP_SketchIndex(QPindex *idx, QPcolsketch *cs) {
+    QPsketch *sk;
+    AM_LEAFHEADER lh;
+    char *page, text[QP_STATKEYLEN];
+    int pagenum = 0, next, recsize = idx->len + AM_ss, i, slot, error;
+    short ptr;
+    uint64_t h;
+
+    if ((sk = QP_SketchCreate(1, 1)) == NULL) return QPerrno;
+    /* down the leftmost path to the first leaf */
+    for (;;) {
+        if (PF_GetThisPage(idx->fd, pagenum, &page) != PFE_OK) {
+            QP_SketchDestroy(sk);
+            return (QPerrno = QPE_PF);
+        }
+        if (*page == 'l') break;
+        memcpy(&next, page + sizeof(AM_INTHEADER), sizeof(int));
+        PF_UnfixPage(idx->fd, pagenum, FALSE);
+        pagenum = next;
+    }
+    for (;;) {
+        memcpy(&lh, page, sizeof(lh));
+        for (i = 0; i < lh.numKeys; i++) {
+            const char *key = page + AM_sl + i * recsize;
+            int j;
+            h = FNV_OFFSET;
+            for (j = 0; j < idx->len; j++)
+                h = (h ^ (unsigned char)key[j]) * FNV_PRIME;
+            hll_add(sk->hll, h);
+            key_text(key, idx->type, idx->len, idx->desc, text);
+            /* one row per recId of the key */
+            memcpy(&ptr, key + idx->len, AM_ss);
+            while (ptr != 0) {
+                sk->passrows++;
+                if ((slot = sample_slot(sk)) >= 0)
+                    keep_row(sk, slot, text, strlen(text));
+                memcpy(&ptr, page + ptr + AM_si, AM_ss);
+            }
+        }
+        PF_UnfixPage(idx->fd, pagenum, FALSE);
+        if ((pagenum = lh.nextLeafPage) == AM_NULL_PAGE) break;
+        if (PF_GetThisPage(idx->fd, pagenum, &page) != PFE_OK) {
+            QP_SketchDestroy(sk);
+            return (QPerrno = QPE_PF);
+        }
+    }
+    sk->maxcols = 1;
+    QP_SketchEndPass(sk);
+    error = finish_col(sk, 0, idx->type, cs);
+    cs->field = idx->field;
+    QP_SketchDestroy(sk);
+    return error == QPE_OK ? QPE_OK : (QPerrno = error);
+}
+
+/******************** catalog ********************/
+
+/* one catalog record: a column of a table */
+typedef struct {
+    char table[QP_MAXNAME];
+    long nrows;
+    int npages;
+    int ncols;
+    QPcolsketch col;
+} catrec_t;
+
+static int open_catalog(const char *catalog) {
+    int fd = SP_OpenFile(catalog);
+    if (fd < 0 && SP_CreateFile(catalog) == PFE_OK) fd = SP_OpenFile(catalog);
+    return fd;
+}
+
+/* Replace whatever the catalog holds on ts->table */
+int QP_CatalogPut(const char *catalog, const QPtablesketch *ts) {
+    SPscan *scan;
+    SPRID rid, *old = NULL;
+    catrec_t cr;
+    char *rec;
+    int fd, reclen, nold = 0, i, error = QPE_OK;
+
+    if ((fd = open_catalog(catalog)) < 0) return (QPerrno = QPE_PF);
+    if (SP_ScanOpen(fd, &scan) != 0) {
+        SP_CloseFile(fd);
+        return (QPerrno = QPE_NOMEM);
+    }
+    while (SP_ScanNext(scan, &rec, &reclen, &rid) == 0) {
+        if (reclen == sizeof(catrec_t)
+                && strncmp(((catrec_t *)rec)->table, ts->table, QP_MAXNAME) == 0) {
+            SPRID *n = (SPRID *)realloc(old, (nold + 1) * sizeof(SPRID));
+            if (!n) { free(rec); error = QPE_NOMEM; break; }
+            old = n;
+            old[nold++] = rid;
+        }
+        free(rec);
+    }
+    SP_ScanClose(scan);
+    for (i = 0; i < nold && error == QPE_OK; i++)
+        if (SP_DeleteRec(fd, old[i]) != 0) error = QPE_PF;
+    free(old);
+
+    memset(&cr, 0, sizeof(cr));
+    strncpy(cr.table, ts->table, QP_MAXNAME - 1);
+    cr.nrows = ts->nrows;
+    cr.npages = ts->npages;
+    cr.ncols = ts->ncols;
+    for (i = 0; i < ts->ncols && error == QPE_OK; i++) {
+        cr.col = ts->col[i];
+        if (SP_AppendRec(fd, (char *)&cr, sizeof(cr), NULL) != 0) error = QPE_PF;
+    }
+    if (SP_CloseFile(fd) != PFE_OK && error == QPE_OK) error = QPE_PF;
+    return error == QPE_OK ? QPE_OK : (QPerrno = error);
+}
+
+int QP_CatalogGet(const char *catalog, const char *table, QPtablesketch *ts) {
+    SPscan *scan;
+    char *rec;
+    int fd, reclen, found = 0;
+
+    if ((fd = SP_OpenFile(catalog)) < 0) return (QPerrno = QPE_PF);
+    if (SP_ScanOpen(fd, &scan) != 0) {
+        SP_CloseFile(fd);
+        return (QPerrno = QPE_NOMEM);
+    }
+    memset(ts, 0, sizeof(*ts));
+    while (SP_ScanNext(scan, &rec, &reclen, NULL) == 0) {
+        catrec_t *cr = (catrec_t *)rec;
+        if (reclen == sizeof(catrec_t)
+                && strncmp(cr->table, table, QP_MAXNAME) == 0
+                && cr->col.field >= 0 && cr->col.field < QP_MAXFIELDS) {
+            if (!found) {
+                strncpy(ts->table, cr->table, QP_MAXNAME - 1);
+                ts->nrows = cr->nrows;
+                ts->npages = cr->npages;
+                ts->ncols = cr->ncols;
+                found = 1;
+            }
+            ts->col[cr->col.field] = cr->col;
+        }
+        free(rec);
+    }
+    SP_ScanClose(scan);
+    SP_CloseFile(fd);
+    return found ? QPE_OK : (QPerrno = QPE_EOF);
+}
@@ -0,0 +1,331 @@
+/* qpsort.c
+ * External merge sort operator.
+ *
+ * The first next() call drains the input: records are buffered until
+ * `membytes` is reached, sorted with qsort and written as a run to a
+ * temporary SP heap file, a PF memory file unless QP_SORT_RUNS says
+ * otherwise. Runs are merged QP_SORT_FANIN at a time until one
+ * pass can produce the output; if the input fits in memory no run is
+ * written at all. The output is ascending on the sort field, or descending
+ * when the sort is opened with desc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "qp.h"
+
+#define QP_SORT_MAXRUNS 4096
+
+typedef struct {
+    union { int i; float f; } key;
+    const char *kp;         /* QP_CHAR key: field start and length */
+    int klen;
+    char *rec;
+    int reclen;
+} sortrec_t;
+
+typedef struct {
+    int fd;
+    SPscan *scan;
+    sortrec_t cur;          /* current record of this run (malloc'd) */
+} runcursor_t;
+
+typedef struct {
+    int field;
+    char type;
+    int desc;
+    long membytes;
+    int started;
+    /* in-memory records */
+    sortrec_t *recs;
+    int nrecs, caprecs;
+    long bytes;
+    int pos;                /* output position when no run was written */
+    /* runs */
+    char *runs[QP_SORT_MAXRUNS];
+    int firstrun, nruns;
+    /* final merge */
+    runcursor_t cur[QP_SORT_FANIN];
+    int heap[QP_SORT_FANIN];    /* cursor indexes, min-heap on key */
+    int nheap;
+    char *out;              /* record handed out by the last next() */
+} sort_t;
+
+static int runseq = 0;      /* makes run file names unique in the process */
+
+/* qsort() has no context argument; the type and direction being sorted
+   are kept here */
+static char sort_type;
+static int sort_desc;
+
+static void set_key(sortrec_t *r, int field, char type) {
+    switch (type) {
+    case QP_INT: r->key.i = QP_FieldInt(r->rec, r->reclen, field); break;
+    case QP_FLOAT: r->key.f = QP_FieldFloat(r->rec, r->reclen, field); break;
+    default:
+        r->kp = QP_GetField(r->rec, r->reclen, field, &r->klen);
+        if (!r->kp) { r->kp = ""; r->klen = 0; }
+        break;
+    }
+}
+
+static int compare_keys(const sortrec_t *a, const sortrec_t *b, char type,
+                        int desc) {
+    int c;
+    switch (type) {
+    case QP_INT: c = (a->key.i > b->key.i) - (a->key.i < b->key.i); break;
+    case QP_FLOAT: c = (a->key.f > b->key.f) - (a->key.f < b->key.f); break;
+    default:
+        c = memcmp(a->kp, b->kp, a->klen < b->klen ? a->klen : b->klen);
+        if (c == 0) c = a->klen - b->klen;
+        break;
+    }
+    return desc ? -c : c;
+}
+
+static int qsort_cmp(const void *a, const void *b) {
+    return compare_keys((const sortrec_t *)a, (const sortrec_t *)b, sort_type,
+                        sort_desc);
+}
+
+static void free_recs(sort_t *st) {
+    int i;
+    for (i = 0; i < st->nrecs; i++) free(st->recs[i].rec);
+    st->nrecs = 0;
+    st->bytes = 0;
+}
+
+/* create a new run file and open it; returns its fd or -1 */
+static int new_run(sort_t *st) {
+    char name[QP_MAXNAME];
+    int fd;
+
+    if (st->firstrun + st->nruns >= QP_SORT_MAXRUNS) return -1;
+    snprintf(name, sizeof(name), "%sqp_sort_%d_%d", QP_SORT_RUNS, (int)getpid(),
+             runseq++);
+    PF_DestroyFile(name);
+    if (SP_CreateFile(name) != PFE_OK || (fd = SP_OpenFile(name)) < 0)
+        return -1;
+    if ((st->runs[st->firstrun + st->nruns] = strdup(name)) == NULL) {
+        SP_CloseFile(fd);
+        return -1;
+    }
+    st->nruns++;
+    return fd;
+}
+
+/* sort the buffered records and write them out as one run */
+static int spill(sort_t *st) {
+    int fd, i;
+
+    sort_type = st->type;
+    sort_desc = st->desc;
+    qsort(st->recs, st->nrecs, sizeof(sortrec_t), qsort_cmp);
+    if ((fd = new_run(st)) < 0) return QPE_PF;
+    for (i = 0; i < st->nrecs; i++)
+        if (SP_AppendRec(fd, st->recs[i].rec, st->recs[i].reclen, NULL) != 0) {
+            SP_CloseFile(fd);
+            return QPE_PF;
+        }
+    free_recs(st);
+    return SP_CloseFile(fd) == PFE_OK ? QPE_OK : QPE_PF;
+}
+
+/******************** k-way merge ********************/
+
+static int heap_less(sort_t *st, int a, int b) {
+    return compare_keys(&st->cur[a].cur, &st->cur[b].cur, st->type,
+                        st->desc) < 0;
+}
+
+static void sift_down(sort_t *st, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i, t;
+        if (l < st->nheap && heap_less(st, st->heap[l], st->heap[m])) m = l;
+        if (r < st->nheap && heap_less(st, st->heap[r], st->heap[m])) m = r;
+        if (m == i) return;
+        t = st->heap[i]; st->heap[i] = st->heap[m]; st->heap[m] = t;
+        i = m;
+    }
+}
+
+/* read the next record of cursor c; returns QPE_OK, QPE_EOF or error */
+static int advance(sort_t *st, runcursor_t *c) {
+    SPRID rid;
+    int error = SP_ScanNext(c->scan, &c->cur.rec, &c->cur.reclen, &rid);
+    if (error == PFE_EOF) { c->cur.rec = NULL; return QPE_EOF; }
+    if (error != 0) return QPE_PF;
+    set_key(&c->cur, st->field, st->type);
+    return QPE_OK;
+}
+
+/* open cursors on runs[firstrun .. firstrun+n-1] and build the heap */
+static int merge_open(sort_t *st, int n) {
+    int i, error;
+
+    st->nheap = 0;
+    for (i = 0; i < n; i++) {
+        runcursor_t *c = &st->cur[i];
+        if ((c->fd = SP_OpenFile(st->runs[st->firstrun + i])) < 0) return QPE_PF;
+        SP_ScanOpen(c->fd, &c->scan);
+        if ((error = advance(st, c)) == QPE_OK) st->heap[st->nheap++] = i;
+        else if (error != QPE_EOF) return error;
+    }
+    for (i = st->nheap / 2 - 1; i >= 0; i--) sift_down(st, i);
+    return QPE_OK;
+}
+
+/* pop the smallest record; the caller owns the returned malloc'd buffer */
+static int merge_pop(sort_t *st, char **rec, int *reclen) {
+    runcursor_t *c;
+    int error;
+
+    if (st->nheap == 0) return QPE_EOF;
+    c = &st->cur[st->heap[0]];
+    *rec = c->cur.rec;
+    *reclen = c->cur.reclen;
+    if ((error = advance(st, c)) == QPE_EOF)
+        st->heap[0] = st->heap[--st->nheap];
+    else if (error != QPE_OK) return error;
+    sift_down(st, 0);
+    return QPE_OK;
+}
+
+/* close the cursors of the first n runs and delete their files */
+static void merge_close(sort_t *st, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        runcursor_t *c = &st->cur[i];
+        if (c->scan) {
+            SP_ScanClose(c->scan);
+            SP_CloseFile(c->fd);
+        }
+        free(c->cur.rec);
+        memset(c, 0, sizeof(*c));
+        PF_DestroyFile(st->runs[st->firstrun + i]);
+        free(st->runs[st->firstrun + i]);
+    }
+    st->firstrun += n;
+    st->nruns -= n;
+    st->nheap = 0;
+}
+
+/* merge passes until at most QP_SORT_FANIN runs remain */
+static int merge_passes(sort_t *st) {
+    int error, fd;
+    char *rec;
+    int reclen;
+
+    while (st->nruns > QP_SORT_FANIN) {
+        if ((error = merge_open(st, QP_SORT_FANIN)) != QPE_OK) return error;
+        if ((fd = new_run(st)) < 0) return QPE_PF;
+        while ((error = merge_pop(st, &rec, &reclen)) == QPE_OK) {
+            error = SP_AppendRec(fd, rec, reclen, NULL) == 0 ? QPE_OK : QPE_PF;
+            free(rec);
+            if (error != QPE_OK) break;
+        }
+        SP_CloseFile(fd);
+        merge_close(st, QP_SORT_FANIN);
+        if (error != QPE_EOF) return error;
+    }
+    return QPE_OK;
+}
+
+/******************** operator ********************/
+
+/* consume the whole input, spilling runs as memory fills up */
+static int sort_input(QPop *op) {
+    sort_t *st = (sort_t *)op->state;
+    QPtuple t;
+    int error;
+
+    while ((error = QP_Next(op->child[0], &t)) == QPE_OK) {
+        sortrec_t *r;
+        long need = t.reclen + (long)sizeof(sortrec_t);
+        if (st->nrecs > 0 && st->bytes + need > st->membytes
+                && (error = spill(st)) != QPE_OK)
+            return error;
+        if (st->nrecs == st->caprecs) {
+            int cap = st->caprecs ? 2 * st->caprecs : 1024;
+            sortrec_t *n = (sortrec_t *)realloc(st->recs, cap * sizeof(sortrec_t));
+            if (!n) return QPE_NOMEM;
+            st->recs = n;
+            st->caprecs = cap;
+        }
+        r = &st->recs[st->nrecs];
+        if ((r->rec = (char *)malloc(t.reclen)) == NULL) return QPE_NOMEM;
+        memcpy(r->rec, t.rec, t.reclen);
+        r->reclen = t.reclen;
+        set_key(r, st->field, st->type);
+        st->nrecs++;
+        st->bytes += need;
+        if (st->bytes > op->peakbytes) op->peakbytes = st->bytes;
+    }
+    if (error != QPE_EOF) return error;
+
+    if (st->nruns == 0) {
+        /* everything fit in memory */
+        sort_type = st->type;
+        sort_desc = st->desc;
+        qsort(st->recs, st->nrecs, sizeof(sortrec_t), qsort_cmp);
+        return QPE_OK;
+    }
+    if (st->nrecs > 0 && (error = spill(st)) != QPE_OK) return error;
+    if ((error = merge_passes(st)) != QPE_OK) return error;
+    return merge_open(st, st->nruns);
+}
+
+static int sort_next(QPop *op, QPtuple *tup) {
+    sort_t *st = (sort_t *)op->state;
+    int error;
+
+    if (!st->started) {
+        st->started = 1;
+        if ((error = sort_input(op)) != QPE_OK) return error;
+    }
+    tup->rid.page = -1;
+    tup->rid.slot = -1;
+    if (st->nruns == 0) {
+        if (st->pos >= st->nrecs) return QPE_EOF;
+        tup->rec = st->recs[st->pos].rec;
+        tup->reclen = st->recs[st->pos].reclen;
+        st->pos++;
+        return QPE_OK;
+    }
+    free(st->out);
+    st->out = NULL;
+    if ((error = merge_pop(st, &tup->rec, &tup->reclen)) != QPE_OK) return error;
+    st->out = tup->rec;
+    return QPE_OK;
+}
+
+static void sort_close(QPop *op) {
+    sort_t *st = (sort_t *)op->state;
+    free(st->out);
+    free_recs(st);
+    free(st->recs);
+    if (st->nruns > 0) merge_close(st, st->nruns);
+}
+
+QPop *QP_SortOpen(QPop *child, int field, char type, int desc,
+                  long membytes) {
+    QPop *op;
+    sort_t *st;
+
+    if (!child) return NULL;
+    if ((op = QP_NewOp("Sort", sizeof(sort_t))) == NULL) return NULL;
+    st = (sort_t *)op->state;
+    st->field = field;
+    st->type = type;
+    st->desc = desc;
+    st->membytes = membytes > 0 ? membytes : QP_SORT_MEM;
+    op->next = sort_next;
+    op->close = sort_close;
+    op->child[0] = child;
+    op->orderfield = field;
+    op->ordertype = type;
+    op->orderdesc = desc;
+    return op;
+}
@@ -0,0 +1,306 @@
+/* qpstats.c
+ * ANALYZE and selectivity estimation.
+ *
+ * QP_Analyze scans the heap once, collecting every value of the requested
+ * numeric fields with the page of its row; each column is then sorted to
+ * get its exact distinct count and an equi-depth histogram whose buckets
+ * also record how many heap pages their rows occupy. For every open index
+ * it walks the tree for its height, leaf count and key count, and scans it
+ * in key order to count how often consecutive entries point to different
+ * heap pages (the clustering factor: about npages for an index in heap
+ * order, about nrows for one whose order is unrelated to the heap's).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "qp.h"
+#include "am.h"
+
+/* one analyzed value and the heap page of its row */
+typedef struct {
+    double v;
+    int page;
+} statval_t;
+
+static int cmp_statval(const void *a, const void *b) {
+    double x = ((const statval_t *)a)->v, y = ((const statval_t *)b)->v;
+    return (x > y) - (x < y);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* sort v[0..n-1] and build the histogram of column c from it; pagebuf has
+   room for n ints */
+static void build_histogram(QPcolstats *c, statval_t *v, long n, int *pagebuf) {
+    long i, start, end, target;
+    int b;
+
+    qsort(v, n, sizeof(statval_t), cmp_statval);
+    c->ndistinct = 0;
+    c->nbuckets = 0;
+    if (n == 0) return;
+    for (i = 0; i < n; i++)
+        if (i == 0 || v[i].v != v[i-1].v) c->ndistinct++;
+    c->lo = v[0].v;
+
+    /* bucket b ends near row (b+1)*n/QP_HISTBUCKETS, moved forward so
+       that all copies of its last value stay in it */
+    for (start = 0, b = 0; start < n && b < QP_HISTBUCKETS; b++) {
+        target = (long)((double)(b + 1) * n / QP_HISTBUCKETS);
+        end = target > start ? target - 1 : start;
+        if (b == QP_HISTBUCKETS - 1 || end >= n) end = n - 1;
+        while (end + 1 < n && v[end + 1].v == v[end].v) end++;
+        c->hi[b] = v[end].v;
+        c->depth[b] = end - start + 1;
+        c->distinct[b] = 0;
+        for (i = start; i <= end; i++) {
+            if (i == start || v[i].v != v[i-1].v) c->distinct[b]++;
+            pagebuf[i - start] = v[i].page;
+        }
+        qsort(pagebuf, c->depth[b], sizeof(int), cmp_int);
+        c->pages[b] = 0;
+        for (i = 0; i < c->depth[b]; i++)
+            if (i == 0 || pagebuf[i] != pagebuf[i-1]) c->pages[b]++;
+        start = end + 1;
+    }
+    c->nbuckets = b;
+}
+
+/* height, leaves and keys of the index by walking the tree */
+static int analyze_tree(QPindex *idx) {
+    AM_LEAFHEADER lh;
+    char *page;
+    int pagenum = 0, next;
+
+    idx->height = 1;
+    idx->nleaves = 0;
+    idx->nkeys = 0;
+    /* down the leftmost path: the first pointer follows the header */
+    for (;;) {
+        if (PF_GetThisPage(idx->fd, pagenum, &page) != PFE_OK) return QPE_PF;
+        if (*page == 'l') break;
+        memcpy(&next, page + sizeof(AM_INTHEADER), sizeof(int));
+        PF_UnfixPage(idx->fd, pagenum, FALSE);
+        pagenum = next;
+        idx->height++;
+    }
+    /* along the leaf chain */
+    for (;;) {
+        memcpy(&lh, page, sizeof(lh));
+        PF_UnfixPage(idx->fd, pagenum, FALSE);
+        idx->nleaves++;
+        idx->nkeys += lh.numKeys;
+        if ((pagenum = lh.nextLeafPage) == AM_NULL_PAGE) break;
+        if (PF_GetThisPage(idx->fd, pagenum, &page) != PFE_OK) return QPE_PF;
+    }
+    return QPE_OK;
+}
+
+/* heap page changes between consecutive entries in key order */
+static int analyze_clustering(QPindex *idx) {
+    int sd, recid, page, lastpage = -1;
+
+    sd = AM_OpenIndexScan(idx->fd, idx->type, idx->len, QP_ALL, NULL);
+    AM_EmptyStack();
+    if (sd < 0) return QPE_AM;
+    idx->clusterfactor = 0;
+    while ((recid = AM_FindNextEntry(sd)) >= 0) {
+        page = recid / SP_MAXSLOTS;
+        if (page != lastpage) idx->clusterfactor++;
+        lastpage = page;
+    }
+    AM_CloseIndexScan(sd);
+    return recid == AME_EOF ? QPE_OK : QPE_AM;
+}
+
+int QP_Analyze(QPtable *t, const int *fields, const char *types, int nfields) {
+    QPtablestats *s = &t->stats;
+    statval_t *vals[QP_MAXSTATCOLS];
+    int *pagebuf = NULL;
+    long cap = 0, n = 0;
+    SPscan *scan;
+    char *rec;
+    int reclen, i, error = QPE_OK;
+    SPRID rid;
+
+    if (nfields > QP_MAXSTATCOLS) return (QPerrno = QPE_INVALIDARG);
+    for (i = 0; i < nfields; i++)
+        if (types[i] != QP_INT && types[i] != QP_FLOAT)
+            return (QPerrno = QPE_INVALIDARG);
+    memset(s, 0, sizeof(*s));
+    memset(vals, 0, sizeof(vals));
+    if ((s->npages = PF_GetNumPages(t->heapfd)) < 0) return (QPerrno = QPE_PF);
+
+    if (SP_ScanOpen(t->heapfd, &scan) != 0) return (QPerrno = QPE_NOMEM);
+    while (SP_ScanNext(scan, &rec, &reclen, &rid) == 0) {
+        if (n == cap) {
+            cap = cap ? 2 * cap : 4096;
+            for (i = 0; i < nfields; i++) {
+                statval_t *v = (statval_t *)realloc(vals[i],
+                                                    cap * sizeof(statval_t));
+                if (!v) { error = QPE_NOMEM; break; }
+                vals[i] = v;
+            }
+            if (error != QPE_OK) { free(rec); break; }
+        }
+        for (i = 0; i < nfields; i++) {
+            vals[i][n].v = types[i] == QP_INT
+                ? (double)QP_FieldInt(rec, reclen, fields[i])
+                : (double)QP_FieldFloat(rec, reclen, fields[i]);
+            vals[i][n].page = rid.page;
+        }
+        free(rec);
+        n++;
+    }
+    SP_ScanClose(scan);
+
+    if (error == QPE_OK && n > 0 && (pagebuf = (int *)malloc(n * sizeof(int))) == NULL)
+        error = QPE_NOMEM;
+    if (error == QPE_OK) {
+        s->nrows = n;
+        s->ncols = nfields;
+        for (i = 0; i < nfields; i++) {
+            s->col[i].field = fields[i];
+            s->col[i].type = types[i];
+            build_histogram(&s->col[i], vals[i], n, pagebuf);
+        }
+        for (i = 0; i < t->nindex && error == QPE_OK; i++)
+            if ((error = analyze_tree(&t->index[i])) == QPE_OK)
+                error = analyze_clustering(&t->index[i]);
+    }
+    for (i = 0; i < nfields; i++) free(vals[i]);
+    free(pagebuf);
+    if (error != QPE_OK) return (QPerrno = error);
+    s->analyzed = 1;
+    return QPE_OK;
+}
+
+QPcolstats *QP_GetColStats(QPtable *t, int field) {
+    int i;
+    if (!t->stats.analyzed) return NULL;
+    for (i = 0; i < t->stats.ncols; i++)
+        if (t->stats.col[i].field == field) return &t->stats.col[i];
+    return NULL;
+}
+
+/* estimated # of rows of bucket b equal to x */
+static double bucket_eq(const QPcolstats *c, int b, double x) {
+    double lo = b == 0 ? c->lo : c->hi[b-1];
+    if (x > c->hi[b] || x < lo || (b > 0 && x == lo)) return 0;
+    return (double)c->depth[b] / c->distinct[b];
+}
+
+/* estimated # of rows of bucket b <= x, interpolating linearly */
+static double bucket_le(const QPcolstats *c, int b, double x) {
+    double lo = b == 0 ? c->lo : c->hi[b-1];
+    if (x >= c->hi[b]) return c->depth[b];
+    if (x < lo || (b > 0 && x == lo)) return 0;
+    if (x == lo) return bucket_eq(c, b, x);     /* first bucket */
+    return c->depth[b] * (x - lo) / (c->hi[b] - lo);
+}
+
+static double bucket_rows(const QPcolstats *c, int b, int scanop, double x) {
+    double eq = bucket_eq(c, b, x), le = bucket_le(c, b, x);
+    switch (scanop) {
+    case QP_EQ: return eq;
+    case QP_LT: return le - eq > 0 ? le - eq : 0;
+    case QP_LE: return le;
+    case QP_GT: return c->depth[b] - le;
+    case QP_GE: return c->depth[b] - le + eq > c->depth[b]
+                       ? c->depth[b] : c->depth[b] - le + eq;
+    default: return c->depth[b];
+    }
+}
+
+/* heap pages touched when m of the rows on `pages` pages holding `rows`
+   rows are picked at random (Cardenas) */
+static double pages_touched(double pages, double rows, double m) {
+    if (pages <= 0 || rows <= 0 || m <= 0) return 0;
+    if (m >= rows) return pages;
+    return pages * (1 - pow(1 - m / rows, rows / pages));
+}
+
+static double value_of(QPcolstats *c, const char *value) {
+    return c->type == QP_INT ? (double)QP_FieldInt(value, strlen(value), 0)
+                             : (double)QP_FieldFloat(value, strlen(value), 0);
+}
+
+/* Rows of an analyzed column matching `scanop value`, summed over the
+ * histogram buckets. Without statistics the usual defaults are used: 1/10
+ * of the rows for an equality, 1/3 for a range. */
+double QP_EstimateRows(QPtable *t, int field, int scanop, const char *value) {
+    QPcolstats *c = QP_GetColStats(t, field);
+    double nrows = t->stats.analyzed ? t->stats.nrows : 0, rows = 0, x;
+    int b;
+
+    if (scanop == QP_ALL) return nrows;
+    if (!c) return nrows * (scanop == QP_EQ ? 0.1 : 1.0 / 3);
+    x = value_of(c, value);
+    for (b = 0; b < c->nbuckets; b++) rows += bucket_rows(c, b, scanop, x);
+    return rows;
+}
+
+/* Distinct heap pages holding those rows: within each bucket the matching
+ * rows are taken to be spread at random over the pages that bucket's rows
+ * occupy, so a column correlated with the heap order touches few pages. */
+double QP_EstimatePages(QPtable *t, int field, int scanop, const char *value) {
+    QPcolstats *c = QP_GetColStats(t, field);
+    double pages = 0, x;
+    int b;
+
+    if (!t->stats.analyzed) return 0;
+    if (scanop == QP_ALL) return t->stats.npages;
+    if (!c)
+        return pages_touched(t->stats.npages, t->stats.nrows,
+                             QP_EstimateRows(t, field, scanop, value));
+    x = value_of(c, value);
+    for (b = 0; b < c->nbuckets; b++)
+        pages += pages_touched(c->pages[b], c->depth[b],
+                               bucket_rows(c, b, scanop, x));
+    return pages < t->stats.npages ? pages : t->stats.npages;
+}
+
+/* Statistics from a sketch (QP_SketchTable, QP_CatalogGet) instead of a
+ * full QP_Analyze. The sketch does not record where rows are, so each
+ * bucket's rows are taken to be spread over the heap at random, and every
+ * index as unclustered. */
+int QP_UseSketch(QPtable *t, const QPtablesketch *ts) {
+    QPtablestats *s = &t->stats;
+    int i, b, error = QPE_OK;
+
+    memset(s, 0, sizeof(*s));
+    s->nrows = ts->nrows;
+    if ((s->npages = PF_GetNumPages(t->heapfd)) < 0) return (QPerrno = QPE_PF);
+    for (i = 0; i < ts->ncols && s->ncols < QP_MAXSTATCOLS; i++) {
+        const QPcolsketch *cs = &ts->col[i];
+        QPcolstats *c;
+        if ((cs->type != QP_INT && cs->type != QP_FLOAT) || cs->nbuckets == 0)
+            continue;
+        c = &s->col[s->ncols++];
+        c->field = cs->field;
+        c->type = cs->type;
+        c->ndistinct = (long)(cs->ndistinct + 0.5);
+        c->nbuckets = cs->nbuckets;
+        c->lo = atof(cs->lo);
+        for (b = 0; b < cs->nbuckets; b++) {
+            c->hi[b] = atof(cs->hi[b]);
+            c->depth[b] = (long)(cs->depth[b] + 0.5);
+            c->distinct[b] = (long)(cs->distinct[b] + 0.5);
+            if (c->depth[b] < 1) c->depth[b] = 1;
+            if (c->distinct[b] < 1) c->distinct[b] = 1;
+            c->pages[b] = (long)(pages_touched(s->npages, s->nrows, c->depth[b]) + 0.5);
+        }
+    }
+    for (i = 0; i < t->nindex && error == QPE_OK; i++) {
+        error = analyze_tree(&t->index[i]);
+        t->index[i].clusterfactor = s->nrows;
+    }
+    if (error != QPE_OK) return (QPerrno = error);
+    s->analyzed = 1;
+    return QPE_OK;
+}
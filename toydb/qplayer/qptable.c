@@ -0,0 +1,170 @@
+/* qptable.c
+ * Loading data/ files into SP heap files, building AM indexes over a heap
+ * field, and the QPtable handle that groups an open heap with its indexes.
+ *
+ * Index entries map the key to the heap rid packed with SP_RidToInt().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "qp.h"
+
+/* Read the next record line of a data/ file into *line (grown as needed,
+ * as by getline()) with its line end stripped. Lines without a ';' (the
+ * "Database dummy" banner, blank lines) and lines longer than QP_MAXREC are
+ * skipped. Returns the record's length, or -1 at the end of f. */
+int QP_ReadLine(FILE *f, char **line, size_t *cap) {
+    int L;
+
+    while (getline(line, cap, f) > 0) {
+        L = strlen(*line);
+        while (L > 0 && ((*line)[L-1] == '\n' || (*line)[L-1] == '\r')) (*line)[--L] = '\0';
+        if (L > 0 && L <= QP_MAXREC && memchr(*line, ';', L)) return L;
+    }
+    return -1;
+}
+
+/* Load up to maxrecs records of datafile (all if maxrecs <= 0), as read by
+ * QP_ReadLine(), into a fresh heap file. Returns the # of records loaded or
+ * a QP error code. */
+int QP_LoadHeap(const char *datafile, const char *heapname, int maxrecs) {
+    FILE *f;
+    char *line = NULL;
+    size_t cap = 0;
+    int fd, n = 0, L;
+
+    if ((f = fopen(datafile, "r")) == NULL) return (QPerrno = QPE_UNIX);
+    PF_DestroyFile((char *)heapname);
+    if (SP_CreateFile(heapname) != PFE_OK || (fd = SP_OpenFile(heapname)) < 0) {
+        fclose(f);
+        return (QPerrno = QPE_PF);
+    }
+    while ((maxrecs <= 0 || n < maxrecs) && (L = QP_ReadLine(f, &line, &cap)) >= 0) {
+        if (SP_AppendRec(fd, line, L, NULL) != 0) {
+            n = QPerrno = QPE_PF;
+            break;
+        }
+        n++;
+    }
+    free(line);
+    fclose(f);
+    if (SP_CloseFile(fd) != PFE_OK) return (QPerrno = QPE_PF);
+    return n;
+}
+
+/* Build AM index <heapname>.<indexno> on `field` of every heap record. A
+ * desc index stores negated keys, so its scans return high values first;
+ * only numeric fields can have one. Returns the # of entries inserted or a
+ * QP error code. */
+int QP_BuildIndex(const char *heapname, int indexno, int field, char type,
+                  int len, int desc) {
+    char idxname[QP_MAXNAME + 8];
+    char key[QP_MAXKEY];
+    int heapfd, idxfd, n = 0;
+    SPscan *scan;
+    char *rec;
+    int reclen;
+    SPRID rid;
+
+    if (desc && type == QP_CHAR) return (QPerrno = QPE_INVALIDARG);
+    AM_DestroyIndex((char *)heapname, indexno);
+    if (AM_CreateIndex((char *)heapname, indexno, type, len) != 0)
+        return (QPerrno = QPE_AM);
+    snprintf(idxname, sizeof(idxname), "%s.%d", heapname, indexno);
+    if ((idxfd = PF_OpenFile(idxname)) < 0) return (QPerrno = QPE_PF);
+    if ((heapfd = SP_OpenFile(heapname)) < 0) {
+        PF_CloseFile(idxfd);
+        return (QPerrno = QPE_PF);
+    }
+
+    SP_ScanOpen(heapfd, &scan);
+    while (SP_ScanNext(scan, &rec, &reclen, &rid) == 0) {
+        QP_MakeKey(rec, reclen, field, type, len, desc, key);
+        free(rec);
+        if (AM_InsertEntry(idxfd, type, len, key, SP_RidToInt(rid)) != 0) {
+            n = QPerrno = QPE_AM;
+            break;
+        }
+        n++;
+    }
+    SP_ScanClose(scan);
+    SP_CloseFile(heapfd);
+    if (PF_CloseFile(idxfd) != PFE_OK) return (QPerrno = QPE_PF);
+    return n;
+}
+
+/* Encode `field` of rec into the AM attribute format: native int/float
+ * (negated for a desc index), or a string of exactly len bytes padded with
+ * '\0'. */
+void QP_MakeKey(const char *rec, int reclen, int field, char type, int len,
+                int desc, char *key) {
+    switch (type) {
+    case QP_INT: {
+        int v = QP_FieldInt(rec, reclen, field);
+        if (desc) v = -v;
+        memcpy(key, &v, sizeof(int));
+        break;
+    }
+    case QP_FLOAT: {
+        float v = QP_FieldFloat(rec, reclen, field);
+        if (desc) v = -v;
+        memcpy(key, &v, sizeof(float));
+        break;
+    }
+    default: {
+        int flen = 0;
+        const char *f = QP_GetField(rec, reclen, field, &flen);
+        memset(key, 0, len);
+        if (f) memcpy(key, f, flen < len ? flen : len);
+        break;
+    }
+    }
+}
+
+int QP_OpenTable(QPtable *t, const char *heapname) {
+    memset(t, 0, sizeof(*t));
+    strncpy(t->name, heapname, QP_MAXNAME - 1);
+    if ((t->heapfd = SP_OpenFile(heapname)) < 0) return (QPerrno = QPE_PF);
+    return QPE_OK;
+}
+
+/* Open index <name>.<indexno> on `field` and attach it to the table */
+int QP_AddIndex(QPtable *t, int indexno, int field, char type, int len,
+                int desc) {
+    char idxname[QP_MAXNAME + 8];
+    QPindex *idx;
+
+    if (t->nindex >= QP_MAXINDEX || (desc && type == QP_CHAR))
+        return (QPerrno = QPE_INVALIDARG);
+    idx = &t->index[t->nindex];
+    snprintf(idxname, sizeof(idxname), "%s.%d", t->name, indexno);
+    if ((idx->fd = PF_OpenFile(idxname)) < 0) return (QPerrno = QPE_PF);
+    idx->indexno = indexno;
+    idx->field = field;
+    idx->type = type;
+    idx->len = len;
+    idx->desc = desc;
+    t->nindex++;
+    return QPE_OK;
+}
+
+/* an index on field whose scans run in the desc direction, or NULL */
+QPindex *QP_FindIndex(QPtable *t, int field, int desc) {
+    int i;
+    for (i = 0; i < t->nindex; i++)
+        if (t->index[i].field == field && t->index[i].desc == desc)
+            return &t->index[i];
+    return NULL;
+}
+
+int QP_CloseTable(QPtable *t) {
+    int i, error = QPE_OK;
+    for (i = 0; i < t->nindex; i++)
+        if (PF_CloseFile(t->index[i].fd) != PFE_OK) error = QPE_PF;
+    t->nindex = 0;
+    if (SP_CloseFile(t->heapfd) != PFE_OK) error = QPE_PF;
+    if (error != QPE_OK) QPerrno = error;
+    return error;
+}
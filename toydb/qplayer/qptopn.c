@@ -0,0 +1,222 @@
+/* qptopn.c
+ * Top-N operator: the first n tuples of its input in (field, desc) order.
+ *
+ * If the input is already in that order (an index scan, or a Sort) the
+ * operator is a Limit: it passes n tuples through and then stops pulling,
+ * so an index scan reads only the leaves and heap pages those n rows need.
+ * Otherwise the first next() call drains the input through a bounded binary
+ * heap holding the n best tuples seen so far, with the worst of them at the
+ * root; memory is n records no matter how large the input is. With n == 0
+ * it is a Limit whatever the input order: there is no heap to fill.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qp.h"
+
+typedef struct {
+    union { int i; float f; } key;
+    int koff, klen;         /* QP_CHAR key: offset and length in rec */
+    char *rec;
+    int reclen, cap;
+    long seq;               /* arrival order, breaks ties */
+} topent_t;
+
+typedef struct {
+    int field;
+    char type;
+    int desc;
+    int n;
+    long seen;
+    topent_t *ents;         /* heap of n entries, worst at ents[0] */
+    int nents;
+    int pos;                /* output position once sorted */
+    int started;
+} topn_t;
+
+/* qsort() has no context argument; the operator being sorted is kept here */
+static topn_t *sort_topn;
+
+static void set_key(topent_t *e, int field, char type) {
+    const char *f;
+    switch (type) {
+    case QP_INT: e->key.i = QP_FieldInt(e->rec, e->reclen, field); break;
+    case QP_FLOAT: e->key.f = QP_FieldFloat(e->rec, e->reclen, field); break;
+    default:
+        f = QP_GetField(e->rec, e->reclen, field, &e->klen);
+        if (!f) e->klen = 0;
+        e->koff = f ? (int)(f - e->rec) : 0;
+        break;
+    }
+}
+
+/* <0 if a comes before b in the output order */
+static int compare_ents(const topn_t *st, const topent_t *a, const topent_t *b) {
+    int c;
+    switch (st->type) {
+    case QP_INT: c = (a->key.i > b->key.i) - (a->key.i < b->key.i); break;
+    case QP_FLOAT: c = (a->key.f > b->key.f) - (a->key.f < b->key.f); break;
+    default:
+        c = memcmp(a->rec + a->koff, b->rec + b->koff,
+                   a->klen < b->klen ? a->klen : b->klen);
+        if (c == 0) c = a->klen - b->klen;
+        break;
+    }
+    if (st->desc) c = -c;
+    if (c == 0) c = (a->seq > b->seq) - (a->seq < b->seq);
+    return c;
+}
+
+static int qsort_cmp(const void *a, const void *b) {
+    return compare_ents(sort_topn, (const topent_t *)a, (const topent_t *)b);
+}
+
+/* restore the heap below i: every entry comes after its children */
+static void sift_down(topn_t *st, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        topent_t t;
+        if (l < st->nents && compare_ents(st, &st->ents[l], &st->ents[m]) > 0) m = l;
+        if (r < st->nents && compare_ents(st, &st->ents[r], &st->ents[m]) > 0) m = r;
+        if (m == i) return;
+        t = st->ents[i]; st->ents[i] = st->ents[m]; st->ents[m] = t;
+        i = m;
+    }
+}
+
+static void sift_up(topn_t *st, int i) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        topent_t t;
+        if (compare_ents(st, &st->ents[i], &st->ents[p]) <= 0) return;
+        t = st->ents[i]; st->ents[i] = st->ents[p]; st->ents[p] = t;
+        i = p;
+    }
+}
+
+static int set_rec(topent_t *e, const QPtuple *t) {
+    if (t->reclen > e->cap) {
+        char *n = (char *)realloc(e->rec, t->reclen);
+        if (!n) return QPE_NOMEM;
+        e->rec = n;
+        e->cap = t->reclen;
+    }
+    memcpy(e->rec, t->rec, t->reclen);
+    e->reclen = t->reclen;
+    return QPE_OK;
+}
+
+/* drain the input, keeping the n best tuples, then sort them */
+static int topn_fill(QPop *op) {
+    topn_t *st = (topn_t *)op->state;
+    QPtuple t;
+    topent_t cand;
+    long bytes = 0;
+    int error;
+
+    memset(&cand, 0, sizeof(cand));
+    while ((error = QP_Next(op->child[0], &t)) == QPE_OK) {
+        if (st->nents < st->n) {
+            topent_t *e = &st->ents[st->nents];
+            if ((error = set_rec(e, &t)) != QPE_OK) return error;
+            set_key(e, st->field, st->type);
+            e->seq = st->seen++;
+            bytes += e->cap;
+            st->nents++;
+            sift_up(st, st->nents - 1);
+            continue;
+        }
+        /* full: the tuple replaces the root only if it comes before it */
+        cand.rec = t.rec;
+        cand.reclen = t.reclen;
+        set_key(&cand, st->field, st->type);
+        cand.seq = st->seen++;
+        if (compare_ents(st, &cand, &st->ents[0]) >= 0) continue;
+        bytes -= st->ents[0].cap;
+        if ((error = set_rec(&st->ents[0], &t)) != QPE_OK) return error;
+        bytes += st->ents[0].cap;
+        set_key(&st->ents[0], st->field, st->type);
+        st->ents[0].seq = cand.seq;
+        sift_down(st, 0);
+        if (bytes > op->peakbytes) op->peakbytes = bytes;
+    }
+    if (error != QPE_EOF) return error;
+    if (bytes > op->peakbytes) op->peakbytes = bytes;
+    sort_topn = st;
+    qsort(st->ents, st->nents, sizeof(topent_t), qsort_cmp);
+    return QPE_OK;
+}
+
+static int topn_next(QPop *op, QPtuple *tup) {
+    topn_t *st = (topn_t *)op->state;
+    int error;
+
+    if (!st->started) {
+        st->started = 1;
+        if ((error = topn_fill(op)) != QPE_OK) return error;
+    }
+    if (st->pos >= st->nents) return QPE_EOF;
+    tup->rec = st->ents[st->pos].rec;
+    tup->reclen = st->ents[st->pos].reclen;
+    tup->rid.page = tup->rid.slot = -1;
+    st->pos++;
+    return QPE_OK;
+}
+
+/* input already ordered: stop after n tuples without pulling another */
+static int limit_next(QPop *op, QPtuple *tup) {
+    topn_t *st = (topn_t *)op->state;
+    int error;
+
+    if (st->seen >= st->n) return QPE_EOF;
+    if ((error = QP_Next(op->child[0], tup)) != QPE_OK) return error;
+    st->seen++;
+    return QPE_OK;
+}
+
+static void topn_close(QPop *op) {
+    topn_t *st = (topn_t *)op->state;
+    int i;
+    if (!st->ents) return;
+    for (i = 0; i < st->n; i++) free(st->ents[i].rec);
+    free(st->ents);
+}
+
+QPop *QP_TopNOpen(QPop *child, int field, char type, int desc, int n) {
+    QPop *op;
+    topn_t *st;
+    int ordered;
+
+    if (!child) return NULL;
+    if (n < 0) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    ordered = n == 0 || (child->orderfield == field && child->ordertype == type
+        && child->orderdesc == (desc != 0));
+    if ((op = QP_NewOp(ordered ? "Limit" : "TopN", sizeof(topn_t))) == NULL)
+        return NULL;
+    st = (topn_t *)op->state;
+    st->field = field;
+    st->type = type;
+    st->desc = desc != 0;
+    st->n = n;
+    op->close = topn_close;
+    op->child[0] = child;
+    op->orderfield = field;
+    op->ordertype = type;
+    op->orderdesc = st->desc;
+    if (ordered) {
+        op->next = limit_next;
+        return op;
+    }
+    if ((st->ents = (topent_t *)calloc(n, sizeof(topent_t))) == NULL) {
+        QPerrno = QPE_NOMEM;
+        op->child[0] = NULL;
+        QP_Close(op);
+        return NULL;
+    }
+    op->next = topn_next;
+    return op;
+}
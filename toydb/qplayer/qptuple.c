@@ -0,0 +1,411 @@
+/* qptuple.c
+ * Table schemas, the binary tuple format of qp.h, and a Filter over binary
+ * tuples.
+ *
+ * A text record has to be split at every ';' up to a field and the field
+ * converted with atoi/atof each time it is read. A binary tuple is encoded
+ * once at load time: int and float fields are stored native at offsets
+ * fixed by the schema, and char fields are reached through a small offset
+ * table, so reading any field is a bitmap test and a memcpy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "qp.h"
+
+#define NULLBYTES(s)	(((s)->ncols + 7) / 8)
+
+void QP_SchemaLayout(QPschema *s) {
+    int c, off = NULLBYTES(s), var = 0;
+
+    for (c = 0; c < s->ncols; c++)
+        if (s->type[c] != QP_CHAR) {
+            s->fixedoff[c] = off;
+            off += 4;
+        }
+    s->varstart = off;
+    for (c = 0; c < s->ncols; c++)
+        if (s->type[c] == QP_CHAR)
+            s->fixedoff[c] = off + var++ * (int)sizeof(unsigned short);
+    s->nvar = var;
+}
+
+/* value of the text field f (flen bytes) as an int / float; 0 if it is not
+   one */
+static int parse_int(const char *f, int flen, int *v) {
+    char tmp[32], *end;
+    long l;
+
+    if (flen <= 0 || flen >= (int)sizeof(tmp)) return 0;
+    memcpy(tmp, f, flen);
+    tmp[flen] = '\0';
+    errno = 0;
+    l = strtol(tmp, &end, 10);
+    if (*end || errno || l < INT_MIN || l > INT_MAX) return 0;
+    *v = (int)l;
+    return 1;
+}
+
+static int parse_float(const char *f, int flen, float *v) {
+    char tmp[64], *end;
+
+    if (flen <= 0 || flen >= (int)sizeof(tmp)) return 0;
+    memcpy(tmp, f, flen);
+    tmp[flen] = '\0';
+    *v = strtof(tmp, &end);
+    return *end == '\0';
+}
+
+/* digits after the point of the text field f */
+static int decimals(const char *f, int flen) {
+    const char *dot = memchr(f, '.', flen);
+    return dot ? (int)(f + flen - dot - 1) : 0;
+}
+
+/* 1 if the text field f is an int / a float with scale decimals that
+   QP_DecodeTuple prints back as it is; *iv or *fv gets the value */
+static int exact_int(const char *f, int flen, int *iv) {
+    char tmp[32];
+    return parse_int(f, flen, iv)
+        && snprintf(tmp, sizeof(tmp), "%d", *iv) == flen
+        && memcmp(tmp, f, flen) == 0;
+}
+
+static int exact_float(const char *f, int flen, int scale, float *fv) {
+    char tmp[64];
+    return parse_float(f, flen, fv)
+        && snprintf(tmp, sizeof(tmp), "%.*f", scale, *fv) == flen
+        && memcmp(tmp, f, flen) == 0;
+}
+
+int QP_SchemaInfer(const char *datafile, const char *table, QPschema *s) {
+    FILE *f;
+    char *line = NULL;
+    size_t cap = 0;
+    int seen[QP_MAXFIELDS];     /* column has a non-empty value */
+    int c, L;
+
+    if ((f = fopen(datafile, "r")) == NULL) return (QPerrno = QPE_UNIX);
+    memset(s, 0, sizeof(*s));
+    memset(seen, 0, sizeof(seen));
+    strncpy(s->table, table, QP_MAXNAME - 1);
+    while ((L = QP_ReadLine(f, &line, &cap)) >= 0) {
+        int flen, iv;
+        const char *p = line, *semi;
+        float fv;
+
+        for (c = 0; c < QP_MAXFIELDS; c++) {
+            semi = memchr(p, ';', line + L - p);
+            flen = (int)((semi ? semi : line + L) - p);
+            if (c >= s->ncols) {
+                s->ncols = c + 1;
+                s->type[c] = QP_INT;
+            }
+            if (flen > 0) {
+                if (flen > s->width[c]) s->width[c] = flen;
+                if (s->type[c] == QP_INT && !exact_int(p, flen, &iv)) {
+                    /* a float has decimals, which the ints before it would
+                       not print back with; no decimals is an int too
+                       large, or not written as one */
+                    s->type[c] = QP_FLOAT;
+                    s->scale[c] = decimals(p, flen);
+                    if (seen[c] || s->scale[c] == 0) s->type[c] = QP_CHAR;
+                }
+                if (s->type[c] == QP_FLOAT && !exact_float(p, flen, s->scale[c], &fv))
+                    s->type[c] = QP_CHAR;
+                seen[c] = 1;
+            }
+            if (!semi) break;
+            p = semi + 1;
+        }
+    }
+    free(line);
+    fclose(f);
+    /* a column that is always empty takes no room as a char column */
+    for (c = 0; c < s->ncols; c++) {
+        if (!seen[c]) s->type[c] = QP_CHAR;
+        if (s->type[c] != QP_CHAR) s->width[c] = 4;
+        if (s->type[c] != QP_FLOAT) s->scale[c] = 0;
+    }
+    QP_SchemaLayout(s);
+    return QPE_OK;
+}
+
+static int open_catalog(const char *catalog) {
+    int fd = SP_OpenFile(catalog);
+    if (fd >= 0) return fd;
+    if (SP_CreateFile(catalog) != PFE_OK) return -1;
+    return SP_OpenFile(catalog);
+}
+
+int QP_SchemaPut(const char *catalog, const QPschema *s) {
+    SPscan *scan;
+    SPRID rid, *old = NULL;
+    char *rec;
+    int fd, reclen, nold = 0, i, error = QPE_OK;
+
+    if ((fd = open_catalog(catalog)) < 0) return (QPerrno = QPE_PF);
+    if (SP_ScanOpen(fd, &scan) != 0) {
+        SP_CloseFile(fd);
+        return (QPerrno = QPE_NOMEM);
+    }
+    while (SP_ScanNext(scan, &rec, &reclen, &rid) == 0) {
+        if (reclen == sizeof(QPschema)
+                && strncmp(((QPschema *)rec)->table, s->table, QP_MAXNAME) == 0) {
+            SPRID *n = (SPRID *)realloc(old, (nold + 1) * sizeof(SPRID));
+            if (!n) { free(rec); error = QPE_NOMEM; break; }
+            old = n;
+            old[nold++] = rid;
+        }
+        free(rec);
+    }
+    SP_ScanClose(scan);
+    for (i = 0; i < nold && error == QPE_OK; i++)
+        if (SP_DeleteRec(fd, old[i]) != 0) error = QPE_PF;
+    free(old);
+    if (error == QPE_OK && SP_AppendRec(fd, (const char *)s, sizeof(*s), NULL) != 0)
+        error = QPE_PF;
+    if (SP_CloseFile(fd) != PFE_OK && error == QPE_OK) error = QPE_PF;
+    return error == QPE_OK ? QPE_OK : (QPerrno = error);
+}
+
+int QP_SchemaGet(const char *catalog, const char *table, QPschema *s) {
+    SPscan *scan;
+    char *rec;
+    int fd, reclen, found = 0;
+
+    if ((fd = SP_OpenFile(catalog)) < 0) return (QPerrno = QPE_PF);
+    if (SP_ScanOpen(fd, &scan) != 0) {
+        SP_CloseFile(fd);
+        return (QPerrno = QPE_NOMEM);
+    }
+    while (!found && SP_ScanNext(scan, &rec, &reclen, NULL) == 0) {
+        if (reclen == sizeof(QPschema)
+                && strncmp(((QPschema *)rec)->table, table, QP_MAXNAME) == 0) {
+            memcpy(s, rec, sizeof(*s));
+            found = 1;
+        }
+        free(rec);
+    }
+    SP_ScanClose(scan);
+    SP_CloseFile(fd);
+    return found ? QPE_OK : (QPerrno = QPE_EOF);
+}
+
+int QP_EncodeTuple(const QPschema *s, const char *rec, int reclen, char *out) {
+    const char *p = rec, *end = rec + reclen, *semi;
+    unsigned short var;
+    int c, flen, iv, n = s->varstart + (s->nvar + 1) * (int)sizeof(unsigned short);
+    float fv;
+
+    memset(out, 0, s->varstart);
+    for (c = 0; c < s->ncols; c++) {
+        /* fields missing from the end of the record are empty */
+        if (p > end) flen = 0;
+        else {
+            semi = memchr(p, ';', end - p);
+            flen = (int)((semi ? semi : end) - p);
+        }
+        if (flen == 0) out[c / 8] |= 1 << (c % 8);
+        switch (s->type[c]) {
+        case QP_INT:
+            if (flen > 0 && !exact_int(p, flen, &iv)) return QPE_INVALIDARG;
+            if (flen > 0) memcpy(out + s->fixedoff[c], &iv, 4);
+            break;
+        case QP_FLOAT:
+            if (flen > 0 && !exact_float(p, flen, s->scale[c], &fv))
+                return QPE_INVALIDARG;
+            if (flen > 0) memcpy(out + s->fixedoff[c], &fv, 4);
+            break;
+        default:
+            if (n + flen > QP_MAXREC) return QPE_INVALIDARG;
+            var = (unsigned short)n;
+            memcpy(out + s->fixedoff[c], &var, sizeof(var));
+            memcpy(out + n, p, flen);
+            n += flen;
+            break;
+        }
+        p += flen + 1;
+    }
+    /* fields past the schema's would be lost */
+    if (p <= end) return QPE_INVALIDARG;
+    var = (unsigned short)n;
+    memcpy(out + s->varstart + s->nvar * sizeof(unsigned short), &var, sizeof(var));
+    return n;
+}
+
+int QP_DecodeTuple(const QPschema *s, const char *tup, char *out) {
+    int c, n = 0, len;
+    const char *f;
+
+    for (c = 0; c < s->ncols; c++) {
+        if (c > 0) out[n++] = ';';
+        if (QP_TupleIsNull(s, tup, c)) continue;
+        switch (s->type[c]) {
+        case QP_INT:
+            n += snprintf(out + n, QP_MAXREC - n, "%d", QP_TupleInt(s, tup, c));
+            break;
+        case QP_FLOAT:
+            n += snprintf(out + n, QP_MAXREC - n, "%.*f", s->scale[c],
+                QP_TupleFloat(s, tup, c));
+            break;
+        default:
+            f = QP_TupleChar(s, tup, c, &len);
+            memcpy(out + n, f, len);
+            n += len;
+            break;
+        }
+    }
+    return n;
+}
+
+int QP_TupleIsNull(const QPschema *s, const char *tup, int col) {
+    return (tup[col / 8] >> (col % 8)) & 1;
+}
+
+int QP_TupleInt(const QPschema *s, const char *tup, int col) {
+    int v;
+    memcpy(&v, tup + s->fixedoff[col], sizeof(int));
+    return v;
+}
+
+float QP_TupleFloat(const QPschema *s, const char *tup, int col) {
+    float v;
+    memcpy(&v, tup + s->fixedoff[col], sizeof(float));
+    return v;
+}
+
+const char *QP_TupleChar(const QPschema *s, const char *tup, int col,
+                         int *len) {
+    unsigned short start, end;
+    memcpy(&start, tup + s->fixedoff[col], sizeof(start));
+    memcpy(&end, tup + s->fixedoff[col] + sizeof(start), sizeof(end));
+    *len = end - start;
+    return tup + start;
+}
+
+int QP_LoadBinaryHeap(const char *datafile, const char *heapname,
+                      const QPschema *s, int maxrecs) {
+    FILE *f;
+    char *line = NULL, tup[QP_MAXREC];
+    size_t cap = 0;
+    int fd, n = 0, len, L;
+
+    if ((f = fopen(datafile, "r")) == NULL) return (QPerrno = QPE_UNIX);
+    PF_DestroyFile((char *)heapname);
+    if (SP_CreateFile(heapname) != PFE_OK || (fd = SP_OpenFile(heapname)) < 0) {
+        fclose(f);
+        return (QPerrno = QPE_PF);
+    }
+    while ((maxrecs <= 0 || n < maxrecs) && (L = QP_ReadLine(f, &line, &cap)) >= 0) {
+        if ((len = QP_EncodeTuple(s, line, L, tup)) < 0) {
+            n = QPerrno = len;
+            break;
+        }
+        if (SP_AppendRec(fd, tup, len, NULL) != 0) {
+            n = QPerrno = QPE_PF;
+            break;
+        }
+        n++;
+    }
+    free(line);
+    fclose(f);
+    if (SP_CloseFile(fd) != PFE_OK) return (QPerrno = QPE_PF);
+    return n;
+}
+
+/******************** filter ********************/
+
+typedef struct {
+    const QPschema *schema;
+    int field;
+    char type;
+    int scanop;
+    int ival;
+    float fval;
+    char *value;
+    int vlen;
+} tuplefilter_t;
+
+static int tuplefilter_next(QPop *op, QPtuple *tup) {
+    tuplefilter_t *st = (tuplefilter_t *)op->state;
+    const QPschema *s = st->schema;
+    int error, c, match, len;
+
+    while ((error = QP_Next(op->child[0], tup)) == QPE_OK) {
+        if (QP_TupleIsNull(s, tup->rec, st->field)) continue;
+        switch (st->type) {
+        case QP_INT: {
+            int v = QP_TupleInt(s, tup->rec, st->field);
+            c = (v > st->ival) - (v < st->ival);
+            break;
+        }
+        case QP_FLOAT: {
+            float v = QP_TupleFloat(s, tup->rec, st->field);
+            c = (v > st->fval) - (v < st->fval);
+            break;
+        }
+        default: {
+            const char *f = QP_TupleChar(s, tup->rec, st->field, &len);
+            c = memcmp(f, st->value, len < st->vlen ? len : st->vlen);
+            if (c == 0) c = (len > st->vlen) - (len < st->vlen);
+            break;
+        }
+        }
+        switch (st->scanop) {
+        case QP_EQ: match = c == 0; break;
+        case QP_LT: match = c < 0; break;
+        case QP_GT: match = c > 0; break;
+        case QP_LE: match = c <= 0; break;
+        case QP_GE: match = c >= 0; break;
+        default: match = 1; break;
+        }
+        if (match) return QPE_OK;
+    }
+    return error;
+}
+
+static void tuplefilter_close(QPop *op) {
+    free(((tuplefilter_t *)op->state)->value);
+}
+
+QPop *QP_TupleFilterOpen(QPop *child, const QPschema *s, int field,
+                         int scanop, const char *value) {
+    QPop *op;
+    tuplefilter_t *st;
+
+    if (!child) return NULL;
+    if (field < 0 || field >= s->ncols || !value) {
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    if ((op = QP_NewOp("TupleFilter", sizeof(tuplefilter_t))) == NULL)
+        return NULL;
+    st = (tuplefilter_t *)op->state;
+    st->schema = s;
+    st->field = field;
+    st->type = s->type[field];
+    st->scanop = scanop;
+    st->vlen = strlen(value);
+    if ((st->type == QP_INT && !parse_int(value, st->vlen, &st->ival))
+            || (st->type == QP_FLOAT && !parse_float(value, st->vlen, &st->fval))) {
+        free(op);
+        QPerrno = QPE_INVALIDARG;
+        return NULL;
+    }
+    if ((st->value = strdup(value)) == NULL) {
+        free(op);
+        QPerrno = QPE_NOMEM;
+        return NULL;
+    }
+    op->next = tuplefilter_next;
+    op->close = tuplefilter_close;
+    op->child[0] = child;
+    op->orderfield = child->orderfield;
+    op->ordertype = child->ordertype;
+    op->orderdesc = child->orderdesc;
+    return op;
+}
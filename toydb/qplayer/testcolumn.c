@@ -0,0 +1,187 @@
+/* testcolumn.c
+ * Column files vs. heap files on rollhist and gradsum.
+ *
+ * Each table is loaded as a text heap (QP_LoadHeap), a binary heap
+ * (QP_LoadBinaryHeap) and a column file (QP_ColBuild). The sizes of the
+ * three and the encodings picked for every column are printed, then each
+ * predicate is counted by
+ *  - text:    HeapScan + Filter on the text heap
+ *  - binary:  HeapScan + TupleFilter on the binary heap
+ *  - decoded: a column scan that decodes every value, tested here
+ *  - encoded: a column scan with the predicate, tested on min/max and codes
+ * Times are the best of REPEAT runs.
+ *
+ * Usage: testcolumn [datadir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "qp.h"
+
+#define TEXT "/tmp/qp_col_text"
+#define BINARY "/tmp/qp_col_binary"
+#define COLUMN "/tmp/qp_col_column"
+#define REPEAT 5
+
+enum { TEXTHEAP, BINARYHEAP, DECODED, ENCODED, NVARIANTS };
+
+static const char *opname[] = { "all", "=", "<", ">", "<=", ">=" };
+
+static struct {
+    const char *table;
+    int field;
+    int op;
+    const char *value;
+} preds[] = {
+    { "rollhist", 2, QP_EQ, "1995" },
+    { "rollhist", 2, QP_GE, "2000" },
+    { "rollhist", 0, QP_LT, "960000" },
+    { "rollhist", 3, QP_EQ, "0000-00-00" },
+    { "gradsum", 6, QP_GE, "9.0" },
+    { "gradsum", 6, QP_EQ, "8.00" },
+    { "gradsum", 1, QP_EQ, "1995" },
+    { "gradsum", 7, QP_LT, "1000" },
+};
+
+/* does row r of a decoded batch satisfy (value op constant) */
+static int test_row(const QPcolbatch *b, int r, char type, int op, const char *value) {
+    int c;
+    if (b->null[r]) return 0;
+    if (type == QP_INT) {
+        int v = atoi(value);
+        c = (b->ival[r] > v) - (b->ival[r] < v);
+    } else if (type == QP_FLOAT) {
+        float v = strtof(value, NULL);
+        c = (b->fval[r] > v) - (b->fval[r] < v);
+    } else {
+        int len = strlen(value);
+        c = memcmp(b->sval[r], value, b->slen[r] < len ? b->slen[r] : len);
+        if (c == 0) c = (b->slen[r] > len) - (b->slen[r] < len);
+    }
+    switch (op) {
+    case QP_EQ: return c == 0;
+    case QP_LT: return c < 0;
+    case QP_GT: return c > 0;
+    case QP_LE: return c <= 0;
+    default:    return c >= 0;
+    }
+}
+
+/* count the rows with (field op value) one way; *skipped gets the segments
+   an encoded scan passed over */
+static long count(int v, const QPschema *s, int field, int op, const char *value,
+                  int *skipped) {
+    QPcolfile *cf;
+    QPcolscan *cs;
+    QPcolbatch b;
+    QPop *plan;
+    QPtuple t;
+    long n = 0;
+    int fd, r;
+
+    *skipped = 0;
+    if (v == TEXTHEAP || v == BINARYHEAP) {
+        fd = SP_OpenFile(v == TEXTHEAP ? TEXT : BINARY);
+        plan = v == TEXTHEAP
+            ? QP_FilterOpen(QP_HeapScanOpen(fd), field, s->type[field], op, value)
+            : QP_TupleFilterOpen(QP_HeapScanOpen(fd), s, field, op, value);
+        if (!plan) {
+            QP_PrintError("filter");
+            exit(1);
+        }
+        while (QP_Next(plan, &t) == QPE_OK) n++;
+        QP_Close(plan);
+        SP_CloseFile(fd);
+        return n;
+    }
+    if (!(cf = QP_ColOpen(COLUMN))
+            || !(cs = v == DECODED ? QP_ColScanOpen(cf, field, QP_ALL, NULL, 1)
+                                   : QP_ColScanOpen(cf, field, op, value, 0))) {
+        QP_PrintError("column scan");
+        exit(1);
+    }
+    while (QP_ColScanNext(cs, &b) == QPE_OK) {
+        if (v == ENCODED) n += b.nmatch;
+        else for (r = 0; r < b.nrows; r++) n += test_row(&b, r, s->type[field], op, value);
+    }
+    *skipped = QP_ColScanSkipped(cs);
+    QP_ColScanClose(cs);
+    QP_ColClose(cf);
+    return n;
+}
+
+static int npages(const char *fname) {
+    int fd = PF_OpenFile((char *)fname), n = PF_GetNumPages(fd);
+    PF_CloseFile(fd);
+    return n;
+}
+
+/* load table three ways and print the sizes and encodings */
+static void load(const char *datadir, const char *table, QPschema *s) {
+    char path[512], encs[128];
+    QPcolfile *cf;
+    int n, c, text, col;
+
+    snprintf(path, sizeof(path), "%s/%s.txt", datadir, table);
+    if (QP_SchemaInfer(path, table, s) != QPE_OK
+            || (n = QP_LoadHeap(path, TEXT, 0)) < 0
+            || QP_LoadBinaryHeap(path, BINARY, s, 0) != n
+            || QP_ColBuild(path, COLUMN, s, 0) != n
+            || !(cf = QP_ColOpen(COLUMN))) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    text = npages(TEXT);
+    col = npages(COLUMN);
+    printf("%s rows=%d pages: text=%d binary=%d column=%d, ratio text/column=%.1f binary/column=%.1f\n",
+        table, n, text, npages(BINARY), col, (double)text / col,
+        (double)npages(BINARY) / col);
+    for (c = 0; c < s->ncols; c++) {
+        long bytes = QP_ColInfo(cf, c, encs, sizeof(encs));
+        printf("  f%d %c %ld bytes (%.2f/row) %s\n", c, s->type[c], bytes,
+            (double)bytes / n, encs);
+    }
+    QP_ColClose(cf);
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data", *loaded = "";
+    QPschema s;
+    int i, v, r, skipped = 0;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    printf("test, text-ms, binary-ms, decoded-ms, encoded-ms, rows, segments-skipped\n");
+    for (i = 0; i < (int)(sizeof(preds) / sizeof(preds[0])); i++) {
+        double best[NVARIANTS];
+        long rows[NVARIANTS];
+        if (strcmp(loaded, preds[i].table) != 0) {
+            printf("\n");
+            load(datadir, preds[i].table, &s);
+            loaded = preds[i].table;
+        }
+        for (v = 0; v < NVARIANTS; v++) {
+            best[v] = -1;
+            for (r = 0; r < REPEAT; r++) {
+                struct timespec t0, t1;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                rows[v] = count(v, &s, preds[i].field, preds[i].op, preds[i].value,
+                                &skipped);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                if (best[v] < 0 || PF_MsBetween(t0, t1) < best[v]) best[v] = PF_MsBetween(t0, t1);
+            }
+        }
+        printf("%s f%d %s %s,%.2f,%.2f,%.2f,%.2f,%ld,%d%s\n", preds[i].table,
+            preds[i].field, opname[preds[i].op], preds[i].value, best[TEXTHEAP],
+            best[BINARYHEAP], best[DECODED], best[ENCODED], rows[ENCODED], skipped,
+            rows[TEXTHEAP] == rows[ENCODED] && rows[BINARYHEAP] == rows[ENCODED]
+            && rows[DECODED] == rows[ENCODED] ? "" : " MISMATCH");
+    }
+
+    PF_DestroyFile(TEXT);
+    PF_DestroyFile(BINARY);
+    PF_DestroyFile(COLUMN);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* testjoin.c
+ * Join benchmark: gradsum JOIN student ON rollno (field 0 of both).
+ *
+ * Both files are loaded into SP heap files and indexed on rollno. The join
+ * is then run twice through the planner:
+ *  - merge:      both tables opened with their rollno index, so the plan is
+ *                a merge join over two AM index scans
+ *  - sort-merge: tables opened without indexes, so both heap scans are
+ *                sorted first (external sort with `mem` bytes per sort)
+ *
+ * It is then run as an index nested-loop join, gradsum heap scan outer and
+ * the student rollno index inner, once probing per outer row and once in
+ * sorted batches of `batch` rows, with the pages read per outer row.
+ *
+ * Usage: testjoin [datadir] [mem_bytes] [batch]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "qp.h"
+
+#define GRADSUM "/tmp/qp_gradsum"
+#define STUDENT "/tmp/qp_student"
+#define ROLLNO 0
+
+static long elapsed_ms(struct timespec a, struct timespec b) {
+    return (b.tv_sec - a.tv_sec) * 1000 + (b.tv_nsec - a.tv_nsec) / 1000000;
+}
+
+static int load(const char *datadir, const char *file, const char *heap) {
+    char path[512];
+    int n;
+    snprintf(path, sizeof(path), "%s/%s", datadir, file);
+    if ((n = QP_LoadHeap(path, heap, 0)) < 0) { QP_PrintError(path); exit(1); }
+    if (QP_BuildIndex(heap, 0, ROLLNO, QP_INT, sizeof(int), 0) < 0) {
+        QP_PrintError("build index");
+        exit(1);
+    }
+    return n;
+}
+
+/* drain plan and print one CSV row for it */
+static void measure(const char *label, const char *method, QPop *plan,
+                    QPop *outer) {
+    QPtuple t;
+    PFstats before, after;
+    struct timespec t0, t1;
+    long rows = 0, peak;
+    int error;
+
+    PF_GetStats(&before);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while ((error = QP_Next(plan, &t)) == QPE_OK) rows++;
+    if (error != QPE_EOF) QP_PrintError("join");
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    PF_GetStats(&after);
+
+    peak = plan->peakbytes + plan->child[0]->peakbytes
+        + (plan->child[1] ? plan->child[1]->peakbytes : 0);
+    printf("%s,%s,%ld,%ld,%ld,%d,%d,%d,%d,%d,%d\n", label, method,
+        elapsed_ms(t0, t1), rows, peak,
+        after.phys_reads - before.phys_reads,
+        after.phys_writes - before.phys_writes,
+        after.logical_reads - before.logical_reads,
+        after.logical_writes - before.logical_writes,
+        after.page_hits - before.page_hits,
+        after.page_misses - before.page_misses);
+    if (outer && outer->nrows > 0)
+        printf("  pages per outer row: logical %.2f, physical %.2f\n",
+            (double)(after.logical_reads - before.logical_reads) / outer->nrows,
+            (double)(after.phys_reads - before.phys_reads) / outer->nrows);
+    QP_PrintPlan(plan, 1);
+}
+
+static void run(const char *label, int use_index, long mem) {
+    QPtable g, s;
+    QPop *plan;
+    int method;
+
+    if (QP_OpenTable(&g, GRADSUM) != QPE_OK || QP_OpenTable(&s, STUDENT) != QPE_OK) {
+        QP_PrintError("open table");
+        exit(1);
+    }
+    if (use_index) {
+        QP_AddIndex(&g, 0, ROLLNO, QP_INT, sizeof(int), 0);
+        QP_AddIndex(&s, 0, ROLLNO, QP_INT, sizeof(int), 0);
+    }
+
+    if ((plan = QP_PlanJoin(&g, ROLLNO, &s, ROLLNO, QP_INT, mem, &method)) == NULL) {
+        QP_PrintError("plan");
+        exit(1);
+    }
+    measure(label, method == QP_JOIN_MERGE ? "merge" : "sort-merge", plan, NULL);
+    QP_Close(plan);
+    QP_CloseTable(&g);
+    QP_CloseTable(&s);
+}
+
+/* gradsum heap scan JOIN student via its rollno index */
+static void run_inl(const char *label, int batch) {
+    QPtable g, s;
+    QPop *outer, *plan;
+
+    if (QP_OpenTable(&g, GRADSUM) != QPE_OK || QP_OpenTable(&s, STUDENT) != QPE_OK
+            || QP_AddIndex(&s, 0, ROLLNO, QP_INT, sizeof(int), 0) != QPE_OK) {
+        QP_PrintError("open table");
+        exit(1);
+    }
+    outer = QP_HeapScanOpen(g.heapfd);
+    if ((plan = QP_IndexNLJoinOpen(outer, ROLLNO, s.heapfd, &s.index[0],
+                                   batch)) == NULL) {
+        QP_PrintError("index nested-loop join");
+        exit(1);
+    }
+    measure(label, batch > 1 ? "inl-batch" : "inl-naive", plan, outer);
+    QP_Close(plan);
+    QP_CloseTable(&g);
+    QP_CloseTable(&s);
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    long mem = QP_SORT_MEM;
+    int batch = QP_INLJ_BATCH;
+    int ng, ns;
+
+    if (argc > 1) datadir = argv[1];
+    if (argc > 2) mem = atol(argv[2]);
+    if (argc > 3) batch = atoi(argv[3]);
+
+    PF_Init();
+    ng = load(datadir, "gradsum.txt", GRADSUM);
+    ns = load(datadir, "student.txt", STUDENT);
+    printf("Loaded gradsum=%d student=%d records, sort memory %ld bytes\n",
+        ng, ns, mem);
+
+    printf("\nInputs, method, time-ms, rows, peak_bytes, phys_reads, phys_writes, logical_reads, logical_writes, page_hits, page_misses\n");
+    run("indexed", 1, mem);
+    run("heap", 0, mem);
+    run_inl("indexed-inner", 1);
+    run_inl("indexed-inner", batch);
+
+    PF_DestroyFile(GRADSUM);
+    PF_DestroyFile(STUDENT);
+    AM_DestroyIndex(GRADSUM, 0);
+    AM_DestroyIndex(STUDENT, 0);
+    return 0;
+}
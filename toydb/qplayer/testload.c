@@ -0,0 +1,254 @@
+/* testload.c
+ * Bulk loader vs. the line-at-a-time path on studregn and crsfmdt, each
+ * with an index on its rollno field.
+ *
+ *  - getline: QP_LoadHeap, then QP_BuildIndex (one AM_InsertEntry per row)
+ *  - bulk:    QP_BulkLoad with 1, 2 and 4 parse threads
+ *
+ * parse-MB/s is the file size over the CPU time the parse workers spent,
+ * i.e. what one core splits and parses; MB/s is over the whole load. After
+ * each bulk load the heap is compared record by record with the getline
+ * heap, the index is compared entry by entry (as (key, rid) pairs) with the
+ * getline index and probed for every 97th key, and then takes further
+ * inserts to check that the packed leaves split as usual.
+ *
+ * Then QP_BuildIndex over DUPFEW and DUPMANY rows of one key: the recIds of
+ * a key have to fit on one leaf, so the first index finds them all and the
+ * second must fail rather than drop the ones that do not fit.
+ *
+ * Usage: testload [datadir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "qp.h"
+
+#define BASE "/tmp/qp_load_base"
+#define BULK "/tmp/qp_load_bulk"
+#define EXTRA 2000
+#define DUPS "/tmp/qp_load_dups.txt"
+#define DUPFEW 600
+#define DUPMANY 2000
+
+typedef struct {
+    int key, rid;
+} pair_t;
+
+static int cmp_pair(const void *a, const void *b) {
+    const pair_t *x = a, *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return (x->rid > y->rid) - (x->rid < y->rid);
+}
+
+/* the index entries in scan order, with each key read back from the heap;
+   *ordered is cleared if the keys are not ascending */
+static pair_t *index_pairs(const char *heapname, int field, int *n,
+                           int *ordered) {
+    char idxname[QP_MAXNAME + 8], rec[QP_MAXREC];
+    pair_t *p = NULL;
+    int cap = 0, sd, recid, reclen, heapfd, idxfd;
+    SPRID rid;
+
+    snprintf(idxname, sizeof(idxname), "%s.0", heapname);
+    if ((heapfd = SP_OpenFile(heapname)) < 0 || (idxfd = PF_OpenFile(idxname)) < 0) {
+        QP_PrintError(heapname);
+        exit(1);
+    }
+    *n = 0;
+    *ordered = 1;
+    sd = AM_OpenIndexScan(idxfd, QP_INT, sizeof(int), QP_ALL, NULL);
+    AM_EmptyStack();
+    while (sd >= 0 && (recid = AM_FindNextEntry(sd)) >= 0) {
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 4096;
+            if (!(p = realloc(p, cap * sizeof(pair_t)))) exit(1);
+        }
+        SP_IntToRid(recid, &rid);
+        p[*n].rid = recid;
+        p[*n].key = SP_GetRec(heapfd, rid, rec, sizeof(rec), &reclen) == 0
+            ? QP_FieldInt(rec, reclen, field) : -1;
+        if (*n > 0 && p[*n].key < p[*n - 1].key) *ordered = 0;
+        (*n)++;
+    }
+    if (sd >= 0) AM_CloseIndexScan(sd);
+    PF_CloseFile(idxfd);
+    SP_CloseFile(heapfd);
+    return p;
+}
+
+/* # of rids an equality scan of idxfd returns for key */
+static int probe(int idxfd, int key) {
+    int sd = AM_OpenIndexScan(idxfd, QP_INT, sizeof(int), QP_EQ, (char *)&key);
+    int n = 0;
+    AM_EmptyStack();
+    if (sd < 0) return -1;
+    while (AM_FindNextEntry(sd) >= 0) n++;
+    AM_CloseIndexScan(sd);
+    return n;
+}
+
+static int same_heaps(void) {
+    int fa = SP_OpenFile(BASE), fb = SP_OpenFile(BULK), same = 1;
+    SPscan *sa, *sb;
+    char *ra, *rb;
+    int la, lb, ea, eb;
+    SPRID ia, ib;
+
+    SP_ScanOpen(fa, &sa);
+    SP_ScanOpen(fb, &sb);
+    for (;;) {
+        ea = SP_ScanNext(sa, &ra, &la, &ia);
+        eb = SP_ScanNext(sb, &rb, &lb, &ib);
+        if (ea != 0 || eb != 0) {
+            if (ea != eb) same = 0;
+            break;
+        }
+        if (la != lb || memcmp(ra, rb, la) != 0 || SP_RidToInt(ia) != SP_RidToInt(ib))
+            same = 0;
+        free(ra);
+        free(rb);
+    }
+    SP_ScanClose(sa);
+    SP_ScanClose(sb);
+    SP_CloseFile(fa);
+    SP_CloseFile(fb);
+    return same;
+}
+
+/* compare the bulk index with the getline one, probe it, then insert EXTRA
+   more entries into it and scan it again */
+static const char *check(int field) {
+    pair_t *a, *b;
+    int na, nb, oa, ob, i, idxfd, ok;
+    char idxname[QP_MAXNAME + 8];
+
+    if (!same_heaps()) return "HEAP MISMATCH";
+    a = index_pairs(BASE, field, &na, &oa);
+    b = index_pairs(BULK, field, &nb, &ob);
+    if (!oa || !ob) return "INDEX NOT ORDERED";
+    qsort(a, na, sizeof(pair_t), cmp_pair);
+    qsort(b, nb, sizeof(pair_t), cmp_pair);
+    if (na != nb || memcmp(a, b, na * sizeof(pair_t)) != 0) return "INDEX MISMATCH";
+
+    snprintf(idxname, sizeof(idxname), "%s.0", BULK);
+    if ((idxfd = PF_OpenFile(idxname)) < 0) return "OPEN FAILED";
+    ok = 1;
+    for (i = 0; ok && i < nb; i += 97) {
+        int j = i, k = i;
+        while (j > 0 && b[j - 1].key == b[i].key) j--;
+        while (k < nb && b[k].key == b[i].key) k++;
+        if (probe(idxfd, b[i].key) != k - j) ok = 0;
+    }
+    /* fresh keys and more rids for existing ones, spread over the tree */
+    for (i = 0; ok && i < EXTRA; i++) {
+        int key = (i % 2) ? b[(long)i * nb / EXTRA].key : b[(long)i * nb / EXTRA].key + 1;
+        if (AM_InsertEntry(idxfd, QP_INT, sizeof(int), (char *)&key, 1000000 + i) != 0)
+            ok = 0;
+    }
+    PF_CloseFile(idxfd);
+    free(a);
+    free(b);
+    if (!ok) return "PROBE/INSERT FAILED";
+    b = index_pairs(BULK, field, &nb, &ob);
+    free(b);
+    if (nb != na + EXTRA) return "LOST INSERTS";
+    return "same heap and index";
+}
+
+static void bench(const char *datadir, const char *table, int field) {
+    char path[512];
+    QPloadindex idx = { 0, 0, QP_INT, sizeof(int), 0 };
+    QPloadstats st;
+    struct stat sb;
+    struct timespec t0, t1, t2;
+    int threads[] = { 1, 2, 4 };
+    int n, i;
+    double mb;
+
+    snprintf(path, sizeof(path), "%s/%s.txt", datadir, table);
+    idx.field = field;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ((n = QP_LoadHeap(path, BASE, 0)) < 0) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (QP_BuildIndex(BASE, 0, field, QP_INT, sizeof(int), 0) < 0) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    if (stat(path, &sb) < 0) {
+        perror(path);
+        exit(1);
+    }
+    mb = sb.st_size / 1e6;
+    printf("%s,getline,1,%d,%.2f,%.1f,%.1f,,,%.1f,\n", table, n, mb,
+        PF_MsBetween(t0, t2), mb / PF_MsBetween(t0, t2) * 1e3, PF_MsBetween(t1, t2));
+
+    for (i = 0; i < (int)(sizeof(threads) / sizeof(threads[0])); i++) {
+        if ((n = QP_BulkLoad(path, BULK, threads[i], &idx, 1, &st)) < 0) {
+            QP_PrintError(path);
+            exit(1);
+        }
+        printf("%s,bulk,%d,%d,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%s\n", table,
+            threads[i], n, mb, st.totalms, mb / st.totalms * 1e3, st.parsems,
+            mb / st.parsems * 1e3, st.indexms, check(field));
+    }
+
+    PF_DestroyFile(BASE);
+    PF_DestroyFile(BULK);
+    AM_DestroyIndex(BASE, 0);
+    AM_DestroyIndex(BULK, 0);
+}
+
+/* build an index over n rows with key 7; the entries an equality scan
+   finds, or -1 if QP_BuildIndex fails */
+static int dup_index(int n) {
+    char idxname[QP_MAXNAME + 8];
+    FILE *f;
+    int i, idxfd, found;
+
+    if (!(f = fopen(DUPS, "w"))) {
+        perror(DUPS);
+        exit(1);
+    }
+    fprintf(f, "Database dummy - table dups\n");
+    for (i = 0; i < n; i++) fprintf(f, "7;%d;\n", i);
+    fclose(f);
+    if (QP_LoadHeap(DUPS, BASE, 0) != n) {
+        QP_PrintError(DUPS);
+        exit(1);
+    }
+    found = -1;
+    snprintf(idxname, sizeof(idxname), "%s.0", BASE);
+    if (QP_BuildIndex(BASE, 0, 0, QP_INT, sizeof(int), 0) >= 0
+            && (idxfd = PF_OpenFile(idxname)) >= 0) {
+        found = probe(idxfd, 7);
+        PF_CloseFile(idxfd);
+    }
+    PF_DestroyFile(BASE);
+    AM_DestroyIndex(BASE, 0);
+    unlink(DUPS);
+    return found;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    int few, many;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    printf("table, loader, threads, records, MB, time-ms, MB/s, parse-ms, parse-MB/s, index-ms, check\n");
+    bench(datadir, "studregn", 6);
+    bench(datadir, "crsfmdt", 0);
+    few = dup_index(DUPFEW);
+    many = dup_index(DUPMANY);
+    printf("\nkey with %d rids: %d found; with %d: %s\n", DUPFEW, few, DUPMANY,
+        many < 0 ? "refused" : "BUILT");
+    return few != DUPFEW || many >= 0;
+}
@@ -0,0 +1,335 @@
+/* testmvcc.c
+ * Reporting scans during a load: a plain SP heap against an MVCC heap
+ * (pflayer/spmvcc.c), both with an AM index on the row id.
+ *
+ * n rows are loaded into each, then a report, a full heap scan followed
+ * by a full index scan, is run over and over, first alone and then
+ * interleaved with a load of n more rows, which inserts STEP rows (and
+ * their index entries) between every SCANSTEP tuples the report reads and
+ * commits every batch rows. A report is consistent if both of its scans
+ * return exactly the rows committed when it began. Each run is printed as
+ *   heap, load, reports, rows-scanned, scan-rows/sec, inserts/sec,
+ *   inconsistent-reports
+ * where the plain heap counts a batch as committed once it is inserted.
+ *
+ * Then every row of the MVCC heap is updated twice while a snapshot taken
+ * before the first update is held, and SP_MvccGC is run before and after
+ * the snapshot is released; the heap's pages and what each scan sees are
+ * printed. Last, a transaction is aborted and another is left uncommitted
+ * by a child process, and both must leave no trace. The child does it
+ * twice: once closing the heap, and once exiting without a close, with a
+ * pool that writes its data pages to the file but not page 0; then a
+ * transaction is committed, which would show the versions left if they
+ * had not been undone.
+ *
+ * Usage: testmvcc [n] [batch]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "qp.h"
+
+#define HEAP "/tmp/qp_mvcc"
+#define INDEXNO 0
+#define IDXNAME "/tmp/qp_mvcc.0"
+#define ID 0
+
+#define STEP 16         /* rows inserted between two steps of a report */
+#define SCANSTEP 256    /* tuples read by a report per step */
+#define NREPORTS 20     /* reports run without a load */
+
+static int mvcc;        /* the heap is an MVCC heap */
+static int heapfd, hint;
+static QPindex idx;
+static SPRID *rids;     /* current version of each row */
+
+static void fail(const char *what) {
+    fprintf(stderr, "testmvcc: %s failed\n", what);
+    exit(1);
+}
+
+static void open_heap(void) {
+    if ((heapfd = mvcc ? SP_MvccOpenFile(HEAP) : SP_OpenFile(HEAP)) < 0) fail("heap open");
+    if ((idx.fd = PF_OpenFile(IDXNAME)) < 0) fail("index open");
+    hint = 0;
+}
+
+static void close_heap(void) {
+    if ((mvcc ? SP_MvccCloseFile(heapfd) : SP_CloseFile(heapfd)) != 0) fail("heap close");
+    if (PF_CloseFile(idx.fd) != PFE_OK) fail("index close");
+}
+
+static void create(void) {
+    PF_DestroyFile(HEAP);
+    AM_DestroyIndex(HEAP, INDEXNO);
+    if ((mvcc ? SP_MvccCreateFile(HEAP) : SP_CreateFile(HEAP)) != 0) fail("heap create");
+    if (AM_CreateIndex(HEAP, INDEXNO, QP_INT, sizeof(int)) != 0) fail("index create");
+    idx.indexno = INDEXNO;
+    idx.field = ID;
+    idx.type = QP_INT;
+    idx.len = sizeof(int);
+    open_heap();
+}
+
+/* insert version v of row id */
+static void insert_row(int id, int v) {
+    char rec[64];
+    int len = snprintf(rec, sizeof(rec), "%d;name%d;%d", id, id, v);
+    SPRID rid;
+
+    if ((mvcc ? SP_MvccInsert(heapfd, rec, len, &rid)
+              : SP_InsertRecFrom(heapfd, &hint, rec, len, &rid)) != 0) fail("insert");
+    if (AM_InsertEntry(idx.fd, QP_INT, sizeof(int), (char *)&id, SP_RidToInt(rid)) != 0)
+        fail("index insert");
+    rids[id] = rid;
+}
+
+/* a report in progress */
+typedef struct {
+    QPop *op;
+    int phase;          /* 0: heap scan, 1: index scan */
+    long counted[2];
+    int expect;         /* rows committed when it began */
+    SPts snap;
+} report_t;
+
+static void report_open(report_t *r, int committed) {
+    memset(r, 0, sizeof(*r));
+    r->expect = committed;
+    if (mvcc) r->snap = SP_MvccSnapshot();
+    r->op = mvcc ? QP_MvccHeapScanOpen(heapfd, r->snap) : QP_HeapScanOpen(heapfd);
+    if (!r->op) fail("scan open");
+}
+
+/* read up to n tuples; returns 1 once the report is over, with *ok set to
+   whether it was consistent */
+static int report_step(report_t *r, int n, long *rows, int *ok) {
+    QPtuple t;
+    int error = QPE_OK;
+
+    while (n-- > 0 && (error = QP_Next(r->op, &t)) == QPE_OK) {
+        r->counted[r->phase]++;
+        (*rows)++;
+    }
+    if (error == QPE_OK) return 0;
+    if (error != QPE_EOF) fail("scan");
+    QP_Close(r->op);
+    if (r->phase == 0) {
+        r->phase = 1;
+        /* the plain heap's entries are read when the scan opens as well */
+        r->op = mvcc ? QP_MvccIndexScanOpen(heapfd, &idx, QP_ALL, NULL, r->snap)
+                     : QP_BitmapScanOpen(heapfd, &idx, QP_ALL, NULL);
+        if (!r->op) fail("index scan open");
+        return 0;
+    }
+    if (mvcc) SP_MvccRelease(r->snap);
+    *ok = r->counted[0] == r->expect && r->counted[1] == r->expect;
+    return 1;
+}
+
+/* reports alone, or while rows n..2n-1 are loaded */
+static void run(int n, int batch, int load) {
+    struct timespec a, b;
+    report_t r;
+    double scanms = 0, loadms = 0;
+    long rows = 0;
+    int reports = 0, bad = 0, ok, committed = n, next = n, i;
+
+    report_open(&r, committed);
+    while (load ? next < 2 * n : reports < NREPORTS) {
+        if (load) {
+            clock_gettime(CLOCK_MONOTONIC, &a);
+            for (i = 0; i < STEP && next < 2 * n; i++, next++) {
+                if (mvcc && (next - n) % batch == 0 && SP_MvccBegin() == 0) fail("begin");
+                insert_row(next, 0);
+                if ((next - n) % batch == batch - 1 || next == 2 * n - 1) {
+                    if (mvcc && SP_MvccCommit() != 0) fail("commit");
+                    committed = next + 1;
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &b);
+            loadms += PF_MsBetween(a, b);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        if (report_step(&r, SCANSTEP, &rows, &ok)) {
+            reports++;
+            bad += !ok;
+            report_open(&r, committed);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        scanms += PF_MsBetween(a, b);
+    }
+    /* the report left open is not counted */
+    QP_Close(r.op);
+    if (mvcc) SP_MvccRelease(r.snap);
+    printf("%s,%s,%d,%ld,%.0f,", mvcc ? "mvcc" : "plain", load ? "loading" : "idle",
+        reports, rows, rows / scanms * 1e3);
+    if (load) printf("%.0f,", n / loadms * 1e3);
+    else printf("-,");
+    printf("%d\n", bad);
+}
+
+/* rows and sum of the third field visible to snap, by heap and index scan */
+static void visible(SPts snap, long *rows, long *sum, long *irows) {
+    QPop *op;
+    QPtuple t;
+
+    *rows = *sum = *irows = 0;
+    if ((op = QP_MvccHeapScanOpen(heapfd, snap)) == NULL) fail("scan open");
+    while (QP_Next(op, &t) == QPE_OK) {
+        (*rows)++;
+        *sum += QP_FieldInt(t.rec, t.reclen, 2);
+    }
+    QP_Close(op);
+    if ((op = QP_MvccIndexScanOpen(heapfd, &idx, QP_ALL, NULL, snap)) == NULL)
+        fail("index scan open");
+    while (QP_Next(op, &t) == QPE_OK) (*irows)++;
+    QP_Close(op);
+}
+
+static void gc_line(const char *what, int n, long expectsum, SPts snap, int *ok) {
+    long freed, rows, sum, irows;
+    int nversions;
+
+    if ((freed = SP_MvccGC(heapfd, &nversions)) < 0) fail("gc");
+    visible(snap, &rows, &sum, &irows);
+    printf("%s,%d,%d,%.1f,%ld,%ld,%ld\n", what, PF_GetNumPages(heapfd), nversions,
+        freed / 1024.0, rows, irows, sum);
+    if (rows != n || irows != n || sum != expectsum) *ok = 0;
+}
+
+/* update every row to version v in one transaction */
+static void update_all(int n, int v) {
+    int id;
+
+    if (SP_MvccBegin() == 0) fail("begin");
+    for (id = 0; id < n; id++) {
+        if (SP_MvccDelete(heapfd, rids[id]) != 0) fail("delete");
+        insert_row(id, v);
+    }
+    if (SP_MvccCommit() != 0) fail("commit");
+}
+
+static int gc(int n) {
+    SPts old, snap;
+    int ok = 1;
+
+    printf("\nstep, heap-pages, versions-reclaimed, KB-freed, rows, index-rows, sum-of-versions\n");
+    old = SP_MvccSnapshot();
+    gc_line("loaded", n, 0, old, &ok);
+    update_all(n, 1);
+    update_all(n, 2);
+    gc_line("updated twice, old snapshot held", n, 0, old, &ok);
+    snap = SP_MvccSnapshot();
+    gc_line("  seen by a new snapshot", n, 2L * n, snap, &ok);
+    SP_MvccRelease(old);
+    SP_MvccRelease(snap);
+    gc_line("old snapshot released", n, 2L * n, SP_MvccHorizon(), &ok);
+    update_all(n, 3);
+    gc_line("updated again", n, 3L * n, SP_MvccHorizon(), &ok);
+    return ok;
+}
+
+/* an aborted transaction, and one left by a process that exited without
+   committing, must change nothing */
+static int undo(int n) {
+    long rows, sum, irows;
+    int i, status, pages = PF_GetNumPages(heapfd), ok = 1;
+    SPRID *saved = malloc(n / 10 * sizeof(SPRID) + 1);
+    pid_t pid;
+
+    memcpy(saved, rids, n / 10 * sizeof(SPRID));
+    if (SP_MvccBegin() == 0) fail("begin");
+    for (i = 0; i < n / 10; i++) {
+        if (SP_MvccDelete(heapfd, rids[i]) != 0) fail("delete");
+        insert_row(i, 100);
+    }
+    if (SP_MvccAbort() != 0) fail("abort");
+    memcpy(rids, saved, n / 10 * sizeof(SPRID));
+    visible(SP_MvccHorizon(), &rows, &sum, &irows);
+    printf("\naborted: %ld rows, %ld by index, sum %ld\n", rows, irows, sum);
+    ok &= rows == n && irows == n && sum == 3L * n;
+
+    close_heap();
+    fflush(stdout);
+    if ((pid = fork()) == 0) {
+        open_heap();
+        if (SP_MvccBegin() == 0) fail("begin");
+        for (i = 0; i < n / 10; i++) {
+            if (SP_MvccDelete(heapfd, rids[i]) != 0) fail("delete");
+            insert_row(i, 100);
+        }
+        /* the pages reach the file, the commit does not */
+        close_heap();
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    open_heap();
+    visible(SP_MvccHorizon(), &rows, &sum, &irows);
+    printf("left uncommitted: %ld rows, %ld by index, sum %ld, %d -> %d pages\n",
+        rows, irows, sum, pages, PF_GetNumPages(heapfd));
+    ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        rows == n && irows == n && sum == 3L * n;
+
+    /* again without the close, in a pool that writes the data pages out
+       and keeps page 0; a commit after the reopen must not show them */
+    close_heap();
+    fflush(stdout);
+    if ((pid = fork()) == 0) {
+        PF_SetBufferParams(4, PF_REPL_MRU);
+        open_heap();
+        if (SP_MvccBegin() == 0) fail("begin");
+        for (i = 0; i < n / 10; i++) {
+            char rec[64];
+            int len = snprintf(rec, sizeof(rec), "%d;name%d;%d", i, i, 100);
+            if (SP_MvccDelete(heapfd, rids[i]) != 0 ||
+                SP_MvccInsert(heapfd, rec, len, NULL) != 0) fail("update");
+        }
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    open_heap();
+    if (SP_MvccBegin() == 0 || SP_MvccCommit() != 0) fail("commit");
+    visible(SP_MvccHorizon(), &rows, &sum, &irows);
+    printf("crashed uncommitted: %ld rows, %ld by index, sum %ld\n", rows, irows, sum);
+    ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        rows == n && irows == n && sum == 3L * n;
+    free(saved);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int n = 20000, batch = 1000, ok = 1, id, load;
+
+    if (argc > 1) n = atoi(argv[1]);
+    if (argc > 2) batch = atoi(argv[2]);
+    if ((rids = malloc(2 * n * sizeof(SPRID))) == NULL) fail("malloc");
+    PF_Init();
+    printf("heap, load, reports, rows-scanned, scan-rows/sec, inserts/sec, inconsistent-reports\n");
+    for (mvcc = 0; mvcc <= 1; mvcc++) {
+        create();
+        if (mvcc && SP_MvccBegin() == 0) fail("begin");
+        for (id = 0; id < n; id++) insert_row(id, 0);
+        if (mvcc && SP_MvccCommit() != 0) fail("commit");
+        for (load = 0; load <= 1; load++) run(n, batch, load);
+        close_heap();
+    }
+
+    /* the MVCC heap with n rows */
+    create();
+    if (SP_MvccBegin() == 0) fail("begin");
+    for (id = 0; id < n; id++) insert_row(id, 0);
+    if (SP_MvccCommit() != 0) fail("commit");
+    ok &= gc(n);
+    ok &= undo(n);
+    close_heap();
+
+    PF_DestroyFile(HEAP);
+    AM_DestroyIndex(HEAP, INDEXNO);
+    free(rids);
+    return !ok;
+}
@@ -0,0 +1,148 @@
+/* testpax.c
+ * Single-column aggregates on gradsum: row-oriented slotted pages vs. PAX
+ * pages.
+ *
+ * gradsum is loaded three times: as text records and as binary tuples in
+ * SP heaps, and into a PAX heap. SUM, MAX and COUNT(>= 9.0) of CGPA are
+ * then computed in one pass by
+ *  - row-text:   HeapScan over the text heap, QP_FieldFloat
+ *  - row-binary: HeapScan over the binary heap, QP_TupleFloat
+ *  - pax-row:    PaxScan of CGPA only, one tuple at a time
+ *  - pax-page:   PX_ScanNextPage, a loop over each page's CGPA minipage
+ * bytes_read is what the scan copies or reads out of the pages: whole
+ * records for the row scans, the CGPA values and null bits for PAX. Times
+ * are the best of REPEAT runs.
+ *
+ * Usage: testpax [datadir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "qp.h"
+
+#define TEXT "/tmp/qp_pax_text"
+#define BINARY "/tmp/qp_pax_binary"
+#define PAX "/tmp/qp_pax_pax"
+#define CGPA 6
+#define REPEAT 5
+
+enum { ROW_TEXT, ROW_BINARY, PAX_ROW, PAX_PAGE, NVARIANTS };
+static const char *variant[NVARIANTS] = { "row-text", "row-binary", "pax-row", "pax-page" };
+
+typedef struct {
+    double sum;
+    float max;
+    long count, rows, bytes;
+} agg_t;
+
+static void add(agg_t *a, float v) {
+    a->sum += v;
+    if (a->rows == 0 || v > a->max) a->max = v;
+    if (v >= 9.0f) a->count++;
+    a->rows++;
+}
+
+static void run(int v, const QPschema *s, agg_t *a) {
+    int col = CGPA, fd, nrows, r;
+    QPop *plan = NULL;
+    QPtuple t;
+    PXscan *scan;
+    const char *values[1];
+    const unsigned char *nulls[1];
+
+    memset(a, 0, sizeof(*a));
+    switch (v) {
+    case ROW_TEXT:
+    case ROW_BINARY:
+        fd = SP_OpenFile(v == ROW_TEXT ? TEXT : BINARY);
+        plan = QP_HeapScanOpen(fd);
+        while (QP_Next(plan, &t) == QPE_OK) {
+            a->bytes += t.reclen;
+            if (v == ROW_TEXT) add(a, QP_FieldFloat(t.rec, t.reclen, CGPA));
+            else if (!QP_TupleIsNull(s, t.rec, CGPA)) add(a, QP_TupleFloat(s, t.rec, CGPA));
+        }
+        QP_Close(plan);
+        SP_CloseFile(fd);
+        break;
+    case PAX_ROW:
+        fd = PX_OpenFile(PAX);
+        if (!(plan = QP_PaxScanOpen(fd, s, &col, 1))) {
+            QP_PrintError("pax scan");
+            exit(1);
+        }
+        while (QP_Next(plan, &t) == QPE_OK) {
+            a->bytes += sizeof(float);
+            if (!QP_TupleIsNull(s, t.rec, CGPA)) add(a, QP_TupleFloat(s, t.rec, CGPA));
+        }
+        QP_Close(plan);
+        PX_CloseFile(fd);
+        break;
+    case PAX_PAGE:
+        fd = PX_OpenFile(PAX);
+        PX_ScanOpen(fd, &col, 1, &scan);
+        while (PX_ScanNextPage(scan, &nrows, values, nulls) == 0) {
+            const float *cgpa = (const float *)values[0];
+            a->bytes += nrows * sizeof(float) + (nrows + 7) / 8;
+            for (r = 0; r < nrows; r++)
+                if (!((nulls[0][r / 8] >> (r % 8)) & 1)) add(a, cgpa[r]);
+        }
+        PX_ScanClose(scan);
+        PX_CloseFile(fd);
+        break;
+    }
+}
+
+static int npages(const char *fname) {
+    int fd = PF_OpenFile((char *)fname), n = PF_GetNumPages(fd);
+    PF_CloseFile(fd);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512];
+    QPschema s;
+    agg_t a, first;
+    int v, r, n;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    snprintf(path, sizeof(path), "%s/gradsum.txt", datadir);
+    if (QP_SchemaInfer(path, "gradsum", &s) != QPE_OK
+            || (n = QP_LoadHeap(path, TEXT, 0)) < 0
+            || QP_LoadBinaryHeap(path, BINARY, &s, 0) != n
+            || QP_LoadPaxHeap(path, PAX, &s, 0) != n) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    printf("gradsum rows=%d pages: text=%d binary=%d pax=%d\n", n, npages(TEXT),
+        npages(BINARY), npages(PAX));
+
+    printf("\nscan, time-ms, logical_reads, bytes_read, bytes/row, sum, max, count>=9\n");
+    for (v = 0; v < NVARIANTS; v++) {
+        double best = -1;
+        PFstats before, after;
+        for (r = 0; r < REPEAT; r++) {
+            struct timespec t0, t1;
+            PF_GetStats(&before);
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            run(v, &s, &a);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            PF_GetStats(&after);
+            if (best < 0 || PF_MsBetween(t0, t1) < best) best = PF_MsBetween(t0, t1);
+        }
+        if (v == 0) first = a;
+        printf("%s,%.2f,%d,%ld,%.1f,%.2f,%.2f,%ld%s\n", variant[v], best,
+            after.logical_reads - before.logical_reads, a.bytes,
+            (double)a.bytes / a.rows, a.sum, a.max, a.count,
+            a.rows == first.rows && a.count == first.count && a.max == first.max
+            ? "" : " MISMATCH");
+    }
+
+    PF_DestroyFile(TEXT);
+    PF_DestroyFile(BINARY);
+    PF_DestroyFile(PAX);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* testselect.c
+ * Access path selection on gradsum: heap scan + filter vs. index scan vs.
+ * bitmap scan for single-field predicates of varying selectivity.
+ *
+ * gradsum is loaded with indexes on rollno (field 0) and CGPA (field 6)
+ * and analyzed. For each predicate all three paths are run; the row the
+ * planner picks is marked with '*', and the estimated rows and cost are
+ * printed next to the actual rows and page reads.
+ *
+ * Usage: testselect [datadir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "qp.h"
+
+#define GRADSUM "/tmp/qp_select_gradsum"
+#define ROLLNO 0
+#define YEAR 1
+#define CGPA 6
+
+static const char *pathname[QP_NPATHS] = { "heap", "index", "bitmap" };
+static const char *opname[] = { "all", "=", "<", ">", "<=", ">=" };
+
+static struct {
+    int field;
+    char type;
+    int op;
+    const char *value;
+} preds[] = {
+    { ROLLNO, QP_INT, QP_EQ, "830043" },
+    { ROLLNO, QP_INT, QP_LT, "850000" },
+    { ROLLNO, QP_INT, QP_GE, "950000" },
+    { CGPA, QP_FLOAT, QP_GE, "9.9" },
+    { CGPA, QP_FLOAT, QP_GE, "9.0" },
+    { CGPA, QP_FLOAT, QP_GE, "7.0" },
+    { CGPA, QP_FLOAT, QP_EQ, "8.00" },
+    { CGPA, QP_FLOAT, QP_LT, "0.5" },
+};
+
+static long elapsed_ms(struct timespec a, struct timespec b) {
+    return (b.tv_sec - a.tv_sec) * 1000 + (b.tv_nsec - a.tv_nsec) / 1000000;
+}
+
+static void print_stats(QPtable *t) {
+    int i;
+    printf("rows=%ld pages=%d\n", t->stats.nrows, t->stats.npages);
+    for (i = 0; i < t->stats.ncols; i++) {
+        QPcolstats *c = &t->stats.col[i];
+        printf("  field %d: distinct=%ld min=%g max=%g buckets=%d\n", c->field,
+            c->ndistinct, c->lo, c->hi[c->nbuckets - 1], c->nbuckets);
+    }
+    for (i = 0; i < t->nindex; i++) {
+        QPindex *x = &t->index[i];
+        printf("  index on field %d: height=%d leaves=%d keys=%ld clusterfactor=%ld\n",
+            x->field, x->height, x->nleaves, x->nkeys, x->clusterfactor);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512], pred[64];
+    int fields[] = { ROLLNO, YEAR, CGPA };
+    char types[] = { QP_INT, QP_INT, QP_FLOAT };
+    QPtable g;
+    int i, p, ng, error, right = 0;
+
+    if (argc > 1) datadir = argv[1];
+
+    PF_Init();
+    snprintf(path, sizeof(path), "%s/gradsum.txt", datadir);
+    if ((ng = QP_LoadHeap(path, GRADSUM, 0)) < 0
+            || QP_BuildIndex(GRADSUM, 0, ROLLNO, QP_INT, sizeof(int), 0) < 0
+            || QP_BuildIndex(GRADSUM, 1, CGPA, QP_FLOAT, sizeof(float), 0) < 0) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    if (QP_OpenTable(&g, GRADSUM) != QPE_OK
+            || QP_AddIndex(&g, 0, ROLLNO, QP_INT, sizeof(int), 0) != QPE_OK
+            || QP_AddIndex(&g, 1, CGPA, QP_FLOAT, sizeof(float), 0) != QPE_OK
+            || QP_Analyze(&g, fields, types, 3) != QPE_OK) {
+        QP_PrintError("analyze");
+        exit(1);
+    }
+    printf("Loaded gradsum: ");
+    print_stats(&g);
+
+    printf("\npredicate, path, chosen, est_rows, actual_rows, est_cost, time-ms, phys_reads, logical_reads\n");
+    for (i = 0; i < (int)(sizeof(preds) / sizeof(preds[0])); i++) {
+        long best_reads = -1, chosen_reads = 0;
+        snprintf(pred, sizeof(pred), "f%d %s %s", preds[i].field,
+            opname[preds[i].op], preds[i].value);
+        for (p = 0; p < QP_NPATHS; p++) {
+            QPcost est;
+            QPop *plan;
+            QPtuple t;
+            PFstats before, after;
+            struct timespec t0, t1;
+            long rows = 0;
+
+            PF_GetStats(&before);
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            plan = QP_PlanSelect(&g, preds[i].field, preds[i].type, preds[i].op,
+                preds[i].value, p, &est);
+            if (!plan) {
+                QP_PrintError(pred);
+                exit(1);
+            }
+            while ((error = QP_Next(plan, &t)) == QPE_OK) rows++;
+            if (error != QPE_EOF) QP_PrintError(pred);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            PF_GetStats(&after);
+            QP_Close(plan);
+
+            printf("%s,%s,%s,%.0f,%ld,%.1f,%ld,%d,%d\n", pred, pathname[p],
+                p == est.best ? "*" : "", est.rows, rows, est.cost[p],
+                elapsed_ms(t0, t1), after.phys_reads - before.phys_reads,
+                after.logical_reads - before.logical_reads);
+            if (best_reads < 0 || after.phys_reads - before.phys_reads < best_reads)
+                best_reads = after.phys_reads - before.phys_reads;
+            if (p == est.best) chosen_reads = after.phys_reads - before.phys_reads;
+        }
+        if (chosen_reads == best_reads) right++;
+    }
+    printf("\nplanner picked the fewest-reads path for %d of %d predicates\n",
+        right, (int)(sizeof(preds) / sizeof(preds[0])));
+
+    QP_CloseTable(&g);
+    PF_DestroyFile(GRADSUM);
+    AM_DestroyIndex(GRADSUM, 0);
+    AM_DestroyIndex(GRADSUM, 1);
+    return 0;
+}
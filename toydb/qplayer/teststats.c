@@ -0,0 +1,315 @@
+/* teststats.c
+ * Cost and accuracy of sampled statistics on every table in data/.
+ *
+ * Each .txt file in data/ is loaded into an SP heap file and scanned:
+ *  - sketch: every row sketched (one-pass collection)
+ *  - pass:   1 row in stride sketched, as by a scan collecting on the
+ *            side, with the stride QP_SketchStride() picks for the table;
+ *            the stride passes that cover the table are timed together
+ * Overheads compare the CPU time of these scans with that of as many plain
+ * scans run next to them; noise is the same measurement with plain scans on
+ * both sides. scan-ms is the plain scan time.
+ *
+ * The piggybacked sketch is stored in a catalog file and read back, and its
+ * distinct counts are checked against exact ones. On gradsum the sketch is
+ * also used for row estimates next to QP_Analyze's exact statistics, and
+ * the rollno index is sketched with a leaf walk.
+ *
+ * Usage: teststats [datadir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <math.h>
+#include <limits.h>
+#include "qp.h"
+
+#define HEAP "/tmp/qp_stats_heap"
+#define CATALOG "/tmp/qp_stats_catalog"
+#define MINMS 300.0	/* least time spent timing each table */
+#define MINPAIRS 4
+#define CHUNKMS 2.0	/* least time of the scans timed together */
+#define MAXPAIRS 999
+
+/* process CPU time, which time spent descheduled does not blur */
+static double now_ms(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/* one scan of fd; sk (if given) sees the rows */
+static void scan(int fd, QPsketch *sk) {
+    SPscan *s;
+    char *rec;
+    int reclen, skip = INT_MAX;
+
+    SP_ScanOpen(fd, &s);
+    if (sk) skip = QP_SketchBeginPass(sk);
+    while (SP_ScanNext(s, &rec, &reclen, NULL) == 0) {
+        if (skip-- == 0) skip = QP_SketchRow(sk, rec, reclen);
+        free(rec);
+    }
+    SP_ScanClose(s);
+    if (sk) QP_SketchEndPass(sk);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Scans with sk against plain scans: each pair runs `stride` plain scans
+ * and the `stride` sketch passes that cover the table once. The two run
+ * interleaved in chunks of about CHUNKMS, in alternating order, so the
+ * halves of a pair see the same machine. With sk NULL both halves are
+ * plain, which shows the noise of the measurement. *plain is set to the
+ * median ms per plain scan; returns the median over the pairs of sketched
+ * time over plain time, which a pair the VM disturbed does not move. */
+static double time_pairs(int fd, QPsketch *sk, int stride, double *plain) {
+    double ms[MAXPAIRS], ratio[MAXPAIRS], total = 0, t0;
+    int n, i, j, k, chunk;
+
+    t0 = now_ms();
+    scan(fd, NULL);
+    chunk = (int)ceil(CHUNKMS / (now_ms() - t0 + 1e-6));
+    if (chunk > stride) chunk = stride;
+
+    for (n = 0; n < MAXPAIRS && (n < MINPAIRS || total < MINMS); n++) {
+        double t1, t2, tplain = 0, tsketch = 0;
+        if (sk) QP_SketchReset(sk);
+        for (i = 0; i < stride; i += chunk) {
+            int first = (n + i / chunk) % 2;	/* 1: sketch half first */
+            k = stride - i < chunk ? stride - i : chunk;
+            t0 = now_ms();
+            for (j = 0; j < k; j++) scan(fd, first ? sk : NULL);
+            t1 = now_ms();
+            for (j = 0; j < k; j++) scan(fd, first ? NULL : sk);
+            t2 = now_ms();
+            tplain += first ? t2 - t1 : t1 - t0;
+            tsketch += first ? t1 - t0 : t2 - t1;
+        }
+        ms[n] = tplain / stride;
+        ratio[n] = tsketch / tplain;
+        total += tplain + tsketch;
+    }
+    qsort(ms, n, sizeof(double), cmp_double);
+    qsort(ratio, n, sizeof(double), cmp_double);
+    *plain = ms[n / 2];
+    return ratio[n / 2];
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* exact # of distinct non-empty values of each field */
+static void exact_distinct(int fd, int ncols, long *nd) {
+    char **vals;
+    long n = 0, cap = 4096, i;
+    int col;
+
+    vals = (char **)malloc(cap * sizeof(char *));
+    for (col = 0; col < ncols; col++) {
+        SPscan *s;
+        char *rec;
+        int reclen, flen;
+        n = 0;
+        SP_ScanOpen(fd, &s);
+        while (SP_ScanNext(s, &rec, &reclen, NULL) == 0) {
+            const char *f = QP_GetField(rec, reclen, col, &flen);
+            if (f && flen > 0) {
+                if (n == cap) vals = (char **)realloc(vals, (cap *= 2) * sizeof(char *));
+                vals[n] = strndup(f, flen);
+                n++;
+            }
+            free(rec);
+        }
+        SP_ScanClose(s);
+        qsort(vals, n, sizeof(char *), cmp_str);
+        nd[col] = 0;
+        for (i = 0; i < n; i++) {
+            if (i == 0 || strcmp(vals[i], vals[i-1]) != 0) nd[col]++;
+            if (i > 0) free(vals[i-1]);
+        }
+        if (n > 0) free(vals[n-1]);
+    }
+    free(vals);
+}
+
+/* rows of table t where field `op` value, counted by a filtered scan */
+static long count_rows(QPtable *t, int field, char type, int op, const char *value) {
+    QPop *plan = QP_FilterOpen(QP_HeapScanOpen(t->heapfd), field, type, op, value);
+    QPtuple tup;
+    long n = 0;
+    while (QP_Next(plan, &tup) == QPE_OK) n++;
+    QP_Close(plan);
+    return n;
+}
+
+static void gradsum_estimates(const char *datadir) {
+    static const struct {
+        int field;
+        char type;
+        int op;
+        const char *value;
+    } preds[] = {
+        { 0, QP_INT, QP_EQ, "830043" },
+        { 0, QP_INT, QP_LT, "850000" },
+        { 0, QP_INT, QP_GE, "950000" },
+        { 1, QP_INT, QP_EQ, "1995" },
+        { 6, QP_FLOAT, QP_GE, "9.0" },
+        { 6, QP_FLOAT, QP_EQ, "8.00" },
+        { 6, QP_FLOAT, QP_LT, "5.0" },
+    };
+    static const char *opname[] = { "all", "=", "<", ">", "<=", ">=" };
+    char path[512];
+    int fields[] = { 0, 1, 6 };
+    char types[] = { QP_INT, QP_INT, QP_FLOAT };
+    QPtablesketch ts;
+    QPcolsketch cs;
+    QPtable exact, sketched;
+    long nkeys;
+    double t0, t1;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/gradsum.txt", datadir);
+    if (QP_LoadHeap(path, HEAP, 0) < 0
+            || QP_BuildIndex(HEAP, 0, 0, QP_INT, sizeof(int), 0) < 0
+            || QP_OpenTable(&exact, HEAP) != QPE_OK
+            || QP_AddIndex(&exact, 0, 0, QP_INT, sizeof(int), 0) != QPE_OK
+            || QP_Analyze(&exact, fields, types, 3) != QPE_OK
+            || QP_OpenTable(&sketched, HEAP) != QPE_OK
+            || QP_AddIndex(&sketched, 0, 0, QP_INT, sizeof(int), 0) != QPE_OK
+            || QP_CatalogGet(CATALOG, "gradsum", &ts) != QPE_OK
+            || QP_UseSketch(&sketched, &ts) != QPE_OK) {
+        QP_PrintError("gradsum");
+        exit(1);
+    }
+
+    printf("\ngradsum estimates, sketch vs. QP_Analyze\n");
+    printf("predicate, actual_rows, sketch_est, analyze_est\n");
+    for (i = 0; i < (int)(sizeof(preds) / sizeof(preds[0])); i++)
+        printf("f%d %s %s,%ld,%.0f,%.0f\n", preds[i].field, opname[preds[i].op],
+            preds[i].value,
+            count_rows(&exact, preds[i].field, preds[i].type, preds[i].op, preds[i].value),
+            QP_EstimateRows(&sketched, preds[i].field, preds[i].op, preds[i].value),
+            QP_EstimateRows(&exact, preds[i].field, preds[i].op, preds[i].value));
+
+    nkeys = exact.index[0].nkeys;
+    t0 = now_ms();
+    if (QP_SketchIndex(&exact.index[0], &cs) != QPE_OK) {
+        QP_PrintError("leaf walk");
+        exit(1);
+    }
+    t1 = now_ms();
+    printf("\nrollno index leaf walk: %.2f ms, distinct %.0f (exact %ld), buckets %d, %s..%s\n",
+        t1 - t0, cs.ndistinct, nkeys, cs.nbuckets, cs.lo, cs.hi[cs.nbuckets - 1]);
+
+    QP_CloseTable(&exact);
+    QP_CloseTable(&sketched);
+    PF_DestroyFile(HEAP);
+    AM_DestroyIndex(HEAP, 0);
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512], table[QP_MAXNAME];
+    struct dirent **files;
+    int nfiles, i, c, fd, ntables = 0, same = 0;
+    QPsketch *full, *pass;
+    int stride;
+    double worst = 0, plainms = 0, passms = 0, noisems = 0;
+
+    if (argc > 1) datadir = argv[1];
+
+    PF_Init();
+    PF_DestroyFile(CATALOG);
+    full = QP_SketchCreate(0, 1);
+    if (!full || (nfiles = scandir(datadir, &files, NULL, alphasort)) < 0) {
+        fprintf(stderr, "teststats: cannot set up\n");
+        exit(1);
+    }
+
+    printf("table, rows, cols, stride, scan-ms, sketch-overhead%%, pass-overhead%%, noise%%, max-distinct-err%%\n");
+    for (i = 0; i < nfiles; i++) {
+        const char *name = files[i]->d_name;
+        int L = strlen(name);
+        QPtablesketch ts;
+        QPtable t;
+        long nd[QP_MAXFIELDS];
+        double tscan, rnoise, rfull, rpass, err = 0;
+
+        if (L < 5 || strcmp(name + L - 4, ".txt") != 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", datadir, name);
+        snprintf(table, sizeof(table), "%.*s", L - 4, name);
+        if (QP_LoadHeap(path, HEAP, 0) < 0 || QP_OpenTable(&t, HEAP) != QPE_OK) {
+            QP_PrintError(path);
+            exit(1);
+        }
+        fd = t.heapfd;
+        stride = QP_SketchStride(&t);
+        if ((pass = QP_SketchCreate(0, stride)) == NULL) {
+            QP_PrintError(table);
+            exit(1);
+        }
+        rnoise = time_pairs(fd, NULL, stride, &tscan);
+        rfull = time_pairs(fd, full, 1, &tscan);
+        rpass = time_pairs(fd, pass, stride, &tscan);
+
+        /* the last round left pass covering the table */
+        if (QP_SketchTable(&t, pass, &ts) != QPE_OK) {
+            QP_PrintError(table);
+            exit(1);
+        }
+        strcpy(ts.table, table);
+        exact_distinct(fd, ts.ncols, nd);
+        for (c = 0; c < ts.ncols; c++)
+            if (nd[c] > 0 && fabs(ts.col[c].ndistinct - nd[c]) / nd[c] > err)
+                err = fabs(ts.col[c].ndistinct - nd[c]) / nd[c];
+        if (QP_CatalogPut(CATALOG, &ts) != QPE_OK) {
+            QP_PrintError(CATALOG);
+            exit(1);
+        }
+        QP_SketchDestroy(pass);
+        QP_CloseTable(&t);
+        PF_DestroyFile(HEAP);
+
+        printf("%s,%ld,%d,%d,%.3f,%.1f,%.1f,%.1f,%.1f\n", table, ts.nrows,
+            ts.ncols, stride, tscan, 100 * (rfull - 1), 100 * (rpass - 1),
+            100 * (rnoise - 1), 100 * err);
+        if (rpass - 1 > worst) worst = rpass - 1;
+        plainms += tscan;
+        passms += tscan * rpass;
+        noisems += tscan * rnoise;
+        ntables++;
+    }
+
+    /* the catalog holds a sketch for every table */
+    for (i = 0; i < nfiles; i++) {
+        const char *name = files[i]->d_name;
+        int L = strlen(name);
+        QPtablesketch ts;
+        if (L >= 5 && strcmp(name + L - 4, ".txt") == 0) {
+            snprintf(table, sizeof(table), "%.*s", L - 4, name);
+            if (QP_CatalogGet(CATALOG, table, &ts) == QPE_OK && ts.ncols > 0
+                    && strcmp(ts.table, table) == 0)
+                same++;
+        }
+        free(files[i]);
+    }
+    free(files);
+    printf("\n%d tables: piggybacked pass overhead %.1f%% over all (noise %.1f%%), %.1f%% worst\n",
+        ntables, 100 * (passms / plainms - 1), 100 * (noisems / plainms - 1),
+        100 * worst);
+    printf("catalog %s holds sketches of %d tables\n", CATALOG, same);
+
+    gradsum_estimates(datadir);
+
+    QP_SketchDestroy(full);
+    PF_DestroyFile(CATALOG);
+    return 0;
+}
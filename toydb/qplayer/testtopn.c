@@ -0,0 +1,155 @@
+/* testtopn.c
+ * Top-N benchmark: the N gradsum rows with the highest CGPA (field 6).
+ *
+ * gradsum is loaded into an SP heap file with a descending AM index on
+ * CGPA (negated float keys). For each N the query is run three ways:
+ *  - sort:  Limit over a full external Sort of the heap scan
+ *  - heap:  bounded-heap TopN over the heap scan
+ *  - index: QP_PlanTopN, a Limit that stops the descending index scan
+ *           after N rows
+ * The CGPA column of the three results is compared as a check. N = 0 must
+ * give no rows from each plan, ordered input or not.
+ *
+ * Usage: testtopn [datadir] [N ...]    (default N: 10 10000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "qp.h"
+
+#define GRADSUM "/tmp/qp_topn_gradsum"
+#define CGPA 6
+
+static long elapsed_ms(struct timespec a, struct timespec b) {
+    return (b.tv_sec - a.tv_sec) * 1000 + (b.tv_nsec - a.tv_nsec) / 1000000;
+}
+
+static long tree_peak(QPop *op) {
+    if (!op) return 0;
+    return op->peakbytes + tree_peak(op->child[0]) + tree_peak(op->child[1]);
+}
+
+static long leaf_rows(QPop *op) {
+    while (op->child[0]) op = op->child[0];
+    return op->nrows;
+}
+
+/* run one plan; the CGPA values it returns are put in keys */
+static void run(int n, const char *label, QPop *plan, float *keys) {
+    QPtuple t;
+    PFstats before, after;
+    struct timespec t0, t1;
+    long rows = 0;
+    int error;
+
+    if (!plan) {
+        QP_PrintError(label);
+        exit(1);
+    }
+    PF_GetStats(&before);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while ((error = QP_Next(plan, &t)) == QPE_OK) {
+        if (rows < n) keys[rows] = QP_FieldFloat(t.rec, t.reclen, CGPA);
+        rows++;
+    }
+    if (error != QPE_EOF) QP_PrintError(label);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    PF_GetStats(&after);
+
+    printf("%d,%s,%ld,%ld,%ld,%ld,%d,%d,%d,%d,%d,%d\n", n, label,
+        elapsed_ms(t0, t1), rows, leaf_rows(plan), tree_peak(plan),
+        after.phys_reads - before.phys_reads,
+        after.phys_writes - before.phys_writes,
+        after.logical_reads - before.logical_reads,
+        after.logical_writes - before.logical_writes,
+        after.page_hits - before.page_hits,
+        after.page_misses - before.page_misses);
+    QP_PrintPlan(plan, 1);
+    QP_Close(plan);
+}
+
+static void bench(int n) {
+    QPtable g;
+    float *sorted, *heap, *index;
+
+    sorted = (float *)calloc(n + 1, sizeof(float));
+    heap = (float *)calloc(n + 1, sizeof(float));
+    index = (float *)calloc(n + 1, sizeof(float));
+    if (!sorted || !heap || !index) {
+        fprintf(stderr, "no memory\n");
+        exit(1);
+    }
+
+    if (QP_OpenTable(&g, GRADSUM) != QPE_OK
+            || QP_AddIndex(&g, 0, CGPA, QP_FLOAT, sizeof(float), 1) != QPE_OK) {
+        QP_PrintError("open table");
+        exit(1);
+    }
+    run(n, "sort", QP_TopNOpen(QP_SortOpen(QP_HeapScanOpen(g.heapfd), CGPA,
+        QP_FLOAT, 1, QP_SORT_MEM), CGPA, QP_FLOAT, 1, n), sorted);
+    run(n, "heap", QP_TopNOpen(QP_HeapScanOpen(g.heapfd), CGPA, QP_FLOAT, 1, n),
+        heap);
+    run(n, "index", QP_PlanTopN(&g, CGPA, QP_FLOAT, 1, n), index);
+    QP_CloseTable(&g);
+
+    printf("  check: %s\n", memcmp(sorted, heap, n * sizeof(float)) == 0
+        && memcmp(sorted, index, n * sizeof(float)) == 0 ? "same CGPAs" : "MISMATCH");
+    free(sorted);
+    free(heap);
+    free(index);
+}
+
+/* 1 if a plan for N = 0 returns a row or fails */
+static int zero_rows(void) {
+    QPtable g;
+    QPop *plans[2];
+    QPtuple t;
+    int bad = 0, i;
+
+    if (QP_OpenTable(&g, GRADSUM) != QPE_OK
+            || QP_AddIndex(&g, 0, CGPA, QP_FLOAT, sizeof(float), 1) != QPE_OK) {
+        QP_PrintError("open table");
+        exit(1);
+    }
+    plans[0] = QP_TopNOpen(QP_HeapScanOpen(g.heapfd), CGPA, QP_FLOAT, 1, 0);
+    plans[1] = QP_PlanTopN(&g, CGPA, QP_FLOAT, 1, 0);
+    for (i = 0; i < 2; i++) {
+        bad += !plans[i] || QP_Next(plans[i], &t) != QPE_EOF;
+        if (plans[i]) QP_Close(plans[i]);
+    }
+    QP_CloseTable(&g);
+    printf("N=0: %s\n", bad ? "ROWS OR ERROR" : "no rows");
+    return bad != 0;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512];
+    int ng, i, bad;
+
+    if (argc > 1) datadir = argv[1];
+
+    PF_Init();
+    snprintf(path, sizeof(path), "%s/gradsum.txt", datadir);
+    if ((ng = QP_LoadHeap(path, GRADSUM, 0)) < 0
+            || QP_BuildIndex(GRADSUM, 0, CGPA, QP_FLOAT, sizeof(float), 1) < 0) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    printf("Loaded gradsum=%d records, descending index on CGPA\n", ng);
+    bad = zero_rows();
+
+    printf("\nN, plan, time-ms, rows, input_rows, peak_bytes, phys_reads, phys_writes, logical_reads, logical_writes, page_hits, page_misses\n");
+    if (argc > 2)
+        for (i = 2; i < argc; i++) bench(atoi(argv[i]));
+    else {
+        bench(10);
+        bench(10000);
+    }
+
+    PF_DestroyFile(GRADSUM);
+    AM_DestroyIndex(GRADSUM, 0);
+    return bad;
+}
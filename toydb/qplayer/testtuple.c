@@ -0,0 +1,269 @@
+/* testtuple.c
+ * Text records vs. binary tuples on gradsum.
+ *
+ * The schema of gradsum is inferred, stored in a catalog and read back, and
+ * gradsum is loaded twice: as text lines (QP_LoadHeap) and as binary tuples
+ * (QP_LoadBinaryHeap). Then, on both heaps:
+ *  - filter: HeapScan + Filter / TupleFilter for predicates on CGPA
+ *  - access: a heap scan that reads every numeric field of every row
+ * Times are the best of REPEAT runs. Every binary tuple is also decoded and
+ * compared with its text line, for gradsum and then for every other .txt
+ * file in data/ with its own inferred schema, and for a file of values
+ * that only round-trip as char: leading zeros and '+', ints past INT_MAX,
+ * floats with more digits than a float holds or different decimals.
+ *
+ * Usage: testtuple [datadir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "qp.h"
+
+#define TEXT "/tmp/qp_tuple_text"
+#define BINARY "/tmp/qp_tuple_binary"
+#define CATALOG "/tmp/qp_tuple_catalog"
+#define CGPA 6
+#define REPEAT 5
+
+static const char *opname[] = { "all", "=", "<", ">", "<=", ">=" };
+
+static struct {
+    int op;
+    const char *value;
+} preds[] = {
+    { QP_GE, "9.0" },
+    { QP_GE, "7.0" },
+    { QP_LT, "5.0" },
+    { QP_EQ, "8.00" },
+};
+
+/* best time of REPEAT runs of a filter on one heap; *rows gets the count */
+static double filter_ms(const QPschema *s, int op, const char *value, long *rows) {
+    double best = -1;
+    int r, fd, error;
+
+    for (r = 0; r < REPEAT; r++) {
+        struct timespec t0, t1;
+        QPop *plan;
+        QPtuple t;
+
+        fd = SP_OpenFile(s ? BINARY : TEXT);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        plan = s ? QP_TupleFilterOpen(QP_HeapScanOpen(fd), s, CGPA, op, value)
+                 : QP_FilterOpen(QP_HeapScanOpen(fd), CGPA, QP_FLOAT, op, value);
+        if (!plan) {
+            QP_PrintError("filter");
+            exit(1);
+        }
+        *rows = 0;
+        while ((error = QP_Next(plan, &t)) == QPE_OK) (*rows)++;
+        if (error != QPE_EOF) QP_PrintError("filter");
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        QP_Close(plan);
+        SP_CloseFile(fd);
+        if (best < 0 || PF_MsBetween(t0, t1) < best) best = PF_MsBetween(t0, t1);
+    }
+    return best;
+}
+
+/* best time of REPEAT scans reading every numeric field; *sum gets their sum */
+static double access_ms(const QPschema *s, const QPschema *types, double *sum) {
+    double best = -1;
+    int r, c, fd;
+
+    for (r = 0; r < REPEAT; r++) {
+        struct timespec t0, t1;
+        QPop *plan;
+        QPtuple t;
+
+        fd = SP_OpenFile(s ? BINARY : TEXT);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        plan = QP_HeapScanOpen(fd);
+        *sum = 0;
+        while (QP_Next(plan, &t) == QPE_OK)
+            for (c = 0; c < types->ncols; c++) {
+                if (types->type[c] == QP_INT)
+                    *sum += s ? QP_TupleInt(s, t.rec, c) : QP_FieldInt(t.rec, t.reclen, c);
+                else if (types->type[c] == QP_FLOAT)
+                    *sum += s ? QP_TupleFloat(s, t.rec, c) : QP_FieldFloat(t.rec, t.reclen, c);
+            }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        QP_Close(plan);
+        SP_CloseFile(fd);
+        if (best < 0 || PF_MsBetween(t0, t1) < best) best = PF_MsBetween(t0, t1);
+    }
+    return best;
+}
+
+static int npages(const char *heapname) {
+    int fd = SP_OpenFile(heapname), n = PF_GetNumPages(fd);
+    SP_CloseFile(fd);
+    return n;
+}
+
+/* decode every binary tuple and compare it with the text line; fields
+   missing from the end of a line decode as empty ones */
+static int roundtrip_errors(const QPschema *s) {
+    int ft = SP_OpenFile(TEXT), fb = SP_OpenFile(BINARY), bad = 0, lt, lb;
+    char out[QP_MAXREC + 1], *rt, *rb;
+    SPscan *st, *sb;
+
+    SP_ScanOpen(ft, &st);
+    SP_ScanOpen(fb, &sb);
+    while (SP_ScanNext(st, &rt, &lt, NULL) == 0) {
+        if (SP_ScanNext(sb, &rb, &lb, NULL) != 0) {
+            free(rt);
+            bad++;
+            break;
+        }
+        lb = QP_DecodeTuple(s, rb, out);
+        out[lb] = '\0';
+        if (lb < lt || memcmp(out, rt, lt) != 0
+                || strspn(out + lt, ";") != (size_t)(lb - lt)) bad++;
+        free(rt);
+        free(rb);
+    }
+    SP_ScanClose(st);
+    SP_ScanClose(sb);
+    SP_CloseFile(ft);
+    SP_CloseFile(fb);
+    return bad;
+}
+
+/* a column of each kind that has to be char, and an int and a float one */
+static const char *oddlines[] = {
+    "01;+2;3000000000;16777217.5;1.5;7;2.25;",
+    "1;2;3;1.5;1.50;-8;-0.50;",
+};
+#define ODDFILE "/tmp/qp_tuple_odd.txt"
+#define ODDTYPES "cccccifc"
+
+/* 1 if a record of datafile has more than QP_MAXFIELDS fields, which no
+   schema holds */
+static int too_wide(const char *datafile) {
+    FILE *f = fopen(datafile, "r");
+    int c, semis = 0, wide = 0;
+
+    while (f && (c = getc(f)) != EOF)
+        if (c == '\n') semis = 0;
+        else if (c == ';' && ++semis >= QP_MAXFIELDS) wide = 1;
+    if (f) fclose(f);
+    return wide;
+}
+
+/* infer the schema of every .txt file in datadir, load it both ways and
+   decode it; the # of tuples differing from their text line, over all. A
+   file too wide for a schema has to be refused. */
+static int roundtrip_all(const char *datadir) {
+    struct dirent **files;
+    char path[512], table[QP_MAXNAME];
+    FILE *f;
+    QPschema s;
+    int nfiles, i, L, n, bad, total = 0;
+
+    if ((nfiles = scandir(datadir, &files, NULL, alphasort)) < 0) {
+        perror(datadir);
+        exit(1);
+    }
+    printf("\ntable, schema, rows, decoded tuples differing from text\n");
+    if (!(f = fopen(ODDFILE, "w"))) {
+        perror(ODDFILE);
+        exit(1);
+    }
+    for (i = 0; i < (int)(sizeof(oddlines) / sizeof(oddlines[0])); i++)
+        fprintf(f, "%s\n", oddlines[i]);
+    fclose(f);
+    if (QP_SchemaInfer(ODDFILE, "odd", &s) != QPE_OK
+            || QP_LoadHeap(ODDFILE, TEXT, 0) != i
+            || QP_LoadBinaryHeap(ODDFILE, BINARY, &s, 0) != i) {
+        QP_PrintError(ODDFILE);
+        exit(1);
+    }
+    bad = roundtrip_errors(&s) + (strncmp(s.type, ODDTYPES, s.ncols) != 0);
+    printf("odd,%.*s,%d,%d%s\n", s.ncols, s.type, i, bad,
+        strncmp(s.type, ODDTYPES, s.ncols) ? " (expected " ODDTYPES ")" : "");
+    total += bad;
+    unlink(ODDFILE);
+    for (i = 0; i < nfiles; i++) {
+        const char *name = files[i]->d_name;
+        L = strlen(name);
+        if (L >= 5 && strcmp(name + L - 4, ".txt") == 0) {
+            snprintf(path, sizeof(path), "%s/%s", datadir, name);
+            snprintf(table, sizeof(table), "%.*s", L - 4, name);
+            if (QP_SchemaInfer(path, table, &s) != QPE_OK
+                    || (n = QP_LoadHeap(path, TEXT, 0)) < 0) {
+                QP_PrintError(path);
+                exit(1);
+            }
+            if (too_wide(path)) {
+                bad = QP_LoadBinaryHeap(path, BINARY, &s, 0) != QPE_INVALIDARG;
+                printf("%s,%.*s,%d,%s\n", table, s.ncols, s.type, n,
+                    bad ? "LOADED" : "refused: too many fields");
+            } else {
+                bad = QP_LoadBinaryHeap(path, BINARY, &s, 0) != n ? n
+                    : roundtrip_errors(&s);
+                printf("%s,%.*s,%d,%d\n", table, s.ncols, s.type, n, bad);
+            }
+            total += bad;
+        }
+        free(files[i]);
+    }
+    free(files);
+    return total;
+}
+
+int main(int argc, char **argv) {
+    const char *datadir = "../../data";
+    char path[512], pred[64];
+    QPschema inferred, s;
+    double tt, tb, sumt, sumb;
+    long rt, rb;
+    int i, c, n, bad;
+
+    if (argc > 1) datadir = argv[1];
+    PF_Init();
+    snprintf(path, sizeof(path), "%s/gradsum.txt", datadir);
+    PF_DestroyFile(CATALOG);
+    if (QP_SchemaInfer(path, "gradsum", &inferred) != QPE_OK
+            || QP_SchemaPut(CATALOG, &inferred) != QPE_OK
+            || QP_SchemaGet(CATALOG, "gradsum", &s) != QPE_OK) {
+        QP_PrintError("schema");
+        exit(1);
+    }
+    printf("gradsum schema: ");
+    for (c = 0; c < s.ncols; c++) printf("%c", s.type[c]);
+    printf(" (%d fixed-width, %d char columns)\n", s.ncols - s.nvar, s.nvar);
+
+    if ((n = QP_LoadHeap(path, TEXT, 0)) < 0 || QP_LoadBinaryHeap(path, BINARY, &s, 0) != n) {
+        QP_PrintError(path);
+        exit(1);
+    }
+    bad = roundtrip_errors(&s);
+    printf("rows=%d text pages=%d binary pages=%d, decoded tuples differing from text: %d\n",
+        n, npages(TEXT), npages(BINARY), bad);
+
+    printf("\ntest, text-ms, binary-ms, speedup, text-rows, binary-rows\n");
+    for (i = 0; i < (int)(sizeof(preds) / sizeof(preds[0])); i++) {
+        snprintf(pred, sizeof(pred), "f%d %s %s", CGPA, opname[preds[i].op],
+            preds[i].value);
+        tt = filter_ms(NULL, preds[i].op, preds[i].value, &rt);
+        tb = filter_ms(&s, preds[i].op, preds[i].value, &rb);
+        printf("%s,%.2f,%.2f,%.2f,%ld,%ld%s\n", pred, tt, tb, tt / tb, rt, rb,
+            rt == rb ? "" : " MISMATCH");
+    }
+    tt = access_ms(NULL, &s, &sumt);
+    tb = access_ms(&s, &s, &sumb);
+    printf("all numeric fields,%.2f,%.2f,%.2f,%.0f,%.0f%s\n", tt, tb, tt / tb,
+        sumt, sumb, sumt == sumb ? "" : " MISMATCH");
+
+    bad += roundtrip_all(datadir);
+
+    PF_DestroyFile(TEXT);
+    PF_DestroyFile(BINARY);
+    PF_DestroyFile(CATALOG);
+    return bad != 0;
+}